@@ -491,6 +491,26 @@ PN_EXTERN bool pn_data_lookup(pn_data_t *data, const char *name);
  * @endcond
  */
 
+/**
+ * **Unsettled API**: Finds the value for a key in the map that is the
+ * parent node, that is after ::pn_data_enter() has been called on a
+ * map.
+ *
+ * Unlike searching the map with ::pn_data_next(), this does not take
+ * longer for bigger maps: the first call for a map builds a hash index
+ * of its keys, which later calls use until the pn_data_t is changed.
+ * Only one map is indexed at a time. Keys only match if they have the
+ * same type as well as the same value, so unlike ::pn_data_lookup() a
+ * string key does not find a symbol. If a key appears more than once
+ * the last value is found.
+ *
+ * @param data a pn_data_t object
+ * @param key the key to find, a scalar value
+ * @return true and the current node set to the value if the key was
+ * found, false and the current node unchanged if not
+ */
+PN_EXTERN bool pn_data_find(pn_data_t *data, pn_atom_t key);
+
 /**
  * Access the type of the current node. Returns PN_INVALID if there is no
  * current node.
@@ -534,6 +554,22 @@ PN_EXTERN int pn_data_format(pn_data_t *data, char *bytes, size_t *size);
  */
 PN_EXTERN ssize_t pn_data_encode(pn_data_t *data, char *bytes, size_t size);
 
+/**
+ * **Unsettled API**: Encode a data object, allocating space if necessary
+ *
+ * The data is encoded in a single pass: if the buffer fills up it is
+ * expanded in place and encoding carries on where it left off.
+ *
+ * @param[in] data the data object to encode
+ * @param[inout] buf Used to encode data.
+ *   If buf->start == NULL memory is allocated with malloc().
+ *   If buf->size is not large enough, buffer is expanded with realloc().
+ *   On return buf holds the address and size of the final buffer.
+ *   buf->size may be larger than the length of the encoded data.
+ * @return the size of the encoded data on success or an error code on failure
+ */
+PN_EXTERN ssize_t pn_data_encode2(pn_data_t *data, pn_rwbytes_t *buf);
+
 /**
  * Returns the number of bytes needed to encode a data object.
  *
@@ -562,6 +598,36 @@ PN_EXTERN ssize_t pn_data_encoded_size(pn_data_t *data);
  */
 PN_EXTERN ssize_t pn_data_decode(pn_data_t *data, const char *bytes, size_t size);
 
+/**
+ * Decodes a single value from the supplied AMQP data stream into the
+ * supplied pn_data_t object without copying binary, string and symbol
+ * values: they refer directly to the supplied bytes.
+ *
+ * This behaves exactly like ::pn_data_decode() except for the lifetime of
+ * those values. The supplied bytes must stay valid and unchanged for as
+ * long as the pn_data_t object refers to them, that is until it is
+ * cleared, freed or ::pn_data_materialize() is called. Values put into
+ * the pn_data_t object in any other way, and copies made with
+ * ::pn_data_copy() or similar, are not affected. Unlike copied values,
+ * borrowed values are not followed by a NUL terminator.
+ *
+ * @param data a pn_data_t object
+ * @param bytes a pointer to an encoded AMQP data stream
+ * @param size the size of the encoded AMQP data stream
+ * @return the number of bytes consumed from the AMQP data stream or an error code
+ */
+PN_EXTERN ssize_t pn_data_decode_borrowed(pn_data_t *data, const char *bytes, size_t size);
+
+/**
+ * Copies any binary, string and symbol values that refer to bytes
+ * outside a pn_data_t object (see ::pn_data_decode_borrowed()) into the
+ * pn_data_t object, so it no longer depends on them.
+ *
+ * @param data a pn_data_t object
+ * @return zero on success or an error code on failure
+ */
+PN_EXTERN int pn_data_materialize(pn_data_t *data);
+
 /**
  * Puts an empty list value into a pn_data_t. Elements may be filled
  * by entering the list node using ::pn_data_enter() and using
@@ -641,6 +707,33 @@ PN_EXTERN int pn_data_put_map(pn_data_t *data);
  */
 PN_EXTERN int pn_data_put_array(pn_data_t *data, bool described, pn_type_t type);
 
+/**
+ * **Unsettled API**: Puts an array of fixed width values into a
+ * pn_data_t in one go.
+ *
+ * The values are copied into a single node rather than a node for
+ * each element, which makes large numeric arrays much cheaper to
+ * build and to encode. The array can still be entered and its
+ * elements read one by one as usual, at the cost of creating the
+ * element nodes at that point.
+ *
+ * Supported types and the C types of their values are ::PN_UBYTE
+ * (uint8_t), ::PN_BYTE (int8_t), ::PN_USHORT (uint16_t), ::PN_SHORT
+ * (int16_t), ::PN_UINT (uint32_t), ::PN_INT (int32_t), ::PN_CHAR
+ * (pn_char_t), ::PN_FLOAT (float), ::PN_DECIMAL32 (pn_decimal32_t),
+ * ::PN_ULONG (uint64_t), ::PN_LONG (int64_t), ::PN_TIMESTAMP
+ * (pn_timestamp_t), ::PN_DOUBLE (double), ::PN_DECIMAL64
+ * (pn_decimal64_t), ::PN_DECIMAL128 (pn_decimal128_t) and ::PN_UUID
+ * (pn_uuid_t).
+ *
+ * @param data a pn_data_t object
+ * @param type the element type of the array
+ * @param values the values, an array of count values of the C type for type
+ * @param count the number of values
+ * @return zero on success or an error code on failure
+ */
+PN_EXTERN int pn_data_put_array_bulk(pn_data_t *data, pn_type_t type, const void *values, size_t count);
+
 /**
  * Puts a described value into a pn_data_t object. A described node
  * has two children, the descriptor and the value. These are specified
@@ -983,6 +1076,25 @@ PN_EXTERN bool pn_data_is_array_described(pn_data_t *data);
  */
 PN_EXTERN pn_type_t pn_data_get_array_type(pn_data_t *data);
 
+/**
+ * **Unsettled API**: Copies the elements of the current array node
+ * into a C array in one go.
+ *
+ * Arrays of the fixed width types listed for pn_data_put_array_bulk()
+ * that have been decoded or put in bulk are copied without creating a
+ * node for each element. Use pn_data_get_array() to find how many
+ * elements there are.
+ *
+ * @param data a pn_data_t object
+ * @param type the element type of the array
+ * @param values where to put the values, an array of at least count
+ * values of the C type for type
+ * @param count the maximum number of values to copy
+ * @return the number of values copied, 0 if the current node is not
+ * an array of type
+ */
+PN_EXTERN size_t pn_data_get_array_bulk(pn_data_t *data, pn_type_t type, void *values, size_t count);
+
 /**
  * Checks if the current node is a described value. The descriptor and
  * value may be accessed by entering the described value node.
@@ -493,6 +493,41 @@ PN_EXTERN pn_data_t *pn_connection_remote_properties(pn_connection_t *connection
  */
 PN_EXTERN pn_transport_t *pn_connection_transport(pn_connection_t *connection);
 
+/**
+ * **Unsettled API** - The memory used by a connection, in bytes, broken
+ * down by what uses it.
+ *
+ * Sizes are what the allocator holds for each block where it can report
+ * that, otherwise what was asked for.
+ */
+typedef struct pn_connection_memory_t {
+  size_t connection;        /**< the connection object, its strings, data and lists */
+  size_t transport;         /**< the bound transport object and its own fields */
+  size_t transport_buffers; /**< the transport's input, output and frame buffers */
+  size_t codec;             /**< the transport's performative and disposition ::pn_data_t */
+  size_t scratch;           /**< the transport's scratch string */
+  size_t sessions;          /**< the sessions and their handle and delivery maps */
+  size_t links;             /**< the links and their termini */
+  size_t deliveries;        /**< unsettled deliveries and the pool of free ones */
+  size_t ssl;               /**< the SSL layer, not counting the SSL library's own state */
+  size_t sasl;              /**< the SASL layer, not counting the mechanism's own state */
+  size_t io;                /**< the IO integration, see ::pn_proactor_connection_memory_usage */
+  size_t total;             /**< the sum of all the above */
+} pn_connection_memory_t;
+
+/**
+ * **Unsettled API** - Measure the memory used by a connection, its
+ * sessions, links and deliveries and the transport bound to it.
+ *
+ * This walks every session, link and unsettled delivery so it costs time
+ * in proportion to them; it is meant for monitoring and tuning, not for
+ * every event.  The io field is zero, an IO integration fills it in.
+ *
+ * @param[in] connection the connection object
+ * @param[out] usage set to the memory used
+ */
+PN_EXTERN void pn_connection_memory_usage(pn_connection_t *connection, pn_connection_memory_t *usage);
+
 /**
  * @}
  */
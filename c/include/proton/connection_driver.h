@@ -175,8 +175,24 @@ PN_EXTERN bool pn_connection_driver_read_closed(pn_connection_driver_t *);
  PN_EXTERN pn_bytes_t pn_connection_driver_write_buffer(pn_connection_driver_t *);
 
 /**
- * Call when the first n bytes of pn_connection_driver_write_buffer() have been
- * written to IO. Reclaims the buffer space and reset the write buffer.
+ * **Unsettled API** - Get the write data as several buffers, to be written in
+ * order with a single gathering call such as writev() or sendmsg().
+ *
+ * Unlike pn_connection_driver_write_buffer() the outgoing frames need not be
+ * copied into one contiguous buffer first, so large messages are copied less.
+ * The buffers are valid until the next call on the driver; call
+ * pn_connection_driver_write_done() with the total number of bytes written.
+ *
+ * @param buffers array to fill in
+ * @param count the number of entries in buffers
+ * @return the number of buffers filled in, 0 means there is nothing to write.
+ */
+PN_EXTERN size_t pn_connection_driver_write_buffers(pn_connection_driver_t *, pn_bytes_t *buffers, size_t count);
+
+/**
+ * Call when the first n bytes of pn_connection_driver_write_buffer() (or of
+ * the buffers from pn_connection_driver_write_buffers()) have been written to
+ * IO. Reclaims the buffer space and reset the write buffer.
  */
 PN_EXTERN void pn_connection_driver_write_done(pn_connection_driver_t *, size_t n);
 
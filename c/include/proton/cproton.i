@@ -881,6 +881,12 @@ typedef unsigned long int uintptr_t;
   msg != NULL;
 }
 
+%contract pn_message_decode_lazy(pn_message_t *msg, const char *bytes, size_t size)
+{
+ require:
+  msg != NULL;
+}
+
 %contract pn_message_encode(pn_message_t *msg, char *bytes, size_t *size)
 {
  require:
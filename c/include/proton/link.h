@@ -586,6 +586,20 @@ PN_EXTERN void pn_link_offered(pn_link_t *sender, int credit);
  */
 PN_EXTERN ssize_t pn_link_send(pn_link_t *sender, const char *bytes, size_t n);
 
+/**
+ * **Unsettled API** - Get how many more bytes ::pn_link_send will take for
+ * the current delivery on a sender.
+ *
+ * This is only limited if the link has a delivery window, see
+ * ::pn_link_set_delivery_window. Space is freed as the data is written to the
+ * transport, which is signalled by a ::PN_LINK_FLOW event.
+ *
+ * @param[in] sender a sending link object
+ * @return the number of bytes, 0 if there is no current delivery, SIZE_MAX if
+ * there is no limit
+ */
+PN_EXTERN size_t pn_link_send_space(pn_link_t *sender);
+
 /**
  * Grant credit for incoming deliveries on a receiver.
  *
@@ -639,6 +653,31 @@ PN_EXTERN void pn_link_set_drain(pn_link_t *receiver, bool drain);
  */
 PN_EXTERN ssize_t pn_link_recv(pn_link_t *receiver, char *bytes, size_t n);
 
+/**
+ * **Unsettled API** - Get the message data received so far for the current
+ * delivery on a link in place, without copying it.
+ *
+ * The data is returned as up to two buffers which hold it in order; with a
+ * count of 1 only the first part may be returned. The buffers stay valid
+ * until data is next received or consumed for the delivery, or it is settled.
+ * Call ::pn_link_recv_done to consume data once it has been used.
+ *
+ * @param[in] receiver a receiving link object
+ * @param[out] buffers the buffers to fill in
+ * @param[in] count the number of entries in buffers
+ * @return The number of buffers filled in, or the same codes as ::pn_link_recv
+ */
+PN_EXTERN ssize_t pn_link_recv_buffers(pn_link_t *receiver, pn_bytes_t *buffers, size_t count);
+
+/**
+ * **Unsettled API** - Consume the first n bytes of the data from
+ * ::pn_link_recv_buffers, as if they had been read with ::pn_link_recv.
+ *
+ * @param[in] receiver a receiving link object with a current delivery
+ * @param[in] n the number of bytes to consume, at most ::pn_delivery_pending
+ */
+PN_EXTERN void pn_link_recv_done(pn_link_t *receiver, size_t n);
+
 /**
  * Check if a link is currently draining.
  *
@@ -670,6 +709,49 @@ PN_EXTERN uint64_t pn_link_max_message_size(pn_link_t *link);
  */
 PN_EXTERN void pn_link_set_max_message_size(pn_link_t *link, uint64_t size);
 
+/**
+ * **Unsettled API** - Get the delivery window of a link.
+ *
+ * @param[in] link a link object
+ * @return the delivery window in bytes, zero means there is none.
+ */
+PN_EXTERN size_t pn_link_delivery_window(pn_link_t *link);
+
+/**
+ * **Unsettled API** - Bound the memory a single delivery being streamed over
+ * a link can use, whatever the size of its message.
+ *
+ * On a sender ::pn_link_send takes no more data for the current delivery
+ * than the window has room for; call it again as the buffered data is
+ * written to the transport (see ::pn_link_send_space).
+ *
+ * On a receiver the session stops granting incoming window once the data
+ * received on its windowed links and not yet read with ::pn_link_recv (or
+ * consumed by ::pn_link_advance) fills the sum of their windows, and reopens
+ * it as the data is read. The data held can exceed the windows by up to one
+ * frame. Link credit counts deliveries, not bytes, so it can't hold back a
+ * delivery part way through and the bound has to be kept for the whole
+ * session.
+ *
+ * @note While a receiver's window is full no transfers arrive on any link
+ * of its session, until the application reads some of the data. Other
+ * sessions on the connection are not affected, as long as the transport has
+ * a maximum frame size (the default, see ::pn_transport_set_max_frame).
+ *
+ * @note With no maximum frame size (0) a single transfer frame can be any
+ * size, so holding back whole frames bounds nothing. The transport instead
+ * stops taking input part way through the transfer, which keeps the data
+ * held within one read of input past the windows. Until some data is read,
+ * the whole connection stalls: no other frame is read at all, including
+ * the flow, detach, end and close frames of other links and sessions.
+ *
+ * A zero window, the default, means no limit.
+ *
+ * @param[in] link a link object
+ * @param[in] window the delivery window in bytes
+ */
+PN_EXTERN void pn_link_set_delivery_window(pn_link_t *link, size_t window);
+
 /**
  * **Unsettled API** - Get the remote view of the maximum message size for a link.
  *
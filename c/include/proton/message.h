@@ -722,6 +722,93 @@ PN_EXTERN pn_data_t *pn_message_body(pn_message_t *msg);
  */
 PN_EXTERN int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size);
 
+/**
+ * Decode/load message content from AMQP formatted binary data,
+ * parsing each section only when it is first used.
+ *
+ * This behaves like ::pn_message_decode(), except that the data is
+ * copied into the message and only split into its sections. A section
+ * (header, delivery annotations, message annotations, properties,
+ * application properties or body) is decoded the first time one of its
+ * fields is read or set, or when the message is encoded or inspected.
+ * A message that is only routed on its address or annotations never has
+ * its body decoded.
+ *
+ * Only the framing of the sections is checked here. An error found when
+ * a section is decoded later is reported by ::pn_message_error() and
+ * leaves the fields of that section unset.
+ *
+ * @param[in] msg a message object
+ * @param[in] bytes the start of the encoded AMQP data
+ * @param[in] size the size of the encoded AMQP data
+ * @return zero on success or an error code on failure
+ */
+PN_EXTERN int pn_message_decode_lazy(pn_message_t *msg, const char *bytes, size_t size);
+
+/**
+ * Routing fields of an encoded message, see ::pn_message_peek().
+ */
+typedef struct pn_message_peek_t {
+  pn_bytes_t address;   /**< The "to" address, or null. Refers to the encoded message. */
+  pn_bytes_t subject;   /**< The subject, or null. Refers to the encoded message. */
+  pn_millis_t ttl;      /**< The ttl, 0 if not set */
+  uint8_t priority;     /**< The priority, ::PN_DEFAULT_PRIORITY if not set */
+  bool durable;         /**< The durable flag */
+} pn_message_peek_t;
+
+/**
+ * Read the routing fields of an encoded message without decoding it.
+ *
+ * The fields are read straight from the header and properties sections
+ * of the encoded message, which are found in the same way as by
+ * ::pn_message_decode(). No ::pn_message_t is needed and nothing is
+ * copied, so a router can look at a message this way for little more
+ * than the cost of reading it.
+ *
+ * @param[in] bytes the start of the encoded AMQP message
+ * @param[in] size the size of the encoded AMQP message
+ * @param[out] fields set to the fields of the message
+ * @return zero on success or an error code if the sections of the
+ * message are incomplete
+ */
+PN_EXTERN int pn_message_peek(const char *bytes, size_t size, pn_message_peek_t *fields);
+
+/**
+ * Read a message annotation from an encoded message without decoding it.
+ *
+ * Scalar values are returned as ::pn_data_get_atom() would return
+ * them, with strings, symbols and binaries referring to the encoded
+ * message. For a list, map, array or described value only the type is
+ * set, and u.as_bytes holds the encoded value, which
+ * ::pn_data_decode() can decode.
+ *
+ * @param[in] bytes the start of the encoded AMQP message
+ * @param[in] size the size of the encoded AMQP message
+ * @param[in] key the annotation to read
+ * @param[out] value set to the value of the annotation, its type is
+ * PN_INVALID if there is no such annotation
+ * @return zero on success or an error code if the sections of the
+ * message are incomplete
+ */
+PN_EXTERN int pn_message_peek_annotation(const char *bytes, size_t size, const char *key, pn_atom_t *value);
+
+/**
+ * Read an application property from an encoded message without
+ * decoding it.
+ *
+ * Like ::pn_message_peek_annotation() but for the application
+ * properties section.
+ *
+ * @param[in] bytes the start of the encoded AMQP message
+ * @param[in] size the size of the encoded AMQP message
+ * @param[in] key the property to read
+ * @param[out] value set to the value of the property, its type is
+ * PN_INVALID if there is no such property
+ * @return zero on success or an error code if the sections of the
+ * message are incomplete
+ */
+PN_EXTERN int pn_message_peek_property(const char *bytes, size_t size, const char *key, pn_atom_t *value);
+
 /**
  * Encode a message as AMQP formatted binary data.
  *
@@ -729,6 +816,11 @@ PN_EXTERN int pn_message_decode(pn_message_t *msg, const char *bytes, size_t siz
  * held in the message, the operation will fail and return a
  * PN_OVERFLOW error code.
  *
+ * A section of a decoded message that has not been changed since is
+ * encoded by copying the bytes it was decoded from. Setting one of its
+ * fields, or getting the ::pn_data_t of the section (for example with
+ * ::pn_message_annotations()), counts as changing it.
+ *
  * @param[in] msg a message object
  * @param[in] bytes the start of empty buffer space
  * @param[in] size the amount of empty buffer space
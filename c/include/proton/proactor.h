@@ -21,6 +21,7 @@
  */
 
 #include <proton/condition.h>
+#include <proton/connection.h>
 #include <proton/event.h>
 #include <proton/import_export.h>
 #include <proton/types.h>
@@ -289,6 +290,19 @@ PNP_EXTERN void pn_connection_wake(pn_connection_t *connection);
  */
 PNP_EXTERN pn_proactor_t *pn_connection_proactor(pn_connection_t *connection);
 
+/**
+ * **Unsettled API** - Measure the memory used by a connection as
+ * ::pn_connection_memory_usage does, with the io field set to the memory
+ * the proactor holds for it: its socket, timer and driver state.  Kernel
+ * memory for the socket and timer is not counted.
+ *
+ * @note **Not thread-safe**, call it while handling an event for the connection.
+ *
+ * @param[in] connection the connection object
+ * @param[out] usage set to the memory used
+ */
+PNP_EXTERN void pn_proactor_connection_memory_usage(pn_connection_t *connection, pn_connection_memory_t *usage);
+
 /**
  * Return the proactor associated with an event.
  *
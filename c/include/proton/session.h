@@ -213,11 +213,12 @@ PN_EXTERN size_t pn_session_get_incoming_capacity(pn_session_t *session);
  * incoming-window for transfer frames. This happens in concert with the
  * transport max frame size, and only when both values have been set.
  *
- * NOTE: If set, this value must be greater than or equal to the negotiated
- * frame size of the transport. The window is computed as a whole number of
- * frames when dividing remaining capacity at a given time by the connection
- * max frame size. As such, capacity and max frame size should be chosen so
- * as to ensure the frame window isn't unduly small and limiting performance.
+ * NOTE: The window is computed as a whole number of frames when dividing
+ * remaining capacity at a given time by the connection max frame size, which
+ * is 16KiB unless set otherwise. A capacity smaller than the frame size is
+ * taken to be one frame. As such, capacity and max frame size should be
+ * chosen so as to ensure the frame window isn't unduly small and limiting
+ * performance.
  *
  * @param[in] session the session object
  * @param[in] capacity the incoming capacity for the session in bytes
@@ -430,6 +430,9 @@ PN_EXTERN uint32_t pn_transport_get_max_frame(pn_transport_t *transport);
 /**
  * Set the maximum frame size of a transport.
  *
+ * The default is 16KiB.  A size of 0 advertises no limit; transfer frames
+ * are then still read as they arrive rather than being held whole.
+ *
  * @param[in] transport a transport object
  * @param[in] size the maximum frame size for the transport object
  *
@@ -471,6 +474,30 @@ PN_EXTERN pn_millis_t pn_transport_get_idle_timeout(pn_transport_t *transport);
  */
 PN_EXTERN void pn_transport_set_idle_timeout(pn_transport_t *transport, pn_millis_t timeout);
 
+/**
+ * **Unsettled API** - Get how long a transport's buffers are kept while
+ * it is idle.
+ *
+ * @param[in] transport a transport object
+ * @return the buffer release timeout, 0 if the buffers are always kept
+ */
+PN_EXTERN pn_millis_t pn_transport_get_buffer_release_timeout(pn_transport_t *transport);
+
+/**
+ * **Unsettled API** - Set how long a transport's buffers are kept while
+ * it is idle.
+ *
+ * When no bytes have gone in or out of the transport for this long, the
+ * memory of its empty buffers is freed.  They are allocated again when
+ * next needed, at half the size they grew to.  This is checked by
+ * pn_transport_tick().  The default, 0, keeps the buffers for the life of
+ * the transport.
+ *
+ * @param[in] transport a transport object
+ * @param[in] timeout the buffer release timeout
+ */
+PN_EXTERN void pn_transport_set_buffer_release_timeout(pn_transport_t *transport, pn_millis_t timeout);
+
 /**
  * Get the idle timeout for a transport's remote peer.
  *
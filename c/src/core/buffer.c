@@ -35,6 +35,7 @@
 
 struct pn_buffer_t {
   size_t capacity;
+  size_t released;      // capacity to allocate again after pn_buffer_release()
   size_t start;
   size_t size;
   char *bytes;
@@ -47,6 +48,7 @@ pn_buffer_t *pn_buffer(size_t capacity)
   pn_buffer_t *buf = (pn_buffer_t *) pni_mem_allocate(PN_CLASSCLASS(pn_buffer), sizeof(pn_buffer_t));
   if (buf != NULL) {
     buf->capacity = capacity;
+    buf->released = 0;
     buf->start = 0;
     buf->size = 0;
     if (capacity > 0) {
@@ -147,7 +149,7 @@ int pn_buffer_ensure(pn_buffer_t *buf, size_t size)
   bool wrapped = pni_buffer_wrapped(buf);
 
   while (pn_buffer_available(buf) < size) {
-    buf->capacity = 2*(buf->capacity ? buf->capacity : 16);
+    buf->capacity = buf->capacity ? 2*buf->capacity : pn_max(buf->released, (size_t) 32);
   }
 
   if (buf->capacity != old_capacity) {
@@ -263,6 +265,18 @@ void pn_buffer_clear(pn_buffer_t *buf)
   buf->size = 0;
 }
 
+// Free the memory of an empty buffer, it is allocated again with at least
+// capacity bytes when needed
+void pn_buffer_release(pn_buffer_t *buf, size_t capacity)
+{
+  if (buf->size) return;
+  pni_mem_subdeallocate(PN_CLASSCLASS(pn_buffer), buf, buf->bytes);
+  buf->bytes = NULL;
+  buf->capacity = 0;
+  buf->released = capacity;
+  buf->start = 0;
+}
+
 static void pn_buffer_rotate (pn_buffer_t *buf, size_t sz) {
   if (sz == 0) return;
 
@@ -311,6 +325,21 @@ pn_rwbytes_t pn_buffer_memory(pn_buffer_t *buf)
   }
 }
 
+// The contents in place, as at most two runs of bytes. Returns how many.
+size_t pn_buffer_chunks(pn_buffer_t *buf, pn_bytes_t chunks[2])
+{
+  size_t count = 0;
+  size_t head_size = pni_buffer_head_size(buf);
+  if (head_size) {
+    chunks[count++] = pn_bytes(head_size, buf->bytes + pni_buffer_head(buf));
+  }
+  size_t tail_size = pni_buffer_tail_size(buf);
+  if (tail_size) {
+    chunks[count++] = pn_bytes(tail_size, buf->bytes);
+  }
+  return count;
+}
+
 int pn_buffer_quote(pn_buffer_t *buf, pn_string_t *str, size_t n)
 {
   size_t hsize = pni_buffer_head_size(buf);
@@ -323,3 +352,9 @@ int pn_buffer_quote(pn_buffer_t *buf, pn_string_t *str, size_t n)
   pn_quote(str, buf->bytes, pn_min(tsize, n-hsize));
   return 0;
 }
+
+size_t pni_buffer_memory(pn_buffer_t *buf)
+{
+  if (!buf) return 0;
+  return pni_mem_size(buf, sizeof(pn_buffer_t)) + pni_mem_size(buf->bytes, buf->capacity);
+}
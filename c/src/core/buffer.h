@@ -43,9 +43,12 @@ int pn_buffer_prepend(pn_buffer_t *buf, const char *bytes, size_t size);
 size_t pn_buffer_get(pn_buffer_t *buf, size_t offset, size_t size, char *dst);
 int pn_buffer_trim(pn_buffer_t *buf, size_t left, size_t right);
 void pn_buffer_clear(pn_buffer_t *buf);
+void pn_buffer_release(pn_buffer_t *buf, size_t capacity);
+size_t pni_buffer_memory(pn_buffer_t *buf);
 int pn_buffer_defrag(pn_buffer_t *buf);
 pn_bytes_t pn_buffer_bytes(pn_buffer_t *buf);
 pn_rwbytes_t pn_buffer_memory(pn_buffer_t *buf);
+size_t pn_buffer_chunks(pn_buffer_t *buf, pn_bytes_t chunks[2]);
 int pn_buffer_quote(pn_buffer_t *buf, pn_string_t *string, size_t n);
 
 #ifdef __cplusplus
@@ -38,6 +38,8 @@
 #include "data.h"
 #include "logger_private.h"
 #include "memory.h"
+#include "packed.h"
+#include "symbols.h"
 
 const char *pn_type_name(pn_type_t type)
 {
@@ -86,6 +88,10 @@ static void pn_data_finalize(void *object)
 {
   pn_data_t *data = (pn_data_t *) object;
   pni_mem_subdeallocate(pn_class(data), data, data->nodes);
+  if (data->index) {
+    pni_mem_subdeallocate(pn_class(data), data, data->index->slots);
+    pni_mem_subdeallocate(pn_class(data), data, data->index);
+  }
   pn_buffer_free(data->buf);
   pn_error_free(data->error);
 }
@@ -246,6 +252,22 @@ static int pni_node_lindex(pn_data_t *data, pni_node_t *node)
   return count - 1;
 }
 
+static int pni_inspect_packed(pni_node_t *node, pn_string_t *str)
+{
+  pn_type_t type = (pn_type_t) node->u.compound.type;
+  size_t count = node->atom.u.as_bytes.size / pni_packed_width(type);
+  for (size_t i = 0; i < count; i++) {
+    pn_atom_t atom = pni_packed_atom(type, node->atom.u.as_bytes, i);
+    int err = pni_inspect_atom(&atom, str);
+    if (err) return err;
+    if (i + 1 < count) {
+      err = pn_string_addf(str, ", ");
+      if (err) return err;
+    }
+  }
+  return 0;
+}
+
 int pni_inspect_enter(void *ctx, pn_data_t *data, pni_node_t *node)
 {
   pn_string_t *str = (pn_string_t *) ctx;
@@ -277,7 +299,9 @@ int pni_inspect_enter(void *ctx, pn_data_t *data, pni_node_t *node)
     return pn_string_addf(str, "@");
   case PN_ARRAY:
     // XXX: need to fix for described arrays
-    return pn_string_addf(str, "@%s[", pn_type_name(node->type));
+    err = pn_string_addf(str, "@%s[", pn_type_name((pn_type_t) node->u.compound.type));
+    if (err || !node->packed) return err;
+    return pni_inspect_packed(node, str);
   case PN_LIST:
     return pn_string_addf(str, "[");
   case PN_MAP:
@@ -383,6 +407,7 @@ pn_data_t *pn_data(size_t capacity)
   data->base_parent = 0;
   data->base_current = 0;
   data->error = NULL;
+  data->index = NULL;
   return data;
 }
 
@@ -391,6 +416,19 @@ void pn_data_free(pn_data_t *data)
   pn_free(data);
 }
 
+size_t pni_data_memory(pn_data_t *data)
+{
+  if (!data) return 0;
+  size_t size = pni_object_memory(data, sizeof(pn_data_t)) +
+    pni_mem_size(data->nodes, data->capacity * sizeof(pni_node_t)) +
+    pni_buffer_memory(data->buf) + pni_error_memory(data->error);
+  if (data->index) {
+    size += pni_mem_size(data->index, sizeof(pni_data_index_t)) +
+      pni_mem_size(data->index->slots, data->index->capacity * sizeof(pni_nid_t));
+  }
+  return size;
+}
+
 int pn_data_errno(pn_data_t *data)
 {
   return pn_error_code(pni_data_error(data));
@@ -414,6 +452,7 @@ void pn_data_clear(pn_data_t *data)
     data->current = 0;
     data->base_parent = 0;
     data->base_current = 0;
+    if (data->index) data->index->map = 0;
     if (data->buf) pn_buffer_clear(data->buf);
   }
 }
@@ -452,34 +491,57 @@ static pn_bytes_t *pni_data_bytes(pn_data_t *data, pni_node_t *node)
   case PN_STRING:
   case PN_SYMBOL:
     return &node->atom.u.as_bytes;
+  case PN_ARRAY:
+    return node->packed ? &node->atom.u.as_bytes : NULL;
   default: return NULL;
   }
 }
 
+// Packed arrays keep their offset with the array type
+static inline size_t pni_data_offset(pni_node_t *node)
+{
+  return node->packed ? node->u.compound.start : node->u.data_offset;
+}
+
 static void pni_data_rebase(pn_data_t *data, char *base)
 {
   for (unsigned i = 0; i < data->size; i++) {
     pni_node_t *node = &data->nodes[i];
     if (node->data) {
       pn_bytes_t *bytes = pni_data_bytes(data, node);
-      bytes->start = base + node->data_offset;
+      bytes->start = base + pni_data_offset(node);
     }
   }
 }
 
+// Refer to the interned copy of a symbol, if there is one, instead of a copy
+static inline bool pni_data_intern_symbol(pn_bytes_t *bytes)
+{
+  if (pni_symbol_is_interned(bytes->start)) return true;
+  pni_symbol_t symbol = pni_symbol_lookup(*bytes);
+  if (!symbol) return false;
+  *bytes = pni_symbol_bytes(symbol);
+  return true;
+}
+
 static int pni_data_intern_node(pn_data_t *data, pni_node_t *node)
 {
   pn_bytes_t *bytes = pni_data_bytes(data, node);
   if (!bytes) return 0;
+  if (node->atom.type == PN_SYMBOL && pni_data_intern_symbol(bytes)) return 0;
   if (data->buf == NULL) {
     data->buf = pn_buffer(bytes->size);
   }
   size_t oldcap = pn_buffer_capacity(data->buf);
   ssize_t offset = pni_data_intern(data, bytes->start, bytes->size);
   if (offset < 0) return offset;
+  if (node->packed) {
+    if ((size_t) offset > UINT32_MAX) return PN_OUT_OF_MEMORY;
+    node->u.compound.start = offset;
+  } else {
+    node->u.data_offset = offset;
+  }
   node->data = true;
-  node->data_offset = offset;
-  node->data_size = bytes->size;
   pn_rwbytes_t buf = pn_buffer_memory(data->buf);
   bytes->start = buf.start + offset;
 
@@ -662,7 +724,7 @@ int pn_data_vfill(pn_data_t *data, const char *fmt, va_list ap)
       {
         pni_node_t *parent = pn_data_node(data, data->parent);
         if (parent->atom.type == PN_ARRAY) {
-          parent->type = (pn_type_t) va_arg(ap, int);
+          parent->u.compound.type = (pn_type_t) va_arg(ap, int);
         } else {
           return pn_error_format(pni_data_error(data), PN_ERR, "naked type");
         }
@@ -1261,7 +1323,7 @@ pn_handle_t pn_data_point(pn_data_t *data)
   if (data->current) {
     return (pn_handle_t)(uintptr_t)data->current;
   } else {
-    return (pn_handle_t)(uintptr_t)-data->parent;
+    return (pn_handle_t)(uintptr_t)-(pn_shandle_t)data->parent;
   }
 }
 
@@ -1402,9 +1464,12 @@ size_t pn_data_siblings(pn_data_t *data)
   }
 }
 
+static int pni_data_unpack(pn_data_t *data, pni_nid_t id);
+
 bool pn_data_enter(pn_data_t *data)
 {
   if (data->current) {
+    if (pni_data_current(data)->packed && pni_data_unpack(data, data->current)) return false;
     data->parent = data->current;
     data->current = 0;
     return true;
@@ -1451,6 +1516,127 @@ bool pn_data_lookup(pn_data_t *data, const char *name)
   return false;
 }
 
+// Maps with fewer entries than this are searched without an index
+#define PNI_INDEX_MIN_ENTRIES 8
+
+static inline bool pni_key_is_bytes(pn_type_t type)
+{
+  return type == PN_STRING || type == PN_SYMBOL || type == PN_BINARY;
+}
+
+// Size of the value of a scalar key that is not a binary, string or symbol,
+// which is held at the start of its atom's union.  -1 for compound keys.
+static inline ssize_t pni_key_width(pn_type_t type)
+{
+  switch (type) {
+  case PN_NULL: return 0;
+  case PN_BOOL: return sizeof(bool);
+  default: {
+    size_t width = pni_packed_width(type);
+    return width ? (ssize_t) width : -1;
+  }
+  }
+}
+
+/* Hash a map key, its type as well as its value.  Returns false for a
+ * compound key, which is never found. */
+static bool pni_key_hash(const pn_atom_t *key, uint32_t *hash)
+{
+  pn_bytes_t value;
+  if (pni_key_is_bytes(key->type)) {
+    value = key->u.as_bytes;
+  } else {
+    ssize_t width = pni_key_width(key->type);
+    if (width < 0) return false;
+    value = pn_bytes(width, (const char *) &key->u);
+  }
+  char type = key->type;
+  *hash = pni_fnv1a_add(pni_fnv1a(pn_bytes(1, &type)), value);
+  return true;
+}
+
+static bool pni_key_equal(const pn_atom_t *a, const pn_atom_t *b)
+{
+  if (a->type != b->type) return false;
+  if (pni_key_is_bytes(a->type)) return pn_bytes_equal(a->u.as_bytes, b->u.as_bytes);
+  ssize_t width = pni_key_width(a->type);
+  return width >= 0 && !memcmp(&a->u, &b->u, width);
+}
+
+// Index the keys of map, the last of any duplicate keys wins
+static int pni_data_index(pn_data_t *data, pni_nid_t map)
+{
+  const pn_class_t *clazz = pn_class(data);
+  pni_data_index_t *index = data->index;
+  if (!index) {
+    index = (pni_data_index_t *) pni_mem_suballocate(clazz, data, sizeof(pni_data_index_t));
+    if (!index) return PN_OUT_OF_MEMORY;
+    index->slots = NULL;
+    index->capacity = 0;
+    index->map = 0;
+    data->index = index;
+  }
+
+  size_t capacity = 2 * PNI_INDEX_MIN_ENTRIES;
+  while (capacity < pn_data_node(data, map)->children) capacity *= 2;
+  if (index->capacity != capacity) {
+    pni_nid_t *slots = (pni_nid_t *) pni_mem_subreallocate(clazz, data, index->slots, capacity * sizeof(pni_nid_t));
+    if (!slots) return PN_OUT_OF_MEMORY;
+    index->slots = slots;
+    index->capacity = capacity;
+  }
+  memset(index->slots, 0, capacity * sizeof(pni_nid_t));
+
+  size_t mask = capacity - 1;
+  pni_node_t *key = pn_data_node(data, pn_data_node(data, map)->down);
+  while (key && key->next) {
+    uint32_t hash;
+    if (pni_key_hash(&key->atom, &hash)) {
+      size_t i = hash & mask;
+      while (index->slots[i] && !pni_key_equal(&pn_data_node(data, index->slots[i])->atom, &key->atom)) {
+        i = (i + 1) & mask;
+      }
+      index->slots[i] = pni_data_id(data, key);
+    }
+    key = pn_data_node(data, pn_data_node(data, key->next)->next);
+  }
+  index->map = map;
+  return 0;
+}
+
+bool pn_data_find(pn_data_t *data, pn_atom_t key)
+{
+  pni_node_t *map = pn_data_node(data, data->parent);
+  uint32_t hash;
+  if (!map || map->atom.type != PN_MAP || !pni_key_hash(&key, &hash)) return false;
+
+  pni_nid_t found = 0;
+  if (map->children < 2 * PNI_INDEX_MIN_ENTRIES) {
+    pni_node_t *node = pn_data_node(data, map->down);
+    while (node && node->next) {
+      if (pni_key_equal(&node->atom, &key)) found = node->next;
+      node = pn_data_node(data, pn_data_node(data, node->next)->next);
+    }
+  } else {
+    if (!data->index || data->index->map != data->parent) {
+      if (pni_data_index(data, data->parent)) return false;
+    }
+    pni_data_index_t *index = data->index;
+    size_t mask = index->capacity - 1;
+    for (size_t i = hash & mask; index->slots[i]; i = (i + 1) & mask) {
+      pni_node_t *node = pn_data_node(data, index->slots[i]);
+      if (pni_key_equal(&node->atom, &key)) {
+        found = node->next;
+        break;
+      }
+    }
+  }
+
+  if (!found) return false;
+  data->current = found;
+  return true;
+}
+
 void pn_data_dump(pn_data_t *data)
 {
   pn_string_t *str = pn_string(0);
@@ -1478,6 +1664,9 @@ static pni_node_t *pni_data_add(pn_data_t *data)
   pni_node_t *parent = pn_data_node(data, data->parent);
   pni_node_t *node;
 
+  // Any change to the nodes may change the keys of the indexed map
+  if (data->index) data->index->map = 0;
+
   if (current) {
     if (current->next) {
       node = pn_data_node(data, current->next);
@@ -1526,8 +1715,8 @@ static pni_node_t *pni_data_add(pn_data_t *data)
   node->children = 0;
   node->data = false;
   node->described = false;
-  node->data_offset = 0;
-  node->data_size = 0;
+  node->packed = false;
+  node->u.data_offset = 0;
   data->current = pni_data_id(data, node);
   return node;
 }
@@ -1541,6 +1730,24 @@ ssize_t pn_data_encode(pn_data_t *data, char *bytes, size_t size)
   return r;
 }
 
+ssize_t pn_data_encode2(pn_data_t *data, pn_rwbytes_t *buffer)
+{
+  pn_encoder_t encoder;
+  pn_encoder_initialize(&encoder);
+  ssize_t r = pn_encoder_encode_grow(&encoder, data, buffer, 0);
+  pn_encoder_finalize(&encoder);
+  return r;
+}
+
+ssize_t pni_data_encode_at(pn_data_t *data, pn_rwbytes_t *buffer, size_t offset)
+{
+  pn_encoder_t encoder;
+  pn_encoder_initialize(&encoder);
+  ssize_t r = pn_encoder_encode_grow(&encoder, data, buffer, offset);
+  pn_encoder_finalize(&encoder);
+  return r;
+}
+
 ssize_t pn_data_encoded_size(pn_data_t *data)
 {
   pn_encoder_t encoder;
@@ -1559,6 +1766,28 @@ ssize_t pn_data_decode(pn_data_t *data, const char *bytes, size_t size)
   return r;
 }
 
+ssize_t pn_data_decode_borrowed(pn_data_t *data, const char *bytes, size_t size)
+{
+  pn_decoder_t decoder;
+  pn_decoder_initialize(&decoder);
+  decoder.borrow = true;
+  ssize_t r = pn_decoder_decode(&decoder, bytes, size, data);
+  pn_decoder_finalize(&decoder);
+  return r;
+}
+
+int pn_data_materialize(pn_data_t *data)
+{
+  for (unsigned i = 0; i < data->size; i++) {
+    pni_node_t *node = &data->nodes[i];
+    if (!node->data) {
+      int err = pni_data_intern_node(data, node);
+      if (err) return err;
+    }
+  }
+  return 0;
+}
+
 int pn_data_put_list(pn_data_t *data)
 {
   pni_node_t *node = pni_data_add(data);
@@ -1581,14 +1810,95 @@ int pn_data_put_array(pn_data_t *data, bool described, pn_type_t type)
   if (node == NULL) return PN_OUT_OF_MEMORY;
   node->atom.type = PN_ARRAY;
   node->described = described;
-  node->type = type;
+  node->u.compound.type = type;
+  return 0;
+}
+
+// Put a packed array whose elements are already encoded, they are copied
+// unless borrow is set in which case they must outlive the node.
+int pni_data_put_packed(pn_data_t *data, pn_type_t type, pn_bytes_t elements, bool borrow)
+{
+  pni_node_t *node = pni_data_add(data);
+  if (node == NULL) return PN_OUT_OF_MEMORY;
+  node->atom.type = PN_ARRAY;
+  node->u.compound.type = type;
+  node->packed = true;
+  node->atom.u.as_bytes = elements;
+  return borrow ? 0 : pni_data_intern_node(data, node);
+}
+
+// Turn a packed array into an ordinary one with a node per element, for
+// anything that navigates into the array.
+static int pni_data_unpack(pn_data_t *data, pni_nid_t id)
+{
+  pni_node_t *node = pn_data_node(data, id);
+  pn_type_t type = (pn_type_t) node->u.compound.type;
+  pn_bytes_t elements = node->atom.u.as_bytes;
+  size_t count = elements.size / pni_packed_width(type);
+  if (count > (size_t) (PNI_NID_MAX - data->size)) return PN_OUT_OF_MEMORY;
+
+  // The elements stay where they are in buf (or the borrowed input) while
+  // the child nodes are added
+  node->packed = false;
+  node->data = false;
+  node->u.compound.start = 0;
+  pni_nid_t parent = data->parent;
+  pni_nid_t current = data->current;
+  data->parent = id;
+  data->current = 0;
+  int err = 0;
+  for (size_t i = 0; i < count && !err; i++) {
+    pni_node_t *child = pni_data_add(data);
+    if (child) {
+      child->atom = pni_packed_atom(type, elements, i);
+    } else {
+      err = PN_OUT_OF_MEMORY;
+    }
+  }
+  data->parent = parent;
+  data->current = current;
+  return err;
+}
+
+int pn_data_put_array_bulk(pn_data_t *data, pn_type_t type, const void *values, size_t count)
+{
+  size_t width = pni_packed_width(type);
+  if (!width || (count && !values)) return PN_ARG_ERR;
+  int err = pni_data_put_packed(data, type, pn_bytes(count * width, values ? (const char *) values : ""), false);
+  if (err) return err;
+  // Now convert the copy in place
+  pni_node_t *node = pni_data_current(data);
+  pni_packed_store((char *) node->atom.u.as_bytes.start, node->atom.u.as_bytes.start, count, width);
   return 0;
 }
 
+size_t pn_data_get_array_bulk(pn_data_t *data, pn_type_t type, void *values, size_t count)
+{
+  pni_node_t *node = pni_data_current(data);
+  if (!node || node->atom.type != PN_ARRAY || node->u.compound.type != type) return 0;
+  size_t width = pni_packed_width(type);
+  if (!width) return 0;
+  if (node->packed) {
+    size_t size = node->atom.u.as_bytes.size / width;
+    if (count > size) count = size;
+    pni_packed_load(values, node->atom.u.as_bytes.start, count, width);
+    return count;
+  }
+  // An array that has been navigated or built element by element
+  pni_node_t *child = pn_data_node(data, node->down);
+  if (child && node->described) child = pn_data_node(data, child->next);
+  size_t i = 0;
+  for (; child && i < count; i++, child = pn_data_node(data, child->next)) {
+    if (child->atom.type != type) break;
+    memcpy((char *) values + i*width, &child->atom.u, width);
+  }
+  return i;
+}
+
 void pni_data_set_array_type(pn_data_t *data, pn_type_t type)
 {
   pni_node_t *array = pni_data_current(data);
-  if (array) array->type = type;
+  if (array) array->u.compound.type = type;
 }
 
 int pn_data_put_described(pn_data_t *data)
@@ -1787,6 +2097,17 @@ int pn_data_put_symbol(pn_data_t *data, pn_bytes_t symbol)
   return pni_data_intern_node(data, node);
 }
 
+// Only used by the decoder: bytes is not copied and must outlive the node
+int pni_data_put_borrowed(pn_data_t *data, pn_type_t type, pn_bytes_t bytes)
+{
+  pni_node_t *node = pni_data_add(data);
+  if (node == NULL) return PN_OUT_OF_MEMORY;
+  node->atom.type = type;
+  node->atom.u.as_bytes = bytes;
+  if (type == PN_SYMBOL) pni_data_intern_symbol(&node->atom.u.as_bytes);
+  return 0;
+}
+
 int pn_data_put_atom(pn_data_t *data, pn_atom_t atom)
 {
   pni_node_t *node = pni_data_add(data);
@@ -1819,7 +2140,9 @@ size_t pn_data_get_array(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
   if (node && node->atom.type == PN_ARRAY) {
-    if (node->described) {
+    if (node->packed) {
+      return node->atom.u.as_bytes.size / pni_packed_width((pn_type_t) node->u.compound.type);
+    } else if (node->described) {
       return node->children - 1;
     } else {
       return node->children;
@@ -1843,7 +2166,7 @@ pn_type_t pn_data_get_array_type(pn_data_t *data)
 {
   pni_node_t *node = pni_data_current(data);
   if (node && node->atom.type == PN_ARRAY) {
-    return node->type;
+    return (pn_type_t) node->u.compound.type;
   } else {
     return PN_INVALID;
   }
@@ -2226,6 +2549,11 @@ int pn_data_appendn(pn_data_t *data, pn_data_t *src, int limit)
       level++;
       break;
     case PN_ARRAY:
+      if (pni_data_current(src)->packed) {
+        err = pni_data_put_packed(data, pn_data_get_array_type(src), pni_data_current(src)->atom.u.as_bytes, false);
+        if (level == 0) count++;
+        break;
+      }
       err = pn_data_put_array(data, pn_data_is_array_described(src),
                               pn_data_get_array_type(src));
       if (level == 0) count++;
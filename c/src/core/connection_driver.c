@@ -122,8 +122,12 @@ pn_bytes_t pn_connection_driver_write_buffer(pn_connection_driver_t *d) {
     pn_bytes(pending, pn_transport_head(d->transport)) : pn_bytes_null;
 }
 
+size_t pn_connection_driver_write_buffers(pn_connection_driver_t *d, pn_bytes_t *buffers, size_t count) {
+  return pni_transport_head_buffers(d->transport, buffers, count);
+}
+
 void pn_connection_driver_write_done(pn_connection_driver_t *d, size_t n) {
-  pn_transport_pop(d->transport, n);
+  pni_transport_pop_buffers(d->transport, n);
 }
 
 bool pn_connection_driver_write_closed(pn_connection_driver_t *d) {
@@ -0,0 +1,561 @@
+#ifndef PROTON_CONSUMERS_H
+#define PROTON_CONSUMERS_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Primitives for reading AMQP encoded values directly from a byte buffer.
+ *
+ * These are the building blocks of the generated performative decoders
+ * (see performatives.h.py) and mirror the pn_data_scan() codes they replace:
+ * each pni_consume_* function reads exactly one value and returns true if it
+ * was present and of the expected type.  Otherwise the output is zeroed (as
+ * pn_data_scan() does) and the value is skipped.
+ *
+ * All reads are bounds checked, running off the end of the buffer just
+ * makes the remaining values look absent.
+ */
+
+#include "encodings.h"
+#include "symbols.h"
+
+#include <proton/codec.h>
+#include <proton/error.h>
+#include <proton/types.h>
+
+#include <string.h>
+
+typedef struct pni_consumer_t {
+  const uint8_t *output_start;
+  size_t size;
+  size_t position;
+} pni_consumer_t;
+
+static inline pni_consumer_t pni_consumer(pn_bytes_t bytes)
+{
+  pni_consumer_t consumer = {(const uint8_t *) bytes.start, bytes.size, 0};
+  return consumer;
+}
+
+static inline size_t pni_consumer_remaining(pni_consumer_t *consumer)
+{
+  return consumer->size - consumer->position;
+}
+
+static inline bool pni_consumer_skip(pni_consumer_t *consumer, size_t size)
+{
+  if (pni_consumer_remaining(consumer) < size) {
+    consumer->position = consumer->size;
+    return false;
+  }
+  consumer->position += size;
+  return true;
+}
+
+static inline bool pni_consumer_readf8(pni_consumer_t *consumer, uint8_t *result)
+{
+  if (pni_consumer_remaining(consumer) < 1) {
+    consumer->position = consumer->size;
+    return false;
+  }
+  *result = consumer->output_start[consumer->position];
+  consumer->position++;
+  return true;
+}
+
+static inline bool pni_consumer_readf16(pni_consumer_t *consumer, uint16_t *result)
+{
+  if (pni_consumer_remaining(consumer) < 2) {
+    consumer->position = consumer->size;
+    return false;
+  }
+  const uint8_t *p = &consumer->output_start[consumer->position];
+  *result = (uint16_t) p[0] << 8 | p[1];
+  consumer->position += 2;
+  return true;
+}
+
+static inline bool pni_consumer_readf32(pni_consumer_t *consumer, uint32_t *result)
+{
+  if (pni_consumer_remaining(consumer) < 4) {
+    consumer->position = consumer->size;
+    return false;
+  }
+  const uint8_t *p = &consumer->output_start[consumer->position];
+  *result = (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+  consumer->position += 4;
+  return true;
+}
+
+static inline bool pni_consumer_readf64(pni_consumer_t *consumer, uint64_t *result)
+{
+  uint32_t a, b;
+  if (!pni_consumer_readf32(consumer, &a) || !pni_consumer_readf32(consumer, &b)) return false;
+  *result = (uint64_t) a << 32 | b;
+  return true;
+}
+
+/* Read the size of a variable width or compound encoding and return the
+ * bytes it covers. */
+static inline bool pni_consumer_readv(pni_consumer_t *consumer, uint8_t type, pn_bytes_t *result)
+{
+  uint32_t size;
+  if ((type & 0x10) == 0) {
+    uint8_t size8;
+    if (!pni_consumer_readf8(consumer, &size8)) return false;
+    size = size8;
+  } else {
+    if (!pni_consumer_readf32(consumer, &size)) return false;
+  }
+  if (pni_consumer_remaining(consumer) < size) {
+    consumer->position = consumer->size;
+    return false;
+  }
+  *result = pn_bytes(size, (const char *) &consumer->output_start[consumer->position]);
+  consumer->position += size;
+  return true;
+}
+
+/* Skip the value that follows the constructor type; the width of the value
+ * is determined by the subcategory (high nibble) of the type code. */
+static inline bool pni_consumer_skip_value(pni_consumer_t *consumer, uint8_t type)
+{
+  pn_bytes_t ignored;
+  switch (type >> 4) {
+  case 0x0: {
+    // Described: skip the descriptor then the value
+    uint8_t dtype, vtype;
+    if (type != PNE_DESCRIPTOR) return false;
+    return pni_consumer_readf8(consumer, &dtype) && pni_consumer_skip_value(consumer, dtype) &&
+           pni_consumer_readf8(consumer, &vtype) && pni_consumer_skip_value(consumer, vtype);
+  }
+  case 0x4: return true;
+  case 0x5: return pni_consumer_skip(consumer, 1);
+  case 0x6: return pni_consumer_skip(consumer, 2);
+  case 0x7: return pni_consumer_skip(consumer, 4);
+  case 0x8: return pni_consumer_skip(consumer, 8);
+  case 0x9: return pni_consumer_skip(consumer, 16);
+  case 0xA: case 0xB: case 0xC: case 0xD: case 0xE: case 0xF:
+    return pni_consumer_readv(consumer, type, &ignored);
+  default:
+    return false;
+  }
+}
+
+/* Skip a single value of any type */
+static inline bool pni_consume_anything(pni_consumer_t *consumer)
+{
+  uint8_t type;
+  return pni_consumer_readf8(consumer, &type) && pni_consumer_skip_value(consumer, type);
+}
+
+static inline bool pni_consume_bool(pni_consumer_t *consumer, bool *result)
+{
+  *result = false;
+  uint8_t type;
+  if (!pni_consumer_readf8(consumer, &type)) return false;
+  switch (type) {
+  case PNE_TRUE:
+    *result = true;
+    return true;
+  case PNE_FALSE:
+    return true;
+  case PNE_BOOLEAN: {
+    uint8_t value;
+    if (!pni_consumer_readf8(consumer, &value)) return false;
+    *result = value;
+    return true;
+  }
+  default:
+    pni_consumer_skip_value(consumer, type);
+    return false;
+  }
+}
+
+static inline bool pni_consume_uint(pni_consumer_t *consumer, uint32_t *result)
+{
+  *result = 0;
+  uint8_t type;
+  if (!pni_consumer_readf8(consumer, &type)) return false;
+  switch (type) {
+  case PNE_UINT0:
+    return true;
+  case PNE_SMALLUINT: {
+    uint8_t value;
+    if (!pni_consumer_readf8(consumer, &value)) return false;
+    *result = value;
+    return true;
+  }
+  case PNE_UINT:
+    return pni_consumer_readf32(consumer, result);
+  default:
+    pni_consumer_skip_value(consumer, type);
+    return false;
+  }
+}
+
+static inline bool pni_consume_ulong(pni_consumer_t *consumer, uint64_t *result)
+{
+  *result = 0;
+  uint8_t type;
+  if (!pni_consumer_readf8(consumer, &type)) return false;
+  switch (type) {
+  case PNE_ULONG0:
+    return true;
+  case PNE_SMALLULONG: {
+    uint8_t value;
+    if (!pni_consumer_readf8(consumer, &value)) return false;
+    *result = value;
+    return true;
+  }
+  case PNE_ULONG:
+    return pni_consumer_readf64(consumer, result);
+  default:
+    pni_consumer_skip_value(consumer, type);
+    return false;
+  }
+}
+
+/* Read a descriptor: a ulong code, or a symbol that names one of the
+ * descriptors AMQP defines, which gives its code (see symbols.h).  Any other
+ * descriptor is skipped. */
+static inline bool pni_consume_descriptor_code(pni_consumer_t *consumer, uint64_t *code)
+{
+  *code = 0;
+  uint8_t type;
+  if (!pni_consumer_readf8(consumer, &type)) return false;
+  switch (type) {
+  case PNE_ULONG0:
+    return true;
+  case PNE_SMALLULONG: {
+    uint8_t value;
+    if (!pni_consumer_readf8(consumer, &value)) return false;
+    *code = value;
+    return true;
+  }
+  case PNE_ULONG:
+    return pni_consumer_readf64(consumer, code);
+  case PNE_SYM8:
+  case PNE_SYM32: {
+    pn_bytes_t symbol;
+    if (!pni_consumer_readv(consumer, type, &symbol)) return false;
+    *code = pni_symbol_descriptor(pni_symbol_lookup(symbol));
+    return *code != 0;
+  }
+  default:
+    pni_consumer_skip_value(consumer, type);
+    return false;
+  }
+}
+
+static inline bool pni_consume_binary(pni_consumer_t *consumer, pn_bytes_t *result)
+{
+  *result = pn_bytes_null;
+  uint8_t type;
+  if (!pni_consumer_readf8(consumer, &type)) return false;
+  switch (type) {
+  case PNE_VBIN8:
+  case PNE_VBIN32:
+    return pni_consumer_readv(consumer, type, result);
+  default:
+    pni_consumer_skip_value(consumer, type);
+    return false;
+  }
+}
+
+/* Enter a list: *list is set up to consume the elements of the list.  If the
+ * value is not a list *list is left empty so all its elements look absent. */
+static inline bool pni_consume_list(pni_consumer_t *consumer, pni_consumer_t *list)
+{
+  *list = pni_consumer(pn_bytes_null);
+  uint8_t type;
+  if (!pni_consumer_readf8(consumer, &type)) return false;
+  switch (type) {
+  case PNE_LIST0:
+    return true;
+  case PNE_LIST8:
+  case PNE_LIST32: {
+    pn_bytes_t body;
+    if (!pni_consumer_readv(consumer, type, &body)) return false;
+    *list = pni_consumer(body);
+    // Skip the element count, the end of the body marks the last element
+    return pni_consumer_skip(list, type == PNE_LIST8 ? 1 : 4);
+  }
+  default:
+    pni_consumer_skip_value(consumer, type);
+    return false;
+  }
+}
+
+/* Enter a map: *map is set up to consume the keys and values of the map in
+ * turn.  If the value is not a map *map is left empty. */
+static inline bool pni_consume_map(pni_consumer_t *consumer, pni_consumer_t *map)
+{
+  *map = pni_consumer(pn_bytes_null);
+  uint8_t type;
+  if (!pni_consumer_readf8(consumer, &type)) return false;
+  switch (type) {
+  case PNE_MAP8:
+  case PNE_MAP32: {
+    pn_bytes_t body;
+    if (!pni_consumer_readv(consumer, type, &body)) return false;
+    *map = pni_consumer(body);
+    return pni_consumer_skip(map, type == PNE_MAP8 ? 1 : 4);
+  }
+  default:
+    pni_consumer_skip_value(consumer, type);
+    return false;
+  }
+}
+
+/* Enter the map of a described map, such as a message annotations section,
+ * ignoring its descriptor. */
+static inline bool pni_consume_described_map(pni_consumer_t *consumer, pni_consumer_t *map)
+{
+  *map = pni_consumer(pn_bytes_null);
+  uint8_t type;
+  if (!pni_consumer_readf8(consumer, &type)) return false;
+  if (type != PNE_DESCRIPTOR) {
+    pni_consumer_skip_value(consumer, type);
+    return false;
+  }
+  return pni_consume_anything(consumer) && pni_consume_map(consumer, map);
+}
+
+/* Read a value of any type, as pn_data_get_atom() would give it.  Strings,
+ * symbols and binaries refer to the consumed bytes.  A compound or described
+ * value only has its type set, with its whole encoding in u.as_bytes. */
+static inline bool pni_consume_atom(pni_consumer_t *consumer, pn_atom_t *atom)
+{
+  size_t start = consumer->position;
+  uint8_t type;
+  atom->type = PN_INVALID;
+  if (!pni_consumer_readf8(consumer, &type)) return false;
+  switch (type) {
+  case PNE_NULL: atom->type = PN_NULL; return true;
+  case PNE_TRUE: atom->type = PN_BOOL; atom->u.as_bool = true; return true;
+  case PNE_FALSE: atom->type = PN_BOOL; atom->u.as_bool = false; return true;
+  case PNE_BOOLEAN: {
+    uint8_t v;
+    atom->type = PN_BOOL;
+    if (!pni_consumer_readf8(consumer, &v)) return false;
+    atom->u.as_bool = v;
+    return true;
+  }
+  case PNE_UBYTE:
+    atom->type = PN_UBYTE;
+    return pni_consumer_readf8(consumer, &atom->u.as_ubyte);
+  case PNE_BYTE: {
+    uint8_t v;
+    atom->type = PN_BYTE;
+    if (!pni_consumer_readf8(consumer, &v)) return false;
+    atom->u.as_byte = (int8_t) v;
+    return true;
+  }
+  case PNE_USHORT:
+    atom->type = PN_USHORT;
+    return pni_consumer_readf16(consumer, &atom->u.as_ushort);
+  case PNE_SHORT: {
+    uint16_t v;
+    atom->type = PN_SHORT;
+    if (!pni_consumer_readf16(consumer, &v)) return false;
+    atom->u.as_short = (int16_t) v;
+    return true;
+  }
+  case PNE_UINT0: atom->type = PN_UINT; atom->u.as_uint = 0; return true;
+  case PNE_SMALLUINT: {
+    uint8_t v;
+    atom->type = PN_UINT;
+    if (!pni_consumer_readf8(consumer, &v)) return false;
+    atom->u.as_uint = v;
+    return true;
+  }
+  case PNE_UINT:
+    atom->type = PN_UINT;
+    return pni_consumer_readf32(consumer, &atom->u.as_uint);
+  case PNE_SMALLINT: {
+    uint8_t v;
+    atom->type = PN_INT;
+    if (!pni_consumer_readf8(consumer, &v)) return false;
+    atom->u.as_int = (int8_t) v;
+    return true;
+  }
+  case PNE_INT: {
+    uint32_t v;
+    atom->type = PN_INT;
+    if (!pni_consumer_readf32(consumer, &v)) return false;
+    atom->u.as_int = (int32_t) v;
+    return true;
+  }
+  case PNE_ULONG0: atom->type = PN_ULONG; atom->u.as_ulong = 0; return true;
+  case PNE_SMALLULONG: {
+    uint8_t v;
+    atom->type = PN_ULONG;
+    if (!pni_consumer_readf8(consumer, &v)) return false;
+    atom->u.as_ulong = v;
+    return true;
+  }
+  case PNE_ULONG:
+    atom->type = PN_ULONG;
+    return pni_consumer_readf64(consumer, &atom->u.as_ulong);
+  case PNE_SMALLLONG: {
+    uint8_t v;
+    atom->type = PN_LONG;
+    if (!pni_consumer_readf8(consumer, &v)) return false;
+    atom->u.as_long = (int8_t) v;
+    return true;
+  }
+  case PNE_LONG: {
+    uint64_t v;
+    atom->type = PN_LONG;
+    if (!pni_consumer_readf64(consumer, &v)) return false;
+    atom->u.as_long = (int64_t) v;
+    return true;
+  }
+  case PNE_MS64: {
+    uint64_t v;
+    atom->type = PN_TIMESTAMP;
+    if (!pni_consumer_readf64(consumer, &v)) return false;
+    atom->u.as_timestamp = (pn_timestamp_t) v;
+    return true;
+  }
+  case PNE_FLOAT: {
+    uint32_t v;
+    atom->type = PN_FLOAT;
+    if (!pni_consumer_readf32(consumer, &v)) return false;
+    memcpy(&atom->u.as_float, &v, 4);
+    return true;
+  }
+  case PNE_DOUBLE: {
+    uint64_t v;
+    atom->type = PN_DOUBLE;
+    if (!pni_consumer_readf64(consumer, &v)) return false;
+    memcpy(&atom->u.as_double, &v, 8);
+    return true;
+  }
+  case PNE_UTF32:
+    atom->type = PN_CHAR;
+    return pni_consumer_readf32(consumer, &atom->u.as_char);
+  case PNE_DECIMAL32:
+    atom->type = PN_DECIMAL32;
+    return pni_consumer_readf32(consumer, &atom->u.as_decimal32);
+  case PNE_DECIMAL64:
+    atom->type = PN_DECIMAL64;
+    return pni_consumer_readf64(consumer, &atom->u.as_decimal64);
+  case PNE_DECIMAL128:
+  case PNE_UUID: {
+    atom->type = type == PNE_UUID ? PN_UUID : PN_DECIMAL128;
+    if (pni_consumer_remaining(consumer) < 16) {
+      consumer->position = consumer->size;
+      return false;
+    }
+    memcpy(atom->type == PN_UUID ? atom->u.as_uuid.bytes : atom->u.as_decimal128.bytes,
+           &consumer->output_start[consumer->position], 16);
+    consumer->position += 16;
+    return true;
+  }
+  case PNE_VBIN8:
+  case PNE_VBIN32:
+    atom->type = PN_BINARY;
+    return pni_consumer_readv(consumer, type, &atom->u.as_bytes);
+  case PNE_STR8_UTF8:
+  case PNE_STR32_UTF8:
+    atom->type = PN_STRING;
+    return pni_consumer_readv(consumer, type, &atom->u.as_bytes);
+  case PNE_SYM8:
+  case PNE_SYM32:
+    atom->type = PN_SYMBOL;
+    return pni_consumer_readv(consumer, type, &atom->u.as_bytes);
+  case PNE_DESCRIPTOR: atom->type = PN_DESCRIBED; break;
+  case PNE_LIST0: case PNE_LIST8: case PNE_LIST32: atom->type = PN_LIST; break;
+  case PNE_MAP8: case PNE_MAP32: atom->type = PN_MAP; break;
+  case PNE_ARRAY8: case PNE_ARRAY32: atom->type = PN_ARRAY; break;
+  default:
+    return false;
+  }
+  if (!pni_consumer_skip_value(consumer, type)) return false;
+  atom->u.as_bytes = pn_bytes(consumer->position - start, (const char *) &consumer->output_start[start]);
+  return true;
+}
+
+/* Enter the list of a described list, such as a performative, ignoring its
+ * descriptor. */
+static inline bool pni_consume_described_list(pni_consumer_t *consumer, pni_consumer_t *list)
+{
+  *list = pni_consumer(pn_bytes_null);
+  uint8_t type;
+  if (!pni_consumer_readf8(consumer, &type)) return false;
+  if (type != PNE_DESCRIPTOR) {
+    pni_consumer_skip_value(consumer, type);
+    return false;
+  }
+  return pni_consume_anything(consumer) && pni_consume_list(consumer, list);
+}
+
+/* Consume a described value: *described is set if the value is described by
+ * a descriptor code (which is returned in *code).  If so the described value is
+ * decoded into data, if data is not NULL.
+ *
+ * Returns an error code if the described value can't be decoded.
+ */
+static inline int pni_consume_described_copy(pni_consumer_t *consumer, bool *described, uint64_t *code, pn_data_t *data)
+{
+  *described = false;
+  *code = 0;
+  uint8_t type;
+  if (!pni_consumer_readf8(consumer, &type)) return 0;
+  if (type != PNE_DESCRIPTOR) {
+    pni_consumer_skip_value(consumer, type);
+    return 0;
+  }
+  if (!pni_consume_descriptor_code(consumer, code)) {
+    pni_consume_anything(consumer);
+    return 0;
+  }
+  size_t start = consumer->position;
+  if (!pni_consume_anything(consumer)) return PN_ERR;
+  *described = true;
+  if (data) {
+    ssize_t n = pn_data_decode(data, (const char *) consumer->output_start + start, consumer->position - start);
+    if (n < 0) return n;
+  }
+  return 0;
+}
+
+/* Read the descriptor code of a described value and skip over the value leaving
+ * the consumer positioned just past it.  Returns false if the bytes don't
+ * hold a complete value; *described is only set if the value is described by
+ * a descriptor code.
+ */
+static inline bool pni_consume_descriptor(pni_consumer_t *consumer, bool *described, uint64_t *code)
+{
+  *described = false;
+  *code = 0;
+  uint8_t type;
+  if (!pni_consumer_readf8(consumer, &type)) return false;
+  if (type != PNE_DESCRIPTOR) return pni_consumer_skip_value(consumer, type);
+  *described = pni_consume_descriptor_code(consumer, code);
+  // Any other descriptor has already been skipped by pni_consume_descriptor_code
+  return pni_consumer_remaining(consumer) > 0 && pni_consume_anything(consumer);
+}
+
+#endif /* consumers.h */
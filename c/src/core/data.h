@@ -27,15 +27,30 @@
 #include "decoder.h"
 #include "encoder.h"
 
+/*
+ * Node ids are 16 bits by default which limits a pn_data_t to 65535 nodes.
+ * Build with PNI_DATA_NID32 (cmake -DENABLE_LARGE_DATA=ON) for 32 bit ids,
+ * at the cost of 8 more bytes per node.
+ */
+#ifdef PNI_DATA_NID32
+typedef uint32_t pni_nid_t;
+#else
 typedef uint16_t pni_nid_t;
+#endif
 #define PNI_NID_MAX ((pni_nid_t)-1)
 
 typedef struct {
-  char *start;
-  size_t data_offset;
-  size_t data_size;
   pn_atom_t atom;
-  pn_type_t type;
+  union {
+    // binary, string, symbol: offset of the copy of the bytes in buf (if data)
+    size_t data_offset;
+    // list, map, array
+    struct {
+      uint32_t start; // offset of the size while encoding, or of the copy of
+                      // the elements in buf for a packed array (if data)
+      int8_t type;    // array element type (pn_type_t)
+    } compound;
+  } u;
   pni_nid_t next;
   pni_nid_t prev;
   pni_nid_t down;
@@ -45,12 +60,26 @@ typedef struct {
   bool described;
   bool data;
   bool small;
+  // array with no child nodes, atom.u.as_bytes holds its encoded elements
+  // (see packed.h)
+  bool packed;
 } pni_node_t;
 
+/*
+ * Hash index of the keys of one map, built by pn_data_find() and discarded
+ * by anything that changes the nodes.
+ */
+typedef struct {
+  pni_nid_t *slots;   // key node ids, open addressed, 0 if empty
+  size_t capacity;    // a power of 2
+  pni_nid_t map;      // the indexed map node, 0 if the index is stale
+} pni_data_index_t;
+
 struct pn_data_t {
   pni_node_t *nodes;
   pn_buffer_t *buf;
   pn_error_t *error;
+  pni_data_index_t *index;
   pni_nid_t capacity;
   pni_nid_t size;
   pni_nid_t parent;
@@ -64,9 +93,16 @@ static inline pni_node_t * pn_data_node(pn_data_t *data, pni_nid_t nd)
   return nd ? (data->nodes + nd - 1) : NULL;
 }
 
+// The bytes held by data, its nodes and its buffers
+size_t pni_data_memory(pn_data_t *data);
+
 int pni_data_traverse(pn_data_t *data,
                       int (*enter)(void *ctx, pn_data_t *data, pni_node_t *node),
                       int (*exit)(void *ctx, pn_data_t *data, pni_node_t *node),
                       void *ctx);
 
+/* Like pn_data_encode2() but the encoding is appended after the first offset
+ * bytes of *buffer, which are kept.  Returns the size of the encoding. */
+ssize_t pni_data_encode_at(pn_data_t *data, pn_rwbytes_t *buffer, size_t offset);
+
 #endif /* data.h */
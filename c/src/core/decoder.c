@@ -24,6 +24,7 @@
 #include <proton/codec.h>
 #include "encodings.h"
 #include "decoder.h"
+#include "packed.h"
 
 #include <string.h>
 
@@ -39,6 +40,7 @@ void pn_decoder_initialize(pn_decoder_t *decoder)
   decoder->size = 0;
   decoder->position = NULL;
   decoder->error = NULL;
+  decoder->borrow = false;
 }
 
 void pn_decoder_finalize(pn_decoder_t *decoder)
@@ -181,6 +183,8 @@ static int pni_decoder_decode_type(pn_decoder_t *decoder, pn_data_t *data, uint8
 static int pni_decoder_single_described(pn_decoder_t *decoder, pn_data_t *data);
 static int pni_decoder_single(pn_decoder_t *decoder, pn_data_t *data);
 void pni_data_set_array_type(pn_data_t *data, pn_type_t type);
+int pni_data_put_borrowed(pn_data_t *data, pn_type_t type, pn_bytes_t bytes);
+int pni_data_put_packed(pn_data_t *data, pn_type_t type, pn_bytes_t elements, bool borrow);
 
 static int pni_decoder_decode_value(pn_decoder_t *decoder, pn_data_t *data, uint8_t code)
 {
@@ -326,13 +330,13 @@ static int pni_decoder_decode_value(pn_decoder_t *decoder, pn_data_t *data, uint
       switch (code & 0x0F)
       {
       case 0x0:
-        err = pn_data_put_binary(data, bytes);
+        err = decoder->borrow ? pni_data_put_borrowed(data, PN_BINARY, bytes) : pn_data_put_binary(data, bytes);
         break;
       case 0x1:
-        err = pn_data_put_string(data, bytes);
+        err = decoder->borrow ? pni_data_put_borrowed(data, PN_STRING, bytes) : pn_data_put_string(data, bytes);
         break;
       case 0x3:
-        err = pn_data_put_symbol(data, bytes);
+        err = decoder->borrow ? pni_data_put_borrowed(data, PN_SYMBOL, bytes) : pn_data_put_symbol(data, bytes);
         break;
       default:
         return PN_ARG_ERR;
@@ -388,6 +392,17 @@ static int pni_decoder_decode_value(pn_decoder_t *decoder, pn_data_t *data, uint
       {
         uint8_t next = *decoder->position;
         bool described = (next == PNE_DESCRIPTOR);
+        pn_type_t packed = pni_packed_type(next);
+        if (packed != PN_INVALID) {
+          // Keep fixed width elements encoded rather than a node each
+          size_t width = pni_packed_width(packed);
+          if ((pn_decoder_remaining(decoder) - 1) / width < count) return PN_UNDERFLOW;
+          pn_bytes_t elements = {count * width, decoder->position + 1};
+          err = pni_data_put_packed(data, packed, elements, decoder->borrow);
+          if (err) return err;
+          decoder->position += 1 + elements.size;
+          return 0;
+        }
         err = pn_data_put_array(data, described, (pn_type_t) 0);
         if (err) return err;
 
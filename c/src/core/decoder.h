@@ -27,6 +27,8 @@ typedef struct pn_decoder_t {
   size_t size;
   const char *position;
   pn_error_t *error;
+  // Binary, string and symbol values refer to the input instead of copies of it
+  bool borrow;
 } pn_decoder_t;
 
 void pn_decoder_initialize(pn_decoder_t *decoder);
@@ -21,6 +21,7 @@
 
 #include "dispatcher.h"
 
+#include "consumers.h"
 #include "engine-internal.h"
 #include "framing.h"
 #include "logger_private.h"
@@ -28,51 +29,61 @@
 
 #include "dispatch_actions.h"
 
-int pni_bad_frame(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload) {
+int pni_bad_frame(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload) {
   PN_LOG(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_ERROR, "Error dispatching frame: type: %d: Unknown performative", frame_type);
   return PN_ERR;
 }
 
-int pni_bad_frame_type(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload) {
+int pni_bad_frame_type(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload) {
   PN_LOG(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_ERROR, "Error dispatching frame: Unknown frame type: %d", frame_type);
   return PN_ERR;
 }
 
+// How a performative is dispatched: the action for it and whether the
+// action decodes the performative bytes itself, in which case args only
+// needs filling in if the frame is traced.
+typedef struct {
+  pn_action_t *action;
+  bool streaming;
+} pni_dispatch_t;
+
+static inline pni_dispatch_t pni_dispatch(pn_action_t *action, bool streaming)
+{
+  pni_dispatch_t dispatch = {action, streaming};
+  return dispatch;
+}
+
 // We could use a table based approach here if we needed to dynamically
 // add new performatives
-static inline int pni_dispatch_action(pn_transport_t* transport, uint64_t lcode, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+static inline pni_dispatch_t pni_dispatch_lookup(uint64_t lcode, uint8_t frame_type)
 {
-  pn_action_t *action;
   switch (frame_type) {
   case AMQP_FRAME_TYPE:
     /* Regular AMQP frames */
     switch (lcode) {
-    case OPEN:            action = pn_do_open; break;
-    case BEGIN:           action = pn_do_begin; break;
-    case ATTACH:          action = pn_do_attach; break;
-    case FLOW:            action = pn_do_flow; break;
-    case TRANSFER:        action = pn_do_transfer; break;
-    case DISPOSITION:     action = pn_do_disposition; break;
-    case DETACH:          action = pn_do_detach; break;
-    case END:             action = pn_do_end; break;
-    case CLOSE:           action = pn_do_close; break;
-    default:              action = pni_bad_frame; break;
+    case OPEN:            return pni_dispatch(pn_do_open, false);
+    case BEGIN:           return pni_dispatch(pn_do_begin, false);
+    case ATTACH:          return pni_dispatch(pn_do_attach, false);
+    case FLOW:            return pni_dispatch(pn_do_flow, true);
+    case TRANSFER:        return pni_dispatch(pn_do_transfer, true);
+    case DISPOSITION:     return pni_dispatch(pn_do_disposition, true);
+    case DETACH:          return pni_dispatch(pn_do_detach, false);
+    case END:             return pni_dispatch(pn_do_end, false);
+    case CLOSE:           return pni_dispatch(pn_do_close, false);
+    default:              return pni_dispatch(pni_bad_frame, false);
     };
-    break;
   case SASL_FRAME_TYPE:
     /* SASL frames */
     switch (lcode) {
-    case SASL_MECHANISMS: action = pn_do_mechanisms; break;
-    case SASL_INIT:       action = pn_do_init; break;
-    case SASL_CHALLENGE:  action = pn_do_challenge; break;
-    case SASL_RESPONSE:   action = pn_do_response; break;
-    case SASL_OUTCOME:    action = pn_do_outcome; break;
-    default:              action = pni_bad_frame; break;
+    case SASL_MECHANISMS: return pni_dispatch(pn_do_mechanisms, false);
+    case SASL_INIT:       return pni_dispatch(pn_do_init, false);
+    case SASL_CHALLENGE:  return pni_dispatch(pn_do_challenge, false);
+    case SASL_RESPONSE:   return pni_dispatch(pn_do_response, false);
+    case SASL_OUTCOME:    return pni_dispatch(pn_do_outcome, false);
+    default:              return pni_dispatch(pni_bad_frame, false);
     };
-    break;
-  default:              action = pni_bad_frame_type; break;
+  default:                return pni_dispatch(pni_bad_frame_type, false);
   };
-  return action(transport, frame_type, channel, args, payload);
 }
 
 static int pni_dispatch_frame(pn_transport_t * transport, pn_data_t *args, pn_frame_t frame)
@@ -82,63 +93,112 @@ static int pni_dispatch_frame(pn_transport_t * transport, pn_data_t *args, pn_fr
     return 0;
   }
 
-  ssize_t dsize = pn_data_decode(args, frame.payload, frame.size);
-  if (dsize < 0) {
-    pn_string_format(transport->scratch,
-                     "Error decoding frame: %s %s\n", pn_code(dsize),
-                     pn_error_text(pn_data_error(args)));
-    pn_quote(transport->scratch, frame.payload, frame.size);
-    PN_LOG(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_ERROR, pn_string_get(transport->scratch));
-    return dsize;
+  // Find the performative and its descriptor without decoding it, a
+  // symbolic descriptor is mapped to its code
+  pni_consumer_t consumer = pni_consumer(pn_bytes(frame.size, frame.payload));
+  uint64_t lcode;
+  bool scanned;
+  bool complete = pni_consume_descriptor(&consumer, &scanned, &lcode);
+  ssize_t dsize = consumer.position;
+  pni_dispatch_t dispatch = pni_dispatch_lookup(lcode, frame.type);
+
+  // Only decode into args if the action needs it, we are going to trace the frame
+  // or we need the decoder to tell us what is wrong with the performative
+  if (!complete || !dispatch.streaming ||
+      PN_SHOULD_LOG(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_FRAME)) {
+    // The frame outlives args (which is cleared below) so there's no need to copy
+    dsize = pn_data_decode_borrowed(args, frame.payload, frame.size);
+    if (dsize < 0) {
+      pn_string_format(transport->scratch,
+                       "Error decoding frame: %s %s\n", pn_code(dsize),
+                       pn_error_text(pn_data_error(args)));
+      pn_quote(transport->scratch, frame.payload, frame.size);
+      PN_LOG(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_ERROR, pn_string_get(transport->scratch));
+      pn_data_clear(args);
+      return dsize;
+    }
   }
 
   uint8_t frame_type = frame.type;
   uint16_t channel = frame.channel;
-  // XXX: assuming numeric -
-  // if we get a symbol we should map it to the numeric value and dispatch on that
-  uint64_t lcode;
-  bool scanned;
-  int e = pn_data_scan(args, "D?L.", &scanned, &lcode);
-  if (e) {
-    PN_LOG(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_ERROR, "Scan error");
-    return e;
-  }
-  if (!scanned) {
+  if (!complete || !scanned) {
     PN_LOG(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_ERROR, "Error dispatching frame");
+    pn_data_clear(args);
     return PN_ERR;
   }
+  pn_bytes_t performative = {dsize, frame.payload};
   size_t payload_size = frame.size - dsize;
   const char *payload_mem = payload_size ? frame.payload + dsize : NULL;
   pn_bytes_t payload = {payload_size, payload_mem};
 
   pn_do_trace(transport, channel, IN, args, payload_mem, payload_size);
 
-  int err = pni_dispatch_action(transport, lcode, frame_type, channel, args, &payload);
+  int err = dispatch.action(transport, frame_type, channel, args, performative, &payload);
 
   pn_data_clear(args);
 
   return err;
 }
 
+// A transfer frame bigger than the input buffer is dispatched as soon as its
+// performative is in, rather than growing the buffer to hold all of it: the
+// payload that has arrived goes to the delivery now and the rest as it comes.
+static ssize_t pni_dispatch_transfer_head(pn_transport_t *transport, const char *bytes, size_t available)
+{
+  pn_frame_t frame;
+  ssize_t size = pn_read_frame_head(&frame, bytes, available, transport->local_max_frame);
+  if (size <= PN_TRANSPORT_INITIAL_BUFFER_SIZE || frame.type != AMQP_FRAME_TYPE) return 0;
+
+  pni_consumer_t consumer = pni_consumer(pn_bytes(frame.size, frame.payload));
+  uint64_t lcode;
+  bool scanned;
+  if (!pni_consume_descriptor(&consumer, &scanned, &lcode) || !scanned || lcode != TRANSFER) {
+    return 0;
+  }
+  size_t dsize = consumer.position;
+  pn_bytes_t performative = {dsize, frame.payload};
+  pn_bytes_t payload = {frame.size - dsize, frame.payload + dsize};
+  if (PN_SHOULD_LOG(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_FRAME)) {
+    pn_data_decode_borrowed(transport->args, frame.payload, dsize);
+    pn_do_trace(transport, frame.channel, IN, transport->args, payload.start, payload.size);
+    pn_data_clear(transport->args);
+  }
+
+  int err = pn_do_transfer_head(transport, frame.channel, performative, &payload, size - available);
+  if (err) return err;
+  return available;
+}
+
 ssize_t pn_dispatcher_input(pn_transport_t *transport, const char *bytes, size_t available, bool batch, bool *halt)
 {
   size_t read = 0;
 
   while (available && !*halt) {
-    pn_frame_t frame;
-
-    ssize_t n = pn_read_frame(&frame, bytes + read, available, transport->local_max_frame);
-    if (n > 0) {
+    if (transport->input_transfer_rest) {
+      size_t n = pn_min(available, transport->input_transfer_rest);
+      int e = pn_do_transfer_rest(transport, pn_bytes(n, bytes + read));
+      if (e) return e;
       read += n;
       available -= n;
-      transport->input_frames_ct += 1;
-      int e = pni_dispatch_frame(transport, transport->args, frame);
-      if (e) return e;
-    } else if (n < 0) {
-      pn_do_error(transport, "amqp:connection:framing-error", "malformed frame");
-      return n;
     } else {
-      break;
+      pn_frame_t frame;
+      ssize_t n = pn_read_frame(&frame, bytes + read, available, transport->local_max_frame);
+      if (n > 0) {
+        transport->input_frames_ct += 1;
+        int e = pni_dispatch_frame(transport, transport->args, frame);
+        if (e) return e;
+      } else if (n < 0) {
+        pn_do_error(transport, "amqp:connection:framing-error", "malformed frame");
+        return n;
+      } else if ((n = pni_dispatch_transfer_head(transport, bytes + read, available)) > 0) {
+        transport->input_frames_ct += 1;
+      } else if (n < 0) {
+        return n;
+      } else {
+        break;
+      }
+      read += n;
+      available -= n;
     }
 
     if (!batch) break;
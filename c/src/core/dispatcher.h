@@ -29,7 +29,12 @@
 #include "proton/codec.h"
 #include "proton/types.h"
 
-typedef int (pn_action_t)(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload);
+/*
+ * args holds the decoded performative, except for the performatives whose
+ * actions decode the raw performative bytes themselves (see
+ * pni_dispatch_lookup) where it is only filled in if the frame is traced.
+ */
+typedef int (pn_action_t)(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload);
 
 ssize_t pn_dispatcher_input(pn_transport_t* transport, const char* bytes, size_t available, bool batch, bool* halt);
 ssize_t pn_dispatcher_output(pn_transport_t *transport, char *bytes, size_t size);
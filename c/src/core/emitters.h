@@ -0,0 +1,378 @@
+#ifndef PROTON_EMITTERS_H
+#define PROTON_EMITTERS_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Primitives for writing AMQP encoded values directly into a byte buffer.
+ *
+ * These are the building blocks of the generated performative encoders
+ * (see performatives.h.py): they produce exactly the same bytes as filling
+ * a pn_data_t and calling pn_data_encode() on it, but without building a
+ * node tree first.
+ *
+ * Writes past the end of the buffer are not performed but the position is
+ * still advanced, so after a pass the emitter knows exactly how big the
+ * buffer needs to be; the generated encoders use this to grow the buffer
+ * and encode again.
+ */
+
+#include "encodings.h"
+
+#include <proton/codec.h>
+#include <proton/error.h>
+#include <proton/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct pni_emitter_t {
+  char *output_start;
+  size_t size;
+  size_t position;
+} pni_emitter_t;
+
+/* Keeps track of an open compound value so its size and count can be
+ * written once all of its elements have been emitted.
+ *
+ * Described lists don't need to encode trailing nulls, so when
+ * elide_nulls is set nulls are only counted and written out lazily if
+ * a non null element follows them.
+ */
+typedef struct pni_compound_context {
+  size_t start;
+  uint32_t count;
+  uint32_t null_count;
+  bool elide_nulls;
+} pni_compound_context;
+
+static inline pni_emitter_t pni_emitter(pn_rwbytes_t *buffer)
+{
+  pni_emitter_t emitter = {buffer->start, buffer->size, 0};
+  return emitter;
+}
+
+static inline pni_compound_context pni_compound_context_init(bool elide_nulls)
+{
+  pni_compound_context compound = {0, 0, 0, elide_nulls};
+  return compound;
+}
+
+static inline size_t pni_emitter_remaining(pni_emitter_t *emitter)
+{
+  return emitter->size > emitter->position ? emitter->size - emitter->position : 0;
+}
+
+/* If the last pass overflowed, grow the buffer to fit and reset the emitter so
+ * the caller can emit again. Returns false when there is nothing to retry.
+ */
+static inline bool pni_emitter_retry(pni_emitter_t *emitter, pn_rwbytes_t *buffer)
+{
+  if (emitter->position <= emitter->size) return false;
+
+  size_t size = buffer->size ? buffer->size : 64;
+  while (size < emitter->position) size *= 2;
+  char *start = (char *) realloc(buffer->start, size);
+  if (!start) return false;
+
+  buffer->start = start;
+  buffer->size = size;
+  *emitter = pni_emitter(buffer);
+  return true;
+}
+
+/* The encoded bytes, or pn_bytes_null if they didn't fit */
+static inline pn_bytes_t pni_emitter_bytes(pni_emitter_t *emitter)
+{
+  if (emitter->position > emitter->size) return pn_bytes_null;
+  return pn_bytes(emitter->position, emitter->output_start);
+}
+
+static inline void pni_emitter_writef8(pni_emitter_t *emitter, uint8_t value)
+{
+  if (pni_emitter_remaining(emitter)) {
+    emitter->output_start[emitter->position] = value;
+  }
+  emitter->position++;
+}
+
+static inline void pni_emitter_writef16(pni_emitter_t *emitter, uint16_t value)
+{
+  if (pni_emitter_remaining(emitter) >= 2) {
+    char *p = emitter->output_start + emitter->position;
+    p[0] = 0xFF & (value >> 8);
+    p[1] = 0xFF & (value     );
+  }
+  emitter->position += 2;
+}
+
+static inline void pni_emitter_writef32(pni_emitter_t *emitter, uint32_t value)
+{
+  if (pni_emitter_remaining(emitter) >= 4) {
+    char *p = emitter->output_start + emitter->position;
+    p[0] = 0xFF & (value >> 24);
+    p[1] = 0xFF & (value >> 16);
+    p[2] = 0xFF & (value >>  8);
+    p[3] = 0xFF & (value      );
+  }
+  emitter->position += 4;
+}
+
+static inline void pni_emitter_writef64(pni_emitter_t *emitter, uint64_t value)
+{
+  pni_emitter_writef32(emitter, value >> 32);
+  pni_emitter_writef32(emitter, value);
+}
+
+static inline void pni_emitter_raw(pni_emitter_t *emitter, const char *bytes, size_t size)
+{
+  if (pni_emitter_remaining(emitter) >= size) {
+    memcpy(emitter->output_start + emitter->position, bytes, size);
+  }
+  emitter->position += size;
+}
+
+static inline void pni_emitter_writev(pni_emitter_t *emitter, uint8_t code8, uint8_t code32, pn_bytes_t value)
+{
+  if (value.size < 256) {
+    pni_emitter_writef8(emitter, code8);
+    pni_emitter_writef8(emitter, value.size);
+  } else {
+    pni_emitter_writef8(emitter, code32);
+    pni_emitter_writef32(emitter, value.size);
+  }
+  pni_emitter_raw(emitter, value.start, value.size);
+}
+
+static inline void pni_emitter_write_ulong(pni_emitter_t *emitter, uint64_t ulong)
+{
+  if (ulong < 256) {
+    pni_emitter_writef8(emitter, PNE_SMALLULONG);
+    pni_emitter_writef8(emitter, ulong);
+  } else {
+    pni_emitter_writef8(emitter, PNE_ULONG);
+    pni_emitter_writef64(emitter, ulong);
+  }
+}
+
+/* Account for a new non null element, writing out any nulls held back before it */
+static inline void pni_compound_element(pni_emitter_t *emitter, pni_compound_context *compound)
+{
+  for (; compound->null_count; compound->null_count--) {
+    pni_emitter_writef8(emitter, PNE_NULL);
+  }
+  compound->count++;
+}
+
+static inline void pni_emit_null(pni_emitter_t *emitter, pni_compound_context *compound)
+{
+  compound->count++;
+  if (compound->elide_nulls) {
+    compound->null_count++;
+  } else {
+    pni_emitter_writef8(emitter, PNE_NULL);
+  }
+}
+
+static inline void pni_emit_bool(pni_emitter_t *emitter, pni_compound_context *compound, bool value)
+{
+  pni_compound_element(emitter, compound);
+  pni_emitter_writef8(emitter, value ? PNE_TRUE : PNE_FALSE);
+}
+
+static inline void pni_emit_ubyte(pni_emitter_t *emitter, pni_compound_context *compound, uint8_t value)
+{
+  pni_compound_element(emitter, compound);
+  pni_emitter_writef8(emitter, PNE_UBYTE);
+  pni_emitter_writef8(emitter, value);
+}
+
+static inline void pni_emit_ushort(pni_emitter_t *emitter, pni_compound_context *compound, uint16_t value)
+{
+  pni_compound_element(emitter, compound);
+  pni_emitter_writef8(emitter, PNE_USHORT);
+  pni_emitter_writef16(emitter, value);
+}
+
+static inline void pni_emit_uint(pni_emitter_t *emitter, pni_compound_context *compound, uint32_t value)
+{
+  pni_compound_element(emitter, compound);
+  if (value < 256) {
+    pni_emitter_writef8(emitter, PNE_SMALLUINT);
+    pni_emitter_writef8(emitter, value);
+  } else {
+    pni_emitter_writef8(emitter, PNE_UINT);
+    pni_emitter_writef32(emitter, value);
+  }
+}
+
+static inline void pni_emit_ulong(pni_emitter_t *emitter, pni_compound_context *compound, uint64_t value)
+{
+  pni_compound_element(emitter, compound);
+  pni_emitter_write_ulong(emitter, value);
+}
+
+static inline void pni_emit_binary(pni_emitter_t *emitter, pni_compound_context *compound, pn_bytes_t bytes)
+{
+  pni_compound_element(emitter, compound);
+  pni_emitter_writev(emitter, PNE_VBIN8, PNE_VBIN32, bytes);
+}
+
+/* Binary, or null if there are no bytes at all */
+static inline void pni_emit_binary_or_null(pni_emitter_t *emitter, pni_compound_context *compound, pn_bytes_t bytes)
+{
+  if (bytes.start) {
+    pni_emit_binary(emitter, compound, bytes);
+  } else {
+    pni_emit_null(emitter, compound);
+  }
+}
+
+/* String from a NUL terminated C string, or null if string is NULL */
+static inline void pni_emit_string(pni_emitter_t *emitter, pni_compound_context *compound, const char *string)
+{
+  if (string) {
+    pni_compound_element(emitter, compound);
+    pni_emitter_writev(emitter, PNE_STR8_UTF8, PNE_STR32_UTF8, pn_bytes(strlen(string), string));
+  } else {
+    pni_emit_null(emitter, compound);
+  }
+}
+
+/* Symbol from a NUL terminated C string, or null if symbol is NULL */
+static inline void pni_emit_symbol(pni_emitter_t *emitter, pni_compound_context *compound, const char *symbol)
+{
+  if (symbol) {
+    pni_compound_element(emitter, compound);
+    pni_emitter_writev(emitter, PNE_SYM8, PNE_SYM32, pn_bytes(strlen(symbol), symbol));
+  } else {
+    pni_emit_null(emitter, compound);
+  }
+}
+
+/* Array of symbols; arrays always use the wide element encoding */
+static inline void pni_emit_symbol_array(pni_emitter_t *emitter, pni_compound_context *compound, size_t count, char **symbols)
+{
+  pni_compound_element(emitter, compound);
+  pni_emitter_writef8(emitter, PNE_ARRAY32);
+  size_t start = emitter->position;
+  emitter->position += 4;
+  pni_emitter_writef32(emitter, count);
+  pni_emitter_writef8(emitter, PNE_SYM32);
+  for (size_t i = 0; i < count; i++) {
+    size_t size = strlen(symbols[i]);
+    pni_emitter_writef32(emitter, size);
+    pni_emitter_raw(emitter, symbols[i], size);
+  }
+  size_t end = emitter->position;
+  emitter->position = start;
+  pni_emitter_writef32(emitter, end - start - 4);
+  emitter->position = end;
+}
+
+/* Write a descriptor, returns the context to emit the described value in */
+static inline pni_compound_context pni_emit_descriptor(pni_emitter_t *emitter, pni_compound_context *compound, uint64_t code)
+{
+  pni_compound_element(emitter, compound);
+  pni_emitter_writef8(emitter, PNE_DESCRIPTOR);
+  pni_emitter_write_ulong(emitter, code);
+  return pni_compound_context_init(false);
+}
+
+/* Start a list, the size and count are back-filled by pni_emit_end_list() */
+static inline pni_compound_context pni_emit_list(pni_emitter_t *emitter, pni_compound_context *compound, bool described)
+{
+  pni_compound_element(emitter, compound);
+  pni_emitter_writef8(emitter, PNE_LIST32);
+  pni_compound_context list = pni_compound_context_init(described);
+  list.start = emitter->position;
+  emitter->position += 8;
+  return list;
+}
+
+static inline void pni_emit_end_list(pni_emitter_t *emitter, pni_compound_context *list)
+{
+  uint32_t count = list->count - list->null_count;
+  // Lists with nothing (or only elided nulls) in them are encoded as list0
+  if (count == 0) {
+    emitter->position = list->start - 1;
+    pni_emitter_writef8(emitter, PNE_LIST0);
+    return;
+  }
+  size_t end = emitter->position;
+  emitter->position = list->start;
+  pni_emitter_writef32(emitter, end - list->start - 4);
+  pni_emitter_writef32(emitter, count);
+  emitter->position = end;
+}
+
+/* Copy the encoding of an existing pn_data_t, or null if it is empty */
+static inline void pni_emit_copy(pni_emitter_t *emitter, pni_compound_context *compound, pn_data_t *data)
+{
+  if (!data || pn_data_size(data) == 0) {
+    pni_emit_null(emitter, compound);
+    return;
+  }
+  pni_compound_element(emitter, compound);
+  size_t remaining = pni_emitter_remaining(emitter);
+  ssize_t size = pn_data_encode(data, remaining ? emitter->output_start + emitter->position : NULL, remaining);
+  if (size == PN_OVERFLOW) {
+    // Only need the size here, the caller will retry with a bigger buffer
+    size = pn_data_encoded_size(data);
+    pn_error_clear(pn_data_error(data));
+  }
+  if (size > 0) emitter->position += size;
+}
+
+/* Copy a "multiple" field value, normalized as pn_data_fill() does for 'M':
+ * null for an empty array and the bare element for a single element array.
+ */
+static inline void pni_emit_multiple(pni_emitter_t *emitter, pni_compound_context *compound, pn_data_t *data)
+{
+  if (!data || pn_data_size(data) == 0) {
+    pni_emit_null(emitter, compound);
+    return;
+  }
+  pn_handle_t point = pn_data_point(data);
+  pn_data_rewind(data);
+  pn_data_next(data);
+  size_t count = pn_data_type(data) == PN_ARRAY ? pn_data_get_array(data) : 2;
+  pn_data_restore(data, point);
+  switch (count) {
+  case 0:
+    pni_emit_null(emitter, compound);
+    return;
+  case 1: {
+    // Rare enough that it isn't worth avoiding the copy
+    pn_data_t *single = pn_data(0);
+    pn_data_fill(single, "M", data);
+    pni_emit_copy(emitter, compound, single);
+    pn_data_free(single);
+    return;
+  }
+  default:
+    pni_emit_copy(emitter, compound, data);
+    return;
+  }
+}
+
+#endif /* emitters.h */
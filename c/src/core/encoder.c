@@ -25,9 +25,11 @@
 #include "encodings.h"
 #include "encoder.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "data.h"
+#include "packed.h"
 
 static inline pn_error_t *pni_encoder_error(pn_encoder_t *encoder)
 {
@@ -42,6 +44,7 @@ void pn_encoder_initialize(pn_encoder_t *encoder)
   encoder->error = NULL;
   encoder->size = 0;
   encoder->null_count = 0;
+  encoder->buffer = NULL;
 }
 
 void pn_encoder_finalize(pn_encoder_t *encoder)
@@ -147,9 +150,38 @@ static size_t pn_encoder_remaining(pn_encoder_t *encoder) {
     return 0;
 }
 
+/* Grow the caller's buffer so that size more bytes fit at the current
+ * position. Everything already written is kept and compound start offsets
+ * are relative to the output so they stay valid.  If the buffer can't be
+ * grown we stop trying and just count bytes from then on.
+ */
+static bool pni_encoder_grow(pn_encoder_t *encoder, size_t size)
+{
+  static const size_t initial_size = 256;
+  size_t offset = encoder->position - encoder->output;
+  size_t capacity = encoder->size ? encoder->size : initial_size;
+  while (capacity < offset + size) capacity *= 2;
+  char *output = (char *) realloc(encoder->output, capacity);
+  if (!output) {
+    encoder->buffer = NULL;
+    return false;
+  }
+  encoder->output = output;
+  encoder->position = output + offset;
+  encoder->size = capacity;
+  *encoder->buffer = pn_rwbytes(capacity, output);
+  return true;
+}
+
+static inline bool pn_encoder_ensure(pn_encoder_t *encoder, size_t size)
+{
+  if (pn_encoder_remaining(encoder) >= size) return true;
+  return encoder->buffer && pni_encoder_grow(encoder, size);
+}
+
 static inline void pn_encoder_writef8(pn_encoder_t *encoder, uint8_t value)
 {
-  if (pn_encoder_remaining(encoder)) {
+  if (pn_encoder_ensure(encoder, 1)) {
     encoder->position[0] = value;
   }
   encoder->position++;
@@ -157,7 +189,7 @@ static inline void pn_encoder_writef8(pn_encoder_t *encoder, uint8_t value)
 
 static inline void pn_encoder_writef16(pn_encoder_t *encoder, uint16_t value)
 {
-  if (pn_encoder_remaining(encoder) >= 2) {
+  if (pn_encoder_ensure(encoder, 2)) {
     encoder->position[0] = 0xFF & (value >> 8);
     encoder->position[1] = 0xFF & (value     );
   }
@@ -166,7 +198,7 @@ static inline void pn_encoder_writef16(pn_encoder_t *encoder, uint16_t value)
 
 static inline void pn_encoder_writef32(pn_encoder_t *encoder, uint32_t value)
 {
-  if (pn_encoder_remaining(encoder) >= 4) {
+  if (pn_encoder_ensure(encoder, 4)) {
     encoder->position[0] = 0xFF & (value >> 24);
     encoder->position[1] = 0xFF & (value >> 16);
     encoder->position[2] = 0xFF & (value >>  8);
@@ -176,7 +208,7 @@ static inline void pn_encoder_writef32(pn_encoder_t *encoder, uint32_t value)
 }
 
 static inline void pn_encoder_writef64(pn_encoder_t *encoder, uint64_t value) {
-  if (pn_encoder_remaining(encoder) >= 8) {
+  if (pn_encoder_ensure(encoder, 8)) {
     encoder->position[0] = 0xFF & (value >> 56);
     encoder->position[1] = 0xFF & (value >> 48);
     encoder->position[2] = 0xFF & (value >> 40);
@@ -190,7 +222,7 @@ static inline void pn_encoder_writef64(pn_encoder_t *encoder, uint64_t value) {
 }
 
 static inline void pn_encoder_writef128(pn_encoder_t *encoder, char *value) {
-  if (pn_encoder_remaining(encoder) >= 16) {
+  if (pn_encoder_ensure(encoder, 16)) {
     memmove(encoder->position, value, 16);
   }
   encoder->position += 16;
@@ -199,7 +231,7 @@ static inline void pn_encoder_writef128(pn_encoder_t *encoder, char *value) {
 static inline void pn_encoder_writev8(pn_encoder_t *encoder, const pn_bytes_t *value)
 {
   pn_encoder_writef8(encoder, value->size);
-  if (pn_encoder_remaining(encoder) >= value->size)
+  if (pn_encoder_ensure(encoder, value->size))
     memmove(encoder->position, value->start, value->size);
   encoder->position += value->size;
 }
@@ -207,7 +239,7 @@ static inline void pn_encoder_writev8(pn_encoder_t *encoder, const pn_bytes_t *v
 static inline void pn_encoder_writev32(pn_encoder_t *encoder, const pn_bytes_t *value)
 {
   pn_encoder_writef32(encoder, value->size);
-  if (pn_encoder_remaining(encoder) >= value->size)
+  if (pn_encoder_ensure(encoder, value->size))
     memmove(encoder->position, value->start, value->size);
   encoder->position += value->size;
 }
@@ -251,7 +283,7 @@ static int pni_encoder_enter(void *ctx, pn_data_t *data, pni_node_t *node)
 
   /** In an array we don't write the code before each element, only the first. */
   if (pn_is_in_array(data, parent, node)) {
-    code = pn_type2code(encoder, parent->type);
+    code = pn_type2code(encoder, (pn_type_t) parent->u.compound.type);
     if (pn_is_first_in_array(data, parent, node)) {
       pn_encoder_writef8(encoder, code);
     }
@@ -308,7 +340,19 @@ static int pni_encoder_enter(void *ctx, pn_data_t *data, pni_node_t *node)
   case PNE_SYM8: pn_encoder_writev8(encoder, &atom->u.as_bytes); return 0;
   case PNE_SYM32: pn_encoder_writev32(encoder, &atom->u.as_bytes); return 0;
   case PNE_ARRAY32:
-    node->start = encoder->position;
+    if (node->packed) {
+      // The elements are already encoded
+      const pn_bytes_t *elements = &atom->u.as_bytes;
+      pn_type_t type = (pn_type_t) node->u.compound.type;
+      pn_encoder_writef32(encoder, elements->size + 5);
+      pn_encoder_writef32(encoder, elements->size / pni_packed_width(type));
+      pn_encoder_writef8(encoder, pn_type2code(encoder, type));
+      if (pn_encoder_ensure(encoder, elements->size))
+        memmove(encoder->position, elements->start, elements->size);
+      encoder->position += elements->size;
+      return 0;
+    }
+    node->u.compound.start = encoder->position - encoder->output;
     node->small = false;
     // we'll backfill the size on exit
     encoder->position += 4;
@@ -318,7 +362,7 @@ static int pni_encoder_enter(void *ctx, pn_data_t *data, pni_node_t *node)
     return 0;
   case PNE_LIST32:
   case PNE_MAP32:
-    node->start = encoder->position;
+    node->u.compound.start = encoder->position - encoder->output;
     node->small = false;
     // we'll backfill the size later
     encoder->position += 4;
@@ -334,11 +378,13 @@ static int pni_encoder_enter(void *ctx, pn_data_t *data, pni_node_t *node)
 static int pni_encoder_exit(void *ctx, pn_data_t *data, pni_node_t *node)
 {
   pn_encoder_t *encoder = (pn_encoder_t *) ctx;
-  char *pos;
+  char *pos, *start;
+
+  if (node->packed) return 0;
 
   // Special case 0 length list
   if (node->atom.type==PN_LIST && node->children-encoder->null_count==0) {
-    encoder->position = node->start-1; // position of list opcode
+    encoder->position = encoder->output + node->u.compound.start - 1; // position of list opcode
     pn_encoder_writef8(encoder, PNE_LIST0);
     encoder->null_count = 0;
     return 0;
@@ -347,16 +393,17 @@ static int pni_encoder_exit(void *ctx, pn_data_t *data, pni_node_t *node)
   switch (node->atom.type) {
   case PN_ARRAY:
     if ((node->described && node->children == 1) || (!node->described && node->children == 0)) {
-      pn_encoder_writef8(encoder, pn_type2code(encoder, node->type));
+      pn_encoder_writef8(encoder, pn_type2code(encoder, (pn_type_t) node->u.compound.type));
     }
   // Fallthrough
   case PN_LIST:
   case PN_MAP:
     pos = encoder->position;
-    encoder->position = node->start;
+    start = encoder->output + node->u.compound.start;
+    encoder->position = start;
     if (node->small) {
       // backfill size
-      size_t size = pos - node->start - 1;
+      size_t size = pos - start - 1;
       pn_encoder_writef8(encoder, size);
       // Adjust count
       if (encoder->null_count) {
@@ -364,7 +411,7 @@ static int pni_encoder_exit(void *ctx, pn_data_t *data, pni_node_t *node)
       }
     } else {
       // backfill size
-      size_t size = pos - node->start - 4;
+      size_t size = pos - start - 4;
       pn_encoder_writef32(encoder, size);
       // Adjust count
       if (encoder->null_count) {
@@ -395,6 +442,29 @@ ssize_t pn_encoder_encode(pn_encoder_t *encoder, pn_data_t *src, char *dst, size
   return (ssize_t)encoded;
 }
 
+ssize_t pn_encoder_encode_grow(pn_encoder_t *encoder, pn_data_t *src, pn_rwbytes_t *buffer, size_t offset)
+{
+  encoder->output = buffer->start;
+  encoder->size = buffer->start ? buffer->size : 0;
+  encoder->buffer = buffer;
+  encoder->position = encoder->output;
+  if (offset > encoder->size && !pni_encoder_grow(encoder, offset)) {
+    pn_error_format(pn_data_error(src), PN_OUT_OF_MEMORY, "not enough memory to encode");
+    return PN_OUT_OF_MEMORY;
+  }
+  encoder->position = encoder->output + offset;
+
+  int err = pni_data_traverse(src, pni_encoder_enter, pni_encoder_exit, encoder);
+  encoder->buffer = NULL;
+  if (err) return err;
+  size_t encoded = encoder->position - encoder->output - offset;
+  if (offset + encoded > encoder->size) {
+      pn_error_format(pn_data_error(src), PN_OUT_OF_MEMORY, "not enough memory to encode");
+      return PN_OUT_OF_MEMORY;
+  }
+  return (ssize_t)encoded;
+}
+
 ssize_t pn_encoder_size(pn_encoder_t *encoder, pn_data_t *src)
 {
   encoder->output = 0;
@@ -28,11 +28,14 @@ typedef struct pn_encoder_t {
   pn_error_t *error;
   size_t size;
   unsigned null_count;
+  pn_rwbytes_t *buffer;         /* if set, output is grown with realloc() as needed */
 } pn_encoder_t;
 
 void pn_encoder_initialize(pn_encoder_t *encoder);
 void pn_encoder_finalize(pn_encoder_t *encoder);
 ssize_t pn_encoder_encode(pn_encoder_t *encoder, pn_data_t *src, char *dst, size_t size);
+/* Encode src after the first offset bytes of *buffer, growing it as needed */
+ssize_t pn_encoder_encode_grow(pn_encoder_t *encoder, pn_data_t *src, pn_rwbytes_t *buffer, size_t offset);
 ssize_t pn_encoder_size(pn_encoder_t *encoder, pn_data_t *src);
 
 #endif /* encoder.h */
@@ -56,6 +56,31 @@ struct pn_endpoint_t {
   bool referenced;
 };
 
+/* The modified endpoints of one kind, those that pni_process() has to look
+ * at, linked through transport_next and transport_prev */
+typedef struct {
+  pn_endpoint_t *transport_head;  // reference counted
+  pn_endpoint_t *transport_tail;
+} pni_endpoint_list_t;
+
+/* Each phase of pni_process() acts on one kind of endpoint, so the modified
+ * endpoints are kept apart by kind */
+typedef enum {
+  PNI_MODIFIED_CONNECTION,
+  PNI_MODIFIED_SESSIONS,
+  PNI_MODIFIED_LINKS,
+  PNI_MODIFIED_COUNT
+} pni_modified_t;
+
+static inline pni_modified_t pni_modified_kind(pn_endpoint_t *endpoint)
+{
+  switch (endpoint->type) {
+  case CONNECTION: return PNI_MODIFIED_CONNECTION;
+  case SESSION: return PNI_MODIFIED_SESSIONS;
+  default: return PNI_MODIFIED_LINKS;
+  }
+}
+
 typedef struct {
   pn_sequence_t id;
   bool sending;
@@ -63,24 +88,72 @@ typedef struct {
   bool init;
 } pn_delivery_state_t;
 
+/* The deliveries of a session in one direction, by delivery id.  Ids are
+ * handed out in order, so the map is a ring indexed by id holding the ids
+ * from first, the oldest that is still mapped, up to next.  The ring spans
+ * at most PNI_DELIVERY_MAP_MAX_CAPACITY ids; deliveries left unsettled
+ * further back than that are moved out to a hash. */
+#define PNI_DELIVERY_MAP_MAX_CAPACITY 4096
+
 typedef struct {
+  pn_delivery_t **deliveries;
+  pn_hash_t *spilled;   // deliveries older than the ring, made when needed
+  size_t capacity;      // a power of 2, 0 until the first delivery
+  size_t size;          // the number of deliveries in the ring
+  pn_sequence_t first;
   pn_sequence_t next;
-  pn_hash_t *deliveries;
 } pn_delivery_map_t;
 
+/* Channels or handles of one end of a connection, mapped to their sessions
+ * or links.  They are small numbers, so they index a table; a peer may use
+ * any handle though, and those far bigger than the number mapped go in a
+ * hash.  The aliases this end hands out come from a free list and are below
+ * PNI_ALIAS_MAX. */
+#define PNI_ALIAS_MAX 65536
+
+typedef struct {
+  void **entries;         // by alias, NULL where unused
+  pn_hash_t *sparse;      // aliases from capacity up, made when needed
+  uint32_t *free;         // aliases handed out and given back
+  uint32_t capacity;
+  uint32_t size;          // entries in the table
+  uint32_t free_count;
+  uint32_t free_capacity;
+  uint32_t next;          // the aliases from here up have not been handed out
+} pni_alias_map_t;
+
+static inline void *pni_alias_map_get(pni_alias_map_t *map, uint32_t alias)
+{
+  if (alias < map->capacity) return map->entries[alias];
+  return map->sparse ? pn_hash_get(map->sparse, alias) : NULL;
+}
+
+/* The first link of ssn named name, then the next one after link, in the
+ * order they were made. */
+pn_link_t *pni_session_link_named(pn_session_t *ssn, pn_bytes_t name);
+pn_link_t *pni_link_named_next(pn_link_t *link, pn_bytes_t name);
+
+// descriptor, list32 header, uint handle and the delivery-id's constructor
+#define PNI_TRANSFER_TEMPLATE_MAX 18
+
 typedef struct {
   // XXX: stop using negative numbers
   uint32_t local_handle;
   uint32_t remote_handle;
   pn_sequence_t delivery_count;
   pn_sequence_t link_credit;
+  // the encoded start of this link's transfers, up to the delivery-id's
+  // value, so that only the fields that change are written per transfer
+  uint32_t transfer_template_handle;
+  uint8_t transfer_template_size;
+  char transfer_template[PNI_TRANSFER_TEMPLATE_MAX];
 } pn_link_state_t;
 
 typedef struct {
   pn_delivery_map_t incoming;
   pn_delivery_map_t outgoing;
-  pn_hash_t *local_handles;
-  pn_hash_t *remote_handles;
+  pni_alias_map_t local_handles;
+  pni_alias_map_t remote_handles;
   uint64_t disp_code;
   pn_sequence_t incoming_transfer_count;
   pn_sequence_t incoming_window;
@@ -134,9 +207,7 @@ struct pn_transport_t {
   pn_data_t *remote_desired_capabilities;
   pn_data_t *remote_properties;
   pn_data_t *disp_data;
-  //#define PN_DEFAULT_MAX_FRAME_SIZE (16*1024)
-/* This is wrong and bad  we should really use a sensible starting size not unlimited */
-#define PN_DEFAULT_MAX_FRAME_SIZE (0)  /* for now, allow unlimited size */
+#define PN_DEFAULT_MAX_FRAME_SIZE (16*1024)
   uint32_t   local_max_frame;
   uint32_t   remote_max_frame;
   pn_condition_t remote_condition;
@@ -156,17 +227,24 @@ struct pn_transport_t {
   pn_timestamp_t keepalive_deadline;
   uint64_t last_bytes_output;
 
-  pn_hash_t *local_channels;
-  pn_hash_t *remote_channels;
+  /* release of idle buffers */
+  pn_millis_t buffer_release_timeout;
+  pn_timestamp_t buffer_release_deadline;
+  uint64_t last_bytes_io;
+  bool buffers_released;
+
+  pni_alias_map_t local_channels;
+  pni_alias_map_t remote_channels;
 
 
   /* scratch area */
   pn_string_t *scratch;
   pn_data_t *args;
   pn_data_t *output_args;
-  pn_buffer_t *frame;  // frame under construction
+  pn_rwbytes_t frame;  // frame under construction
 
   // Temporary - ??
+  #define PN_TRANSPORT_INITIAL_FRAME_BUFFER_SIZE (4*1024)
   pn_buffer_t *output_buffer;
 
   /* statistics */
@@ -175,7 +253,8 @@ struct pn_transport_t {
   uint64_t output_frames_ct;
   uint64_t input_frames_ct;
 
-  /* output buffered for send */
+  /* output buffered for send, the buffers are allocated when first used
+     and the sizes kept while they are released */
   #define PN_TRANSPORT_INITIAL_BUFFER_SIZE (8*1024)
   size_t output_size;
   size_t output_pending;
@@ -186,6 +265,14 @@ struct pn_transport_t {
   size_t input_pending;
   char *input_buf;
 
+  /* A transfer frame too big for the input buffer, whose payload is handed
+     to the delivery as it arrives (see pn_do_transfer_rest) */
+  uint32_t input_transfer_rest;  // bytes of its payload still to come
+  uint32_t input_transfer_handle;
+  uint16_t input_transfer_channel;
+  bool input_transfer_more;
+  bool input_transfer_aborted;
+
   pn_record_t *context;
 
   /*
@@ -227,8 +314,7 @@ struct pn_connection_t {
   pn_endpoint_t endpoint;
   pn_endpoint_t *endpoint_head;
   pn_endpoint_t *endpoint_tail;
-  pn_endpoint_t *transport_head;  // reference counted
-  pn_endpoint_t *transport_tail;
+  pni_endpoint_list_t modified[PNI_MODIFIED_COUNT];
   pn_list_t *sessions;
   pn_list_t *freed;
   pn_transport_t *transport;
@@ -255,8 +341,12 @@ struct pn_session_t {
   pn_connection_t *connection;  // reference counted
   pn_list_t *links;
   pn_list_t *freed;
+  pn_link_t **named_links;      // links by the hash of their name, chained through name_next
+  size_t named_links_capacity;
   pn_record_t *context;
   size_t incoming_capacity;
+  size_t delivery_windows;      // total delivery window of its receiving links
+  size_t windowed_bytes;        // unread bytes received on those links
   pn_sequence_t incoming_bytes;
   pn_sequence_t outgoing_bytes;
   pn_sequence_t incoming_deliveries;
@@ -287,12 +377,15 @@ struct pn_link_t {
   pn_terminus_t remote_target;
   pn_link_state_t state;
   pn_string_t *name;
+  pn_link_t *name_next;   // in its session's named_links
   pn_session_t *session;  // reference counted
   pn_delivery_t *unsettled_head;
   pn_delivery_t *unsettled_tail;
   pn_delivery_t *current;
   pn_record_t *context;
   size_t unsettled_count;
+  size_t delivery_window;
+  size_t incoming_bytes;  // received and not yet read or dropped
   uint64_t max_message_size;
   uint64_t remote_max_message_size;
   pn_sequence_t available;
@@ -343,6 +436,20 @@ struct pn_delivery_t {
   bool aborted;
 };
 
+/* Account for data received on a receiving link, and for it being read or
+ * dropped, in the link and in its session's delivery window total. */
+static inline void pni_link_received(pn_link_t *link, size_t n)
+{
+  link->incoming_bytes += n;
+  if (link->delivery_window) link->session->windowed_bytes += n;
+}
+
+static inline void pni_link_consumed(pn_link_t *link, size_t n)
+{
+  link->incoming_bytes -= n;
+  if (link->delivery_window) link->session->windowed_bytes -= n;
+}
+
 #define PN_SET_LOCAL(OLD, NEW)                                          \
   (OLD) = ((OLD) & PN_REMOTE_MASK) | (NEW)
 
@@ -356,6 +463,9 @@ void pn_transport_sasl_init(pn_transport_t *transport);
 
 void pn_condition_init(pn_condition_t *condition);
 void pn_condition_tini(pn_condition_t *condition);
+size_t pni_condition_memory(pn_condition_t *condition);
+// Add the memory of the transport and its layers to usage
+void pni_transport_memory(pn_transport_t *transport, pn_connection_memory_t *usage);
 void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint, bool emit);
 void pn_real_settle(pn_delivery_t *delivery);  // will free delivery if link is freed
 void pn_clear_tpwork(pn_delivery_t *delivery);
@@ -370,7 +480,14 @@ void pn_link_unbound(pn_link_t* link);
 void pn_ep_incref(pn_endpoint_t *endpoint);
 void pn_ep_decref(pn_endpoint_t *endpoint);
 
-int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const char *fmt, ...);
+int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, pn_bytes_t performative);
+
+/* Output to write as up to count buffers, without first copying the frames
+ * into a single buffer when no layer needs to change them. Returns the number
+ * of buffers filled in. */
+size_t pni_transport_head_buffers(pn_transport_t *transport, pn_bytes_t *buffers, size_t count);
+/* Consume size bytes of the output from pni_transport_head_buffers() */
+void pni_transport_pop_buffers(pn_transport_t *transport, size_t size);
 
 typedef enum {IN, OUT} pn_dir_t;
 
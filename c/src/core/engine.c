@@ -21,6 +21,7 @@
 
 #include "engine-internal.h"
 
+#include "data.h"
 #include "framing.h"
 #include "memory.h"
 #include "platform/platform.h"
@@ -31,7 +32,9 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 
@@ -168,8 +171,10 @@ void pn_connection_unbound(pn_connection_t *connection)
     // connection has been freed prior to unbinding, thus it
     // cannot be re-assigned to a new transport.  Clear the
     // transport work lists to allow the connection to be freed.
-    while (connection->transport_head) {
-        pn_clear_modified(connection, connection->transport_head);
+    for (int i = 0; i < PNI_MODIFIED_COUNT; i++) {
+      while (connection->modified[i].transport_head) {
+        pn_clear_modified(connection, connection->modified[i].transport_head);
+      }
     }
     while (connection->tpwork_head) {
       pn_clear_tpwork(connection->tpwork_head);
@@ -203,6 +208,92 @@ pn_transport_t *pn_connection_transport(pn_connection_t *connection)
   return connection->transport;
 }
 
+static size_t pni_endpoint_memory(pn_endpoint_t *endpoint)
+{
+  return pni_condition_memory(&endpoint->condition) + pni_condition_memory(&endpoint->remote_condition);
+}
+
+static size_t pni_terminus_memory(pn_terminus_t *terminus)
+{
+  return pni_string_memory(terminus->address) + pni_data_memory(terminus->properties) +
+    pni_data_memory(terminus->capabilities) + pni_data_memory(terminus->outcomes) +
+    pni_data_memory(terminus->filter);
+}
+
+static size_t pni_disposition_memory(pn_disposition_t *ds)
+{
+  return pni_condition_memory(&ds->condition) + pni_data_memory(ds->data) +
+    pni_data_memory(ds->annotations);
+}
+
+static size_t pni_delivery_memory(pn_delivery_t *delivery)
+{
+  return pni_object_memory(delivery, sizeof(pn_delivery_t)) +
+    pni_disposition_memory(&delivery->local) + pni_disposition_memory(&delivery->remote) +
+    pni_buffer_memory(delivery->tag) + pni_buffer_memory(delivery->bytes) +
+    pni_record_memory(delivery->context);
+}
+
+static size_t pni_delivery_map_memory(pn_delivery_map_t *map)
+{
+  return pni_mem_size(map->deliveries, map->capacity * sizeof(pn_delivery_t *)) +
+    pni_hash_memory(map->spilled);
+}
+
+void pn_connection_memory_usage(pn_connection_t *connection, pn_connection_memory_t *usage)
+{
+  assert(connection);
+  assert(usage);
+  memset(usage, 0, sizeof(*usage));
+
+  usage->connection = pni_object_memory(connection, sizeof(pn_connection_t)) +
+    pni_endpoint_memory(&connection->endpoint) +
+    pni_list_memory(connection->sessions) + pni_list_memory(connection->freed) +
+    pni_string_memory(connection->container) + pni_string_memory(connection->hostname) +
+    pni_string_memory(connection->auth_user) + pni_string_memory(connection->auth_password) +
+    pni_data_memory(connection->offered_capabilities) +
+    pni_data_memory(connection->desired_capabilities) +
+    pni_data_memory(connection->properties) +
+    pni_record_memory(connection->context);
+
+  usage->deliveries = pni_list_memory(connection->delivery_pool);
+  for (size_t i = 0; i < pn_list_size(connection->delivery_pool); i++) {
+    usage->deliveries += pni_delivery_memory((pn_delivery_t *) pn_list_get(connection->delivery_pool, i));
+  }
+
+  for (size_t i = 0; i < pn_list_size(connection->sessions); i++) {
+    pn_session_t *ssn = (pn_session_t *) pn_list_get(connection->sessions, i);
+    usage->sessions += pni_object_memory(ssn, sizeof(pn_session_t)) +
+      pni_endpoint_memory(&ssn->endpoint) +
+      pni_list_memory(ssn->links) + pni_list_memory(ssn->freed) +
+      pni_mem_size(ssn->named_links, ssn->named_links_capacity * sizeof(pn_link_t *)) +
+      pni_record_memory(ssn->context) +
+      pni_delivery_map_memory(&ssn->state.incoming) + pni_delivery_map_memory(&ssn->state.outgoing) +
+      pni_alias_map_memory(&ssn->state.local_handles) + pni_alias_map_memory(&ssn->state.remote_handles);
+
+    for (size_t j = 0; j < pn_list_size(ssn->links); j++) {
+      pn_link_t *link = (pn_link_t *) pn_list_get(ssn->links, j);
+      usage->links += pni_object_memory(link, sizeof(pn_link_t)) +
+        pni_endpoint_memory(&link->endpoint) +
+        pni_terminus_memory(&link->source) + pni_terminus_memory(&link->target) +
+        pni_terminus_memory(&link->remote_source) + pni_terminus_memory(&link->remote_target) +
+        pni_string_memory(link->name) + pni_record_memory(link->context);
+
+      for (pn_delivery_t *d = link->unsettled_head; d; d = d->unsettled_next) {
+        usage->deliveries += pni_delivery_memory(d);
+      }
+    }
+  }
+
+  if (connection->transport) {
+    pni_transport_memory(connection->transport, usage);
+  }
+
+  usage->total = usage->connection + usage->transport + usage->transport_buffers +
+    usage->codec + usage->scratch + usage->sessions + usage->links + usage->deliveries +
+    usage->ssl + usage->sasl + usage->io;
+}
+
 void pn_condition_init(pn_condition_t *condition)
 {
   condition->name = NULL;
@@ -216,6 +307,13 @@ pn_condition_t *pn_condition() {
   return c;
 }
 
+// The bytes held by condition's fields, not the condition itself
+size_t pni_condition_memory(pn_condition_t *condition)
+{
+  return pni_string_memory(condition->name) + pni_string_memory(condition->description) +
+    pni_data_memory(condition->info);
+}
+
 void pn_condition_tini(pn_condition_t *condition)
 {
   pn_data_free(condition->info);
@@ -301,9 +399,80 @@ void pn_session_set_context(pn_session_t *session, void *context)
 }
 
 
+#define PNI_NAMED_LINKS_MIN_CAPACITY 16
+
+static pn_link_t **pni_named_links_bucket(pn_session_t *ssn, pn_bytes_t name)
+{
+  return &ssn->named_links[pni_fnv1a(name) & (ssn->named_links_capacity - 1)];
+}
+
+// Add link at the end of its chain, so links of the same name stay in order
+static void pni_named_links_append(pn_session_t *ssn, pn_link_t *link)
+{
+  pn_link_t **tail = pni_named_links_bucket(ssn, pn_string_bytes(link->name));
+  while (*tail) tail = &(*tail)->name_next;
+  link->name_next = NULL;
+  *tail = link;
+}
+
+// Keep about one link per bucket, if the table cannot grow its chains just
+// get longer
+static void pni_named_links_add(pn_session_t *ssn, pn_link_t *link)
+{
+  size_t count = pn_list_size(ssn->links);
+  if (count > ssn->named_links_capacity) {
+    size_t capacity = ssn->named_links_capacity ? 2 * ssn->named_links_capacity : PNI_NAMED_LINKS_MIN_CAPACITY;
+    pn_link_t **buckets = (pn_link_t **) calloc(capacity, sizeof(pn_link_t *));
+    if (buckets) {
+      pn_link_t **old = ssn->named_links;
+      size_t old_capacity = ssn->named_links_capacity;
+      ssn->named_links = buckets;
+      ssn->named_links_capacity = capacity;
+      for (size_t i = 0; i < old_capacity; i++) {
+        for (pn_link_t *l = old[i], *next; l; l = next) {
+          next = l->name_next;
+          pni_named_links_append(ssn, l);
+        }
+      }
+      free(old);
+    }
+  }
+  if (ssn->named_links_capacity) pni_named_links_append(ssn, link);
+}
+
+static void pni_named_links_remove(pn_session_t *ssn, pn_link_t *link)
+{
+  if (!ssn->named_links_capacity) return;
+  for (pn_link_t **l = pni_named_links_bucket(ssn, pn_string_bytes(link->name)); *l; l = &(*l)->name_next) {
+    if (*l == link) {
+      *l = link->name_next;
+      link->name_next = NULL;
+      return;
+    }
+  }
+}
+
+static pn_link_t *pni_named_from(pn_link_t *link, pn_bytes_t name)
+{
+  while (link && !pn_bytes_equal(name, pn_string_bytes(link->name))) link = link->name_next;
+  return link;
+}
+
+pn_link_t *pni_session_link_named(pn_session_t *ssn, pn_bytes_t name)
+{
+  if (!ssn->named_links_capacity) return NULL;
+  return pni_named_from(*pni_named_links_bucket(ssn, name), name);
+}
+
+pn_link_t *pni_link_named_next(pn_link_t *link, pn_bytes_t name)
+{
+  return pni_named_from(link->name_next, name);
+}
+
 static void pni_add_link(pn_session_t *ssn, pn_link_t *link)
 {
   pn_list_add(ssn->links, link);
+  pni_named_links_add(ssn, link);
   link->session = ssn;
   pn_ep_incref(&ssn->endpoint);
 }
@@ -311,6 +480,8 @@ static void pni_add_link(pn_session_t *ssn, pn_link_t *link)
 static void pni_remove_link(pn_session_t *ssn, pn_link_t *link)
 {
   if (pn_list_remove(ssn->links, link)) {
+    pni_named_links_remove(ssn, link);
+    if (pn_link_is_receiver(link)) pn_link_set_delivery_window(link, 0);
     pn_ep_decref(&ssn->endpoint);
     LL_REMOVE(ssn->connection, endpoint, &link->endpoint);
   }
@@ -518,8 +689,10 @@ pn_connection_t *pn_connection()
   conn->endpoint_head = NULL;
   conn->endpoint_tail = NULL;
   pn_endpoint_init(&conn->endpoint, CONNECTION, conn);
-  conn->transport_head = NULL;
-  conn->transport_tail = NULL;
+  for (int i = 0; i < PNI_MODIFIED_COUNT; i++) {
+    conn->modified[i].transport_head = NULL;
+    conn->modified[i].transport_tail = NULL;
+  }
   conn->sessions = pn_list(PN_WEAKREF, 0);
   conn->freed = pn_list(PN_WEAKREF, 0);
   conn->transport = NULL;
@@ -746,21 +919,24 @@ void pn_clear_tpwork(pn_delivery_t *delivery)
 
 void pn_dump(pn_connection_t *conn)
 {
-  pn_endpoint_t *endpoint = conn->transport_head;
-  while (endpoint)
-  {
-    printf("%p", (void *) endpoint);
-    endpoint = endpoint->transport_next;
-    if (endpoint)
-      printf(" -> ");
+  for (int i = 0; i < PNI_MODIFIED_COUNT; i++) {
+    pn_endpoint_t *endpoint = conn->modified[i].transport_head;
+    while (endpoint)
+    {
+      printf("%p", (void *) endpoint);
+      endpoint = endpoint->transport_next;
+      if (endpoint)
+        printf(" -> ");
+    }
+    printf("\n");
   }
-  printf("\n");
 }
 
 void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint, bool emit)
 {
   if (!endpoint->modified) {
-    LL_ADD(connection, transport, endpoint);
+    pni_endpoint_list_t *list = &connection->modified[pni_modified_kind(endpoint)];
+    LL_ADD(list, transport, endpoint);
     endpoint->modified = true;
   }
 
@@ -773,7 +949,8 @@ void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint, bool emit
 void pn_clear_modified(pn_connection_t *connection, pn_endpoint_t *endpoint)
 {
   if (endpoint->modified) {
-    LL_REMOVE(connection, transport, endpoint);
+    pni_endpoint_list_t *list = &connection->modified[pni_modified_kind(endpoint)];
+    LL_REMOVE(list, transport, endpoint);
     endpoint->transport_next = NULL;
     endpoint->transport_prev = NULL;
     endpoint->modified = false;
@@ -926,7 +1103,7 @@ static bool pni_preserve_child(pn_endpoint_t *endpoint)
     pn_decref(parent);
     return true;
   } else {
-    LL_REMOVE(conn, transport, endpoint);
+    pn_clear_modified(conn, endpoint);
     return false;
   }
 }
@@ -945,15 +1122,16 @@ static void pn_session_finalize(void *object)
   pni_endpoint_tini(endpoint);
   pn_delivery_map_free(&session->state.incoming);
   pn_delivery_map_free(&session->state.outgoing);
-  pn_free(session->state.local_handles);
-  pn_free(session->state.remote_handles);
+  pni_alias_map_free(&session->state.local_handles);
+  pni_alias_map_free(&session->state.remote_handles);
+  free(session->named_links);
   pni_remove_session(session->connection, session);
   pn_list_remove(session->connection->freed, session);
 
   if (session->connection->transport) {
     pn_transport_t *transport = session->connection->transport;
-    pn_hash_del(transport->local_channels, session->state.local_channel);
-    pn_hash_del(transport->remote_channels, session->state.remote_channel);
+    pni_alias_map_del(&transport->local_channels, session->state.local_channel, session);
+    pni_alias_map_del(&transport->remote_channels, session->state.remote_channel, session);
   }
 
   if (endpoint->referenced) {
@@ -982,8 +1160,12 @@ pn_session_t *pn_session(pn_connection_t *conn)
   pni_add_session(conn, ssn);
   ssn->links = pn_list(PN_WEAKREF, 0);
   ssn->freed = pn_list(PN_WEAKREF, 0);
+  ssn->named_links = NULL;
+  ssn->named_links_capacity = 0;
   ssn->context = pn_record();
   ssn->incoming_capacity = 0;
+  ssn->delivery_windows = 0;
+  ssn->windowed_bytes = 0;
   ssn->incoming_bytes = 0;
   ssn->outgoing_bytes = 0;
   ssn->incoming_deliveries = 0;
@@ -996,8 +1178,8 @@ pn_session_t *pn_session(pn_connection_t *conn)
   ssn->state.remote_channel = (uint16_t)-1;
   pn_delivery_map_init(&ssn->state.incoming, 0);
   pn_delivery_map_init(&ssn->state.outgoing, 0);
-  ssn->state.local_handles = pn_hash(PN_WEAKREF, 0, 0.75);
-  ssn->state.remote_handles = pn_hash(PN_WEAKREF, 0, 0.75);
+  pni_alias_map_init(&ssn->state.local_handles);
+  pni_alias_map_init(&ssn->state.remote_handles);
   // end transport state
 
   pn_collector_put(conn->collector, PN_OBJECT, ssn, PN_SESSION_INIT);
@@ -1119,8 +1301,8 @@ static void pn_link_finalize(void *object)
   pn_free(link->name);
   pni_endpoint_tini(endpoint);
   pni_remove_link(link->session, link);
-  pn_hash_del(link->session->state.local_handles, link->state.local_handle);
-  pn_hash_del(link->session->state.remote_handles, link->state.remote_handle);
+  pni_alias_map_del(&link->session->state.local_handles, link->state.local_handle, link);
+  pni_alias_map_del(&link->session->state.remote_handles, link->state.remote_handle, link);
   pn_list_remove(link->session->freed, link);
   if (endpoint->referenced) {
     pn_decref(link->session);
@@ -1145,15 +1327,17 @@ pn_link_t *pn_link_new(int type, pn_session_t *session, const char *name)
   pn_link_t *link = (pn_link_t *) pn_class_new(&clazz, sizeof(pn_link_t));
 
   pn_endpoint_init(&link->endpoint, type, session->connection);
+  link->name = pn_string(name);
   pni_add_link(session, link);
   pn_incref(session);  // keep session until link finalized
-  link->name = pn_string(name);
   pni_terminus_init(&link->source, PN_SOURCE);
   pni_terminus_init(&link->target, PN_TARGET);
   pni_terminus_init(&link->remote_source, PN_UNSPECIFIED);
   pni_terminus_init(&link->remote_target, PN_UNSPECIFIED);
   link->unsettled_head = link->unsettled_tail = link->current = NULL;
   link->unsettled_count = 0;
+  link->delivery_window = 0;
+  link->incoming_bytes = 0;
   link->max_message_size = 0;
   link->remote_max_message_size = 0;
   link->available = 0;
@@ -1174,6 +1358,7 @@ pn_link_t *pn_link_new(int type, pn_session_t *session, const char *name)
   link->state.remote_handle = -1;
   link->state.delivery_count = 0;
   link->state.link_credit = 0;
+  link->state.transfer_template_size = 0;
   // end transport state
 
   pn_collector_put(session->connection->collector, PN_OBJECT, link, PN_LINK_INIT);
@@ -1195,6 +1380,7 @@ void pn_link_unbound(pn_link_t* link)
   link->state.remote_handle = -1;
   link->state.delivery_count = 0;
   link->state.link_credit = 0;
+  link->state.transfer_template_size = 0;
 }
 
 pn_terminus_t *pn_link_source(pn_link_t *link)
@@ -1437,6 +1623,7 @@ static void pn_delivery_finalize(void *object)
                         ? &link->session->state.outgoing
                         : &link->session->state.incoming,
                         delivery);
+    if (pn_link_is_receiver(link)) pni_link_consumed(link, pn_buffer_size(delivery->bytes));
     pn_buffer_clear(delivery->tag);
     pn_buffer_clear(delivery->bytes);
     pn_record_clear(delivery->context);
@@ -1758,6 +1945,7 @@ static void pni_advance_receiver(pn_link_t *link)
 
   pn_delivery_t *current = link->current;
   link->session->incoming_bytes -= pn_buffer_size(current->bytes);
+  pni_link_consumed(link, pn_buffer_size(current->bytes));
   pn_buffer_clear(current->bytes);
 
   if (!link->session->state.incoming_window) {
@@ -1869,10 +2057,21 @@ void pn_link_offered(pn_link_t *sender, int credit)
   sender->available = credit;
 }
 
+size_t pn_link_send_space(pn_link_t *sender)
+{
+  assert(sender);
+  pn_delivery_t *current = pn_link_current(sender);
+  if (!current) return 0;
+  if (!sender->delivery_window) return SIZE_MAX;
+  size_t buffered = pn_buffer_size(current->bytes);
+  return buffered < sender->delivery_window ? sender->delivery_window - buffered : 0;
+}
+
 ssize_t pn_link_send(pn_link_t *sender, const char *bytes, size_t n)
 {
   pn_delivery_t *current = pn_link_current(sender);
   if (!current) return PN_EOS;
+  if (sender->delivery_window) n = pn_min(n, pn_link_send_space(sender));
   if (!bytes || !n) return 0;
   pn_buffer_append(current->bytes, bytes, n);
   sender->session->outgoing_bytes += n;
@@ -1907,18 +2106,44 @@ ssize_t pn_link_recv(pn_link_t *receiver, char *bytes, size_t n)
   if (!delivery) return PN_STATE_ERR;
   if (delivery->aborted) return PN_ABORTED;
   size_t size = pn_buffer_get(delivery->bytes, 0, n, bytes);
-  pn_buffer_trim(delivery->bytes, size, 0);
   if (size) {
-    receiver->session->incoming_bytes -= size;
-    if (!receiver->session->state.incoming_window) {
-      pni_add_tpwork(delivery);
-    }
+    pn_link_recv_done(receiver, size);
     return size;
   } else {
     return delivery->done ? PN_EOS : 0;
   }
 }
 
+ssize_t pn_link_recv_buffers(pn_link_t *receiver, pn_bytes_t *buffers, size_t count)
+{
+  if (!receiver) return PN_ARG_ERR;
+  pn_delivery_t *delivery = receiver->current;
+  if (!delivery) return PN_STATE_ERR;
+  if (delivery->aborted) return PN_ABORTED;
+  pn_bytes_t chunks[2];
+  size_t n = pn_buffer_chunks(delivery->bytes, chunks);
+  if (!n) return delivery->done ? PN_EOS : 0;
+  if (n > count) n = count;
+  for (size_t i = 0; i < n; i++) {
+    buffers[i] = chunks[i];
+  }
+  return n;
+}
+
+void pn_link_recv_done(pn_link_t *receiver, size_t n)
+{
+  assert(receiver && receiver->current);
+  pn_delivery_t *delivery = receiver->current;
+  assert(n <= pn_buffer_size(delivery->bytes));
+  if (!n) return;
+  pn_buffer_trim(delivery->bytes, n, 0);
+  receiver->session->incoming_bytes -= n;
+  pni_link_consumed(receiver, n);
+  if (!receiver->session->state.incoming_window) {
+    pni_add_tpwork(delivery);
+  }
+}
+
 
 void pn_link_flow(pn_link_t *receiver, int credit)
 {
@@ -1967,6 +2192,27 @@ void pn_link_set_max_message_size(pn_link_t *link, uint64_t size)
   link->max_message_size = size;
 }
 
+size_t pn_link_delivery_window(pn_link_t *link)
+{
+  return link->delivery_window;
+}
+
+void pn_link_set_delivery_window(pn_link_t *link, size_t window)
+{
+  if (pn_link_is_receiver(link)) {
+    pn_session_t *ssn = link->session;
+    ssn->delivery_windows = ssn->delivery_windows - link->delivery_window + window;
+    if (!link->delivery_window != !window) {
+      if (window) {
+        ssn->windowed_bytes += link->incoming_bytes;
+      } else {
+        ssn->windowed_bytes -= link->incoming_bytes;
+      }
+    }
+  }
+  link->delivery_window = window;
+}
+
 uint64_t pn_link_remote_max_message_size(pn_link_t *link)
 {
   return link->remote_max_message_size;
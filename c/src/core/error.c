@@ -151,3 +151,9 @@ static const pn_error_t pn_error_null = {NULL, 0};
 pn_error_t *pn_connection_error(pn_connection_t *c) {return (pn_error_t*) &pn_error_null;}
 pn_error_t *pn_session_error(pn_session_t *c) {return (pn_error_t*) &pn_error_null;}
 pn_error_t *pn_link_error(pn_link_t *c) {return (pn_error_t*) &pn_error_null;}
+
+size_t pni_error_memory(pn_error_t *error)
+{
+  if (!error) return 0;
+  return pni_mem_size(error, sizeof(pn_error_t)) + pni_mem_string_size(error->text);
+}
@@ -65,15 +65,25 @@ static inline uint32_t pn_i_read32(const char *bytes)
 
 
 ssize_t pn_read_frame(pn_frame_t *frame, const char *bytes, size_t available, uint32_t max)
+{
+  ssize_t size = pn_read_frame_head(frame, bytes, available, max);
+  if (size > 0 && (size_t) size > available) return 0;
+  return size;
+}
+
+// Read the header of a frame of which only the start may have arrived, the
+// payload in frame is the part of it that has.  Returns the size of the
+// whole frame, 0 if its header is not all here yet.
+ssize_t pn_read_frame_head(pn_frame_t *frame, const char *bytes, size_t available, uint32_t max)
 {
   if (available < AMQP_HEADER_SIZE) return 0;
   uint32_t size = pn_i_read32(&bytes[0]);
   if (max && size > max) return PN_ERR;
-  if (available < size) return 0;
   unsigned int doff = 4 * (uint8_t)bytes[4];
   if (doff < AMQP_HEADER_SIZE || doff > size) return PN_ERR;
+  if (available < doff) return 0;
 
-  frame->size = size - doff;
+  frame->size = (available < size ? available : size) - doff;
   frame->ex_size = doff - AMQP_HEADER_SIZE;
   frame->type = bytes[5];
   frame->channel = pn_i_read16(&bytes[6]);
@@ -85,7 +95,14 @@ ssize_t pn_read_frame(pn_frame_t *frame, const char *bytes, size_t available, ui
 
 size_t pn_write_frame(pn_buffer_t* buffer, pn_frame_t frame)
 {
-  size_t size = AMQP_HEADER_SIZE + frame.ex_size + frame.size;
+  return pn_write_frame_body(buffer, frame, pn_bytes(0, NULL));
+}
+
+// Write a frame whose payload is frame.payload followed by body, so that a
+// performative and the message data after it need not be joined up first.
+size_t pn_write_frame_body(pn_buffer_t* buffer, pn_frame_t frame, pn_bytes_t body)
+{
+  size_t size = AMQP_HEADER_SIZE + frame.ex_size + frame.size + body.size;
   if (size <= pn_buffer_available(buffer))
   {
     // Prepare header
@@ -101,6 +118,7 @@ size_t pn_write_frame(pn_buffer_t* buffer, pn_frame_t frame)
     if (frame.extended)
         pn_buffer_append(buffer, frame.extended, frame.ex_size);
     pn_buffer_append(buffer, frame.payload, frame.size);
+    pn_buffer_append(buffer, body.start, body.size);
     return size;
   } else {
     return 0;
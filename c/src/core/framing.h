@@ -42,6 +42,8 @@ typedef struct {
 } pn_frame_t;
 
 ssize_t pn_read_frame(pn_frame_t *frame, const char *bytes, size_t available, uint32_t max);
+ssize_t pn_read_frame_head(pn_frame_t *frame, const char *bytes, size_t available, uint32_t max);
 size_t pn_write_frame(pn_buffer_t* buffer, pn_frame_t frame);
+size_t pn_write_frame_body(pn_buffer_t* buffer, pn_frame_t frame, pn_bytes_t body);
 
 #endif /* framing.h */
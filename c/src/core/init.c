@@ -19,11 +19,13 @@
 
 #include "core/logger_private.h"
 #include "core/memory.h"
+#include "core/symbols.h"
 
 void pn_init(void)
 {
   pni_init_default_logger();
   pni_init_memory();
+  pni_init_symbols();
 }
 
 void pn_fini(void)
@@ -21,16 +21,6 @@
 
 #include "core/memory.h"
 
-#ifdef PN_MEMDEBUG
-#include "logger_private.h"
-
-#include "proton/object.h"
-#include "proton/cid.h"
-
-#include <stdlib.h>
-
-#include <signal.h>
-
 // Non portable actual size of allocated block
 // malloc_usable_size() for glibc
 // _msize() for MSCRT
@@ -48,6 +38,18 @@
 #define msize(x) (0)
 #endif
 
+#include <string.h>
+
+#ifdef PN_MEMDEBUG
+#include "logger_private.h"
+
+#include "proton/object.h"
+#include "proton/cid.h"
+
+#include <stdlib.h>
+
+#include <signal.h>
+
 static struct stats {
   const char* name;
   size_t count_alloc;
@@ -276,3 +278,15 @@ void *pni_mem_subreallocate(const pn_class_t *clazz, void *object, void *buffer,
 void pni_mem_subdeallocate(const pn_class_t *clazz, void *object, void *buffer) { free(buffer); }
 
 #endif
+
+size_t pni_mem_size(void *block, size_t size)
+{
+  if (!block) return 0;
+  size_t actual = msize(block);
+  return actual ? actual : size;
+}
+
+size_t pni_mem_string_size(const char *string)
+{
+  return string ? pni_mem_size((void *) string, strlen(string) + 1) : 0;
+}
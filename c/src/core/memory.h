@@ -22,6 +22,7 @@
  *
  */
 
+#include <proton/error.h>
 #include <proton/object.h>
 
 #include <stddef.h>
@@ -39,4 +40,20 @@ void *pni_mem_suballocate(const pn_class_t *clazz, void *object, size_t size);
 void *pni_mem_subreallocate(const pn_class_t *clazz, void *object, void *buffer, size_t size);
 void pni_mem_subdeallocate(const pn_class_t *clazz, void *object, void *buffer);
 
+/* The bytes held by an allocated block: its usable size if the allocator
+ * can tell, else size, the size that was asked for. */
+size_t pni_mem_size(void *block, size_t size);
+/* The bytes held by an allocated copy of a NUL terminated string */
+size_t pni_mem_string_size(const char *string);
+
+/* The bytes held by an object made by pn_class_new() and the memory it owns
+ * directly, not counting other objects it refers to */
+size_t pni_object_memory(void *object, size_t size);
+size_t pni_string_memory(pn_string_t *string);
+size_t pni_list_memory(pn_list_t *list);
+size_t pni_record_memory(pn_record_t *record);
+size_t pni_hash_memory(pn_hash_t *hash);
+
+size_t pni_error_memory(pn_error_t *error);
+
 #endif // MEMORY_H
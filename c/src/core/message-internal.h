@@ -34,6 +34,50 @@ PN_EXTERN pn_message_t * pni_message_with_extra(size_t extra);
 /** Pointer to extra space allocated by pn_message_with_extra(). */
 PN_EXTERN void* pni_message_get_extra(pn_message_t *msg);
 
+/** The sections of an encoded message, in the order they are encoded */
+typedef enum {
+  PNI_SECTION_HEADER,
+  PNI_SECTION_DELIVERY_ANNOTATIONS,
+  PNI_SECTION_MESSAGE_ANNOTATIONS,
+  PNI_SECTION_PROPERTIES,
+  PNI_SECTION_APPLICATION_PROPERTIES,
+  PNI_SECTION_BODY,
+  PNI_SECTION_COUNT
+} pni_section_t;
+
+/**
+ * Make a section of a decoded message ready to read. Unlike the
+ * pn_message_*() accessors this doesn't mark the section as changed, so it is
+ * still encoded by copying the bytes it was decoded from.
+ *
+ * @return 0, or an error code if the section is malformed; the error is also
+ * in pn_message_error() and is returned again by every later load.
+ */
+PN_EXTERN int pni_message_load(pn_message_t *msg, pni_section_t section);
+
+/**
+ * Like pn_message_decode_lazy() but without copying bytes: the message
+ * refers to them until it is cleared or decoded again, so they must stay
+ * valid and unchanged until then.
+ */
+PN_EXTERN int pni_message_decode_borrowed(pn_message_t *msg, const char *bytes, size_t size);
+
+/**
+ * Copy the bytes a message decoded by pni_message_decode_borrowed() refers
+ * to into the message, so they need not stay valid any longer. Does nothing
+ * for a message that doesn't borrow its bytes.
+ */
+PN_EXTERN int pni_message_own(pn_message_t *msg);
+
+/**
+ * Find the value of key in the map of a section of an encoded message, which
+ * must be the message or delivery annotations or the application properties.
+ * *value is set to the encoded value, which refers to bytes. Returns 1 if it
+ * was found, 0 if not or an error code if the message is incomplete.
+ */
+PN_EXTERN ssize_t pni_message_peek_value(const char *bytes, size_t size, pni_section_t section, const char *key,
+                                         pn_bytes_t *value);
+
 /** @endcond */
 
 #ifdef __cplusplus
@@ -21,6 +21,8 @@
 
 #include "platform/platform_fmt.h"
 
+#include "consumers.h"
+#include "data.h"
 #include "max_align.h"
 #include "message-internal.h"
 #include "protocol.h"
@@ -59,6 +61,17 @@ struct pn_message_t {
 
   pn_error_t *error;
 
+  // Copy of the bytes the message was decoded from and the extent of each
+  // section within it, or within the caller's bytes if they were borrowed.
+  // Sections still to be parsed are flagged in lazy, sections that may have
+  // been changed since in dirty; the others are encoded by copying their
+  // original bytes.
+  pn_rwbytes_t encoded;
+  pn_bytes_t borrowed;
+  pn_bytes_t sections[PNI_SECTION_COUNT];
+  uint8_t lazy;
+  uint8_t dirty;
+
   pn_sequence_t group_sequence;
   pn_millis_t ttl;
   uint32_t delivery_count;
@@ -89,11 +102,181 @@ void pn_message_finalize(void *obj)
   pn_data_free(msg->properties);
   pn_data_free(msg->body);
   pn_error_free(msg->error);
+  free(msg->encoded.start);
+}
+
+static pn_bytes_t pn_string_get_bytes(pn_string_t *string)
+{
+  return pn_bytes(pn_string_size(string), (char *) pn_string_get(string));
+}
+
+static int pn_string_set_bytes(pn_string_t *string, pn_bytes_t bytes)
+{
+  return pn_string_setn(string, bytes.start, bytes.size);
+}
+
+/* Decode the section at the start of bytes into msg, returning the number of
+ * bytes it used or an error code. */
+static ssize_t pni_message_decode_section(pn_message_t *msg, const char *bytes, size_t size)
+{
+  pn_data_clear(msg->data);
+  ssize_t used = pn_data_decode(msg->data, bytes, size);
+  if (used < 0)
+    return pn_error_format(msg->error, used, "data error: %s",
+                           pn_error_text(pn_data_error(msg->data)));
+  bool scanned;
+  uint64_t desc;
+  int err = pn_data_scan(msg->data, "D?L.", &scanned, &desc);
+  if (err) return pn_error_format(msg->error, err, "data error: %s",
+                                  pn_error_text(pn_data_error(msg->data)));
+  if (!scanned) {
+    desc = 0;
+  }
+
+  pn_data_rewind(msg->data);
+  pn_data_next(msg->data);
+  pn_data_enter(msg->data);
+  pn_data_next(msg->data);
+
+  switch (desc) {
+  case HEADER: {
+    bool priority_q;
+    uint8_t priority;
+    err = pn_data_scan(msg->data, "D.[o?BIoI]",
+                       &msg->durable,
+                       &priority_q, &priority,
+                       &msg->ttl,
+                       &msg->first_acquirer,
+                       &msg->delivery_count);
+    if (err) return pn_error_format(msg->error, err, "data error: %s",
+                                    pn_error_text(pn_data_error(msg->data)));
+    msg->priority = priority_q ? priority : HEADER_PRIORITY_DEFAULT;
+    break;
+  }
+  case PROPERTIES:
+    {
+      pn_bytes_t user_id, address, subject, reply_to, ctype, cencoding,
+        group_id, reply_to_group_id;
+      pn_data_clear(msg->id);
+      pn_data_clear(msg->correlation_id);
+      err = pn_data_scan(msg->data, "D.[CzSSSCssttSIS]", msg->id,
+                         &user_id, &address, &subject, &reply_to,
+                         msg->correlation_id, &ctype, &cencoding,
+                         &msg->expiry_time, &msg->creation_time, &group_id,
+                         &msg->group_sequence, &reply_to_group_id);
+      if (err) return pn_error_format(msg->error, err, "data error: %s",
+                                      pn_error_text(pn_data_error(msg->data)));
+      err = pn_string_set_bytes(msg->user_id, user_id);
+      if (err) return pn_error_format(msg->error, err, "error setting user_id");
+      err = pn_string_setn(msg->address, address.start, address.size);
+      if (err) return pn_error_format(msg->error, err, "error setting address");
+      err = pn_string_setn(msg->subject, subject.start, subject.size);
+      if (err) return pn_error_format(msg->error, err, "error setting subject");
+      err = pn_string_setn(msg->reply_to, reply_to.start, reply_to.size);
+      if (err) return pn_error_format(msg->error, err, "error setting reply_to");
+      err = pn_string_setn(msg->content_type, ctype.start, ctype.size);
+      if (err) return pn_error_format(msg->error, err, "error setting content_type");
+      err = pn_string_setn(msg->content_encoding, cencoding.start,
+                           cencoding.size);
+      if (err) return pn_error_format(msg->error, err, "error setting content_encoding");
+      err = pn_string_setn(msg->group_id, group_id.start, group_id.size);
+      if (err) return pn_error_format(msg->error, err, "error setting group_id");
+      err = pn_string_setn(msg->reply_to_group_id, reply_to_group_id.start,
+                           reply_to_group_id.size);
+      if (err) return pn_error_format(msg->error, err, "error setting reply_to_group_id");
+    }
+    break;
+  case DELIVERY_ANNOTATIONS:
+    pn_data_narrow(msg->data);
+    err = pn_data_copy(msg->instructions, msg->data);
+    if (err) return err;
+    break;
+  case MESSAGE_ANNOTATIONS:
+    pn_data_narrow(msg->data);
+    err = pn_data_copy(msg->annotations, msg->data);
+    if (err) return err;
+    break;
+  case APPLICATION_PROPERTIES:
+    pn_data_narrow(msg->data);
+    err = pn_data_copy(msg->properties, msg->data);
+    if (err) return err;
+    break;
+  case DATA:
+  case AMQP_SEQUENCE:
+    msg->inferred = true;
+    pn_data_narrow(msg->data);
+    err = pn_data_copy(msg->body, msg->data);
+    if (err) return err;
+    break;
+  case AMQP_VALUE:
+    msg->inferred = false;
+    pn_data_narrow(msg->data);
+    err = pn_data_copy(msg->body, msg->data);
+    if (err) return err;
+    break;
+  case FOOTER:
+    break;
+  default:
+    err = pn_data_copy(msg->body, msg->data);
+    if (err) return err;
+    break;
+  }
+  return used;
+}
+
+/* Parse a section that hasn't been yet, errors are recorded in the message's
+ * error and returned.  A malformed section stays unparsed, so every later use
+ * reports it again. */
+static int pni_message_parse(pn_message_t *msg, pni_section_t section)
+{
+  uint8_t flag = 1 << section;
+  if (!(msg->lazy & flag)) return 0;
+  msg->lazy &= ~flag;
+  // The inferred flag is known from the layout and may have been changed since
+  bool inferred = msg->inferred;
+  ssize_t used = pni_message_decode_section(msg, msg->sections[section].start, msg->sections[section].size);
+  msg->inferred = inferred;
+  pn_data_clear(msg->data);
+  if (used < 0) {
+    msg->lazy |= flag;
+    return (int) used;
+  }
+  return 0;
+}
+
+int pni_message_load(pn_message_t *msg, pni_section_t section)
+{
+  return pni_message_parse(msg, section);
+}
+
+/* Load a section that is about to be changed, or may be through a pn_data_t.
+ * A section that fails to load is left as it was, not marked as changed: the
+ * error is returned and recorded in the message's error. */
+static int pni_message_touch(pn_message_t *msg, pni_section_t section)
+{
+  int err = pni_message_parse(msg, section);
+  if (err) return err;
+  msg->dirty |= 1 << section;
+  return 0;
+}
+
+/* True if the section can be encoded by copying its original bytes */
+static bool pni_message_reuse(pn_message_t *msg, pni_section_t section)
+{
+  return msg->sections[section].size && !(msg->dirty & (1 << section));
+}
+
+static void pni_message_load_all(pn_message_t *msg)
+{
+  for (int i = 0; msg->lazy && i < PNI_SECTION_COUNT; i++) {
+    pni_message_load(msg, (pni_section_t) i);
+  }
 }
 
 int pn_message_inspect(void *obj, pn_string_t *dst)
 {
   pn_message_t *msg = (pn_message_t *) obj;
+  pni_message_load_all(msg);
   int err = pn_string_addf(dst, "Message{");
   if (err) return err;
 
@@ -336,6 +519,11 @@ static pn_message_t *pni_message_new(size_t size)
   msg->body = pn_data(16);
 
   msg->error = pn_error();
+  msg->encoded = pn_rwbytes(0, NULL);
+  msg->borrowed = pn_bytes_null;
+  memset(msg->sections, 0, sizeof(msg->sections));
+  msg->lazy = 0;
+  msg->dirty = 0;
   return msg;
 }
 
@@ -362,7 +550,8 @@ void pn_message_free(pn_message_t *msg)
   pn_free(msg);
 }
 
-void pn_message_clear(pn_message_t *msg)
+/* Clear the fields, keeping the copy of the last encoded message for reuse */
+static void pni_message_reset(pn_message_t *msg)
 {
   msg->durable = false;
   msg->priority = HEADER_PRIORITY_DEFAULT;
@@ -388,6 +577,17 @@ void pn_message_clear(pn_message_t *msg)
   pn_data_clear(msg->annotations);
   pn_data_clear(msg->properties);
   pn_data_clear(msg->body);
+  msg->borrowed = pn_bytes_null;
+  memset(msg->sections, 0, sizeof(msg->sections));
+  msg->lazy = 0;
+  msg->dirty = 0;
+}
+
+void pn_message_clear(pn_message_t *msg)
+{
+  pni_message_reset(msg);
+  free(msg->encoded.start);
+  msg->encoded = pn_rwbytes(0, NULL);
 }
 
 int pn_message_errno(pn_message_t *msg)
@@ -411,6 +611,11 @@ bool pn_message_is_inferred(pn_message_t *msg)
 int pn_message_set_inferred(pn_message_t *msg, bool inferred)
 {
   assert(msg);
+  // The body section's descriptor depends on inferred
+  if (inferred != msg->inferred) {
+    int err = pni_message_touch(msg, PNI_SECTION_BODY);
+    if (err) return err;
+  }
   msg->inferred = inferred;
   return 0;
 }
@@ -418,11 +623,14 @@ int pn_message_set_inferred(pn_message_t *msg, bool inferred)
 bool pn_message_is_durable(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_HEADER);
   return msg->durable;
 }
 int pn_message_set_durable(pn_message_t *msg, bool durable)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_HEADER);
+  if (err) return err;
   msg->durable = durable;
   return 0;
 }
@@ -431,11 +639,14 @@ int pn_message_set_durable(pn_message_t *msg, bool durable)
 uint8_t pn_message_get_priority(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_HEADER);
   return msg->priority;
 }
 int pn_message_set_priority(pn_message_t *msg, uint8_t priority)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_HEADER);
+  if (err) return err;
   msg->priority = priority;
   return 0;
 }
@@ -443,11 +654,14 @@ int pn_message_set_priority(pn_message_t *msg, uint8_t priority)
 pn_millis_t pn_message_get_ttl(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_HEADER);
   return msg->ttl;
 }
 int pn_message_set_ttl(pn_message_t *msg, pn_millis_t ttl)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_HEADER);
+  if (err) return err;
   msg->ttl = ttl;
   return 0;
 }
@@ -455,11 +669,14 @@ int pn_message_set_ttl(pn_message_t *msg, pn_millis_t ttl)
 bool pn_message_is_first_acquirer(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_HEADER);
   return msg->first_acquirer;
 }
 int pn_message_set_first_acquirer(pn_message_t *msg, bool first)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_HEADER);
+  if (err) return err;
   msg->first_acquirer = first;
   return 0;
 }
@@ -467,11 +684,14 @@ int pn_message_set_first_acquirer(pn_message_t *msg, bool first)
 uint32_t pn_message_get_delivery_count(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_HEADER);
   return msg->delivery_count;
 }
 int pn_message_set_delivery_count(pn_message_t *msg, uint32_t count)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_HEADER);
+  if (err) return err;
   msg->delivery_count = count;
   return 0;
 }
@@ -479,87 +699,97 @@ int pn_message_set_delivery_count(pn_message_t *msg, uint32_t count)
 pn_data_t *pn_message_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_PROPERTIES);
   return msg->id;
 }
 pn_atom_t pn_message_get_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return pn_data_get_atom(msg->id);
 }
 int pn_message_set_id(pn_message_t *msg, pn_atom_t id)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   pn_data_rewind(msg->id);
   return pn_data_put_atom(msg->id, id);
 }
 
-static pn_bytes_t pn_string_get_bytes(pn_string_t *string)
-{
-  return pn_bytes(pn_string_size(string), (char *) pn_string_get(string));
-}
-
-static int pn_string_set_bytes(pn_string_t *string, pn_bytes_t bytes)
-{
-  return pn_string_setn(string, bytes.start, bytes.size);
-}
-
 pn_bytes_t pn_message_get_user_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return pn_string_get_bytes(msg->user_id);
 }
 int pn_message_set_user_id(pn_message_t *msg, pn_bytes_t user_id)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   return pn_string_set_bytes(msg->user_id, user_id);
 }
 
 const char *pn_message_get_address(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return pn_string_get(msg->address);
 }
 int pn_message_set_address(pn_message_t *msg, const char *address)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   return pn_string_set(msg->address, address);
 }
 
 const char *pn_message_get_subject(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return pn_string_get(msg->subject);
 }
 int pn_message_set_subject(pn_message_t *msg, const char *subject)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   return pn_string_set(msg->subject, subject);
 }
 
 const char *pn_message_get_reply_to(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return pn_string_get(msg->reply_to);
 }
 int pn_message_set_reply_to(pn_message_t *msg, const char *reply_to)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   return pn_string_set(msg->reply_to, reply_to);
 }
 
 pn_data_t *pn_message_correlation_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_PROPERTIES);
   return msg->correlation_id;
 }
 pn_atom_t pn_message_get_correlation_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return pn_data_get_atom(msg->correlation_id);
 }
 int pn_message_set_correlation_id(pn_message_t *msg, pn_atom_t atom)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   pn_data_rewind(msg->correlation_id);
   return pn_data_put_atom(msg->correlation_id, atom);
 }
@@ -567,33 +797,42 @@ int pn_message_set_correlation_id(pn_message_t *msg, pn_atom_t atom)
 const char *pn_message_get_content_type(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return pn_string_get(msg->content_type);
 }
 int pn_message_set_content_type(pn_message_t *msg, const char *type)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   return pn_string_set(msg->content_type, type);
 }
 
 const char *pn_message_get_content_encoding(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return pn_string_get(msg->content_encoding);
 }
 int pn_message_set_content_encoding(pn_message_t *msg, const char *encoding)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   return pn_string_set(msg->content_encoding, encoding);
 }
 
 pn_timestamp_t pn_message_get_expiry_time(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return msg->expiry_time;
 }
 int pn_message_set_expiry_time(pn_message_t *msg, pn_timestamp_t time)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   msg->expiry_time = time;
   return 0;
 }
@@ -601,11 +840,14 @@ int pn_message_set_expiry_time(pn_message_t *msg, pn_timestamp_t time)
 pn_timestamp_t pn_message_get_creation_time(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return msg->creation_time;
 }
 int pn_message_set_creation_time(pn_message_t *msg, pn_timestamp_t time)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   msg->creation_time = time;
   return 0;
 }
@@ -613,22 +855,28 @@ int pn_message_set_creation_time(pn_message_t *msg, pn_timestamp_t time)
 const char *pn_message_get_group_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return pn_string_get(msg->group_id);
 }
 int pn_message_set_group_id(pn_message_t *msg, const char *group_id)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   return pn_string_set(msg->group_id, group_id);
 }
 
 pn_sequence_t pn_message_get_group_sequence(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return msg->group_sequence;
 }
 int pn_message_set_group_sequence(pn_message_t *msg, pn_sequence_t n)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   msg->group_sequence = n;
   return 0;
 }
@@ -636,291 +884,441 @@ int pn_message_set_group_sequence(pn_message_t *msg, pn_sequence_t n)
 const char *pn_message_get_reply_to_group_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_PROPERTIES);
   return pn_string_get(msg->reply_to_group_id);
 }
 int pn_message_set_reply_to_group_id(pn_message_t *msg, const char *reply_to_group_id)
 {
   assert(msg);
+  int err = pni_message_touch(msg, PNI_SECTION_PROPERTIES);
+  if (err) return err;
   return pn_string_set(msg->reply_to_group_id, reply_to_group_id);
 }
 
-int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
+/* Find the sections of an encoded message, the last of each kind wins as it
+ * does when the sections are parsed in order. *inferred is set as parsing the
+ * body sections would set it and *body_code to the descriptor of the body.
+ * Returns an error if the sections are incomplete. */
+static int pni_message_sections(pn_bytes_t bytes, pn_bytes_t *sections, uint64_t *body_code, bool *inferred)
 {
-  assert(msg && bytes && size);
-
-  pn_message_clear(msg);
-
-  while (size) {
-    pn_data_clear(msg->data);
-    ssize_t used = pn_data_decode(msg->data, bytes, size);
-    if (used < 0)
-        return pn_error_format(msg->error, used, "data error: %s",
-                               pn_error_text(pn_data_error(msg->data)));
-    size -= used;
-    bytes += used;
-    bool scanned;
+  memset(sections, 0, PNI_SECTION_COUNT * sizeof(pn_bytes_t));
+  *body_code = 0;
+  pni_consumer_t consumer = pni_consumer(bytes);
+  while (pni_consumer_remaining(&consumer)) {
+    size_t start = consumer.position;
+    bool described;
     uint64_t desc;
-    int err = pn_data_scan(msg->data, "D?L.", &scanned, &desc);
-    if (err) return pn_error_format(msg->error, err, "data error: %s",
-                                    pn_error_text(pn_data_error(msg->data)));
-    if (!scanned) {
-      desc = 0;
-    }
-
-    pn_data_rewind(msg->data);
-    pn_data_next(msg->data);
-    pn_data_enter(msg->data);
-    pn_data_next(msg->data);
+    if (!pni_consume_descriptor(&consumer, &described, &desc)) return PN_UNDERFLOW;
 
+    pni_section_t section;
     switch (desc) {
-    case HEADER: {
-      bool priority_q;
-      uint8_t priority;
-      err = pn_data_scan(msg->data, "D.[o?BIoI]",
-                         &msg->durable,
-                         &priority_q, &priority,
-                         &msg->ttl,
-                         &msg->first_acquirer,
-                         &msg->delivery_count);
-      if (err) return pn_error_format(msg->error, err, "data error: %s",
-                                      pn_error_text(pn_data_error(msg->data)));
-      msg->priority = priority_q ? priority : HEADER_PRIORITY_DEFAULT;
-      break;
-    }
-    case PROPERTIES:
-      {
-        pn_bytes_t user_id, address, subject, reply_to, ctype, cencoding,
-          group_id, reply_to_group_id;
-        pn_data_clear(msg->id);
-        pn_data_clear(msg->correlation_id);
-        err = pn_data_scan(msg->data, "D.[CzSSSCssttSIS]", msg->id,
-                           &user_id, &address, &subject, &reply_to,
-                           msg->correlation_id, &ctype, &cencoding,
-                           &msg->expiry_time, &msg->creation_time, &group_id,
-                           &msg->group_sequence, &reply_to_group_id);
-        if (err) return pn_error_format(msg->error, err, "data error: %s",
-                                        pn_error_text(pn_data_error(msg->data)));
-        err = pn_string_set_bytes(msg->user_id, user_id);
-        if (err) return pn_error_format(msg->error, err, "error setting user_id");
-        err = pn_string_setn(msg->address, address.start, address.size);
-        if (err) return pn_error_format(msg->error, err, "error setting address");
-        err = pn_string_setn(msg->subject, subject.start, subject.size);
-        if (err) return pn_error_format(msg->error, err, "error setting subject");
-        err = pn_string_setn(msg->reply_to, reply_to.start, reply_to.size);
-        if (err) return pn_error_format(msg->error, err, "error setting reply_to");
-        err = pn_string_setn(msg->content_type, ctype.start, ctype.size);
-        if (err) return pn_error_format(msg->error, err, "error setting content_type");
-        err = pn_string_setn(msg->content_encoding, cencoding.start,
-                             cencoding.size);
-        if (err) return pn_error_format(msg->error, err, "error setting content_encoding");
-        err = pn_string_setn(msg->group_id, group_id.start, group_id.size);
-        if (err) return pn_error_format(msg->error, err, "error setting group_id");
-        err = pn_string_setn(msg->reply_to_group_id, reply_to_group_id.start,
-                             reply_to_group_id.size);
-        if (err) return pn_error_format(msg->error, err, "error setting reply_to_group_id");
-      }
-      break;
-    case DELIVERY_ANNOTATIONS:
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->instructions, msg->data);
-      if (err) return err;
-      break;
-    case MESSAGE_ANNOTATIONS:
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->annotations, msg->data);
-      if (err) return err;
-      break;
-    case APPLICATION_PROPERTIES:
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->properties, msg->data);
-      if (err) return err;
-      break;
+    case HEADER: section = PNI_SECTION_HEADER; break;
+    case DELIVERY_ANNOTATIONS: section = PNI_SECTION_DELIVERY_ANNOTATIONS; break;
+    case MESSAGE_ANNOTATIONS: section = PNI_SECTION_MESSAGE_ANNOTATIONS; break;
+    case PROPERTIES: section = PNI_SECTION_PROPERTIES; break;
+    case APPLICATION_PROPERTIES: section = PNI_SECTION_APPLICATION_PROPERTIES; break;
     case DATA:
     case AMQP_SEQUENCE:
-      msg->inferred = true;
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->body, msg->data);
-      if (err) return err;
+      *inferred = true;
+      section = PNI_SECTION_BODY;
       break;
     case AMQP_VALUE:
-      msg->inferred = false;
-      pn_data_narrow(msg->data);
-      err = pn_data_copy(msg->body, msg->data);
-      if (err) return err;
+      *inferred = false;
+      section = PNI_SECTION_BODY;
       break;
     case FOOTER:
-      break;
+      continue;
     default:
-      err = pn_data_copy(msg->body, msg->data);
-      if (err) return err;
+      section = PNI_SECTION_BODY;
       break;
     }
+    if (section == PNI_SECTION_BODY) *body_code = desc;
+    sections[section] = pn_bytes(consumer.position - start, bytes.start + start);
   }
+  return 0;
+}
 
-  pn_data_clear(msg->data);
+/* The copy of a decoded message is replaced rather than reused for one this
+ * many times smaller, so one large message doesn't pin its size for good. */
+#define PNI_MESSAGE_ENCODED_SLACK 4
+
+/* Copy bytes into msg->encoded */
+static int pni_message_copy_encoded(pn_message_t *msg, const char *bytes, size_t size)
+{
+  // Reuse the copy of the last message decoded, unless it is far too small or large
+  if (msg->encoded.size < size || msg->encoded.size / PNI_MESSAGE_ENCODED_SLACK > size) {
+    free(msg->encoded.start);
+    msg->encoded = pn_rwbytes(0, NULL);
+    char *start = (char *) malloc(size);
+    if (!start) return pn_error_format(msg->error, PN_OUT_OF_MEMORY, "out of memory");
+    msg->encoded = pn_rwbytes(size, start);
+  }
+  memcpy(msg->encoded.start, bytes, size);
   return 0;
 }
 
-int pn_message_encode(pn_message_t *msg, char *bytes, size_t *size)
+/* Find the sections of the encoded message, none of which are parsed yet.
+ * Unless borrowed, the bytes are copied into msg first. */
+static int pni_message_split(pn_message_t *msg, const char *bytes, size_t size, bool borrowed)
 {
-  if (!msg || !bytes || !size || !*size) return PN_ARG_ERR;
-  pn_data_clear(msg->data);
-  pn_message_data(msg, msg->data);
-  size_t remaining = *size;
-  ssize_t encoded = pn_data_encode(msg->data, bytes, remaining);
-  if (encoded < 0) {
-    if (encoded == PN_OVERFLOW) {
-      return encoded;
-    } else {
-      return pn_error_format(msg->error, encoded, "data error: %s",
-                             pn_error_text(pn_data_error(msg->data)));
+  pni_message_reset(msg);
+
+  if (borrowed) {
+    msg->borrowed = pn_bytes(size, bytes);
+  } else {
+    int err = pni_message_copy_encoded(msg, bytes, size);
+    if (err) return err;
+    bytes = msg->encoded.start;
+  }
+
+  uint64_t body_code;
+  int err = pni_message_sections(pn_bytes(size, bytes), msg->sections, &body_code, &msg->inferred);
+  if (err) return pn_error_format(msg->error, err, "data error: incomplete section");
+  for (int i = 0; i < PNI_SECTION_COUNT; i++) {
+    if (msg->sections[i].size) msg->lazy |= 1 << i;
+  }
+  // A body that isn't a body section is re-encoded as an amqp-value
+  if (msg->sections[PNI_SECTION_BODY].size &&
+      body_code != DATA && body_code != AMQP_SEQUENCE && body_code != AMQP_VALUE) {
+    msg->dirty |= 1 << PNI_SECTION_BODY;
+  }
+  return 0;
+}
+
+int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
+{
+  assert(msg && bytes && size);
+
+  int err = pni_message_split(msg, bytes, size, false);
+  if (err) return err;
+  for (int i = 0; i < PNI_SECTION_COUNT; i++) {
+    err = pni_message_parse(msg, (pni_section_t) i);
+    if (err) return err;
+  }
+  return 0;
+}
+
+int pn_message_decode_lazy(pn_message_t *msg, const char *bytes, size_t size)
+{
+  assert(msg && bytes && size);
+  return pni_message_split(msg, bytes, size, false);
+}
+
+int pni_message_decode_borrowed(pn_message_t *msg, const char *bytes, size_t size)
+{
+  assert(msg && bytes && size);
+  return pni_message_split(msg, bytes, size, true);
+}
+
+int pni_message_own(pn_message_t *msg)
+{
+  assert(msg);
+  pn_bytes_t borrowed = msg->borrowed;
+  if (!borrowed.start) return 0;
+  int err = pni_message_copy_encoded(msg, borrowed.start, borrowed.size);
+  if (err) return err;
+  for (int i = 0; i < PNI_SECTION_COUNT; i++) {
+    if (msg->sections[i].size) {
+      msg->sections[i].start = msg->encoded.start + (msg->sections[i].start - borrowed.start);
     }
   }
-  bytes += encoded;
-  remaining -= encoded;
-  *size -= remaining;
-  pn_data_clear(msg->data);
+  msg->borrowed = pn_bytes_null;
   return 0;
 }
 
-int pn_message_data(pn_message_t *msg, pn_data_t *data)
+int pn_message_peek(const char *bytes, size_t size, pn_message_peek_t *fields)
 {
-  pn_data_clear(data);
-  int err = pn_data_fill(data, "DL[?o?B?I?o?I]", HEADER,
-                         msg->durable, msg->durable,
-                         msg->priority!=HEADER_PRIORITY_DEFAULT, msg->priority,
-                         (bool)msg->ttl, msg->ttl,
-                         msg->first_acquirer, msg->first_acquirer,
-                         (bool)msg->delivery_count, msg->delivery_count);
-  if (err)
-    return pn_error_format(msg->error, err, "data error: %s",
-                           pn_error_text(pn_data_error(data)));
+  assert(bytes && fields);
+  pn_bytes_t sections[PNI_SECTION_COUNT];
+  uint64_t body_code;
+  bool inferred = false;
+  int err = pni_message_sections(pn_bytes(size, bytes), sections, &body_code, &inferred);
+  if (err) return err;
 
-  if (pn_data_size(msg->instructions)) {
-    pn_data_put_described(data);
-    pn_data_enter(data);
-    pn_data_put_ulong(data, DELIVERY_ANNOTATIONS);
-    pn_data_rewind(msg->instructions);
-    err = pn_data_append(data, msg->instructions);
-    if (err)
-      return pn_error_format(msg->error, err, "data error: %s",
-                             pn_error_text(pn_data_error(data)));
-    pn_data_exit(data);
+  // header: [durable, priority, ttl, ...]
+  pni_consumer_t consumer = pni_consumer(sections[PNI_SECTION_HEADER]);
+  pni_consumer_t list;
+  pn_atom_t atom;
+  pni_consume_described_list(&consumer, &list);
+  pni_consume_bool(&list, &fields->durable);
+  pni_consume_atom(&list, &atom);
+  fields->priority = atom.type == PN_UBYTE ? atom.u.as_ubyte : HEADER_PRIORITY_DEFAULT;
+  pni_consume_uint(&list, &fields->ttl);
+
+  // properties: [message-id, user-id, to, subject, ...]
+  consumer = pni_consumer(sections[PNI_SECTION_PROPERTIES]);
+  pni_consume_described_list(&consumer, &list);
+  pni_consume_anything(&list);
+  pni_consume_anything(&list);
+  pni_consume_atom(&list, &atom);
+  fields->address = atom.type == PN_STRING ? atom.u.as_bytes : pn_bytes_null;
+  pni_consume_atom(&list, &atom);
+  fields->subject = atom.type == PN_STRING ? atom.u.as_bytes : pn_bytes_null;
+  return 0;
+}
+
+ssize_t pni_message_peek_value(const char *bytes, size_t size, pni_section_t section, const char *key,
+                               pn_bytes_t *value)
+{
+  *value = pn_bytes_null;
+  pn_bytes_t sections[PNI_SECTION_COUNT];
+  uint64_t body_code;
+  bool inferred = false;
+  int err = pni_message_sections(pn_bytes(size, bytes), sections, &body_code, &inferred);
+  if (err) return err;
+
+  // Keys are symbols for annotations and strings for properties, either is
+  // matched here
+  size_t key_size = strlen(key);
+  pni_consumer_t consumer = pni_consumer(sections[section]);
+  pni_consumer_t map;
+  pni_consume_described_map(&consumer, &map);
+  while (pni_consumer_remaining(&map)) {
+    pn_atom_t name;
+    if (!pni_consume_atom(&map, &name)) break;
+    size_t start = map.position;
+    if (!pni_consume_anything(&map)) break;
+    if ((name.type == PN_SYMBOL || name.type == PN_STRING) &&
+        name.u.as_bytes.size == key_size && !memcmp(name.u.as_bytes.start, key, key_size)) {
+      *value = pn_bytes(map.position - start, (const char *) map.output_start + start);
+      return 1;
+    }
   }
+  return 0;
+}
 
-  if (pn_data_size(msg->annotations)) {
-    pn_data_put_described(data);
-    pn_data_enter(data);
-    pn_data_put_ulong(data, MESSAGE_ANNOTATIONS);
-    pn_data_rewind(msg->annotations);
-    err = pn_data_append(data, msg->annotations);
-    if (err)
-      return pn_error_format(msg->error, err, "data error: %s",
-                             pn_error_text(pn_data_error(data)));
-    pn_data_exit(data);
-  }
-
-  err = pn_data_fill(data, "DL[CzSSSCss?t?tS?IS]", PROPERTIES,
-                     msg->id,
-                     pn_string_size(msg->user_id), pn_string_get(msg->user_id),
-                     pn_string_get(msg->address),
-                     pn_string_get(msg->subject),
-                     pn_string_get(msg->reply_to),
-                     msg->correlation_id,
-                     pn_string_get(msg->content_type),
-                     pn_string_get(msg->content_encoding),
-                     (bool)msg->expiry_time, msg->expiry_time,
-                     (bool)msg->creation_time, msg->creation_time,
-                     pn_string_get(msg->group_id),
-                     /*
-                      * As a heuristic, null out group_sequence if there is no group_id and
-                      * group_sequence is 0. In this case it is extremely unlikely we want
-                      * group semantics
-                      */
-                     (bool)pn_string_get(msg->group_id) || (bool)msg->group_sequence , msg->group_sequence,
-                     pn_string_get(msg->reply_to_group_id));
+static int pni_message_peek_atom(const char *bytes, size_t size, pni_section_t section, const char *key,
+                                 pn_atom_t *value)
+{
+  assert(bytes && key && value);
+  pn_bytes_t encoded;
+  value->type = PN_INVALID;
+  ssize_t found = pni_message_peek_value(bytes, size, section, key, &encoded);
+  if (found <= 0) return found;
+  pni_consumer_t consumer = pni_consumer(encoded);
+  pni_consume_atom(&consumer, value);
+  return 0;
+}
+
+int pn_message_peek_annotation(const char *bytes, size_t size, const char *key, pn_atom_t *value)
+{
+  return pni_message_peek_atom(bytes, size, PNI_SECTION_MESSAGE_ANNOTATIONS, key, value);
+}
+
+int pn_message_peek_property(const char *bytes, size_t size, const char *key, pn_atom_t *value)
+{
+  return pni_message_peek_atom(bytes, size, PNI_SECTION_APPLICATION_PROPERTIES, key, value);
+}
+
+/* Append a section of msg to data */
+static int pni_message_fill(pn_message_t *msg, pn_data_t *data, pni_section_t section)
+{
+  int err = 0;
+  switch (section) {
+  case PNI_SECTION_HEADER:
+    err = pn_data_fill(data, "DL[?o?B?I?o?I]", HEADER,
+                       msg->durable, msg->durable,
+                       msg->priority!=HEADER_PRIORITY_DEFAULT, msg->priority,
+                       (bool)msg->ttl, msg->ttl,
+                       msg->first_acquirer, msg->first_acquirer,
+                       (bool)msg->delivery_count, msg->delivery_count);
+    break;
+
+  case PNI_SECTION_DELIVERY_ANNOTATIONS:
+    if (pn_data_size(msg->instructions)) {
+      pn_data_put_described(data);
+      pn_data_enter(data);
+      pn_data_put_ulong(data, DELIVERY_ANNOTATIONS);
+      pn_data_rewind(msg->instructions);
+      err = pn_data_append(data, msg->instructions);
+      pn_data_exit(data);
+    }
+    break;
+
+  case PNI_SECTION_MESSAGE_ANNOTATIONS:
+    if (pn_data_size(msg->annotations)) {
+      pn_data_put_described(data);
+      pn_data_enter(data);
+      pn_data_put_ulong(data, MESSAGE_ANNOTATIONS);
+      pn_data_rewind(msg->annotations);
+      err = pn_data_append(data, msg->annotations);
+      pn_data_exit(data);
+    }
+    break;
+
+  case PNI_SECTION_PROPERTIES:
+    err = pn_data_fill(data, "DL[CzSSSCss?t?tS?IS]", PROPERTIES,
+                       msg->id,
+                       pn_string_size(msg->user_id), pn_string_get(msg->user_id),
+                       pn_string_get(msg->address),
+                       pn_string_get(msg->subject),
+                       pn_string_get(msg->reply_to),
+                       msg->correlation_id,
+                       pn_string_get(msg->content_type),
+                       pn_string_get(msg->content_encoding),
+                       (bool)msg->expiry_time, msg->expiry_time,
+                       (bool)msg->creation_time, msg->creation_time,
+                       pn_string_get(msg->group_id),
+                       /*
+                        * As a heuristic, null out group_sequence if there is no group_id and
+                        * group_sequence is 0. In this case it is extremely unlikely we want
+                        * group semantics
+                        */
+                       (bool)pn_string_get(msg->group_id) || (bool)msg->group_sequence , msg->group_sequence,
+                       pn_string_get(msg->reply_to_group_id));
+    break;
+
+  case PNI_SECTION_APPLICATION_PROPERTIES:
+    if (pn_data_size(msg->properties)) {
+      pn_data_put_described(data);
+      pn_data_enter(data);
+      pn_data_put_ulong(data, APPLICATION_PROPERTIES);
+      pn_data_rewind(msg->properties);
+      err = pn_data_append(data, msg->properties);
+      pn_data_exit(data);
+    }
+    break;
+
+  case PNI_SECTION_BODY:
+    if (pn_data_size(msg->body)) {
+      pn_data_rewind(msg->body);
+      pn_data_next(msg->body);
+      pn_type_t body_type = pn_data_type(msg->body);
+      pn_data_rewind(msg->body);
+
+      pn_data_put_described(data);
+      pn_data_enter(data);
+      if (msg->inferred) {
+        switch (body_type) {
+        case PN_BINARY:
+          pn_data_put_ulong(data, DATA);
+          break;
+        case PN_LIST:
+          pn_data_put_ulong(data, AMQP_SEQUENCE);
+          break;
+        default:
+          pn_data_put_ulong(data, AMQP_VALUE);
+          break;
+        }
+      } else {
+        pn_data_put_ulong(data, AMQP_VALUE);
+      }
+      pn_data_append(data, msg->body);
+      pn_data_exit(data);
+    }
+    break;
+
+  default:
+    break;
+  }
   if (err)
     return pn_error_format(msg->error, err, "data error: %s",
                            pn_error_text(pn_data_error(data)));
+  return 0;
+}
 
-  if (pn_data_size(msg->properties)) {
-    pn_data_put_described(data);
-    pn_data_enter(data);
-    pn_data_put_ulong(data, APPLICATION_PROPERTIES);
-    pn_data_rewind(msg->properties);
-    err = pn_data_append(data, msg->properties);
-    if (err)
-      return pn_error_format(msg->error, err, "data error: %s",
-                             pn_error_text(pn_data_error(data)));
-    pn_data_exit(data);
+int pn_message_data(pn_message_t *msg, pn_data_t *data)
+{
+  // Loading uses msg->data, so do it before data is filled
+  pni_message_load_all(msg);
+  pn_data_clear(data);
+  for (int i = 0; i < PNI_SECTION_COUNT; i++) {
+    int err = pni_message_fill(msg, data, (pni_section_t) i);
+    if (err) return err;
   }
+  return 0;
+}
 
-  if (pn_data_size(msg->body)) {
-    pn_data_rewind(msg->body);
-    pn_data_next(msg->body);
-    pn_type_t body_type = pn_data_type(msg->body);
-    pn_data_rewind(msg->body);
-
-    pn_data_put_described(data);
-    pn_data_enter(data);
-    if (msg->inferred) {
-      switch (body_type) {
-      case PN_BINARY:
-        pn_data_put_ulong(data, DATA);
-        break;
-      case PN_LIST:
-        pn_data_put_ulong(data, AMQP_SEQUENCE);
-        break;
-      default:
-        pn_data_put_ulong(data, AMQP_VALUE);
-        break;
+/* Encode msg at the start of *buffer.  Sections that haven't changed since
+ * the message was decoded are copied from the bytes it was decoded from, the
+ * runs of sections in between are filled into msg->data and encoded.  If grow
+ * is set the buffer is grown with realloc() as needed, otherwise PN_OVERFLOW is
+ * returned if it is too small. */
+static ssize_t pni_message_encode(pn_message_t *msg, pn_rwbytes_t *buffer, bool grow)
+{
+  // Parsing uses msg->data, so parse what has to be encoded first
+  for (int i = 0; i < PNI_SECTION_COUNT; i++) {
+    if (!pni_message_reuse(msg, (pni_section_t) i)) pni_message_load(msg, (pni_section_t) i);
+  }
+
+  size_t position = 0;
+  int i = 0;
+  while (i < PNI_SECTION_COUNT) {
+    if (pni_message_reuse(msg, (pni_section_t) i)) {
+      pn_bytes_t section = msg->sections[i++];
+      if (buffer->size - position < section.size) {
+        if (!grow) return PN_OVERFLOW;
+        size_t size = buffer->size ? buffer->size : 256;
+        while (size - position < section.size) size *= 2;
+        char *start = (char *) realloc(buffer->start, size);
+        if (!start) return pn_error_format(msg->error, PN_OUT_OF_MEMORY, "out of memory");
+        *buffer = pn_rwbytes(size, start);
       }
-    } else {
-      pn_data_put_ulong(data, AMQP_VALUE);
+      memcpy(buffer->start + position, section.start, section.size);
+      position += section.size;
+      continue;
+    }
+
+    pn_data_clear(msg->data);
+    for (; i < PNI_SECTION_COUNT && !pni_message_reuse(msg, (pni_section_t) i); i++) {
+      int err = pni_message_fill(msg, msg->data, (pni_section_t) i);
+      if (err) return err;
     }
-    pn_data_append(data, msg->body);
+    ssize_t encoded = grow ?
+      pni_data_encode_at(msg->data, buffer, position) :
+      pn_data_encode(msg->data, buffer->start + position, buffer->size - position);
+    if (encoded < 0) {
+      if (encoded == PN_OVERFLOW) return encoded;
+      return pn_error_format(msg->error, encoded, "data error: %s",
+                             pn_error_text(pn_data_error(msg->data)));
+    }
+    position += encoded;
   }
+  pn_data_clear(msg->data);
+  return position;
+}
+
+int pn_message_encode(pn_message_t *msg, char *bytes, size_t *size)
+{
+  if (!msg || !bytes || !size || !*size) return PN_ARG_ERR;
+  pn_rwbytes_t buffer = pn_rwbytes(*size, bytes);
+  ssize_t encoded = pni_message_encode(msg, &buffer, false);
+  if (encoded < 0) return encoded;
+  *size = encoded;
   return 0;
 }
 
 pn_data_t *pn_message_instructions(pn_message_t *msg)
 {
-  return msg ? msg->instructions : NULL;
+  if (!msg) return NULL;
+  pni_message_touch(msg, PNI_SECTION_DELIVERY_ANNOTATIONS);
+  return msg->instructions;
 }
 
 pn_data_t *pn_message_annotations(pn_message_t *msg)
 {
-  return msg ? msg->annotations : NULL;
+  if (!msg) return NULL;
+  pni_message_touch(msg, PNI_SECTION_MESSAGE_ANNOTATIONS);
+  return msg->annotations;
 }
 
 pn_data_t *pn_message_properties(pn_message_t *msg)
 {
-  return msg ? msg->properties : NULL;
+  if (!msg) return NULL;
+  pni_message_touch(msg, PNI_SECTION_APPLICATION_PROPERTIES);
+  return msg->properties;
 }
 
 pn_data_t *pn_message_body(pn_message_t *msg)
 {
-  return msg ? msg->body : NULL;
+  if (!msg) return NULL;
+  pni_message_touch(msg, PNI_SECTION_BODY);
+  return msg->body;
 }
 
 ssize_t pn_message_encode2(pn_message_t *msg, pn_rwbytes_t *buffer) {
-  static const size_t initial_size = 256;
-  int err = 0;
-  size_t size = 0;
-
-  if (buffer->start == NULL) {
-    buffer->start = (char*)malloc(initial_size);
-    buffer->size = initial_size;
-  }
-  if (buffer->start == NULL) return PN_OUT_OF_MEMORY;
-  size = buffer->size;
-  while ((err = pn_message_encode(msg, buffer->start, &size)) == PN_OVERFLOW) {
-    buffer->size *= 2;
-    buffer->start = (char*)realloc(buffer->start, buffer->size);
-    if (buffer->start == NULL) return PN_OUT_OF_MEMORY;
-    size = buffer->size;
-  }
-  return err == 0 ? (ssize_t)size : err;
+  if (!msg || !buffer) return PN_ARG_ERR;
+  return pni_message_encode(msg, buffer, true);
 }
 
 ssize_t pn_message_send(pn_message_t *msg, pn_link_t *sender, pn_rwbytes_t *buffer) {
@@ -268,3 +268,9 @@ pn_list_t *pn_list(const pn_class_t *clazz, size_t capacity)
   return list;
 }
 
+size_t pni_list_memory(pn_list_t *list)
+{
+  if (!list) return 0;
+  return pni_object_memory(list, sizeof(pn_list_t)) +
+    pni_mem_size(list->elements, list->capacity * sizeof(void *));
+}
@@ -462,3 +462,10 @@ void *pn_hash_value(pn_hash_t *hash, pn_handle_t entry)
 {
   return pn_map_value(&hash->map, entry);
 }
+
+size_t pni_hash_memory(pn_hash_t *hash)
+{
+  if (!hash) return 0;
+  return pni_object_memory(hash, sizeof(pn_hash_t)) +
+    pni_mem_size(hash->map.entries, hash->map.capacity * sizeof(pni_entry_t));
+}
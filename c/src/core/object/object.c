@@ -313,3 +313,9 @@ static int pn_weakref_inspect(void *object, pn_string_t *dst) {
 }
 
 const pn_class_t PN_WEAKREF[] = {PN_METACLASS(pn_weakref)};
+
+size_t pni_object_memory(void *object, size_t size)
+{
+  if (!object) return 0;
+  return pni_mem_size(pni_head(object), sizeof(pni_head_t) + size);
+}
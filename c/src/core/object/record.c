@@ -154,3 +154,10 @@ void pn_record_clear(pn_record_t *record)
   record->size = 0;
   pn_record_def(record, PN_LEGCTX, PN_VOID);
 }
+
+size_t pni_record_memory(pn_record_t *record)
+{
+  if (!record) return 0;
+  return pni_object_memory(record, sizeof(pn_record_t)) +
+    pni_mem_size(record->fields, record->capacity * sizeof(pni_field_t));
+}
@@ -270,3 +270,10 @@ int pn_string_copy(pn_string_t *string, pn_string_t *src)
   assert(string);
   return pn_string_setn(string, pn_string_get(src), pn_string_size(src));
 }
+
+size_t pni_string_memory(pn_string_t *string)
+{
+  if (!string) return 0;
+  return pni_object_memory(string, sizeof(pn_string_t)) +
+    pni_mem_size(string->bytes, string->capacity);
+}
@@ -0,0 +1,182 @@
+#ifndef PROTON_PACKED_H
+#define PROTON_PACKED_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Packed arrays.
+ *
+ * An array of fixed width numeric elements can be held in a pn_data_t as a
+ * single node referring to the encoded elements, instead of a node per
+ * element.  The elements are kept exactly as they are encoded (big endian,
+ * in the canonical width for their type) so encoding and decoding them is a
+ * copy; only moving them to and from native values needs the bytes of each
+ * element swapped.
+ */
+
+#include "encodings.h"
+
+#include <proton/codec.h>
+#include <proton/types.h>
+
+#include <string.h>
+
+/* Width of an encoded element of type, or 0 if arrays of type can't be packed */
+static inline size_t pni_packed_width(pn_type_t type)
+{
+  switch (type) {
+  case PN_UBYTE:
+  case PN_BYTE:
+    return 1;
+  case PN_USHORT:
+  case PN_SHORT:
+    return 2;
+  case PN_UINT:
+  case PN_INT:
+  case PN_CHAR:
+  case PN_FLOAT:
+  case PN_DECIMAL32:
+    return 4;
+  case PN_ULONG:
+  case PN_LONG:
+  case PN_TIMESTAMP:
+  case PN_DOUBLE:
+  case PN_DECIMAL64:
+    return 8;
+  case PN_DECIMAL128:
+  case PN_UUID:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+/* The element type of an array whose elements use the constructor code, if
+ * it can be kept packed: only the full width encodings are, as those are
+ * what the encoder writes for arrays.  Returns PN_INVALID otherwise. */
+static inline pn_type_t pni_packed_type(uint8_t code)
+{
+  switch (code) {
+  case PNE_UBYTE: return PN_UBYTE;
+  case PNE_BYTE: return PN_BYTE;
+  case PNE_USHORT: return PN_USHORT;
+  case PNE_SHORT: return PN_SHORT;
+  case PNE_UINT: return PN_UINT;
+  case PNE_INT: return PN_INT;
+  case PNE_UTF32: return PN_CHAR;
+  case PNE_FLOAT: return PN_FLOAT;
+  case PNE_DECIMAL32: return PN_DECIMAL32;
+  case PNE_ULONG: return PN_ULONG;
+  case PNE_LONG: return PN_LONG;
+  case PNE_MS64: return PN_TIMESTAMP;
+  case PNE_DOUBLE: return PN_DOUBLE;
+  case PNE_DECIMAL64: return PN_DECIMAL64;
+  case PNE_DECIMAL128: return PN_DECIMAL128;
+  case PNE_UUID: return PN_UUID;
+  default: return PN_INVALID;
+  }
+}
+
+/* Convert count encoded elements of width bytes at src to native values at dst */
+static inline void pni_packed_load(void *dst, const char *src, size_t count, size_t width)
+{
+  char *d = (char *) dst;
+  const uint8_t *s = (const uint8_t *) src;
+  switch (width) {
+  case 2:
+    for (size_t i = 0; i < count; i++) {
+      const uint8_t *p = s + 2*i;
+      uint16_t v = (uint16_t) (p[0] << 8 | p[1]);
+      memcpy(d + 2*i, &v, 2);
+    }
+    break;
+  case 4:
+    for (size_t i = 0; i < count; i++) {
+      const uint8_t *p = s + 4*i;
+      uint32_t v = (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+      memcpy(d + 4*i, &v, 4);
+    }
+    break;
+  case 8:
+    for (size_t i = 0; i < count; i++) {
+      const uint8_t *p = s + 8*i;
+      uint64_t v = (uint64_t) p[0] << 56 | (uint64_t) p[1] << 48 | (uint64_t) p[2] << 40 | (uint64_t) p[3] << 32 |
+                   (uint64_t) p[4] << 24 | (uint64_t) p[5] << 16 | (uint64_t) p[6] << 8 | p[7];
+      memcpy(d + 8*i, &v, 8);
+    }
+    break;
+  default:
+    // Single bytes, uuids and decimal128s are kept as they are
+    memcpy(d, src, count * width);
+    break;
+  }
+}
+
+/* Convert count native values of width bytes at src to their encoding at dst.
+ * src and dst may be the same. */
+static inline void pni_packed_store(char *dst, const void *src, size_t count, size_t width)
+{
+  const char *s = (const char *) src;
+  uint8_t *d = (uint8_t *) dst;
+  switch (width) {
+  case 2:
+    for (size_t i = 0; i < count; i++) {
+      uint16_t v;
+      memcpy(&v, s + 2*i, 2);
+      uint8_t *p = d + 2*i;
+      p[0] = v >> 8; p[1] = v;
+    }
+    break;
+  case 4:
+    for (size_t i = 0; i < count; i++) {
+      uint32_t v;
+      memcpy(&v, s + 4*i, 4);
+      uint8_t *p = d + 4*i;
+      p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+    }
+    break;
+  case 8:
+    for (size_t i = 0; i < count; i++) {
+      uint64_t v;
+      memcpy(&v, s + 8*i, 8);
+      uint8_t *p = d + 8*i;
+      p[0] = v >> 56; p[1] = v >> 48; p[2] = v >> 40; p[3] = v >> 32;
+      p[4] = v >> 24; p[5] = v >> 16; p[6] = v >> 8; p[7] = v;
+    }
+    break;
+  default:
+    if (dst != s) memmove(dst, s, count * width);
+    break;
+  }
+}
+
+/* The value of element i of a packed array of type */
+static inline pn_atom_t pni_packed_atom(pn_type_t type, pn_bytes_t elements, size_t i)
+{
+  pn_atom_t atom;
+  size_t width = pni_packed_width(type);
+  atom.type = type;
+  pni_packed_load(&atom.u, elements.start + i*width, 1, width);
+  return atom;
+}
+
+#endif /* packed.h */
@@ -0,0 +1,112 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "core/symbols.h"
+#include "core/util.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// All the interned symbols, one after another
+struct pni_symbol_pool_t {
+  char sym_NONE[1];
+#define PNI_SYMBOL_POOL(NAME, S) char sym_##NAME[sizeof(S)];
+  PN_DESCRIPTOR_SYMBOLS(PNI_SYMBOL_POOL)
+  PNI_OTHER_SYMBOLS(PNI_SYMBOL_POOL)
+#undef PNI_SYMBOL_POOL
+};
+
+static const struct pni_symbol_pool_t pni_symbol_pool = {
+  "",
+#define PNI_SYMBOL_STRING(NAME, S) S,
+  PN_DESCRIPTOR_SYMBOLS(PNI_SYMBOL_STRING)
+  PNI_OTHER_SYMBOLS(PNI_SYMBOL_STRING)
+#undef PNI_SYMBOL_STRING
+};
+
+typedef struct {
+  uint16_t offset;              // in pni_symbol_pool
+  uint16_t size;
+} pni_symbol_entry_t;
+
+static const pni_symbol_entry_t pni_symbol_entries[PNI_SYM_COUNT] = {
+  {0, 0},
+#define PNI_SYMBOL_ENTRY(NAME, S) {offsetof(struct pni_symbol_pool_t, sym_##NAME), sizeof(S) - 1},
+  PN_DESCRIPTOR_SYMBOLS(PNI_SYMBOL_ENTRY)
+  PNI_OTHER_SYMBOLS(PNI_SYMBOL_ENTRY)
+#undef PNI_SYMBOL_ENTRY
+};
+
+static const uint64_t pni_symbol_descriptors[PNI_SYM_COUNT] = {
+  0,
+#define PNI_SYMBOL_DESCRIPTOR(NAME, S) NAME,
+  PN_DESCRIPTOR_SYMBOLS(PNI_SYMBOL_DESCRIPTOR)
+#undef PNI_SYMBOL_DESCRIPTOR
+};
+
+// Open addressed hash table of the symbols, at most half full.  It is filled
+// in once by pni_init_symbols() and only read after that.
+#define PNI_SYMBOL_SLOTS 256
+static uint8_t pni_symbol_slots[PNI_SYMBOL_SLOTS];
+static size_t pni_symbol_max_size;
+
+void pni_init_symbols(void)
+{
+  if (pni_symbol_max_size) return;
+  for (int sym = 1; sym < PNI_SYM_COUNT; sym++) {
+    pn_bytes_t bytes = pni_symbol_bytes((pni_symbol_t) sym);
+    size_t i = pni_fnv1a(bytes) & (PNI_SYMBOL_SLOTS - 1);
+    while (pni_symbol_slots[i]) i = (i + 1) & (PNI_SYMBOL_SLOTS - 1);
+    pni_symbol_slots[i] = (uint8_t) sym;
+    if (bytes.size > pni_symbol_max_size) pni_symbol_max_size = bytes.size;
+  }
+}
+
+pni_symbol_t pni_symbol_lookup(pn_bytes_t bytes)
+{
+  if (!bytes.start || bytes.size > pni_symbol_max_size) return PNI_SYM_NONE;
+  for (size_t i = pni_fnv1a(bytes) & (PNI_SYMBOL_SLOTS - 1); pni_symbol_slots[i];
+       i = (i + 1) & (PNI_SYMBOL_SLOTS - 1)) {
+    const pni_symbol_entry_t *entry = &pni_symbol_entries[pni_symbol_slots[i]];
+    if (entry->size == bytes.size &&
+        !memcmp((const char *) &pni_symbol_pool + entry->offset, bytes.start, bytes.size)) {
+      return (pni_symbol_t) pni_symbol_slots[i];
+    }
+  }
+  return PNI_SYM_NONE;
+}
+
+pn_bytes_t pni_symbol_bytes(pni_symbol_t symbol)
+{
+  const pni_symbol_entry_t *entry = &pni_symbol_entries[symbol];
+  return pn_bytes(entry->size, (const char *) &pni_symbol_pool + entry->offset);
+}
+
+uint64_t pni_symbol_descriptor(pni_symbol_t symbol)
+{
+  return pni_symbol_descriptors[symbol];
+}
+
+bool pni_symbol_is_interned(const char *start)
+{
+  const char *pool = (const char *) &pni_symbol_pool;
+  return start >= pool && start < pool + sizeof(pni_symbol_pool);
+}
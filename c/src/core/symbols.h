@@ -0,0 +1,141 @@
+#ifndef PROTON_SYMBOLS_H
+#define PROTON_SYMBOLS_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Interned symbols.
+ *
+ * The symbols that turn up in every connection - descriptors, terminus
+ * policies, capabilities, error conditions and common annotation keys - are
+ * held once for the whole process, in a table that pni_init_symbols() builds
+ * when the library is loaded and that is only read after that, so looking a
+ * symbol up needs no lock.
+ *
+ * The bytes of an interned symbol are always at the same address, so two
+ * interned symbols are equal exactly when their starts are.  pn_data_t holds
+ * symbols found in the table as references to it instead of copying them.
+ */
+
+#include "protocol.h"
+
+#include <proton/import_export.h>
+#include <proton/types.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* X(NAME, symbol) for each symbol interned besides the descriptors */
+#define PNI_OTHER_SYMBOLS(X) \
+  X(LINK_DETACH, "link-detach") \
+  X(SESSION_END, "session-end") \
+  X(CONNECTION_CLOSE, "connection-close") \
+  X(NEVER, "never") \
+  X(MOVE, "move") \
+  X(COPY, "copy") \
+  X(SHARED, "shared") \
+  X(GLOBAL, "global") \
+  X(QUEUE, "queue") \
+  X(TOPIC, "topic") \
+  X(TEMPORARY_QUEUE, "temporary-queue") \
+  X(TEMPORARY_TOPIC, "temporary-topic") \
+  X(ANONYMOUS_RELAY, "ANONYMOUS-RELAY") \
+  X(DELAYED_DELIVERY, "DELAYED_DELIVERY") \
+  X(SHARED_SUBS, "SHARED-SUBS") \
+  X(SOLE_CONNECTION, "sole-connection-for-container") \
+  X(PRODUCT, "product") \
+  X(VERSION, "version") \
+  X(PLATFORM, "platform") \
+  X(NETWORK_HOST, "network-host") \
+  X(PORT, "port") \
+  X(ANONYMOUS, "ANONYMOUS") \
+  X(PLAIN, "PLAIN") \
+  X(EXTERNAL, "EXTERNAL") \
+  X(X_OPT_TO, "x-opt-to") \
+  X(X_OPT_JMS_MSG_TYPE, "x-opt-jms-msg-type") \
+  X(X_OPT_JMS_DEST, "x-opt-jms-dest") \
+  X(X_OPT_JMS_REPLY_TO, "x-opt-jms-reply-to") \
+  X(X_OPT_DELIVERY_TIME, "x-opt-delivery-time") \
+  X(X_OPT_DELIVERY_DELAY, "x-opt-delivery-delay") \
+  X(X_OPT_QD_TO, "x-opt-qd.to") \
+  X(X_OPT_QD_INGRESS, "x-opt-qd.ingress") \
+  X(X_OPT_QD_TRACE, "x-opt-qd.trace") \
+  X(X_OPT_QD_PHASE, "x-opt-qd.phase") \
+  X(INTERNAL_ERROR, "amqp:internal-error") \
+  X(NOT_FOUND, "amqp:not-found") \
+  X(UNAUTHORIZED_ACCESS, "amqp:unauthorized-access") \
+  X(DECODE_ERROR, "amqp:decode-error") \
+  X(RESOURCE_LIMIT_EXCEEDED, "amqp:resource-limit-exceeded") \
+  X(NOT_ALLOWED, "amqp:not-allowed") \
+  X(INVALID_FIELD, "amqp:invalid-field") \
+  X(NOT_IMPLEMENTED, "amqp:not-implemented") \
+  X(RESOURCE_LOCKED, "amqp:resource-locked") \
+  X(PRECONDITION_FAILED, "amqp:precondition-failed") \
+  X(RESOURCE_DELETED, "amqp:resource-deleted") \
+  X(ILLEGAL_STATE, "amqp:illegal-state") \
+  X(FRAME_SIZE_TOO_SMALL, "amqp:frame-size-too-small") \
+  X(CONNECTION_FORCED, "amqp:connection:forced") \
+  X(FRAMING_ERROR, "amqp:connection:framing-error") \
+  X(CONNECTION_REDIRECT, "amqp:connection:redirect") \
+  X(WINDOW_VIOLATION, "amqp:session:window-violation") \
+  X(ERRANT_LINK, "amqp:session:errant-link") \
+  X(HANDLE_IN_USE, "amqp:session:handle-in-use") \
+  X(UNATTACHED_HANDLE, "amqp:session:unattached-handle") \
+  X(DETACH_FORCED, "amqp:link:detach-forced") \
+  X(TRANSFER_LIMIT_EXCEEDED, "amqp:link:transfer-limit-exceeded") \
+  X(MESSAGE_SIZE_EXCEEDED, "amqp:link:message-size-exceeded") \
+  X(LINK_REDIRECT, "amqp:link:redirect") \
+  X(LINK_STOLEN, "amqp:link:stolen")
+
+typedef enum {
+  PNI_SYM_NONE = 0,
+#define PNI_SYMBOL_ENUM(NAME, S) PNI_SYM_##NAME,
+  PN_DESCRIPTOR_SYMBOLS(PNI_SYMBOL_ENUM)
+  PNI_OTHER_SYMBOLS(PNI_SYMBOL_ENUM)
+#undef PNI_SYMBOL_ENUM
+  PNI_SYM_COUNT
+} pni_symbol_t;
+
+void pni_init_symbols(void);
+
+/* The interned symbol with the same characters as bytes, PNI_SYM_NONE if
+ * there is none. */
+PN_EXTERN pni_symbol_t pni_symbol_lookup(pn_bytes_t bytes);
+
+/* The interned bytes of symbol, followed by a NUL. */
+PN_EXTERN pn_bytes_t pni_symbol_bytes(pni_symbol_t symbol);
+
+/* The descriptor code of symbol, 0 if it is not a descriptor. */
+PN_EXTERN uint64_t pni_symbol_descriptor(pni_symbol_t symbol);
+
+/* True if start points into the interned symbols. */
+PN_EXTERN bool pni_symbol_is_interned(const char *start);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* symbols.h */
@@ -20,6 +20,7 @@
  */
 
 #include "engine-internal.h"
+#include "data.h"
 #include "framing.h"
 #include "memory.h"
 #include "platform/platform.h"
@@ -29,13 +30,16 @@
 
 #include "autodetect.h"
 #include "protocol.h"
+#include "performatives.h"
 #include "dispatch_actions.h"
 #include "config.h"
 #include "logger_private.h"
+#include "symbols.h"
 
 #include "proton/event.h"
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <stdarg.h>
@@ -74,24 +78,77 @@ static void pni_calculate_channel_max(pn_transport_t *transport) {
 
 void pn_delivery_map_init(pn_delivery_map_t *db, pn_sequence_t next)
 {
-  db->deliveries = pn_hash(PN_WEAKREF, 0, 0.75);
+  db->deliveries = NULL;
+  db->spilled = NULL;
+  db->capacity = 0;
+  db->size = 0;
+  db->first = next;
   db->next = next;
 }
 
 void pn_delivery_map_free(pn_delivery_map_t *db)
 {
-  pn_free(db->deliveries);
+  free(db->deliveries);
+  pn_free(db->spilled);
 }
 
-static inline uintptr_t pni_sequence_make_hash ( pn_sequence_t i )
+#define PNI_DELIVERY_MAP_MIN_CAPACITY 16
+
+static inline pn_delivery_t **pni_delivery_map_slot(pn_delivery_map_t *db, pn_sequence_t id)
 {
-  return i & 0x00000000FFFFFFFFUL;
+  return &db->deliveries[id & (db->capacity - 1)];
 }
 
+static inline bool pni_delivery_map_in_ring(pn_delivery_map_t *db, pn_sequence_t id)
+{
+  return (pn_sequence_t) (id - db->first) < (pn_sequence_t) (db->next - db->first);
+}
+
+static inline size_t pni_delivery_map_spilled(pn_delivery_map_t *db)
+{
+  return db->spilled ? pn_hash_size(db->spilled) : 0;
+}
+
+// move first on past the ids whose deliveries are gone
+static void pni_delivery_map_advance(pn_delivery_map_t *db)
+{
+  while (db->size && !*pni_delivery_map_slot(db, db->first)) db->first++;
+  if (!db->size) db->first = db->next;
+}
 
-static pn_delivery_t *pni_delivery_map_get(pn_delivery_map_t *db, pn_sequence_t id)
+// Move the deliveries out of the ring until it spans fewer than capacity ids
+static bool pni_delivery_map_spill(pn_delivery_map_t *db)
 {
-  return (pn_delivery_t *) pn_hash_get(db->deliveries, pni_sequence_make_hash(id) );
+  while ((pn_sequence_t) (db->next - db->first) >= db->capacity) {
+    pn_delivery_t **slot = pni_delivery_map_slot(db, db->first);
+    if (*slot) {
+      if (!db->spilled) db->spilled = pn_hash(PN_WEAKREF, 0, 0.75);
+      if (!db->spilled || pn_hash_put(db->spilled, db->first, *slot)) return false;
+      *slot = NULL;
+      db->size--;
+    }
+    db->first++;
+    pni_delivery_map_advance(db);
+  }
+  return true;
+}
+
+// Make room for the ids from first up to and including next
+static bool pni_delivery_map_grow(pn_delivery_map_t *db)
+{
+  size_t span = (pn_sequence_t) (db->next - db->first);
+  if (span < db->capacity) return true;
+  if (db->capacity >= PNI_DELIVERY_MAP_MAX_CAPACITY) return pni_delivery_map_spill(db);
+  size_t capacity = db->capacity ? 2 * db->capacity : PNI_DELIVERY_MAP_MIN_CAPACITY;
+  pn_delivery_t **deliveries = (pn_delivery_t **) calloc(capacity, sizeof(pn_delivery_t *));
+  if (!deliveries) return false;
+  for (pn_sequence_t id = db->first; id != db->next; id++) {
+    deliveries[id & (capacity - 1)] = *pni_delivery_map_slot(db, id);
+  }
+  free(db->deliveries);
+  db->deliveries = deliveries;
+  db->capacity = capacity;
+  return true;
 }
 
 static void pn_delivery_state_init(pn_delivery_state_t *ds, pn_delivery_t *delivery, pn_sequence_t id)
@@ -105,8 +162,11 @@ static void pn_delivery_state_init(pn_delivery_state_t *ds, pn_delivery_t *deliv
 static pn_delivery_state_t *pni_delivery_map_push(pn_delivery_map_t *db, pn_delivery_t *delivery)
 {
   pn_delivery_state_t *ds = &delivery->state;
+  if (!db->size) db->first = db->next;
+  if (!pni_delivery_map_grow(db)) return NULL;
   pn_delivery_state_init(ds, delivery, db->next++);
-  pn_hash_put(db->deliveries, pni_sequence_make_hash(ds->id), delivery);
+  *pni_delivery_map_slot(db, ds->id) = delivery;
+  db->size++;
   return ds;
 }
 
@@ -116,23 +176,153 @@ void pn_delivery_map_del(pn_delivery_map_t *db, pn_delivery_t *delivery)
     delivery->state.init = false;
     delivery->state.sending = false;
     delivery->state.sent = false;
-    pn_hash_del(db->deliveries, pni_sequence_make_hash(delivery->state.id) );
+    pn_sequence_t id = delivery->state.id;
+    if (pni_delivery_map_in_ring(db, id)) {
+      pn_delivery_t **slot = pni_delivery_map_slot(db, id);
+      if (*slot != delivery) return;
+      *slot = NULL;
+      db->size--;
+      pni_delivery_map_advance(db);
+    } else if (db->spilled && pn_hash_get(db->spilled, id) == delivery) {
+      pn_hash_del(db->spilled, id);
+    }
   }
 }
 
 static void pni_delivery_map_clear(pn_delivery_map_t *dm)
 {
-  pn_hash_t *hash = dm->deliveries;
-  for (pn_handle_t entry = pn_hash_head(hash);
-       entry;
-       entry = pn_hash_next(hash, entry))
-  {
-    pn_delivery_t *dlv = (pn_delivery_t *) pn_hash_value(hash, entry);
-    pn_delivery_map_del(dm, dlv);
+  for (pn_sequence_t id = dm->first; dm->size && id != dm->next; id++) {
+    pn_delivery_t *dlv = *pni_delivery_map_slot(dm, id);
+    if (dlv) pn_delivery_map_del(dm, dlv);
   }
+  while (pni_delivery_map_spilled(dm)) {
+    pn_handle_t entry = pn_hash_head(dm->spilled);
+    pn_delivery_map_del(dm, (pn_delivery_t *) pn_hash_value(dm->spilled, entry));
+  }
+  dm->first = 0;
   dm->next = 0;
 }
 
+// channel and handle maps
+
+#define PNI_ALIAS_MAP_MIN_CAPACITY 16
+
+void pni_alias_map_init(pni_alias_map_t *map)
+{
+  memset(map, 0, sizeof(*map));
+}
+
+void pni_alias_map_free(pni_alias_map_t *map)
+{
+  free(map->entries);
+  free(map->free);
+  pn_free(map->sparse);
+}
+
+size_t pni_alias_map_memory(pni_alias_map_t *map)
+{
+  return pni_mem_size(map->entries, map->capacity * sizeof(void *)) +
+    pni_mem_size(map->free, map->free_capacity * sizeof(uint32_t)) +
+    pni_hash_memory(map->sparse);
+}
+
+// The table only grows to hold aliases within a small factor of the number
+// mapped, so a peer choosing big ones cannot make it take up much memory
+#define PNI_ALIAS_MAP_SPREAD 4
+
+static bool pni_alias_map_grow(pni_alias_map_t *map, uint32_t alias)
+{
+  size_t count = map->size + (map->sparse ? pn_hash_size(map->sparse) : 0);
+  if (alias >= PNI_ALIAS_MAP_MIN_CAPACITY && alias / PNI_ALIAS_MAP_SPREAD > count) return false;
+  uint32_t capacity = map->capacity ? map->capacity : PNI_ALIAS_MAP_MIN_CAPACITY;
+  while (capacity <= alias) capacity *= 2;
+  void **entries = (void **) realloc(map->entries, capacity * sizeof(void *));
+  if (!entries) return false;
+  memset(entries + map->capacity, 0, (capacity - map->capacity) * sizeof(void *));
+  // the aliases the table now covers move out of the hash, deleting can
+  // move the other entries so look again from the start after each
+  pn_handle_t entry = map->sparse ? pn_hash_head(map->sparse) : 0;
+  while (entry) {
+    uintptr_t key = pn_hash_key(map->sparse, entry);
+    if (key < capacity) {
+      entries[key] = pn_hash_value(map->sparse, entry);
+      map->size++;
+      pn_hash_del(map->sparse, key);
+      entry = pn_hash_head(map->sparse);
+    } else {
+      entry = pn_hash_next(map->sparse, entry);
+    }
+  }
+  map->entries = entries;
+  map->capacity = capacity;
+  return true;
+}
+
+static bool pni_alias_map_put(pni_alias_map_t *map, uint32_t alias, void *value)
+{
+  if (alias >= map->capacity && !pni_alias_map_grow(map, alias)) {
+    if (!map->sparse) map->sparse = pn_hash(PN_WEAKREF, 0, 0.75);
+    return map->sparse && !pn_hash_put(map->sparse, alias, value);
+  }
+  if (!map->entries[alias]) map->size++;
+  map->entries[alias] = value;
+  return true;
+}
+
+// Remove alias if it maps to value, giving it back if it was handed out
+bool pni_alias_map_del(pni_alias_map_t *map, uint32_t alias, void *value)
+{
+  if (!value || pni_alias_map_get(map, alias) != value) return false;
+  if (alias >= map->capacity) {
+    pn_hash_del(map->sparse, alias);
+  } else {
+    map->entries[alias] = NULL;
+    map->size--;
+  }
+  if (alias < map->next) {
+    if (map->free_count == map->free_capacity) {
+      uint32_t capacity = map->free_capacity ? 2 * map->free_capacity : PNI_ALIAS_MAP_MIN_CAPACITY;
+      uint32_t *free_aliases = (uint32_t *) realloc(map->free, capacity * sizeof(uint32_t));
+      if (!free_aliases) {
+        // only lose the reuse of alias, it can still be found by a scan
+        return true;
+      }
+      map->free = free_aliases;
+      map->free_capacity = capacity;
+    }
+    map->free[map->free_count++] = alias;
+  }
+  return true;
+}
+
+// Hand out an unused alias no bigger than max, the one most recently given
+// back if there is one
+static bool pni_alias_map_allocate(pni_alias_map_t *map, uint32_t max, uint32_t *alias)
+{
+  for (uint32_t i = map->free_count; i > 0; i--) {
+    uint32_t candidate = map->free[i - 1];
+    if (candidate <= max && !pni_alias_map_get(map, candidate)) {
+      map->free[i - 1] = map->free[--map->free_count];
+      *alias = candidate;
+      return true;
+    }
+  }
+  for (; map->next <= max && map->next < PNI_ALIAS_MAX; map->next++) {
+    if (!pni_alias_map_get(map, map->next)) {
+      *alias = map->next++;
+      return true;
+    }
+  }
+  // an alias given back when the free list could not grow
+  for (uint32_t i = 0; i <= max && i < map->next; i++) {
+    if (!pni_alias_map_get(map, i)) {
+      *alias = i;
+      return true;
+    }
+  }
+  return false;
+}
+
 static ssize_t pn_io_layer_input_passthru(pn_transport_t *, unsigned int, const char *, size_t );
 static ssize_t pn_io_layer_output_passthru(pn_transport_t *, unsigned int, char *, size_t );
 
@@ -410,7 +600,7 @@ static void pn_transport_initialize(void *object)
   transport->scratch = pn_string(NULL);
   transport->args = pn_data(16);
   transport->output_args = pn_data(16);
-  transport->frame = pn_buffer(PN_TRANSPORT_INITIAL_FRAME_SIZE);
+  transport->frame = pn_rwbytes(PN_TRANSPORT_INITIAL_FRAME_SIZE, (char *) malloc(PN_TRANSPORT_INITIAL_FRAME_SIZE));
   transport->input_frames_ct = 0;
   transport->output_frames_ct = 0;
 
@@ -460,6 +650,10 @@ static void pn_transport_initialize(void *object)
   transport->remote_idle_timeout = 0;
   transport->keepalive_deadline = 0;
   transport->last_bytes_output = 0;
+  transport->buffer_release_timeout = 0;
+  transport->buffer_release_deadline = 0;
+  transport->last_bytes_io = 0;
+  transport->buffers_released = false;
   transport->remote_offered_capabilities = pn_data(0);
   transport->remote_desired_capabilities = pn_data(0);
   transport->remote_properties = pn_data(0);
@@ -468,14 +662,15 @@ static void pn_transport_initialize(void *object)
   pn_condition_init(&transport->condition);
   transport->error = pn_error();
 
-  transport->local_channels = pn_hash(PN_WEAKREF, 0, 0.75);
-  transport->remote_channels = pn_hash(PN_WEAKREF, 0, 0.75);
+  pni_alias_map_init(&transport->local_channels);
+  pni_alias_map_init(&transport->remote_channels);
 
   transport->bytes_input = 0;
   transport->bytes_output = 0;
 
   transport->input_pending = 0;
   transport->output_pending = 0;
+  transport->input_transfer_rest = 0;
 
   transport->done_processing = false;
 
@@ -493,32 +688,32 @@ static void pn_transport_initialize(void *object)
 
 static pn_session_t *pni_channel_state(pn_transport_t *transport, uint16_t channel)
 {
-  return (pn_session_t *) pn_hash_get(transport->remote_channels, channel);
+  return (pn_session_t *) pni_alias_map_get(&transport->remote_channels, channel);
 }
 
-static void pni_map_remote_channel(pn_session_t *session, uint16_t channel)
+static int pni_map_remote_channel(pn_session_t *session, uint16_t channel)
 {
   pn_transport_t *transport = session->connection->transport;
-  pn_hash_put(transport->remote_channels, channel, session);
+  if (!pni_alias_map_put(&transport->remote_channels, channel, session)) return PN_OUT_OF_MEMORY;
   session->state.remote_channel = channel;
   pn_ep_incref(&session->endpoint);
+  return 0;
 }
 
-void pni_transport_unbind_handles(pn_hash_t *handles, bool reset_state);
+void pni_transport_unbind_handles(pni_alias_map_t *handles, bool reset_state);
 
 static void pni_unmap_remote_channel(pn_session_t *ssn)
 {
   // XXX: should really update link state also
   pni_delivery_map_clear(&ssn->state.incoming);
-  pni_transport_unbind_handles(ssn->state.remote_handles, false);
+  pni_transport_unbind_handles(&ssn->state.remote_handles, false);
   pn_transport_t *transport = ssn->connection->transport;
   uint16_t channel = ssn->state.remote_channel;
   ssn->state.remote_channel = -2;
-  if (pn_hash_get(transport->remote_channels, channel)) {
+  if (pni_alias_map_del(&transport->remote_channels, channel, ssn)) {
+    // note: may free the session:
     pn_ep_decref(&ssn->endpoint);
   }
-  // note: may free the session:
-  pn_hash_del(transport->remote_channels, channel);
 }
 
 static void pn_transport_incref(void *object)
@@ -554,19 +749,7 @@ pn_transport_t *pn_transport(void)
     (pn_transport_t *) pn_class_new(&clazz, sizeof(pn_transport_t));
   if (!transport) return NULL;
 
-  transport->output_buf = (char *) pni_mem_suballocate(&clazz, transport, transport->output_size);
-  if (!transport->output_buf) {
-    pn_transport_free(transport);
-    return NULL;
-  }
-
-  transport->input_buf = (char *) pni_mem_suballocate(&clazz, transport, transport->input_size);
-  if (!transport->input_buf) {
-    pn_transport_free(transport);
-    return NULL;
-  }
-
-  transport->output_buffer = pn_buffer(4*1024);
+  transport->output_buffer = pn_buffer(PN_TRANSPORT_INITIAL_FRAME_BUFFER_SIZE);
   if (!transport->output_buffer) {
     pn_transport_free(transport);
     return NULL;
@@ -659,14 +842,14 @@ static void pn_transport_finalize(void *object)
   pn_condition_tini(&transport->remote_condition);
   pn_condition_tini(&transport->condition);
   pn_error_free(transport->error);
-  pn_free(transport->local_channels);
-  pn_free(transport->remote_channels);
+  pni_alias_map_free(&transport->local_channels);
+  pni_alias_map_free(&transport->remote_channels);
   pni_mem_subdeallocate(pn_class(transport), transport, transport->input_buf);
   pni_mem_subdeallocate(pn_class(transport), transport, transport->output_buf);
   pn_free(transport->scratch);
   pn_data_free(transport->args);
   pn_data_free(transport->output_args);
-  pn_buffer_free(transport->frame);
+  free(transport->frame.start);
   pn_free(transport->context);
   pn_buffer_free(transport->output_buffer);
   pni_logger_fini(&transport->logger);
@@ -726,32 +909,61 @@ int pn_transport_bind(pn_transport_t *transport, pn_connection_t *connection)
   return 0;
 }
 
-void pni_transport_unbind_handles(pn_hash_t *handles, bool reset_state)
+static void pni_transport_unbind_handle(pn_link_t *link, bool reset_state)
 {
-  for (pn_handle_t h = pn_hash_head(handles); h; h = pn_hash_next(handles, h)) {
-    uintptr_t key = pn_hash_key(handles, h);
-    pn_link_t *link = (pn_link_t *) pn_hash_value(handles, h);
-    if (reset_state) {
-      pn_link_unbound(link);
-    }
-    pn_ep_decref(&link->endpoint);
-    pn_hash_del(handles, key);
+  if (reset_state) {
+    pn_link_unbound(link);
   }
+  pn_ep_decref(&link->endpoint);
 }
 
-void pni_transport_unbind_channels(pn_hash_t *channels)
+// Empty handles, each entry is cleared before its link may be freed
+void pni_transport_unbind_handles(pni_alias_map_t *handles, bool reset_state)
 {
-  for (pn_handle_t h = pn_hash_head(channels); h; h = pn_hash_next(channels, h)) {
-    uintptr_t key = pn_hash_key(channels, h);
-    pn_session_t *ssn = (pn_session_t *) pn_hash_value(channels, h);
-    pni_delivery_map_clear(&ssn->state.incoming);
-    pni_delivery_map_clear(&ssn->state.outgoing);
-    pni_transport_unbind_handles(ssn->state.local_handles, true);
-    pni_transport_unbind_handles(ssn->state.remote_handles, true);
-    pn_session_unbound(ssn);
-    pn_ep_decref(&ssn->endpoint);
-    pn_hash_del(channels, key);
+  for (uint32_t i = 0; handles->size && i < handles->capacity; i++) {
+    pn_link_t *link = (pn_link_t *) handles->entries[i];
+    if (!link) continue;
+    handles->entries[i] = NULL;
+    handles->size--;
+    pni_transport_unbind_handle(link, reset_state);
+  }
+  while (handles->sparse && pn_hash_size(handles->sparse)) {
+    pn_handle_t h = pn_hash_head(handles->sparse);
+    pn_link_t *link = (pn_link_t *) pn_hash_value(handles->sparse, h);
+    pn_hash_del(handles->sparse, pn_hash_key(handles->sparse, h));
+    pni_transport_unbind_handle(link, reset_state);
   }
+  handles->next = 0;
+  handles->free_count = 0;
+}
+
+static void pni_transport_unbind_channel(pn_session_t *ssn)
+{
+  pni_delivery_map_clear(&ssn->state.incoming);
+  pni_delivery_map_clear(&ssn->state.outgoing);
+  pni_transport_unbind_handles(&ssn->state.local_handles, true);
+  pni_transport_unbind_handles(&ssn->state.remote_handles, true);
+  pn_session_unbound(ssn);
+  pn_ep_decref(&ssn->endpoint);
+}
+
+void pni_transport_unbind_channels(pni_alias_map_t *channels)
+{
+  for (uint32_t i = 0; channels->size && i < channels->capacity; i++) {
+    pn_session_t *ssn = (pn_session_t *) channels->entries[i];
+    if (!ssn) continue;
+    channels->entries[i] = NULL;
+    channels->size--;
+    pni_transport_unbind_channel(ssn);
+  }
+  while (channels->sparse && pn_hash_size(channels->sparse)) {
+    pn_handle_t h = pn_hash_head(channels->sparse);
+    pn_session_t *ssn = (pn_session_t *) pn_hash_value(channels->sparse, h);
+    pn_hash_del(channels->sparse, pn_hash_key(channels->sparse, h));
+    pni_transport_unbind_channel(ssn);
+  }
+  channels->next = 0;
+  channels->free_count = 0;
 }
 
 int pn_transport_unbind(pn_transport_t *transport)
@@ -781,8 +993,8 @@ int pn_transport_unbind(pn_transport_t *transport)
     endpoint = endpoint->endpoint_next;
   }
 
-  pni_transport_unbind_channels(transport->local_channels);
-  pni_transport_unbind_channels(transport->remote_channels);
+  pni_transport_unbind_channels(&transport->local_channels);
+  pni_transport_unbind_channels(&transport->remote_channels);
 
   pn_connection_unbound(conn);
   if (was_referenced) {
@@ -816,27 +1028,27 @@ pn_logger_t *pn_transport_logger(pn_transport_t *transport)
   return &transport->logger;
 }
 
-static void pni_map_remote_handle(pn_link_t *link, uint32_t handle)
+static int pni_map_remote_handle(pn_link_t *link, uint32_t handle)
 {
+  if (!pni_alias_map_put(&link->session->state.remote_handles, handle, link)) return PN_OUT_OF_MEMORY;
   link->state.remote_handle = handle;
-  pn_hash_put(link->session->state.remote_handles, handle, link);
   pn_ep_incref(&link->endpoint);
+  return 0;
 }
 
 static void pni_unmap_remote_handle(pn_link_t *link)
 {
-  uintptr_t handle = link->state.remote_handle;
+  uint32_t handle = link->state.remote_handle;
   link->state.remote_handle = -2;
-  if (pn_hash_get(link->session->state.remote_handles, handle)) {
+  if (pni_alias_map_del(&link->session->state.remote_handles, handle, link)) {
+    // may delete link:
     pn_ep_decref(&link->endpoint);
   }
-  // may delete link:
-  pn_hash_del(link->session->state.remote_handles, handle);
 }
 
 static pn_link_t *pni_handle_state(pn_session_t *ssn, uint32_t handle)
 {
-  return (pn_link_t *) pn_hash_get(ssn->state.remote_handles, handle);
+  return (pn_link_t *) pni_alias_map_get(&ssn->state.remote_handles, handle);
 }
 
 bool pni_disposition_batchable(pn_disposition_t *disposition)
@@ -903,59 +1115,156 @@ void pn_do_trace(pn_transport_t *transport, uint16_t ch, pn_dir_t dir,
   }
 }
 
-int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const char *fmt, ...)
+/* Only decode what we sent if we are going to log it */
+static void pni_trace_performative(pn_transport_t *transport, uint16_t ch, pn_bytes_t performative,
+                                   const char *payload, size_t size)
 {
-  pn_buffer_t *frame_buf = transport->frame;
-  va_list ap;
-  va_start(ap, fmt);
-  pn_data_clear(transport->output_args);
-  int err = pn_data_vfill(transport->output_args, fmt, ap);
-  va_end(ap);
-  if (err) {
-    pn_logger_logf(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_ERROR,
-                      "error posting frame: %s, %s: %s", fmt, pn_code(err),
-                      pn_error_text(pn_data_error(transport->output_args)));
-    return PN_ERR;
+  if (PN_SHOULD_LOG(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_FRAME)) {
+    pn_data_clear(transport->output_args);
+    if (performative.size) {
+      pn_data_decode(transport->output_args, performative.start, performative.size);
+    }
+    pn_do_trace(transport, ch, OUT, transport->output_args, payload, size);
   }
+}
 
-  pn_do_trace(transport, ch, OUT, transport->output_args, NULL, 0);
+static void pni_write_frame_body(pn_transport_t *transport, pn_frame_t frame, pn_bytes_t body)
+{
+  size_t size = AMQP_HEADER_SIZE+frame.ex_size+frame.size+body.size;
+  pn_buffer_ensure(transport->output_buffer, size);
+  pn_write_frame_body(transport->output_buffer, frame, body);
+  transport->output_frames_ct += 1;
+  if (PN_SHOULD_LOG(&transport->logger, PN_SUBSYSTEM_IO, PN_LEVEL_RAW)) {
+    pn_string_set(transport->scratch, "RAW: \"");
+    pn_buffer_quote(transport->output_buffer, transport->scratch, size);
+    pn_string_addf(transport->scratch, "\"");
+    pni_logger_log(&transport->logger, PN_SUBSYSTEM_IO, PN_LEVEL_RAW, pn_string_get(transport->scratch));
+  }
+}
 
- encode_performatives:
-  pn_buffer_clear( frame_buf );
-  pn_rwbytes_t buf = pn_buffer_memory( frame_buf );
-  buf.size = pn_buffer_available( frame_buf );
+static void pni_write_frame(pn_transport_t *transport, pn_frame_t frame)
+{
+  pni_write_frame_body(transport, frame, pn_bytes(0, NULL));
+}
 
-  ssize_t wr = pn_data_encode( transport->output_args, buf.start, buf.size );
-  if (wr < 0) {
-    if (wr == PN_OVERFLOW) {
-      pn_buffer_ensure( frame_buf, pn_buffer_available( frame_buf ) * 2 );
-      goto encode_performatives;
-    }
+/* Post a frame whose performative has already been encoded by one of the
+ * pn_amqp_encode_* functions (which return pn_bytes_null if they failed).
+ * An empty performative makes an empty frame.
+ */
+int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, pn_bytes_t performative)
+{
+  if (!performative.start) {
     pn_logger_logf(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_ERROR,
-                      "error posting frame: %s", pn_code(wr));
+                   "error posting frame: %s", pn_code(PN_OUT_OF_MEMORY));
     return PN_ERR;
   }
 
+  pni_trace_performative(transport, ch, performative, NULL, 0);
+
   pn_frame_t frame = {AMQP_FRAME_TYPE};
   frame.type = type;
   frame.channel = ch;
-  frame.payload = buf.start;
-  frame.size = wr;
-  pn_buffer_ensure(transport->output_buffer, AMQP_HEADER_SIZE+frame.ex_size+frame.size);
-  pn_write_frame(transport->output_buffer, frame);
-  transport->output_frames_ct += 1;
-  if (PN_SHOULD_LOG(&transport->logger, PN_SUBSYSTEM_IO, PN_LEVEL_RAW)) {
-    pn_string_set(transport->scratch, "RAW: \"");
-    pn_buffer_quote(transport->output_buffer, transport->scratch, AMQP_HEADER_SIZE+frame.ex_size+frame.size);
-    pn_string_addf(transport->scratch, "\"");
-    pni_logger_log(&transport->logger, PN_SUBSYSTEM_IO, PN_LEVEL_RAW, pn_string_get(transport->scratch));
-  }
+  frame.payload = performative.start;
+  frame.size = performative.size;
+  pni_write_frame(transport, frame);
 
   return 0;
 }
 
+// Offset of the list32 size in an encoded transfer, after the descriptor
+#define PNI_TRANSFER_LIST_START 4
+// Fields always present in a templated transfer: handle, delivery-id, tag and
+// message-format
+#define PNI_TRANSFER_FIXED_COUNT 4
+
+// Encode the part of a transfer that is the same for every transfer on the
+// link: the descriptor, the list32 header, the handle and the constructor of
+// the fixed width delivery-id.  The list size and count are patched per
+// transfer.
+static void pni_transfer_template(pn_link_state_t *link_state)
+{
+  pn_rwbytes_t buffer = pn_rwbytes(PNI_TRANSFER_TEMPLATE_MAX, link_state->transfer_template);
+  pni_emitter_t emitter = pni_emitter(&buffer);
+  pni_compound_context c0 = pni_compound_context_init(false);
+  pni_compound_context c1 = pni_emit_descriptor(&emitter, &c0, TRANSFER);
+  pni_compound_context c2 = pni_emit_list(&emitter, &c1, true);
+  assert(c2.start == PNI_TRANSFER_LIST_START);
+  pni_emit_uint(&emitter, &c2, link_state->local_handle);
+  pni_emitter_writef8(&emitter, PNE_UINT);
+  assert(emitter.position <= PNI_TRANSFER_TEMPLATE_MAX);
+  link_state->transfer_template_handle = link_state->local_handle;
+  link_state->transfer_template_size = emitter.position;
+}
+
+// Write the settled and more flags at offset flags of a transfer image and
+// patch the list size and count to match.  False flags at the end are left
+// off, just as the emitters elide trailing nulls.  Returns the image size.
+static size_t pni_transfer_image_flags(char *image, size_t flags, bool settled, bool more)
+{
+  size_t size = flags;
+  uint32_t count = PNI_TRANSFER_FIXED_COUNT;
+  if (settled || more) {
+    image[size++] = settled ? PNE_TRUE : PNE_NULL;
+    count++;
+  }
+  if (more) {
+    image[size++] = PNE_TRUE;
+    count++;
+  }
+  pn_rwbytes_t buffer = pn_rwbytes(size, image);
+  pni_emitter_t emitter = pni_emitter(&buffer);
+  emitter.position = PNI_TRANSFER_LIST_START;
+  pni_emitter_writef32(&emitter, size - PNI_TRANSFER_LIST_START - 4);
+  pni_emitter_writef32(&emitter, count);
+  return size;
+}
+
+// Encode a transfer without a delivery state from the link's template.  The
+// delivery-id and message-format are fixed width uints, so apart from the tag
+// every field sits at a known offset: the template is copied and only the
+// delivery-id, tag, message-format and flags are written after it.  The
+// offset of the flags is returned in *flags so a later change of the more
+// flag can be patched into the image in place.
+static pn_bytes_t pni_encode_transfer_from_template(pn_rwbytes_t *buffer,
+                                                    pn_link_state_t *link_state,
+                                                    pn_sequence_t id,
+                                                    pn_bytes_t tag,
+                                                    uint32_t message_format,
+                                                    bool settled,
+                                                    bool more,
+                                                    size_t *flags)
+{
+  if (!link_state->transfer_template_size ||
+      link_state->transfer_template_handle != link_state->local_handle) {
+    pni_transfer_template(link_state);
+  }
+  size_t head = link_state->transfer_template_size;
+  size_t tag_size = !tag.start ? 1 : (tag.size < 256 ? 2 : 5) + tag.size;
+  *flags = head + 4 + tag_size + 5;
+
+  // room for both flags, so flipping more never has to grow the buffer
+  pni_emitter_t emitter = pni_emitter(buffer);
+  emitter.position = *flags + 2;
+  if (emitter.position > buffer->size && !pni_emitter_retry(&emitter, buffer)) {
+    return pn_bytes_null;
+  }
+  emitter = pni_emitter(buffer);
+
+  pni_emitter_raw(&emitter, link_state->transfer_template, head);
+  pni_emitter_writef32(&emitter, id);
+  if (tag.start) {
+    pni_emitter_writev(&emitter, PNE_VBIN8, PNE_VBIN32, tag);
+  } else {
+    pni_emitter_writef8(&emitter, PNE_NULL);
+  }
+  pni_emitter_writef8(&emitter, PNE_UINT);
+  pni_emitter_writef32(&emitter, message_format);
+  assert(emitter.position == *flags);
+  return pn_bytes(pni_transfer_image_flags(buffer->start, *flags, settled, more), buffer->start);
+}
+
 static int pni_post_amqp_transfer_frame(pn_transport_t *transport, uint16_t ch,
-                                        uint32_t handle,
+                                        pn_link_state_t *link_state,
                                         pn_sequence_t id,
                                         pn_bytes_t *payload,
                                         const pn_bytes_t *tag,
@@ -971,53 +1280,51 @@ static int pni_post_amqp_transfer_frame(pn_transport_t *transport, uint16_t ch,
 {
   bool more_flag = more;
   unsigned framecount = 0;
-  pn_buffer_t *frame = transport->frame;
+  // only transfers with nothing but the handle, id, tag, format and flags set
+  // can be encoded from the link's template
+  bool templated = !code && !resume && !aborted && !batchable;
+
+  // offset of the flags in a templated transfer, once it has been encoded
+  size_t flags = 0;
 
   // create performatives, assuming 'more' flag need not change
 
- compute_performatives:
-  pn_data_clear(transport->output_args);
-  int err = pn_data_fill(transport->output_args, "DL[IIzI?o?on?DLC?o?o?o]", TRANSFER,
-                         handle,
-                         id,
-                         tag->size, tag->start,
-                         message_format,
-                         settled, settled,
-                         more_flag, more_flag,
-                         (bool)code, code, state,
-                         resume, resume,
-                         aborted, aborted,
-                         batchable, batchable);
-  if (err) {
+ compute_performatives:;
+  pn_bytes_t performative;
+  if (flags) {
+    // only the more flag changed, patch it into the image in the frame buffer
+    performative = pn_bytes(pni_transfer_image_flags(transport->frame.start, flags, settled, more_flag),
+                            transport->frame.start);
+  } else if (templated) {
+    performative = pni_encode_transfer_from_template(&transport->frame, link_state,
+                                                     id, *tag, message_format,
+                                                     settled, more_flag, &flags);
+  } else {
+    performative = pn_amqp_encode_transfer(&transport->frame,
+                                           link_state->local_handle,
+                                           id,
+                                           *tag,
+                                           message_format,
+                                           settled, settled,
+                                           more_flag, more_flag,
+                                           (bool)code, code, state,
+                                           resume, resume,
+                                           aborted, aborted,
+                                           batchable, batchable);
+  }
+  if (!performative.start) {
     pn_logger_logf(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_ERROR,
-                      "error posting transfer frame: %s: %s", pn_code(err),
-                      pn_error_text(pn_data_error(transport->output_args)));
+                   "error posting transfer frame: %s", pn_code(PN_OUT_OF_MEMORY));
     return PN_ERR;
   }
 
   do { // send as many frames as possible without changing the 'more' flag...
 
-  encode_performatives:
-    pn_buffer_clear( frame );
-    pn_rwbytes_t buf = pn_buffer_memory( frame );
-    buf.size = pn_buffer_available( frame );
-
-    ssize_t wr = pn_data_encode(transport->output_args, buf.start, buf.size);
-    if (wr < 0) {
-      if (wr == PN_OVERFLOW) {
-        pn_buffer_ensure( frame, pn_buffer_available( frame ) * 2 );
-        goto encode_performatives;
-      }
-      pn_logger_logf(&transport->logger, PN_SUBSYSTEM_AMQP, PN_LEVEL_ERROR, "error posting frame: %s", pn_code(wr));
-      return PN_ERR;
-    }
-    buf.size = wr;
-
     // check if we need to break up the outbound frame
     size_t available = payload->size;
     if (transport->remote_max_frame) {
-      if ((available + buf.size) > transport->remote_max_frame - 8) {
-        available = transport->remote_max_frame - 8 - buf.size;
+      if ((available + performative.size) > transport->remote_max_frame - 8) {
+        available = transport->remote_max_frame - 8 - performative.size;
         if (more_flag == false) {
           more_flag = true;
           goto compute_performatives;  // deal with flag change
@@ -1029,34 +1336,17 @@ static int pni_post_amqp_transfer_frame(pn_transport_t *transport, uint16_t ch,
       }
     }
 
-    if (pn_buffer_available( frame ) < (available + buf.size)) {
-      // not enough room for payload - try again...
-      pn_buffer_ensure( frame, available + buf.size );
-      goto encode_performatives;
-    }
-
-    pn_do_trace(transport, ch, OUT, transport->output_args, payload->start, available);
-
-    memmove( buf.start + buf.size, payload->start, available);
-    payload->start += available;
-    payload->size -= available;
-    buf.size += available;
+    pni_trace_performative(transport, ch, performative, payload->start, available);
 
+    // the payload goes straight from the delivery into the output buffer
     pn_frame_t frame = {AMQP_FRAME_TYPE};
     frame.channel = ch;
-    frame.payload = buf.start;
-    frame.size = buf.size;
-
-    pn_buffer_ensure(transport->output_buffer, AMQP_HEADER_SIZE+frame.ex_size+frame.size);
-    pn_write_frame(transport->output_buffer, frame);
-    transport->output_frames_ct += 1;
+    frame.payload = performative.start;
+    frame.size = performative.size;
+    pni_write_frame_body(transport, frame, pn_bytes(available, payload->start));
+    payload->start += available;
+    payload->size -= available;
     framecount++;
-    if (PN_SHOULD_LOG(&transport->logger, PN_SUBSYSTEM_IO, PN_LEVEL_RAW)) {
-      pn_string_set(transport->scratch, "RAW: \"");
-      pn_buffer_quote(transport->output_buffer, transport->scratch, AMQP_HEADER_SIZE+frame.ex_size+frame.size);
-      pn_string_addf(transport->scratch, "\"");
-      pni_logger_log(&transport->logger, PN_SUBSYSTEM_IO, PN_LEVEL_RAW, pn_string_get(transport->scratch));
-    }
   } while (payload->size > 0 && framecount < frame_limit);
 
   return framecount;
@@ -1076,8 +1366,8 @@ static int pni_post_close(pn_transport_t *transport, pn_condition_t *cond)
     info = pn_condition_info(cond);
   }
 
-  return pn_post_frame(transport, AMQP_FRAME_TYPE, 0, "DL[?DL[sSC]]", CLOSE,
-                       (bool) condition, ERROR, condition, description, info);
+  return pn_post_frame(transport, AMQP_FRAME_TYPE, 0,
+                       pn_amqp_encode_close(&transport->frame, (bool) condition, ERROR, condition, description, info));
 }
 
 static pn_collector_t *pni_transport_collector(pn_transport_t *transport)
@@ -1159,7 +1449,7 @@ static char *pn_bytes_strdup(pn_bytes_t str)
   return pn_strndup(str.start, str.size);
 }
 
-int pn_do_open(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_open(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   pn_connection_t *conn = transport->connection;
   bool container_q, hostname_q, remote_channel_max_q, remote_max_frame_q;
@@ -1212,7 +1502,7 @@ int pn_do_open(pn_transport_t *transport, uint8_t frame_type, uint16_t channel,
   return 0;
 }
 
-int pn_do_begin(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_begin(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   bool reply;
   uint16_t remote_channel;
@@ -1234,7 +1524,7 @@ int pn_do_begin(pn_transport_t *transport, uint8_t frame_type, uint16_t channel,
 
   pn_session_t *ssn;
   if (reply) {
-    ssn = (pn_session_t *) pn_hash_get(transport->local_channels, remote_channel);
+    ssn = (pn_session_t *) pni_alias_map_get(&transport->local_channels, remote_channel);
     if (ssn == 0) {
       pn_do_error(transport,
                 "amqp:invalid-field",
@@ -1247,7 +1537,8 @@ int pn_do_begin(pn_transport_t *transport, uint8_t frame_type, uint16_t channel,
     ssn = pn_session(transport->connection);
   }
   ssn->state.incoming_transfer_count = next;
-  pni_map_remote_channel(ssn, channel);
+  err = pni_map_remote_channel(ssn, channel);
+  if (err) return err;
   PN_SET_REMOTE(ssn->endpoint.state, PN_REMOTE_ACTIVE);
   pn_collector_put(transport->connection->collector, PN_OBJECT, ssn, PN_SESSION_REMOTE_OPEN);
   return 0;
@@ -1257,16 +1548,14 @@ static pn_link_t *pni_find_link(pn_session_t *ssn, pn_bytes_t name, bool is_send
 {
   pn_endpoint_type_t type = is_sender ? SENDER : RECEIVER;
 
-  for (size_t i = 0; i < pn_list_size(ssn->links); i++)
+  for (pn_link_t *link = pni_session_link_named(ssn, name); link; link = pni_link_named_next(link, name))
   {
-    pn_link_t *link = (pn_link_t *) pn_list_get(ssn->links, i);
     if (link->endpoint.type == type &&
         // This function is used to locate the link object for an
         // incoming attach. If a link object of the same name is found
         // which is remotely closed or detached, assume that is
         // no longer in use and a new link is intended.
-        (!(link->endpoint.state & PN_REMOTE_CLOSED) && ((int32_t) link->state.remote_handle != -2)) &&
-        pn_bytes_equal(name, pn_string_bytes(link->name)))
+        (!(link->endpoint.state & PN_REMOTE_CLOSED) && ((int32_t) link->state.remote_handle != -2)))
     {
       return link;
     }
@@ -1276,29 +1565,31 @@ static pn_link_t *pni_find_link(pn_session_t *ssn, pn_bytes_t name, bool is_send
 
 static void set_expiry_policy_from_symbol(pn_terminus_t* terminus, pn_bytes_t symbol)
 {
-  if (symbol.start) {
-    if (pn_bytes_equal(symbol, PN_BYTES_LITERAL(link-detach)))
-      pn_terminus_set_expiry_policy(terminus, PN_EXPIRE_WITH_LINK);
-    if (pn_bytes_equal(symbol, PN_BYTES_LITERAL(session-end)))
-      pn_terminus_set_expiry_policy(terminus, PN_EXPIRE_WITH_SESSION);
-    if (pn_bytes_equal(symbol, PN_BYTES_LITERAL(connection-close)))
-      pn_terminus_set_expiry_policy(terminus, PN_EXPIRE_WITH_CONNECTION);
-    if (pn_bytes_equal(symbol, PN_BYTES_LITERAL(never)))
-      pn_terminus_set_expiry_policy(terminus, PN_EXPIRE_NEVER);
+  switch (pni_symbol_lookup(symbol)) {
+  case PNI_SYM_LINK_DETACH:
+    pn_terminus_set_expiry_policy(terminus, PN_EXPIRE_WITH_LINK);
+    break;
+  case PNI_SYM_SESSION_END:
+    pn_terminus_set_expiry_policy(terminus, PN_EXPIRE_WITH_SESSION);
+    break;
+  case PNI_SYM_CONNECTION_CLOSE:
+    pn_terminus_set_expiry_policy(terminus, PN_EXPIRE_WITH_CONNECTION);
+    break;
+  case PNI_SYM_NEVER:
+    pn_terminus_set_expiry_policy(terminus, PN_EXPIRE_NEVER);
+    break;
+  default:
+    break;
   }
 }
 
 static pn_distribution_mode_t symbol2dist_mode(const pn_bytes_t symbol)
 {
-  if (!symbol.start)
-    return PN_DIST_MODE_UNSPECIFIED;
-
-  if (pn_bytes_equal(symbol, PN_BYTES_LITERAL(move)))
-    return PN_DIST_MODE_MOVE;
-  if (pn_bytes_equal(symbol, PN_BYTES_LITERAL(copy)))
-    return PN_DIST_MODE_COPY;
-
-  return PN_DIST_MODE_UNSPECIFIED;
+  switch (pni_symbol_lookup(symbol)) {
+  case PNI_SYM_MOVE: return PN_DIST_MODE_MOVE;
+  case PNI_SYM_COPY: return PN_DIST_MODE_COPY;
+  default: return PN_DIST_MODE_UNSPECIFIED;
+  }
 }
 
 static const char *dist_mode2symbol(const pn_distribution_mode_t mode)
@@ -1320,7 +1611,7 @@ int pn_terminus_set_address_bytes(pn_terminus_t *terminus, pn_bytes_t address)
   return pn_string_setn(terminus->address, address.start, address.size);
 }
 
-int pn_do_attach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_attach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   pn_bytes_t name;
   uint32_t handle;
@@ -1373,7 +1664,8 @@ int pn_do_attach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel
     free(strheap);
   }
 
-  pni_map_remote_handle(link, handle);
+  err = pni_map_remote_handle(link, handle);
+  if (err) return err;
   PN_SET_REMOTE(link->endpoint.state, PN_REMOTE_ACTIVE);
   pn_terminus_t *rsrc = &link->remote_source;
   if (source.start || src_dynamic) {
@@ -1473,7 +1765,18 @@ static void pn_full_settle(pn_delivery_map_t *db, pn_delivery_t *delivery)
   pn_decref(delivery);
 }
 
-int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+static void pni_transfer_aborted(pn_transport_t *transport, pn_delivery_t *delivery)
+{
+  delivery->aborted = true;
+  delivery->remote.settled = true;
+  delivery->done = true;
+  delivery->updated = true;
+  pn_work_update(transport->connection, delivery);
+}
+
+// Handle a transfer frame of which only the first part of the payload, with
+// rest more bytes to come, may have arrived
+int pn_do_transfer_head(pn_transport_t *transport, uint16_t channel, pn_bytes_t performative, const pn_bytes_t *payload, uint32_t rest)
 {
   // XXX: multi transfer
   uint32_t handle;
@@ -1486,9 +1789,9 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
   bool resume, aborted, batchable;
   uint64_t type;
   pn_data_clear(transport->disp_data);
-  int err = pn_data_scan(args, "D.[I?Iz.?oo.D?LCooo]", &handle, &id_present, &id, &tag,
-                         &settled_set, &settled, &more, &has_type, &type, transport->disp_data,
-                         &resume, &aborted, &batchable);
+  int err = pn_amqp_decode_transfer(performative, &handle, &id_present, &id, &tag,
+                                    &settled_set, &settled, &more, &has_type, &type, transport->disp_data,
+                                    &resume, &aborted, &batchable);
   if (err) return err;
   pn_session_t *ssn = pni_channel_state(transport, channel);
   if (!ssn) {
@@ -1519,6 +1822,7 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
 
     delivery = pn_delivery(link, pn_dtag(tag.start, tag.size));
     pn_delivery_state_t *state = pni_delivery_map_push(incoming, delivery);
+    if (!state) return PN_OUT_OF_MEMORY;
     if (id_present && id != state->id) {
       return pn_do_error(transport, "amqp:session:invalid-field",
                          "sequencing error, expected delivery-id %u, got %u",
@@ -1536,7 +1840,16 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
 
   pn_buffer_append(delivery->bytes, payload->start, payload->size);
   ssn->incoming_bytes += payload->size;
-  delivery->done = !more;
+  pni_link_received(link, payload->size);
+  if (rest) {
+    transport->input_transfer_rest = rest;
+    transport->input_transfer_handle = handle;
+    transport->input_transfer_channel = channel;
+    transport->input_transfer_more = more;
+    transport->input_transfer_aborted = aborted;
+  } else {
+    delivery->done = !more;
+  }
 
   // XXX: need to fill in remote state: delivery->remote.state = ...;
   if (settled && !delivery->remote.settled) {
@@ -1553,25 +1866,52 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
     pni_post_flow(transport, ssn, link);
   }
 
-  if ((delivery->aborted = aborted)) {
-    delivery->remote.settled = true;
-    delivery->done = true;
-    delivery->updated = true;
-    pn_work_update(transport->connection, delivery);
+  if (!rest && aborted) {
+    pni_transfer_aborted(transport, delivery);
+  }
+  pn_collector_put(transport->connection->collector, PN_OBJECT, delivery, PN_DELIVERY);
+  return 0;
+}
+
+int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
+{
+  return pn_do_transfer_head(transport, channel, performative, payload, 0);
+}
+
+// Handle more of the payload of the transfer frame started by
+// pn_do_transfer_head()
+int pn_do_transfer_rest(pn_transport_t *transport, pn_bytes_t payload)
+{
+  transport->input_transfer_rest -= payload.size;
+  pn_session_t *ssn = pni_channel_state(transport, transport->input_transfer_channel);
+  pn_link_t *link = ssn ? pni_handle_state(ssn, transport->input_transfer_handle) : NULL;
+  pn_delivery_t *delivery = link ? link->unsettled_tail : NULL;
+  // Drop the payload if the delivery was settled while it arrived
+  if (!delivery || delivery->done) return 0;
+
+  pn_buffer_append(delivery->bytes, payload.start, payload.size);
+  ssn->incoming_bytes += payload.size;
+  pni_link_received(link, payload.size);
+  if (!transport->input_transfer_rest) {
+    delivery->done = !transport->input_transfer_more;
+    if (transport->input_transfer_aborted) {
+      pni_transfer_aborted(transport, delivery);
+    }
   }
   pn_collector_put(transport->connection->collector, PN_OBJECT, delivery, PN_DELIVERY);
   return 0;
 }
 
-int pn_do_flow(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+
+int pn_do_flow(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   pn_sequence_t onext, inext, delivery_count;
   uint32_t iwin, owin, link_credit;
   uint32_t handle;
   bool inext_init, handle_init, dcount_init, drain;
-  int err = pn_data_scan(args, "D.[?IIII?I?II.o]", &inext_init, &inext, &iwin,
-                         &onext, &owin, &handle_init, &handle, &dcount_init,
-                         &delivery_count, &link_credit, &drain);
+  int err = pn_amqp_decode_flow(performative, &inext_init, &inext, &iwin,
+                                &onext, &owin, &handle_init, &handle, &dcount_init,
+                                &delivery_count, &link_credit, &drain);
   if (err) return err;
 
   pn_session_t *ssn = pni_channel_state(transport, channel);
@@ -1710,16 +2050,16 @@ static int pni_do_delivery_disposition(pn_transport_t * transport, pn_delivery_t
   return 0;
 }
 
-int pn_do_disposition(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_disposition(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   bool role;
   pn_sequence_t first, last;
   uint64_t type = 0;
   bool last_init, settled, type_init;
   pn_data_clear(transport->disp_data);
-  int err = pn_data_scan(args, "D.[oI?IoD?LC]", &role, &first, &last_init,
-                         &last, &settled, &type_init, &type,
-                         transport->disp_data);
+  int err = pn_amqp_decode_disposition(performative, &role, &first, &last_init,
+                                       &last, &settled, &type_init, &type,
+                                       transport->disp_data);
   if (err) return err;
   if (!last_init) last = first;
 
@@ -1743,37 +2083,49 @@ int pn_do_disposition(pn_transport_t *transport, uint8_t frame_type, uint16_t ch
   bool remote_data = (pn_data_next(transport->disp_data) &&
                       pn_data_get_list(transport->disp_data) > 0);
 
-  // Do some validation of received first and last values
-  // TODO: We should really also clamp the first value here, but we're not keeping track of the earliest
-  // unsettled delivery sequence no
-  last = sequence_lte(last, deliveries->next) ? last : deliveries->next;
-
-  // If there are fewer deliveries in the session than the range then look at every delivery in the session
-  // otherwise look at every delivery_id in the disposition performative
-  pn_hash_t *dh = deliveries->deliveries;
-  if (last-first+1 >= pn_hash_size(dh)) {
-    for (pn_handle_t entry = pn_hash_head(dh); entry!=0 ; entry = pn_hash_next(dh, entry)) {
-      pn_sequence_t key = pn_hash_key(dh, entry);
-      if (sequence_lte(first, key) && sequence_lte(key, last)) {
-        pn_delivery_t *delivery = (pn_delivery_t*) pn_hash_value(dh, entry);
-        err = pni_do_delivery_disposition(transport, delivery, settled, remote_data, type_init, type);
-        if (err) return err;
+  // Only the mapped ids in the range can name a delivery.  Those spilled out
+  // of the ring come before its first id: look at each of them if there are
+  // fewer than the ids in that part of the range, otherwise at each id.
+  size_t spilled = pni_delivery_map_spilled(deliveries);
+  if (spilled && !sequence_lte(deliveries->first, first)) {
+    pn_sequence_t spill_last = sequence_lte(last, deliveries->first - 1) ? last : deliveries->first - 1;
+    pn_hash_t *dh = deliveries->spilled;
+    if ((pn_sequence_t) (spill_last - first) >= spilled - 1) {
+      for (pn_handle_t entry = pn_hash_head(dh); entry; entry = pn_hash_next(dh, entry)) {
+        pn_sequence_t key = pn_hash_key(dh, entry);
+        if (sequence_lte(first, key) && sequence_lte(key, spill_last)) {
+          pn_delivery_t *delivery = (pn_delivery_t *) pn_hash_value(dh, entry);
+          err = pni_do_delivery_disposition(transport, delivery, settled, remote_data, type_init, type);
+          if (err) return err;
+        }
       }
-    }
-  } else {
-    for (pn_sequence_t id = first; sequence_lte(id, last); ++id) {
-      pn_delivery_t *delivery = pni_delivery_map_get(deliveries, id);
-      if (delivery) {
-        err = pni_do_delivery_disposition(transport, delivery, settled, remote_data, type_init, type);
-        if (err) return err;
+    } else {
+      for (pn_sequence_t id = first; sequence_lte(id, spill_last); ++id) {
+        pn_delivery_t *delivery = (pn_delivery_t *) pn_hash_get(dh, id);
+        if (delivery) {
+          err = pni_do_delivery_disposition(transport, delivery, settled, remote_data, type_init, type);
+          if (err) return err;
+        }
       }
     }
   }
 
+  if (!deliveries->size) return 0;
+  if (!sequence_lte(deliveries->first, first)) first = deliveries->first;
+  if (!sequence_lte(last, deliveries->next - 1)) last = deliveries->next - 1;
+
+  for (pn_sequence_t id = first; sequence_lte(id, last); ++id) {
+    pn_delivery_t *delivery = *pni_delivery_map_slot(deliveries, id);
+    if (delivery) {
+      err = pni_do_delivery_disposition(transport, delivery, settled, remote_data, type_init, type);
+      if (err) return err;
+    }
+  }
+
   return 0;
 }
 
-int pn_do_detach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_detach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   uint32_t handle;
   bool closed;
@@ -1804,7 +2156,7 @@ int pn_do_detach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel
   return 0;
 }
 
-int pn_do_end(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_end(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   pn_session_t *ssn = pni_channel_state(transport, channel);
   if (!ssn) {
@@ -1818,7 +2170,7 @@ int pn_do_end(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, p
   return 0;
 }
 
-int pn_do_close(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_close(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   pn_connection_t *conn = transport->connection;
   int err = pn_scan_error(args, &transport->remote_condition, SCAN_ERROR_DEFAULT);
@@ -1912,7 +2264,7 @@ static int pni_process_conn_setup(pn_transport_t *transport, pn_endpoint_t *endp
       pn_connection_t *connection = (pn_connection_t *) endpoint;
       const char *cid = pn_string_get(connection->container);
       pni_calculate_channel_max(transport);
-      int err = pn_post_frame(transport, AMQP_FRAME_TYPE, 0, "DL[SS?I?H?InnMMC]", OPEN,
+      pn_bytes_t open = pn_amqp_encode_open(&transport->frame,
                               cid ? cid : "",
                               pn_string_get(connection->hostname),
                               // TODO: This is messy, because we also have to allow local_max_frame_ to be 0 to mean unlimited
@@ -1924,6 +2276,7 @@ static int pni_process_conn_setup(pn_transport_t *transport, pn_endpoint_t *endp
                               connection->offered_capabilities,
                               connection->desired_capabilities,
                               connection->properties);
+      int err = pn_post_frame(transport, AMQP_FRAME_TYPE, 0, open);
       if (err) return err;
       transport->open_sent = true;
     }
@@ -1932,22 +2285,19 @@ static int pni_process_conn_setup(pn_transport_t *transport, pn_endpoint_t *endp
   return 0;
 }
 
-static uint16_t allocate_alias(pn_hash_t *aliases, uint32_t max_index, int * valid)
+static size_t pni_session_outgoing_window(pn_session_t *ssn)
 {
-  for (uint32_t i = 0; i <= max_index; i++) {
-    if (!pn_hash_get(aliases, i)) {
-      * valid = 1;
-      return i;
-    }
-  }
-
-  * valid = 0;
-  return 0;
+  return ssn->outgoing_window;
 }
 
-static size_t pni_session_outgoing_window(pn_session_t *ssn)
+// The incoming window, in frames, left by the delivery windows of the
+// session's receivers
+static size_t pni_delivery_windows(pn_session_t *ssn, uint32_t frame_size)
 {
-  return ssn->outgoing_window;
+  if (ssn->windowed_bytes >= ssn->delivery_windows) return 0;
+  size_t room = ssn->delivery_windows - ssn->windowed_bytes;
+  // always allow a frame so a window smaller than a frame still progresses
+  return frame_size ? pn_max(room / frame_size, 1) : 1;
 }
 
 static size_t pni_session_incoming_window(pn_session_t *ssn)
@@ -1955,32 +2305,25 @@ static size_t pni_session_incoming_window(pn_session_t *ssn)
   pn_transport_t *t = ssn->connection->transport;
   uint32_t size = t->local_max_frame;
   size_t capacity = ssn->incoming_capacity;
+  size_t window = ssn->delivery_windows ? pni_delivery_windows(ssn, size) : AMQP_MAX_WINDOW_SIZE;
   if (!size || !capacity) {     /* session flow control is not enabled */
-    return AMQP_MAX_WINDOW_SIZE;
-  } else if (capacity >= size) { /* precondition */
-    return (capacity - ssn->incoming_bytes) / size;
-  } else {                     /* error: we will never have a non-zero window */
-    pn_condition_format(
-      pn_transport_condition(t),
-      "amqp:internal-error",
-      "session capacity %" PN_ZU " is less than frame size %" PRIu32,
-      capacity, size);
-    pn_transport_close_tail(t);
-    return 0;
+    return window;
   }
+  /* A capacity under one frame would never open the window, so it counts as one frame */
+  capacity = pn_max(capacity, size);
+  return pn_min(window, (capacity - ssn->incoming_bytes) / size);
 }
 
 static int pni_map_local_channel(pn_session_t *ssn)
 {
   pn_transport_t *transport = ssn->connection->transport;
   pn_session_state_t *state = &ssn->state;
-  int valid;
-  uint16_t channel = allocate_alias(transport->local_channels, transport->channel_max, & valid);
-  if (!valid) {
+  uint32_t channel;
+  if (!pni_alias_map_allocate(&transport->local_channels, transport->channel_max, &channel) ||
+      !pni_alias_map_put(&transport->local_channels, channel, ssn)) {
     return 0;
   }
   state->local_channel = channel;
-  pn_hash_put(transport->local_channels, channel, ssn);
   pn_ep_incref(&ssn->endpoint);
   return 1;
 }
@@ -1999,11 +2342,12 @@ static int pni_process_ssn_setup(pn_transport_t *transport, pn_endpoint_t *endpo
       }
       state->incoming_window = pni_session_incoming_window(ssn);
       state->outgoing_window = pni_session_outgoing_window(ssn);
-      pn_post_frame(transport, AMQP_FRAME_TYPE, state->local_channel, "DL[?HIII]", BEGIN,
-                    ((int16_t) state->remote_channel >= 0), state->remote_channel,
-                    state->outgoing_transfer_count,
-                    state->incoming_window,
-                    state->outgoing_window);
+      pn_post_frame(transport, AMQP_FRAME_TYPE, state->local_channel,
+                    pn_amqp_encode_begin(&transport->frame,
+                                         ((int16_t) state->remote_channel >= 0), state->remote_channel,
+                                         state->outgoing_transfer_count,
+                                         state->incoming_window,
+                                         state->outgoing_window));
     }
   }
 
@@ -2031,12 +2375,12 @@ static const char *expiry_symbol(pn_terminus_t* terminus)
 static int pni_map_local_handle(pn_link_t *link) {
   pn_link_state_t *state = &link->state;
   pn_session_state_t *ssn_state = &link->session->state;
-  int valid;
+  uint32_t handle;
   // XXX TODO MICK: once changes are made to handle_max, change this hardcoded value to something reasonable.
-  state->local_handle = allocate_alias(ssn_state->local_handles, 65536, & valid);
-  if ( ! valid )
+  if (!pni_alias_map_allocate(&ssn_state->local_handles, PNI_ALIAS_MAX - 1, &handle) ||
+      !pni_alias_map_put(&ssn_state->local_handles, handle, link))
     return 0;
-  pn_hash_put(ssn_state->local_handles, state->local_handle, link);
+  state->local_handle = handle;
   pn_ep_incref(&link->endpoint);
   return 1;
 }
@@ -2055,8 +2399,7 @@ static int pni_process_link_setup(pn_transport_t *transport, pn_endpoint_t *endp
       pni_map_local_handle(link);
       const pn_distribution_mode_t dist_mode = (pn_distribution_mode_t) link->source.distribution_mode;
       if (link->target.type == PN_COORDINATOR) {
-        int err = pn_post_frame(transport, AMQP_FRAME_TYPE, ssn_state->local_channel,
-                                "DL[SIoBB?DL[SIsIoC?sCnCC]DL[C]nnI]", ATTACH,
+        pn_bytes_t attach = pn_amqp_encode_attach_coordinator(&transport->frame,
                                 pn_string_get(link->name),
                                 state->local_handle,
                                 endpoint->type == RECEIVER,
@@ -2075,10 +2418,10 @@ static int pni_process_link_setup(pn_transport_t *transport, pn_endpoint_t *endp
                                 link->source.capabilities,
                                 COORDINATOR, link->target.capabilities,
                                 0);
+        int err = pn_post_frame(transport, AMQP_FRAME_TYPE, ssn_state->local_channel, attach);
         if (err) return err;
       } else {
-        int err = pn_post_frame(transport, AMQP_FRAME_TYPE, ssn_state->local_channel,
-                                "DL[SIoBB?DL[SIsIoC?sCnMM]?DL[SIsIoCM]nnIL]", ATTACH,
+        pn_bytes_t attach = pn_amqp_encode_attach(&transport->frame,
                                 pn_string_get(link->name),
                                 state->local_handle,
                                 endpoint->type == RECEIVER,
@@ -2107,6 +2450,7 @@ static int pni_process_link_setup(pn_transport_t *transport, pn_endpoint_t *endp
                                 link->target.capabilities,
 
                                 0, link->max_message_size);
+        int err = pn_post_frame(transport, AMQP_FRAME_TYPE, ssn_state->local_channel, attach);
         if (err) return err;
       }
     }
@@ -2121,7 +2465,7 @@ static int pni_post_flow(pn_transport_t *transport, pn_session_t *ssn, pn_link_t
   ssn->state.outgoing_window = pni_session_outgoing_window(ssn);
   bool linkq = (bool) link;
   pn_link_state_t *state = &link->state;
-  return pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, "DL[?IIII?I?I?In?o]", FLOW,
+  pn_bytes_t flow = pn_amqp_encode_flow(&transport->frame,
                        (int16_t) ssn->state.remote_channel >= 0, ssn->state.incoming_transfer_count,
                        ssn->state.incoming_window,
                        ssn->state.outgoing_transfer_count,
@@ -2130,6 +2474,7 @@ static int pni_post_flow(pn_transport_t *transport, pn_session_t *ssn, pn_link_t
                        linkq, linkq ? state->delivery_count : 0,
                        linkq, linkq ? state->link_credit : 0,
                        linkq, linkq ? link->drain : false);
+  return pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, flow);
 }
 
 static int pni_process_flow_receiver(pn_transport_t *transport, pn_endpoint_t *endpoint)
@@ -2155,12 +2500,13 @@ static int pni_flush_disp(pn_transport_t *transport, pn_session_t *ssn)
   uint64_t code = ssn->state.disp_code;
   bool settled = ssn->state.disp_settled;
   if (ssn->state.disp) {
-    int err = pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, "DL[oI?I?o?DL[]]", DISPOSITION,
+    pn_bytes_t disposition = pn_amqp_encode_disposition_range(&transport->frame,
                             ssn->state.disp_type,
                             ssn->state.disp_first,
                             ssn->state.disp_last!=ssn->state.disp_first, ssn->state.disp_last,
                             settled, settled,
                             (bool)code, code);
+    int err = pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, disposition);
     if (err) return err;
     ssn->state.disp_type = 0;
     ssn->state.disp_code = 0;
@@ -2191,10 +2537,10 @@ static int pni_post_disp(pn_transport_t *transport, pn_delivery_t *delivery)
     pn_data_clear(transport->disp_data);
     PN_RETURN_IF_ERROR(pni_disposition_encode(&delivery->local, transport->disp_data));
     return pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel,
-      "DL[oIn?o?DLC]", DISPOSITION,
-      role, state->id,
-      delivery->local.settled, delivery->local.settled,
-      (bool)code, code, transport->disp_data);
+      pn_amqp_encode_disposition(&transport->frame,
+                                 role, state->id,
+                                 delivery->local.settled, delivery->local.settled,
+                                 (bool)code, code, transport->disp_data));
   }
 
   if (ssn_state->disp && code == ssn_state->disp_code &&
@@ -2244,6 +2590,7 @@ static int pni_process_tpwork_sender(pn_transport_t *transport, pn_delivery_t *d
         ssn_state->remote_incoming_window > 0 && link_state->link_credit > 0) {
       if (!state->init) {
         state = pni_delivery_map_push(&ssn_state->outgoing, delivery);
+        if (!state) return PN_OUT_OF_MEMORY;
       }
 
       pn_bytes_t bytes = pn_buffer_bytes(delivery->bytes);
@@ -2253,7 +2600,7 @@ static int pni_process_tpwork_sender(pn_transport_t *transport, pn_delivery_t *d
       PN_RETURN_IF_ERROR(pni_disposition_encode(&delivery->local, transport->disp_data));
       int count = pni_post_amqp_transfer_frame(transport,
                                                ssn_state->local_channel,
-                                               link_state->local_handle,
+                                               link_state,
                                                state->id, &bytes, &tag,
                                                0, // message-format
                                                delivery->local.settled,
@@ -2394,13 +2741,12 @@ static int pni_process_flow_sender(pn_transport_t *transport, pn_endpoint_t *end
 
 static void pni_unmap_local_handle(pn_link_t *link) {
   pn_link_state_t *state = &link->state;
-  uintptr_t handle = state->local_handle;
+  uint32_t handle = state->local_handle;
   state->local_handle = -2;
-  if (pn_hash_get(link->session->state.local_handles, handle)) {
+  if (pni_alias_map_del(&link->session->state.local_handles, handle, link)) {
+    // may delete link
     pn_ep_decref(&link->endpoint);
   }
-  // may delete link
-  pn_hash_del(link->session->state.local_handles, handle);
 }
 
 static int pni_process_link_teardown(pn_transport_t *transport, pn_endpoint_t *endpoint)
@@ -2430,9 +2776,9 @@ static int pni_process_link_teardown(pn_transport_t *transport, pn_endpoint_t *e
 
       int err =
           pn_post_frame(transport, AMQP_FRAME_TYPE, ssn_state->local_channel,
-                        "DL[I?o?DL[sSC]]", DETACH, state->local_handle,
-                        !link->detached, !link->detached,
-                        (bool)name, ERROR, name, description, info);
+                        pn_amqp_encode_detach(&transport->frame, state->local_handle,
+                                              !link->detached, !link->detached,
+                                              (bool)name, ERROR, name, description, info));
       if (err) return err;
       pni_unmap_local_handle(link);
     }
@@ -2447,20 +2793,16 @@ static bool pni_pointful_buffering(pn_transport_t *transport, pn_session_t *sess
 {
   if (transport->close_rcvd) return false;
   if (!transport->open_rcvd) return true;
-
-  pn_connection_t *conn = transport->connection;
-  pn_link_t *link = pn_link_head(conn, 0);
-  while (link) {
-    if (pn_link_is_sender(link) && pn_link_queued(link) > 0) {
-      pn_session_t *ssn = link->session;
-      if (session && session == ssn) {
-        if ((int32_t) link->state.remote_handle != -2 &&
-            (int16_t) session->state.remote_channel != -2) {
-          return true;
-        }
-      }
+  if (!session || (int16_t) session->state.remote_channel == -2) return false;
+
+  // only the session's own links can hold it open
+  size_t nlinks = pn_list_size(session->links);
+  for (size_t i = 0; i < nlinks; i++) {
+    pn_link_t *link = (pn_link_t *) pn_list_get(session->links, i);
+    if (pn_link_is_sender(link) && pn_link_queued(link) > 0 &&
+        (int32_t) link->state.remote_handle != -2) {
+      return true;
     }
-    link = pn_link_next(link, 0);
   }
 
   return false;
@@ -2469,16 +2811,15 @@ static bool pni_pointful_buffering(pn_transport_t *transport, pn_session_t *sess
 static void pni_unmap_local_channel(pn_session_t *ssn) {
   // XXX: should really update link state also
   pni_delivery_map_clear(&ssn->state.outgoing);
-  pni_transport_unbind_handles(ssn->state.local_handles, false);
+  pni_transport_unbind_handles(&ssn->state.local_handles, false);
   pn_transport_t *transport = ssn->connection->transport;
   pn_session_state_t *state = &ssn->state;
-  uintptr_t channel = state->local_channel;
+  uint16_t channel = state->local_channel;
   state->local_channel = -2;
-  if (pn_hash_get(transport->local_channels, channel)) {
+  if (pni_alias_map_del(&transport->local_channels, channel, ssn)) {
+    // may delete session
     pn_ep_decref(&ssn->endpoint);
   }
-  // may delete session
-  pn_hash_del(transport->local_channels, channel);
 }
 
 static int pni_process_ssn_teardown(pn_transport_t *transport, pn_endpoint_t *endpoint)
@@ -2504,8 +2845,8 @@ static int pni_process_ssn_teardown(pn_transport_t *transport, pn_endpoint_t *en
         info = pn_condition_info(&endpoint->condition);
       }
 
-      int err = pn_post_frame(transport, AMQP_FRAME_TYPE, state->local_channel, "DL[?DL[sSC]]", END,
-                              (bool) name, ERROR, name, description, info);
+      int err = pn_post_frame(transport, AMQP_FRAME_TYPE, state->local_channel,
+                              pn_amqp_encode_end(&transport->frame, (bool) name, ERROR, name, description, info));
       if (err) return err;
       pni_unmap_local_channel(session);
     }
@@ -2531,10 +2872,12 @@ static int pni_process_conn_teardown(pn_transport_t *transport, pn_endpoint_t *e
   return 0;
 }
 
-static int pni_phase(pn_transport_t *transport, int (*phase)(pn_transport_t *, pn_endpoint_t *))
+// Run phase on the modified endpoints of one kind
+static int pni_phase(pn_transport_t *transport, pni_modified_t kind,
+                     int (*phase)(pn_transport_t *, pn_endpoint_t *))
 {
   pn_connection_t *conn = transport->connection;
-  pn_endpoint_t *endpoint = conn->transport_head;
+  pn_endpoint_t *endpoint = conn->modified[kind].transport_head;
   while (endpoint)
   {
     pn_endpoint_t *next = endpoint->transport_next;
@@ -2548,23 +2891,23 @@ static int pni_phase(pn_transport_t *transport, int (*phase)(pn_transport_t *, p
 static int pni_process(pn_transport_t *transport)
 {
   int err;
-  if ((err = pni_phase(transport, pni_process_conn_setup))) return err;
-  if ((err = pni_phase(transport, pni_process_ssn_setup))) return err;
-  if ((err = pni_phase(transport, pni_process_link_setup))) return err;
-  if ((err = pni_phase(transport, pni_process_flow_receiver))) return err;
+  if ((err = pni_phase(transport, PNI_MODIFIED_CONNECTION, pni_process_conn_setup))) return err;
+  if ((err = pni_phase(transport, PNI_MODIFIED_SESSIONS, pni_process_ssn_setup))) return err;
+  if ((err = pni_phase(transport, PNI_MODIFIED_LINKS, pni_process_link_setup))) return err;
+  if ((err = pni_phase(transport, PNI_MODIFIED_LINKS, pni_process_flow_receiver))) return err;
 
   // XXX: this has to happen two times because we might settle stuff
   // on the first pass and create space for more work to be done on the
   // second pass
-  if ((err = pni_phase(transport, pni_process_tpwork))) return err;
-  if ((err = pni_phase(transport, pni_process_tpwork))) return err;
+  if ((err = pni_phase(transport, PNI_MODIFIED_CONNECTION, pni_process_tpwork))) return err;
+  if ((err = pni_phase(transport, PNI_MODIFIED_CONNECTION, pni_process_tpwork))) return err;
 
-  if ((err = pni_phase(transport, pni_process_flush_disp))) return err;
+  if ((err = pni_phase(transport, PNI_MODIFIED_SESSIONS, pni_process_flush_disp))) return err;
 
-  if ((err = pni_phase(transport, pni_process_flow_sender))) return err;
-  if ((err = pni_phase(transport, pni_process_link_teardown))) return err;
-  if ((err = pni_phase(transport, pni_process_ssn_teardown))) return err;
-  if ((err = pni_phase(transport, pni_process_conn_teardown))) return err;
+  if ((err = pni_phase(transport, PNI_MODIFIED_LINKS, pni_process_flow_sender))) return err;
+  if ((err = pni_phase(transport, PNI_MODIFIED_LINKS, pni_process_link_teardown))) return err;
+  if ((err = pni_phase(transport, PNI_MODIFIED_SESSIONS, pni_process_ssn_teardown))) return err;
+  if ((err = pni_phase(transport, PNI_MODIFIED_CONNECTION, pni_process_conn_teardown))) return err;
 
   if (transport->connection->tpwork_head) {
     pn_modified(transport->connection, &transport->connection->endpoint, false);
@@ -2579,7 +2922,8 @@ static void pn_error_amqp(pn_transport_t* transport, unsigned int layer)
 {
   if (!transport->close_sent) {
     if (!transport->open_sent) {
-      pn_post_frame(transport, AMQP_FRAME_TYPE, 0, "DL[S]", OPEN, "");
+      pn_post_frame(transport, AMQP_FRAME_TYPE, 0,
+                    pn_amqp_encode_open(&transport->frame, "", NULL, false, 0, false, 0, false, 0, NULL, NULL, NULL));
     }
 
     pni_post_close(transport, &transport->condition);
@@ -2676,7 +3020,7 @@ static int64_t pn_tick_amqp(pn_transport_t* transport, unsigned int layer, int64
       transport->keepalive_deadline = now + (pn_timestamp_t)(transport->remote_idle_timeout/2.0);
       if (pn_buffer_size(transport->output_buffer) == 0) {    // no outbound data pending
         // so send empty frame (and account for it!)
-        pn_post_frame(transport, AMQP_FRAME_TYPE, 0, "");
+        pn_post_frame(transport, AMQP_FRAME_TYPE, 0, pn_bytes(0, ""));
         transport->last_bytes_output += pn_buffer_size(transport->output_buffer);
       }
     }
@@ -2741,6 +3085,28 @@ static ssize_t transport_produce(pn_transport_t *transport)
 {
   if (transport->head_closed) return PN_EOS;
 
+  if (!transport->output_buf) {
+    // Only allocate the buffer, which may have been released, once there is
+    // some output to put in it
+    char first[64];
+    ssize_t n = transport->io_layers[0]->process_output(transport, 0, first, sizeof(first));
+    if (n == 0) return 0;
+    if (n < 0) {
+      PN_LOG(&transport->logger, PN_SUBSYSTEM_AMQP | PN_SUBSYSTEM_IO, PN_LEVEL_FRAME | PN_LEVEL_RAW, "  -> EOS");
+      pni_close_head(transport);
+      return n;
+    }
+    transport->output_buf = (char *) pni_mem_suballocate(pn_class(transport), transport, transport->output_size);
+    if (!transport->output_buf) {
+      // The output taken can't be kept, so the connection can't go on
+      pn_condition_format(pn_transport_condition(transport), "proton:io", "out of memory for output");
+      pni_close_head(transport);
+      return PN_OUT_OF_MEMORY;
+    }
+    memcpy(transport->output_buf, first, n);
+    transport->output_pending = n;
+  }
+
   ssize_t space = transport->output_size - transport->output_pending;
 
   if (space <= 0) {     // can we expand the buffer?
@@ -2934,11 +3300,95 @@ void pn_transport_set_idle_timeout(pn_transport_t *transport, pn_millis_t timeou
   transport->local_idle_timeout = timeout;
 }
 
+pn_millis_t pn_transport_get_buffer_release_timeout(pn_transport_t *transport)
+{
+  return transport->buffer_release_timeout;
+}
+
+void pn_transport_set_buffer_release_timeout(pn_transport_t *transport, pn_millis_t timeout)
+{
+  transport->buffer_release_timeout = timeout;
+  transport->buffer_release_deadline = 0;
+}
+
 pn_millis_t pn_transport_get_remote_idle_timeout(pn_transport_t *transport)
 {
   return transport->remote_idle_timeout;
 }
 
+// The size to allocate a released buffer at next time: half what it grew to,
+// so the buffers of a busy transport stay near its bursts and those of an
+// idle one go back to the initial size.
+static size_t pni_released_buffer_size(size_t size, size_t initial)
+{
+  return pn_max(size / 2, initial);
+}
+
+// Free the memory of the transport's buffers if they are empty
+static bool pni_transport_release_buffers(pn_transport_t *transport)
+{
+  if (transport->input_pending || transport->output_pending ||
+      pn_buffer_size(transport->output_buffer)) {
+    return false;
+  }
+  pni_mem_subdeallocate(pn_class(transport), transport, transport->input_buf);
+  transport->input_buf = NULL;
+  transport->input_size = pni_released_buffer_size(transport->input_size, PN_TRANSPORT_INITIAL_BUFFER_SIZE);
+  pni_mem_subdeallocate(pn_class(transport), transport, transport->output_buf);
+  transport->output_buf = NULL;
+  transport->output_size = pni_released_buffer_size(transport->output_size, PN_TRANSPORT_INITIAL_BUFFER_SIZE);
+  pn_buffer_release(transport->output_buffer,
+                    pni_released_buffer_size(pn_buffer_capacity(transport->output_buffer),
+                                             PN_TRANSPORT_INITIAL_FRAME_BUFFER_SIZE));
+  if (transport->frame.size > PN_TRANSPORT_INITIAL_FRAME_SIZE) {
+    char *frame = (char *) realloc(transport->frame.start, PN_TRANSPORT_INITIAL_FRAME_SIZE);
+    if (frame) transport->frame = pn_rwbytes(PN_TRANSPORT_INITIAL_FRAME_SIZE, frame);
+  }
+  return true;
+}
+
+static int64_t pni_tick_buffers(pn_transport_t *transport, int64_t now)
+{
+  uint64_t bytes_io = transport->bytes_input + transport->bytes_output;
+  if (transport->last_bytes_io != bytes_io) {
+    transport->last_bytes_io = bytes_io;
+    transport->buffers_released = false;
+    transport->buffer_release_deadline = now + transport->buffer_release_timeout;
+  } else if (transport->buffers_released) {
+    return 0;
+  } else if (transport->buffer_release_deadline == 0) {
+    transport->buffer_release_deadline = now + transport->buffer_release_timeout;
+  } else if (transport->buffer_release_deadline <= now) {
+    transport->buffers_released = pni_transport_release_buffers(transport);
+    transport->buffer_release_deadline = transport->buffers_released ? 0 : now + transport->buffer_release_timeout;
+  }
+  return transport->buffer_release_deadline;
+}
+
+void pni_transport_memory(pn_transport_t *transport, pn_connection_memory_t *usage)
+{
+  usage->transport += pni_object_memory(transport, sizeof(pn_transport_t)) +
+    pni_mem_string_size(transport->remote_container) +
+    pni_mem_string_size(transport->remote_hostname) +
+    pni_data_memory(transport->remote_offered_capabilities) +
+    pni_data_memory(transport->remote_desired_capabilities) +
+    pni_data_memory(transport->remote_properties) +
+    pni_condition_memory(&transport->remote_condition) +
+    pni_condition_memory(&transport->condition) +
+    pni_error_memory(transport->error) +
+    pni_alias_map_memory(&transport->local_channels) + pni_alias_map_memory(&transport->remote_channels) +
+    pni_record_memory(transport->context);
+  usage->transport_buffers += pni_mem_size(transport->input_buf, transport->input_size) +
+    pni_mem_size(transport->output_buf, transport->output_size) +
+    pni_mem_size(transport->frame.start, transport->frame.size) +
+    pni_buffer_memory(transport->output_buffer);
+  usage->codec += pni_data_memory(transport->args) + pni_data_memory(transport->output_args) +
+    pni_data_memory(transport->disp_data);
+  usage->scratch += pni_string_memory(transport->scratch);
+  usage->ssl += pni_ssl_memory(transport);
+  usage->sasl += pni_sasl_memory(transport);
+}
+
 int64_t pn_transport_tick(pn_transport_t *transport, int64_t now)
 {
   int64_t r = 0;
@@ -2946,6 +3396,9 @@ int64_t pn_transport_tick(pn_transport_t *transport, int64_t now)
     if (transport->io_layers[i] && transport->io_layers[i]->process_tick)
       r = pn_timestamp_min(r, transport->io_layers[i]->process_tick(transport, i, now));
   }
+  if (transport->buffer_release_timeout) {
+    r = pn_timestamp_min(r, pni_tick_buffers(transport, now));
+  }
   return r;
 }
 
@@ -2963,12 +3416,30 @@ uint64_t pn_transport_get_frames_input(const pn_transport_t *transport)
   return 0;
 }
 
+// True while the rest of a transfer frame is still to come for a receiver
+// whose session has no room left in its delivery windows.  The incoming window
+// can only hold back whole frames, so this stops input part way through one
+// until some of the data is read, however big frames are allowed to be.
+static bool pni_input_transfer_blocked(pn_transport_t *transport)
+{
+  if (!transport->input_transfer_rest) return false;
+  pn_session_t *ssn = pni_channel_state(transport, transport->input_transfer_channel);
+  pn_link_t *link = ssn ? pni_handle_state(ssn, transport->input_transfer_handle) : NULL;
+  return link && link->delivery_window && ssn->windowed_bytes >= ssn->delivery_windows;
+}
+
 // input
 ssize_t pn_transport_capacity(pn_transport_t *transport)  /* <0 == done */
 {
   if (transport->tail_closed) return PN_EOS;
+  if (pni_input_transfer_blocked(transport)) return 0;
   //if (pn_error_code(transport->error)) return pn_error_code(transport->error);
 
+  if (!transport->input_buf) {
+    transport->input_buf = (char *) pni_mem_suballocate(pn_class(transport), transport, transport->input_size);
+    if (!transport->input_buf) return 0;
+  }
+
   ssize_t capacity = transport->input_size - transport->input_pending;
   if ( capacity<=0 ) {
     // can we expand the size of the input buffer?
@@ -2993,7 +3464,8 @@ ssize_t pn_transport_capacity(pn_transport_t *transport)  /* <0 == done */
 
 char *pn_transport_tail(pn_transport_t *transport)
 {
-  if (transport && transport->input_pending < transport->input_size) {
+  if (transport && !transport->input_buf) pn_transport_capacity(transport);
+  if (transport && transport->input_buf && transport->input_pending < transport->input_size) {
     return &transport->input_buf[transport->input_pending];
   }
   return NULL;
@@ -3082,16 +3554,21 @@ ssize_t pn_transport_peek(pn_transport_t *transport, char *dst, size_t size)
   return size;
 }
 
+static void pni_transport_pop_head(pn_transport_t *transport, size_t size)
+{
+  assert( transport->output_pending >= size );
+  transport->output_pending -= size;
+  transport->bytes_output += size;
+  if (transport->output_pending) {
+    memmove( transport->output_buf,  &transport->output_buf[size],
+             transport->output_pending );
+  }
+}
+
 void pn_transport_pop(pn_transport_t *transport, size_t size)
 {
   if (transport) {
-    assert( transport->output_pending >= size );
-    transport->output_pending -= size;
-    transport->bytes_output += size;
-    if (transport->output_pending) {
-      memmove( transport->output_buf,  &transport->output_buf[size],
-               transport->output_pending );
-    }
+    pni_transport_pop_head(transport, size);
 
     if (transport->output_pending==0 && pn_transport_pending(transport) < 0) {
       // TODO: It looks to me that this is a NOP as iff we ever get here
@@ -3101,6 +3578,68 @@ void pn_transport_pop(pn_transport_t *transport, size_t size)
   }
 }
 
+// The layer writing AMQP frames if every layer above it is a passthrough, so
+// the frames in the output buffer are exactly the next bytes out, else -1.
+static int pni_transport_frames_layer(pn_transport_t *transport)
+{
+  for (int layer = 0; layer < PN_IO_LAYER_CT; ++layer) {
+    const pn_io_layer_t *io_layer = transport->io_layers[layer];
+    if (io_layer != &pni_passthru_layer) {
+      return (io_layer && io_layer->process_output == pn_output_write_amqp) ? layer : -1;
+    }
+  }
+  return -1;
+}
+
+size_t pni_transport_head_buffers(pn_transport_t *transport, pn_bytes_t *buffers, size_t count)
+{
+  assert(transport);
+  if (count == 0) return 0;
+
+  int layer = transport->head_closed ? -1 : pni_transport_frames_layer(transport);
+  // writing nothing processes the connection into frames without copying them
+  if (layer < 0 || pn_output_write_amqp(transport, layer, NULL, 0) < 0) {
+    // Output has to go through the layers (or is finished): only the
+    // contiguous head is available
+    ssize_t pending = pn_transport_pending(transport);
+    if (pending <= 0) return 0;
+    buffers[0] = pn_bytes(pending, transport->output_buf);
+    return 1;
+  }
+
+  // Anything already produced goes first, then the frames in place
+  size_t n = 0;
+  if (transport->output_pending) {
+    buffers[n++] = pn_bytes(transport->output_pending, transport->output_buf);
+  }
+  pn_bytes_t chunks[2];
+  size_t nchunks = pn_buffer_chunks(transport->output_buffer, chunks);
+  for (size_t i = 0; i < nchunks && n < count; ++i) {
+    buffers[n++] = chunks[i];
+  }
+  return n;
+}
+
+void pni_transport_pop_buffers(pn_transport_t *transport, size_t size)
+{
+  assert(transport);
+  size_t head = pn_min(size, transport->output_pending);
+  if (head < size) {
+    // the rest was written from the output buffer by pni_transport_head_buffers()
+    pni_transport_pop_head(transport, head);
+    assert(pn_buffer_size(transport->output_buffer) >= size - head);
+    pn_buffer_trim(transport->output_buffer, size - head, 0);
+    transport->bytes_output += size - head;
+    if (!pn_buffer_size(transport->output_buffer)) {
+      // as in pn_transport_pop(), go on to produce more output or notice
+      // the end of it straight away
+      pn_transport_pending(transport);
+    }
+  } else {
+    pn_transport_pop(transport, size);
+  }
+}
+
 int pn_transport_close_head(pn_transport_t *transport)
 {
   ssize_t pending = pn_transport_pending(transport);
@@ -54,6 +54,18 @@ static inline pn_bytes_t pn_string_bytes(pn_string_t *s) {
   return pn_bytes(pn_string_size(s), pn_string_get(s));
 }
 
+/* FNV-1a hash of bytes, pni_fnv1a_add() carries on hashing more bytes into h */
+static inline uint32_t pni_fnv1a_add(uint32_t h, pn_bytes_t bytes) {
+  for (size_t i = 0; i < bytes.size; i++) {
+    h = (h ^ (uint8_t) bytes.start[i]) * 16777619u;
+  }
+  return h;
+}
+
+static inline uint32_t pni_fnv1a(pn_bytes_t bytes) {
+  return pni_fnv1a_add(2166136261u, bytes);
+}
+
 /* Create a literal bytes value, e.g. PN_BYTES_LITERAL(foo) == pn_bytes(3, "foo") */
 #define PN_BYTES_LITERAL(X) (pn_bytes(sizeof(#X)-1, #X))
 
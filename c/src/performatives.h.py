@@ -0,0 +1,302 @@
+#!/usr/bin/python
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements.  See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership.  The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License.  You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+# Generate specialized encoders for the performatives that the transport
+# sends and decoders for the most frequent performatives it receives.
+#
+# Each encoder is described by the fields of the performative in the same
+# notation that pn_data_fill() uses and writes the AMQP bytes straight into a
+# buffer using the primitives in core/emitters.h.  The resulting encoding is
+# identical to filling a pn_data_t with the same format and encoding it.
+#
+# Supported codes: n o B H I L z Z s S C M ? D [ ] and @T[*s] (symbol array).
+#
+# Each decoder is described by the fields of the performative's list in the
+# notation that pn_data_scan() uses and reads them straight from the frame
+# bytes using the primitives in core/consumers.h, giving the same results as
+# decoding into a pn_data_t and scanning it.
+#
+# Supported codes: o I z . ? and DLC (a described value, its ulong descriptor
+# and a copy of the value into a pn_data_t).
+#
+# Parameter names come from the field names in the AMQP type definitions.
+
+from __future__ import print_function
+from protocol import *
+
+# (encoder name, performative, format of the performative's field list,
+#  composite to use for named described fields if not implied by the field)
+ENCODERS = [
+  ("open",               "open",            "[SS?I?H?InnMMC]", {}),
+  ("begin",              "begin",           "[?HIII]", {}),
+  ("attach",             "attach",          "[SIoBB?DL[SIsIoC?sCnMM]?DL[SIsIoCM]nnIL]", {}),
+  ("attach_coordinator", "attach",          "[SIoBB?DL[SIsIoC?sCnCC]DL[C]nnI]", {"target": "coordinator"}),
+  ("flow",               "flow",            "[?IIII?I?I?In?o]", {}),
+  ("transfer",           "transfer",        "[IIzI?o?on?DLC?o?o?o]", {}),
+  ("disposition",        "disposition",     "[oIn?o?DLC]", {}),
+  ("disposition_range",  "disposition",     "[oI?I?o?DL[]]", {}),
+  ("detach",             "detach",          "[I?o?DL[sSC]]", {}),
+  ("end",                "end",             "[?DL[sSC]]", {}),
+  ("close",              "close",           "[?DL[sSC]]", {}),
+  ("sasl_mechanisms",    "sasl-mechanisms", "[@T[*s]]", {}),
+  ("sasl_init",          "sasl-init",       "[szS]", {}),
+  ("sasl_challenge",     "sasl-challenge",  "[Z]", {}),
+  ("sasl_response",      "sasl-response",   "[Z]", {}),
+  ("sasl_outcome",       "sasl-outcome",    "[B]", {}),
+]
+
+# (decoder name, performative, format of the performative's field list)
+DECODERS = [
+  ("transfer",    "transfer",    "[I?Iz.?oo.?DLCooo]"),
+  ("flow",        "flow",        "[?IIII?I?II.o]"),
+  ("disposition", "disposition", "[oI?Io?DLC]"),
+]
+
+SCALARS = {
+  "o": ("bool", "pni_emit_bool"),
+  "B": ("uint8_t", "pni_emit_ubyte"),
+  "H": ("uint16_t", "pni_emit_ushort"),
+  "I": ("uint32_t", "pni_emit_uint"),
+  "L": ("uint64_t", "pni_emit_ulong"),
+  "z": ("pn_bytes_t", "pni_emit_binary_or_null"),
+  "Z": ("pn_bytes_t", "pni_emit_binary"),
+  "s": ("const char *", "pni_emit_symbol"),
+  "S": ("const char *", "pni_emit_string"),
+  "C": ("pn_data_t *", "pni_emit_copy"),
+  "M": ("pn_data_t *", "pni_emit_multiple"),
+}
+
+def parse(fmt, i=0):
+  """Parse a single value from fmt at i, returns (node, next index)"""
+  c = fmt[i]
+  if c == "n" or c in SCALARS:
+    return (c,), i+1
+  elif c == "?":
+    value, i = parse(fmt, i+1)
+    return ("?", value), i
+  elif c == "D":
+    descriptor, i = parse(fmt, i+1)
+    value, i = parse(fmt, i)
+    return ("D", descriptor, value), i
+  elif c == "[":
+    i += 1
+    elements = []
+    while fmt[i] != "]":
+      element, i = parse(fmt, i)
+      elements.append(element)
+    return ("[", elements), i+1
+  elif fmt.startswith("@T[*s]", i):
+    return ("@",), i+6
+  else:
+    raise Exception("unsupported code '%s' in %s" % (c, fmt))
+
+def composite(name):
+  for t in TYPES:
+    if t["@name"] == name:
+      return t
+  raise Exception("unknown composite %s" % name)
+
+def field_names(type):
+  return [fname(f) for f in type.query["field"]]
+
+class Encoder:
+
+  def __init__(self, overrides):
+    self.overrides = overrides
+    self.params = []
+    self.lines = []
+    self.contexts = 0
+
+  def line(self, depth, text):
+    self.lines.append("  "*depth + text)
+
+  def param(self, ctype, name):
+    if ctype.endswith("*"):
+      self.params.append("%s%s" % (ctype, name))
+    else:
+      self.params.append("%s %s" % (ctype, name))
+    return name
+
+  def context(self):
+    self.contexts += 1
+    return "c%d" % self.contexts
+
+  def value(self, node, name, ctx, depth, described=False, field_type=None):
+    code = node[0]
+    if code == "n":
+      self.line(depth, "pni_emit_null(&emitter, &%s);" % ctx)
+    elif code in SCALARS:
+      ctype, emit = SCALARS[code]
+      self.line(depth, "%s(&emitter, &%s, %s);" % (emit, ctx, self.param(ctype, name)))
+    elif code == "@":
+      count = self.param("size_t", name + "_count")
+      self.line(depth, "pni_emit_symbol_array(&emitter, &%s, %s, %s);" % (ctx, count, self.param("char **", name)))
+    elif code == "?":
+      self.line(depth, "if (%s) {" % self.param("bool", "has_" + name))
+      self.value(node[1], name, ctx, depth+1, field_type=field_type)
+      self.line(depth, "} else {")
+      self.line(depth+1, "pni_emit_null(&emitter, &%s);" % ctx)
+      self.line(depth, "}")
+    elif code == "D":
+      # Nested descriptors are passed in, only the performative's is fixed
+      dctx = self.context()
+      if node[1] == ("L",):
+        descriptor = self.param("uint64_t", name + "_code")
+      else:
+        raise Exception("unsupported descriptor")
+      self.line(depth, "pni_compound_context %s = pni_emit_descriptor(&emitter, &%s, %s);" % (dctx, ctx, descriptor))
+      self.value(node[2], name, dctx, depth, described=True, field_type=field_type)
+    elif code == "[":
+      lctx = self.context()
+      self.line(depth, "{")
+      self.line(depth+1, "pni_compound_context %s = pni_emit_list(&emitter, &%s, %s);" %
+                (lctx, ctx, "true" if described else "false"))
+      names = field_names(composite(field_type)) if field_type else []
+      for i, element in enumerate(node[1]):
+        if i < len(names):
+          ename = names[i] if depth == 1 else "%s_%s" % (name, names[i])
+          etype = self.overrides.get(names[i], self.element_type(field_type, i))
+        else:
+          ename = "%s_%d" % (name, i)
+          etype = None
+        self.value(element, ename, lctx, depth+1, field_type=etype)
+      self.line(depth+1, "pni_emit_end_list(&emitter, &%s);" % lctx)
+      self.line(depth, "}")
+    else:
+      raise Exception("unsupported code %s" % code)
+
+  def element_type(self, type, index):
+    """The composite type of field index of type, if it is one"""
+    field = list(composite(type).query["field"])[index]
+    for t in (field["@type"], field["@requires"]):
+      if t in COMPOSITES:
+        return t
+    return None
+
+CONSUMERS = {
+  "o": ("bool", "pni_consume_bool"),
+  "I": ("uint32_t", "pni_consume_uint"),
+  "z": ("pn_bytes_t", "pni_consume_binary"),
+}
+
+def generate_decoder(name, performative, fmt):
+  if not (fmt.startswith("[") and fmt.endswith("]")):
+    raise Exception("bad performative format: %s" % fmt)
+  names = field_names(composite(performative))
+  params = []
+  lines = []
+  i = 1
+  index = 0
+  while fmt[i] != "]":
+    field = names[index]
+    present = None
+    if fmt[i] == "?":
+      present = "has_" + field
+      params.append("bool *%s" % present)
+      i += 1
+    if fmt[i] == ".":
+      lines.append("pni_consume_anything(&fields);")
+      i += 1
+    elif fmt.startswith("DLC", i):
+      if not present:
+        raise Exception("described fields must be optional: %s" % fmt)
+      params.append("uint64_t *%s_code" % field)
+      params.append("pn_data_t *%s" % field)
+      lines.append("err = pni_consume_described_copy(&fields, %s, %s_code, %s);" % (present, field, field))
+      lines.append("if (err) return err;")
+      i += 3
+    elif fmt[i] in CONSUMERS:
+      ctype, consume = CONSUMERS[fmt[i]]
+      params.append("%s *%s" % (ctype, field))
+      if present:
+        lines.append("*%s = %s(&fields, %s);" % (present, consume, field))
+      else:
+        lines.append("%s(&fields, %s);" % (consume, field))
+      i += 1
+    else:
+      raise Exception("unsupported code '%s' in %s" % (fmt[i], fmt))
+    index += 1
+
+  print("/* %s: D.%s */" % (performative, fmt))
+  print("static inline int pn_amqp_decode_%s(%s)" % (name, ", ".join(["pn_bytes_t bytes"] + params)))
+  print("{")
+  print("  pni_consumer_t consumer = pni_consumer(bytes);")
+  print("  pni_consumer_t fields;")
+  if "DLC" in fmt:
+    print("  int err;")
+  print("  pni_consume_described_list(&consumer, &fields);")
+  for l in lines:
+    print("  " + l)
+  print("  return 0;")
+  print("}")
+  print()
+
+def generate(name, performative, fmt, overrides):
+  node, end = parse(fmt)
+  if end != len(fmt) or node[0] != "[":
+    raise Exception("bad performative format: %s" % fmt)
+  encoder = Encoder(overrides)
+  encoder.line(1, "pni_compound_context c0 = pni_compound_context_init(false);")
+  encoder.line(1, "pni_compound_context %s = pni_emit_descriptor(&emitter, &c0, %s);" %
+               (encoder.context(), performative.upper().replace("-", "_")))
+  encoder.value(node, "", "c1", 1, described=True, field_type=performative)
+
+  print("/* %s: DL%s */" % (performative, fmt))
+  print("static inline pn_bytes_t pn_amqp_encode_%s(%s)" % (name, ", ".join(["pn_rwbytes_t *buffer"] + encoder.params)))
+  print("{")
+  print("  pni_emitter_t emitter = pni_emitter(buffer);")
+  print("  do {")
+  for l in encoder.lines:
+    print("  " + l)
+  print("  } while (pni_emitter_retry(&emitter, buffer));")
+  print("  return pni_emitter_bytes(&emitter);")
+  print("}")
+  print()
+
+print("/* generated */")
+print("#ifndef _PROTON_PERFORMATIVES_H")
+print("#define _PROTON_PERFORMATIVES_H 1")
+print()
+print("#include \"core/consumers.h\"")
+print("#include \"core/emitters.h\"")
+print("#include \"protocol.h\"")
+print()
+print("/*")
+print(" * Each encoder writes its performative into *buffer, growing it with realloc()")
+print(" * if it is too small, and returns the encoded bytes (pn_bytes_null if the")
+print(" * buffer could not be grown).")
+print(" */")
+print()
+
+for e in ENCODERS:
+  generate(*e)
+
+print("/*")
+print(" * Each decoder reads the fields of its performative from bytes (which must")
+print(" * hold the complete described performative) into the pointed to variables.")
+print(" * Fields that are absent or of the wrong type are zeroed, as pn_data_scan()")
+print(" * would do.  Returns 0 or an error code if a copied value can't be decoded.")
+print(" */")
+print()
+
+for d in DECODERS:
+  generate_decoder(*d)
+
+print("#endif /* performatives.h */")
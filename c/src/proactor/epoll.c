@@ -48,6 +48,7 @@
 #include <sys/epoll.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <fcntl.h>
 #include <netinet/tcp.h>
@@ -430,6 +431,13 @@ struct pn_proactor_t {
   // If the process runs out of file descriptors, disarm listening sockets temporarily and save them here.
   acceptor_t *overflow;
   pmutex overflow_mutex;
+  // ready subsystem: events harvested by epoll_wait() and not yet processed
+  pmutex ready_mutex;
+  struct epoll_event *ready;    /* ring of ready_capacity */
+  size_t ready_capacity;
+  size_t ready_first;
+  size_t ready_count;
+  int ready_waiters;            /* threads blocked in epoll_wait() */
 };
 
 static void rearm(pn_proactor_t *p, epoll_extended_t *ee);
@@ -439,6 +447,8 @@ static void rearm(pn_proactor_t *p, epoll_extended_t *ee);
  *  - wakees can be in the list only once
  *  - wakers only write() if wakes_in_progress is false
  *  - wakees only read() if about to set wakes_in_progress to false
+ *  - the eventfd is also written to hand queued ready events to a thread
+ *    blocked in epoll_wait(), and not read while that is still needed
  * When multiple wakes are pending, the kernel cost is a single rearm().
  * Otherwise it is the trio of write/read/rearm.
  * Only the writes and reads need to be carefully ordered.
@@ -480,6 +490,8 @@ static inline void wake_notify(pcontext_t *ctx) {
     EPOLL_FATAL("setting eventfd", errno);
 }
 
+static bool ready_wanted(pn_proactor_t *p);
+
 // call with no locks
 static pcontext_t *wake_pop_front(pn_proactor_t *p) {
   pcontext_t *ctx = NULL;
@@ -490,15 +502,14 @@ static pcontext_t *wake_pop_front(pn_proactor_t *p) {
     p->wake_list_first = ctx->wake_next;
     if (!p->wake_list_first) p->wake_list_last = NULL;
     ctx->wake_next = NULL;
-
-    if (!p->wake_list_first) {
-      /* Reset the eventfd until a future write.
-       * Can the read system call be made without holding the lock?
-       * Note that if the reads/writes happen out of order, the wake
-       * mechanism will hang. */
-      (void)read_uint64(p->eventfd);
-      p->wakes_in_progress = false;
-    }
+  }
+  if (!p->wake_list_first && !ready_wanted(p)) {
+    /* Reset the eventfd until a future write.
+     * Can the read system call be made without holding the lock?
+     * Note that if the reads/writes happen out of order, the wake
+     * mechanism will hang. */
+    (void)read_uint64(p->eventfd);
+    p->wakes_in_progress = false;
   }
   unlock(&p->eventfd_mutex);
   rearm(p, &p->epoll_wake);
@@ -511,6 +522,95 @@ static inline void wake_done(pcontext_t *ctx) {
   ctx->wake_ops--;
 }
 
+/*
+ * Ready strategy.
+ *  - an epoll_wait() harvests up to PROACTOR_EPOLL_BATCH events, the calling
+ *    thread processes the first and queues the rest
+ *  - threads take queued events before making another epoll_wait()
+ *  - with EPOLLONESHOT a queued event is still outstanding for its epoll
+ *    arming, so contexts see their events one at a time as before and are
+ *    not freed while one is queued
+ *  - when events are queued while threads are blocked in epoll_wait(), one
+ *    of them is woken with the wake eventfd to take them, so they are not
+ *    stranded behind the batch the harvesting thread returns.  The wake
+ *    eventfd event itself is always processed by the harvesting thread.
+ * Under load the kernel cost is a single epoll_wait() per
+ * PROACTOR_EPOLL_BATCH events, plus a wake only while threads are idle in
+ * epoll_wait().
+ */
+#define PROACTOR_EPOLL_BATCH 16
+
+// call with ready_mutex held, return true if notify required by caller
+static inline bool ready_notify_lh(pn_proactor_t *p) {
+  return p->ready_count && p->ready_waiters;
+}
+
+// call with eventfd_mutex held: is a waiter needed for queued events?
+static bool ready_wanted(pn_proactor_t *p) {
+  lock(&p->ready_mutex);
+  bool wanted = ready_notify_lh(p);
+  unlock(&p->ready_mutex);
+  return wanted;
+}
+
+// call with no locks
+static void ready_notify(pn_proactor_t *p) {
+  lock(&p->eventfd_mutex);
+  bool notify = !p->wakes_in_progress;
+  p->wakes_in_progress = true;
+  unlock(&p->eventfd_mutex);
+  if (notify && p->eventfd != -1) {
+    uint64_t increment = 1;
+    if (write(p->eventfd, &increment, sizeof(uint64_t)) != sizeof(uint64_t))
+      EPOLL_FATAL("setting eventfd", errno);
+  }
+}
+
+// call with no locks.  Take a queued event, or if there is none and the
+// caller will block in epoll_wait(), count it as a waiter.
+static bool ready_pop(pn_proactor_t *p, struct epoll_event *ev, bool can_block) {
+  bool popped = false;
+  lock(&p->ready_mutex);
+  if (p->ready_count) {
+    *ev = p->ready[p->ready_first];
+    p->ready_first = (p->ready_first + 1) % p->ready_capacity;
+    p->ready_count--;
+    popped = true;
+  } else if (can_block) {
+    p->ready_waiters++;
+  }
+  bool notify = ready_notify_lh(p);
+  unlock(&p->ready_mutex);
+  if (notify) ready_notify(p);
+  return popped;
+}
+
+// call with no locks after an epoll_wait() that followed a ready_pop() with
+// the same can_block.  Queue n harvested events.
+static void ready_push(pn_proactor_t *p, struct epoll_event *evs, int n, bool can_block) {
+  lock(&p->ready_mutex);
+  if (can_block)
+    p->ready_waiters--;
+  if (n > 0 && p->ready_count + n > p->ready_capacity) {
+    size_t capacity = p->ready_capacity ? 2 * p->ready_capacity : PROACTOR_EPOLL_BATCH;
+    while (capacity < p->ready_count + n) capacity *= 2;
+    struct epoll_event *ready = (struct epoll_event *) malloc(capacity * sizeof(struct epoll_event));
+    if (!ready)
+      EPOLL_FATAL("ready queue allocation", ENOMEM);  // the events cannot be dropped
+    for (size_t i = 0; i < p->ready_count; i++)
+      ready[i] = p->ready[(p->ready_first + i) % p->ready_capacity];
+    free(p->ready);
+    p->ready = ready;
+    p->ready_capacity = capacity;
+    p->ready_first = 0;
+  }
+  for (int i = 0; i < n; i++)
+    p->ready[(p->ready_first + p->ready_count++) % p->ready_capacity] = evs[i];
+  bool notify = ready_notify_lh(p);
+  unlock(&p->ready_mutex);
+  if (notify) ready_notify(p);
+}
+
 
 static void psocket_init(psocket_t* ps, pn_proactor_t* p, pn_listener_t *listener, const char *addr)
 {
@@ -978,8 +1078,8 @@ static bool pconnection_rearm_check(pconnection_t *pc) {
     if (pc->write_blocked)
       wanted_now |= EPOLLOUT;
     else {
-      pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
-      if (wbuf.size > 0)
+      pn_bytes_t wbuf;
+      if (pn_connection_driver_write_buffers(&pc->driver, &wbuf, 1))
         wanted_now |= EPOLLOUT;
     }
   }
@@ -1018,8 +1118,8 @@ static inline bool pconnection_work_pending(pconnection_t *pc) {
     return true;
   if (!pc->read_blocked && !pconnection_rclosed(pc))
     return true;
-  pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
-  return (wbuf.size > 0 && !pc->write_blocked);
+  pn_bytes_t wbuf;
+  return (!pc->write_blocked && pn_connection_driver_write_buffers(&pc->driver, &wbuf, 1));
 }
 
 static void pconnection_done(pconnection_t *pc) {
@@ -1045,12 +1145,25 @@ static void pconnection_done(pconnection_t *pc) {
   return;
 }
 
+// Most buffers pn_connection_driver_write_buffers() returns at once
+#define PCONNECTION_WRITE_BUFFERS 4
+
 // Return true unless error
-static bool pconnection_write(pconnection_t *pc, pn_bytes_t wbuf) {
-  ssize_t n = send(pc->psocket.sockfd, wbuf.start, wbuf.size, MSG_NOSIGNAL);
+static bool pconnection_write(pconnection_t *pc, pn_bytes_t *wbufs, size_t count) {
+  struct iovec iov[PCONNECTION_WRITE_BUFFERS];
+  size_t size = 0;
+  for (size_t i = 0; i < count; ++i) {
+    iov[i].iov_base = (void *) wbufs[i].start;
+    iov[i].iov_len = wbufs[i].size;
+    size += wbufs[i].size;
+  }
+  struct msghdr msg = {0};
+  msg.msg_iov = iov;
+  msg.msg_iovlen = count;
+  ssize_t n = sendmsg(pc->psocket.sockfd, &msg, MSG_NOSIGNAL);
   if (n > 0) {
     pn_connection_driver_write_done(&pc->driver, n);
-    if ((size_t) n < wbuf.size) pc->write_blocked = true;
+    if ((size_t) n < size) pc->write_blocked = true;
   } else if (errno == EWOULDBLOCK) {
     pc->write_blocked = true;
   } else if (!(errno == EAGAIN || errno == EINTR)) {
@@ -1061,9 +1174,10 @@ static bool pconnection_write(pconnection_t *pc, pn_bytes_t wbuf) {
 
 static void write_flush(pconnection_t *pc) {
   if (!pc->write_blocked && !pconnection_wclosed(pc)) {
-    pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
-    if (wbuf.size > 0) {
-      if (!pconnection_write(pc, wbuf)) {
+    pn_bytes_t wbufs[PCONNECTION_WRITE_BUFFERS];
+    size_t count = pn_connection_driver_write_buffers(&pc->driver, wbufs, PCONNECTION_WRITE_BUFFERS);
+    if (count > 0) {
+      if (!pconnection_write(pc, wbufs, count)) {
         psocket_error(&pc->psocket, errno, pc->disconnected ? "disconnected" : "on write to");
       }
     }
@@ -1206,9 +1320,11 @@ static pn_event_batch_t *pconnection_process(pconnection_t *pc, uint32_t events,
   // read... tick... write
   // perhaps should be: write_if_recent_EPOLLOUT... read... tick... write
 
-  if (!pconnection_rclosed(pc)) {
+  // Only ask for the read buffer if there may be something to read, it may
+  // have been released while the connection was idle
+  if (!pconnection_rclosed(pc) && !pc->read_blocked) {
     pn_rwbytes_t rbuf = pn_connection_driver_read_buffer(&pc->driver);
-    if (rbuf.size > 0 && !pc->read_blocked) {
+    if (rbuf.size > 0) {
       ssize_t n = read(pc->psocket.sockfd, rbuf.start, rbuf.size);
 
       if (n > 0) {
@@ -1417,7 +1533,8 @@ void pn_proactor_connect2(pn_proactor_t *p, pn_connection_t *c, pn_transport_t *
 
 static void pconnection_tick(pconnection_t *pc) {
   pn_transport_t *t = pc->driver.transport;
-  if (pn_transport_get_idle_timeout(t) || pn_transport_get_remote_idle_timeout(t)) {
+  if (pn_transport_get_idle_timeout(t) || pn_transport_get_remote_idle_timeout(t) ||
+      pn_transport_get_buffer_release_timeout(t)) {
     ptimer_set(&pc->timer, 0);
     uint64_t now = pn_proactor_now_64();
     uint64_t next = pn_transport_tick(t, now);
@@ -1866,6 +1983,7 @@ pn_proactor_t *pn_proactor() {
   p->epollfd = p->eventfd = p->timer.timerfd = -1;
   pcontext_init(&p->context, PROACTOR, p, p);
   pmutex_init(&p->eventfd_mutex);
+  pmutex_init(&p->ready_mutex);
   ptimer_init(&p->timer, 0);
 
   if ((p->epollfd = epoll_create(1)) >= 0 && (p->epollfd_2 = epoll_create(1)) >= 0) {
@@ -1890,6 +2008,7 @@ pn_proactor_t *pn_proactor() {
   if (p->interruptfd >= 0) close(p->interruptfd);
   ptimer_finalize(&p->timer);
   if (p->collector) pn_free(p->collector);
+  pmutex_finalize(&p->ready_mutex);
   free (p);
   return NULL;
 }
@@ -1923,6 +2042,8 @@ void pn_proactor_free(pn_proactor_t *p) {
 
   pn_collector_free(p->collector);
   pmutex_finalize(&p->eventfd_mutex);
+  pmutex_finalize(&p->ready_mutex);
+  free(p->ready);
   pcontext_finalize(&p->context);
   free(p);
 }
@@ -2097,24 +2218,39 @@ static pn_event_batch_t *proactor_do_epoll(struct pn_proactor_t* p, bool can_blo
   while(true) {
     pn_event_batch_t *batch = NULL;
     struct epoll_event ev = {0};
-    int n = epoll_wait(p->epollfd, &ev, 1, timeout);
+    if (!ready_pop(p, &ev, can_block)) {
+      struct epoll_event evs[PROACTOR_EPOLL_BATCH];
+      int n = epoll_wait(p->epollfd, evs, PROACTOR_EPOLL_BATCH, timeout);
+      int err = errno;
+      for (int i = 1; i < n; i++) {
+        if (evs[i].data.ptr == &p->epoll_wake) {  /* Never queue the wake */
+          ev = evs[0];
+          evs[0] = evs[i];
+          evs[i] = ev;
+          break;
+        }
+      }
+      ready_push(p, evs + 1, n - 1, can_block);
 
-    if (n < 0) {
-      if (errno != EINTR)
-        perror("epoll_wait"); // TODO: proper log
-      if (!can_block)
-        return NULL;
-      else
-        continue;
-    } else if (n == 0) {
-      if (!can_block)
-        return NULL;
-      else {
-        perror("epoll_wait unexpected timeout"); // TODO: proper log
-        continue;
+      if (n < 0) {
+        if (err != EINTR) {
+          errno = err;
+          perror("epoll_wait"); // TODO: proper log
+        }
+        if (!can_block)
+          return NULL;
+        else
+          continue;
+      } else if (n == 0) {
+        if (!can_block)
+          return NULL;
+        else {
+          perror("epoll_wait unexpected timeout"); // TODO: proper log
+          continue;
+        }
       }
+      ev = evs[0];
     }
-    assert(n == 1);
     epoll_extended_t *ee = (epoll_extended_t *) ev.data.ptr;
     memory_barrier(ee);
 
@@ -2227,6 +2363,14 @@ pn_proactor_t *pn_connection_proactor(pn_connection_t* c) {
   return pc ? pc->psocket.proactor : NULL;
 }
 
+void pn_proactor_connection_memory_usage(pn_connection_t *c, pn_connection_memory_t *usage) {
+  pn_connection_memory_usage(c, usage);
+  if (get_pconnection(c)) {
+    usage->io = sizeof(pconnection_t);
+    usage->total += usage->io;
+  }
+}
+
 void pn_proactor_disconnect(pn_proactor_t *p, pn_condition_t *cond) {
   bool notify = false;
 
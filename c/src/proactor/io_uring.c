@@ -0,0 +1,1835 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/* Enable POSIX features beyond c99 for modern pthread and standard strerror_r() */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+/* syscall() and MAP_POPULATE for the io_uring system calls and rings */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+/* Avoid GNU extensions, in particular the incompatible alternative strerror_r() */
+#undef _GNU_SOURCE
+
+#include "core/logger_private.h"
+#include "proactor-internal.h"
+
+#include <proton/condition.h>
+#include <proton/connection_driver.h>
+#include <proton/engine.h>
+#include <proton/proactor.h>
+#include <proton/transport.h>
+#include <proton/listener.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <linux/io_uring.h>
+#include <limits.h>
+#include <time.h>
+
+#include "./netaddr-internal.h" /* Include after socket/inet headers */
+
+/*
+  The io_uring proactor drives completions rather than readiness: a receive,
+  send, connect or accept is handed to the kernel and its result comes back on
+  the completion queue.  Nothing is re-armed after each event as with
+  EPOLLONESHOT, and completions from every socket share one queue, so there is
+  no need for a secondary epoll set either.
+
+  The ring has a single submitter and a single reaper, so like the libuv
+  proactor this uses a "leader-worker-follower" model:
+
+  - At most one thread at a time is the "leader".  It alone touches the ring:
+  it prepares submissions, waits in io_uring_enter() and reaps completions,
+  then hands connections and listeners with events to workers.
+
+  - Concurrent "worker" threads process event batches for separate connections
+  or listeners.  When they run out of work they become "followers".
+
+  - A "follower" is idle, waiting for work.  When the leader becomes a worker,
+  one follower takes over as the new leader.
+
+  Workers never call into the ring.  pn_proactor_done() and the thread-safe
+  calls put the context on the leader's queue and, if the leader is blocked in
+  the kernel, wake it through an eventfd it always has a read pending on.
+
+  Submissions made while processing are not sent one at a time: they collect
+  in the submission queue and go to the kernel with the io_uring_enter() that
+  waits for the next completions.
+
+  Function naming:
+  - leader_* - only called in the leader thread (or by pn_proactor_free())
+  - *_lh - called with the relevant lock held
+*/
+
+typedef char strerrorbuf[1024];      /* used for pstrerror message buffer */
+
+/* Like strerror_r but provide a default message if strerror_r fails */
+static void pstrerror(int err, strerrorbuf msg) {
+  int e = strerror_r(err, msg, sizeof(strerrorbuf));
+  if (e) snprintf(msg, sizeof(strerrorbuf), "unknown error %d", err);
+}
+
+/* Internal error, no recovery */
+#define URING_FATAL(EXPR, SYSERRNO)                                     \
+  do {                                                                  \
+    strerrorbuf msg;                                                    \
+    pstrerror((SYSERRNO), msg);                                         \
+    fprintf(stderr, "io_uring proactor failure in %s:%d: %s: %s\n",     \
+            __FILE__, __LINE__ , #EXPR, msg);                           \
+    abort();                                                            \
+  } while (0)
+
+typedef pthread_mutex_t pmutex;
+static void pmutex_init(pthread_mutex_t *pm){
+  if (pthread_mutex_init(pm, NULL)) {
+    perror("pthread failure");
+    abort();
+  }
+}
+
+static void pmutex_finalize(pthread_mutex_t *m) { pthread_mutex_destroy(m); }
+static inline void lock(pmutex *m) { pthread_mutex_lock(m); }
+static inline void unlock(pmutex *m) { pthread_mutex_unlock(m); }
+
+const char *AMQP_PORT = "5672";
+const char *AMQP_PORT_NAME = "amqp";
+
+/* pn_proactor_t and pn_listener_t are plain C structs with normal memory management.
+   CLASSDEF is for identification when used as a pn_event_t context.
+*/
+PN_STRUCT_CLASSDEF(pn_proactor)
+PN_STRUCT_CLASSDEF(pn_listener)
+
+// ========================================================================
+// The ring
+// ========================================================================
+
+#define PROACTOR_URING_ENTRIES 256  /* Submission queue size, the kernel doubles it for completions */
+
+typedef struct uring_t {
+  int fd;
+  unsigned features;
+  /* Submission queue, shared with the kernel */
+  void *sq_ring;
+  size_t sq_ring_size;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_flags, *sq_array;
+  unsigned sq_entries;
+  unsigned sq_unsubmitted;      /* Prepared entries the kernel has not yet consumed */
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  /* Completion queue, shared with the kernel */
+  void *cq_ring;
+  size_t cq_ring_size;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+} uring_t;
+
+/* There is no libc wrapper for the io_uring system calls */
+static int uring_setup(unsigned entries, struct io_uring_params *params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void *uring_mmap(int fd, size_t size, off_t offset) {
+  void *m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+  return (m == MAP_FAILED) ? NULL : m;
+}
+
+static void uring_finalize(uring_t *r) {
+  if (r->sqes) munmap(r->sqes, r->sqes_size);
+  if (r->cq_ring && r->cq_ring != r->sq_ring) munmap(r->cq_ring, r->cq_ring_size);
+  if (r->sq_ring) munmap(r->sq_ring, r->sq_ring_size);
+  if (r->fd >= 0) close(r->fd);
+  r->fd = -1;
+}
+
+/* Return 0 or an errno */
+static int uring_init(uring_t *r, unsigned entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  memset(r, 0, sizeof(*r));
+  r->fd = uring_setup(entries, &params);
+  if (r->fd < 0) return errno;
+  r->features = params.features;
+  r->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  r->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (r->features & IORING_FEAT_SINGLE_MMAP) {
+    if (r->cq_ring_size > r->sq_ring_size) r->sq_ring_size = r->cq_ring_size;
+    r->sq_ring = r->cq_ring = uring_mmap(r->fd, r->sq_ring_size, IORING_OFF_SQ_RING);
+  } else {
+    r->sq_ring = uring_mmap(r->fd, r->sq_ring_size, IORING_OFF_SQ_RING);
+    r->cq_ring = uring_mmap(r->fd, r->cq_ring_size, IORING_OFF_CQ_RING);
+  }
+  r->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = (struct io_uring_sqe*)uring_mmap(r->fd, r->sqes_size, IORING_OFF_SQES);
+  if (!r->sq_ring || !r->cq_ring || !r->sqes) {
+    int err = errno;
+    uring_finalize(r);
+    return err;
+  }
+  char *sq = (char*)r->sq_ring;
+  r->sq_head = (unsigned*)(sq + params.sq_off.head);
+  r->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+  r->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+  r->sq_flags = (unsigned*)(sq + params.sq_off.flags);
+  r->sq_array = (unsigned*)(sq + params.sq_off.array);
+  r->sq_entries = params.sq_entries;
+  char *cq = (char*)r->cq_ring;
+  r->cq_head = (unsigned*)(cq + params.cq_off.head);
+  r->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+  r->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+  return 0;
+}
+
+/*
+ * Submit prepared entries to the kernel and, if wait, block until there is at
+ * least one completion.  An interrupted or busy call is harmless: the entries
+ * stay queued for the next one.
+ */
+static void uring_submit(uring_t *r, bool wait) {
+  bool overflow = __atomic_load_n(r->sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW;
+  if (!r->sq_unsubmitted && !wait && !overflow) return;
+  unsigned flags = (wait || overflow) ? IORING_ENTER_GETEVENTS : 0;
+  int n = uring_enter(r->fd, r->sq_unsubmitted, wait ? 1 : 0, flags);
+  if (n >= 0) {
+    r->sq_unsubmitted -= (unsigned)n;
+  } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+    URING_FATAL(io_uring_enter, errno);
+  }
+}
+
+/* Add a submission queue entry, making room by submitting if the queue is full */
+static void uring_push(uring_t *r, const struct io_uring_sqe *sqe) {
+  unsigned tail = *r->sq_tail;  /* Only we write the tail */
+  while (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries) {
+    uring_submit(r, false);
+  }
+  unsigned i = tail & *r->sq_mask;
+  r->sqes[i] = *sqe;
+  r->sq_array[i] = i;
+  __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ++r->sq_unsubmitted;
+}
+
+/* Pop the next completion, return false if there is none */
+static bool uring_pop(uring_t *r, struct io_uring_cqe *cqe) {
+  unsigned head = *r->cq_head;  /* Only we write the head */
+  if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return false;
+  *cqe = r->cqes[head & *r->cq_mask];
+  __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static void sqe_init(struct io_uring_sqe *sqe, uint8_t opcode, int fd) {
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+}
+
+// ========================================================================
+// Operations and timers
+// ========================================================================
+
+typedef enum {
+  OP_WAKE,                      /* Read on the wake eventfd */
+  OP_INTERRUPT,                 /* Read on the interrupt eventfd */
+  OP_PROACTOR_TIMER,
+  OP_READ,
+  OP_SEND,
+  OP_WRITE,                     /* Poll for POLLOUT on a full socket */
+  OP_CONNECT,
+  OP_CONNECTION_TIMER,
+  OP_ACCEPT
+} uring_op_type_t;
+
+/*
+ * An operation in flight, its address is the user_data of its submission and
+ * completions.  Cancel submissions have user_data 0, their completions are
+ * ignored.
+ */
+typedef struct uring_op_t {
+  uring_op_type_t type;
+  void *owner;                  /* pn_proactor_t, pconnection_t or acceptor_t */
+  bool pending;                 /* Submitted, final completion not yet reaped */
+  bool cancelled;               /* Cancel submitted */
+} uring_op_t;
+
+static void uring_op_init(uring_op_t *op, uring_op_type_t type, void *owner) {
+  op->type = type;
+  op->owner = owner;
+  op->pending = false;
+  op->cancelled = false;
+}
+
+/*
+ * Timers are IORING_OP_TIMEOUT operations with an absolute CLOCK_MONOTONIC
+ * expiry, at most one in flight per timer.  Moving a deadline later costs
+ * nothing: the timeout fires early and its owner sets it again.  Moving it
+ * earlier, or clearing it, cancels the timeout in flight and the new deadline
+ * is set when the cancellation completes.
+ */
+typedef struct ptimer_t {
+  uring_op_t op;
+  struct __kernel_timespec ts;  /* Expiry of the timeout in flight */
+  uint64_t armed;               /* Deadline in flight, 0 if none */
+} ptimer_t;
+
+// ========================================================================
+// Contexts: connections and listeners
+// ========================================================================
+
+typedef enum {
+  PCONNECTION,
+  LISTENER
+} pcontext_type_t;
+
+typedef struct pcontext_t {
+  pmutex mutex;
+  pn_proactor_t *proactor;
+  void *owner;                  /* pconnection_t or pn_listener_t */
+  pcontext_type_t type;
+  bool closing;                 /* Protected by mutex */
+  /* Protected by the proactor mutex */
+  struct pcontext_t *next, *prev; /* Proactor contexts list */
+  struct pcontext_t *q_next;    /* leader_q or worker_q */
+  bool queued;                  /* On leader_q or worker_q */
+  bool working;                 /* Owned by a worker thread */
+  bool disconnect;              /* Disconnect requested by pn_proactor_disconnect() */
+} pcontext_t;
+
+static void pcontext_init(pcontext_t *ctx, pcontext_type_t t, pn_proactor_t *p, void *o) {
+  memset(ctx, 0, sizeof(*ctx));
+  pmutex_init(&ctx->mutex);
+  ctx->proactor = p;
+  ctx->owner = o;
+  ctx->type = t;
+}
+
+static void pcontext_finalize(pcontext_t* ctx) {
+  pmutex_finalize(&ctx->mutex);
+}
+
+typedef struct pcontext_queue_t {
+  pcontext_t *front, *back;
+} pcontext_queue_t;
+
+static void pcontext_push(pcontext_queue_t *q, pcontext_t *ctx) {
+  assert(!ctx->queued);
+  ctx->q_next = NULL;
+  ctx->queued = true;
+  if (q->back) q->back->q_next = ctx;
+  else q->front = ctx;
+  q->back = ctx;
+}
+
+static pcontext_t *pcontext_pop(pcontext_queue_t *q) {
+  pcontext_t *ctx = q->front;
+  if (ctx) {
+    q->front = ctx->q_next;
+    if (!q->front) q->back = NULL;
+    ctx->q_next = NULL;
+    ctx->queued = false;
+  }
+  return ctx;
+}
+
+static void pcontext_unqueue(pcontext_queue_t *q, pcontext_t *ctx) {
+  pcontext_t *prev = NULL;
+  for (pcontext_t *c = q->front; c; prev = c, c = c->q_next) {
+    if (c == ctx) {
+      if (prev) prev->q_next = c->q_next;
+      else q->front = c->q_next;
+      if (q->back == c) q->back = prev;
+      c->q_next = NULL;
+      c->queued = false;
+      return;
+    }
+  }
+}
+
+/*
+ * Read buffers.  The proactor registers one region of PROACTOR_READ_BUFFERS
+ * buffers with the ring so reads into it are IORING_OP_READ_FIXED and the
+ * kernel does not map the pages for every read.  A connection takes a buffer
+ * for its first read and keeps it until it is freed.  Once they are all taken,
+ * connections use a buffer of their own and a plain IORING_OP_RECV.
+ */
+#define PROACTOR_READ_BUFFER_SIZE (16 * 1024)
+#define PROACTOR_READ_BUFFERS 64
+
+/*
+ * Output is sent straight from the transport's buffers with a non-blocking
+ * IORING_OP_SENDMSG.  The transport may move its buffers as soon as anything
+ * uses it, so while a send is in flight the leader leaves the connection
+ * alone and keeps it from the workers until the send completes.  Sends are
+ * submitted with everything else the leader has queued, so the sends of many
+ * connections go to the kernel in one io_uring_enter().  If the socket is full
+ * the leader polls it for POLLOUT, the output waits in the transport meanwhile.
+ */
+#define PCONNECTION_WRITE_BUFFERS 4
+
+typedef struct pconnection_t {
+  pcontext_t context;
+  int sockfd;
+  char addr_buf[PN_MAX_ADDR];
+  const char *host, *port;
+  pn_connection_driver_t driver;
+  pn_event_batch_t batch;
+  struct pn_netaddr_t local, remote; /* Actual addresses */
+  bool wake_pending;            /* Protected by context.mutex */
+  // Following values only used by the leader:
+  struct addrinfo *addrinfo;    /* Resolved address list */
+  struct addrinfo *ai;          /* Next connect address */
+  bool connecting;
+  bool connected;
+  int connect_error;            /* errno of the last failed connect */
+  bool wshutdown;               /* shutdown(SHUT_WR) done */
+  uring_op_t read_op, send_op, write_op, connect_op;
+  ptimer_t timer;
+  uint64_t tick_deadline;       /* Next pn_transport_tick(), 0 if none */
+  bool tick_pending;
+  bool read_completed, send_completed, write_completed, connect_completed;
+  int read_result, send_result, write_result, connect_result;
+  bool send_full;               /* The last send found the socket full */
+  struct msghdr send_msg;       /* The send in flight */
+  struct iovec send_iov[PCONNECTION_WRITE_BUFFERS];
+  size_t send_size;
+  char *rbuf;                   /* Received bytes not yet given to the transport */
+  bool rbuf_registered;         /* rbuf is in the registered region */
+  size_t rbuf_start, rbuf_len;
+} pconnection_t;
+
+/* Protects read/update of pn_connection_t pointer to it's pconnection_t
+ *
+ * Global because pn_connection_wake()/pn_connection_proactor() navigate from
+ * the pn_connection_t before we know the proactor or driver. Critical sections
+ * are small: only get/set of the pn_connection_t driver pointer.
+ */
+static pthread_mutex_t driver_ptr_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pconnection_t *get_pconnection(pn_connection_t* c) {
+  if (!c) return NULL;
+  lock(&driver_ptr_mutex);
+  pn_connection_driver_t *d = *pn_connection_driver_ptr(c);
+  unlock(&driver_ptr_mutex);
+  if (!d) return NULL;
+  return (pconnection_t*)((char*)d-offsetof(pconnection_t, driver));
+}
+
+static void set_pconnection(pn_connection_t* c, pconnection_t *pc) {
+  lock(&driver_ptr_mutex);
+  *pn_connection_driver_ptr(c) = pc ? &pc->driver : NULL;
+  unlock(&driver_ptr_mutex);
+}
+
+/*
+ * A listener can have multiple sockets (as specified in the addrinfo), each
+ * with its own multishot accept.  Accepted sockets wait in the listener until
+ * the application claims them with pn_listener_accept2().
+ */
+typedef struct acceptor_t {
+  int fd;
+  pn_listener_t *listener;
+  uring_op_t accept_op;
+  bool overflowed;              /* Out of file descriptors, waiting for one to close */
+  struct acceptor_t *overflow_next;
+  struct pn_netaddr_t addr;     /* listening address */
+} acceptor_t;
+
+struct pn_listener_t {
+  pcontext_t context;
+  acceptor_t *acceptors;        /* Array of listening sockets */
+  size_t acceptors_size;
+  char addr_buf[PN_MAX_ADDR];
+  const char *host, *port;
+  pn_condition_t *condition;
+  pn_collector_t *collector;
+  pn_event_batch_t batch;
+  pn_record_t *attachments;
+  void *listener_context;
+  size_t backlog;
+  // Following values protected by context.mutex:
+  int *accepted;                /* Ring of accepted sockets not yet claimed */
+  size_t accepted_start, accepted_count, accepted_capacity;
+  bool unclaimed;               /* ACCEPT event dispatched but no pn_listener_accept2() call yet */
+  bool close_dispatched;
+};
+
+struct pn_proactor_t {
+  pmutex mutex;
+  pthread_cond_t cond;          /* Followers wait for the leader */
+  // Following values protected by mutex:
+  pcontext_t *contexts;         /* All connections and listeners */
+  pcontext_queue_t leader_q;    /* Waiting for attention by the leader */
+  pcontext_queue_t worker_q;    /* Ready for work, to be returned via pn_proactor_wait() */
+  pn_collector_t *collector;
+  pn_event_batch_t batch;
+  pn_condition_t *disconnect_cond; /* disconnect condition */
+  uint64_t timeout_deadline;
+  bool has_leader;              /* A thread is working as leader */
+  bool leader_waiting;          /* The leader is, or is about to be, blocked in the kernel */
+  bool wake_pending;            /* wakefd written, completion not yet reaped */
+  bool batch_working;           /* batch is being processed in a worker thread */
+  bool need_interrupt;          /* Need a PN_PROACTOR_INTERRUPT event */
+  bool need_timeout;
+  bool need_inactive;
+  bool timeout_set;
+  bool timeout_processed;       /* timeout event dispatched in the most recent event batch */
+  bool shutting_down;
+  // Following values only used by the leader:
+  uring_t ring;
+  size_t ops_pending;           /* Operations submitted, final completion not yet reaped */
+  int wakefd;
+  int interruptfd;
+  uint64_t wake_buf, interrupt_buf;
+  uring_op_t wake_op, interrupt_op;
+  ptimer_t timer;
+  bool accept_multishot;        /* Kernel accepts IORING_ACCEPT_MULTISHOT */
+  acceptor_t *overflow;         /* Acceptors waiting for a free file descriptor */
+  char *rpool;                  /* Registered read buffers, NULL if registration failed */
+  int rpool_free[PROACTOR_READ_BUFFERS];
+  size_t rpool_free_count;
+};
+
+static inline pconnection_t *pcontext_pconnection(pcontext_t *c) {
+  return c->type == PCONNECTION ?
+    (pconnection_t*)((char*)c - offsetof(pconnection_t, context)) : NULL;
+}
+
+static inline pn_listener_t *pcontext_listener(pcontext_t *c) {
+  return c->type == LISTENER ?
+    (pn_listener_t*)((char*)c - offsetof(pn_listener_t, context)) : NULL;
+}
+
+static pn_event_t *listener_batch_next(pn_event_batch_t *batch);
+static pn_event_t *proactor_batch_next(pn_event_batch_t *batch);
+static pn_event_t *pconnection_batch_next(pn_event_batch_t *batch);
+
+static inline pn_proactor_t *batch_proactor(pn_event_batch_t *batch) {
+  return (batch->next_event == proactor_batch_next) ?
+    (pn_proactor_t*)((char*)batch - offsetof(pn_proactor_t, batch)) : NULL;
+}
+
+static inline pn_listener_t *batch_listener(pn_event_batch_t *batch) {
+  return (batch->next_event == listener_batch_next) ?
+    (pn_listener_t*)((char*)batch - offsetof(pn_listener_t, batch)) : NULL;
+}
+
+static inline pconnection_t *batch_pconnection(pn_event_batch_t *batch) {
+  return (batch->next_event == pconnection_batch_next) ?
+    (pconnection_t*)((char*)batch - offsetof(pconnection_t, batch)) : NULL;
+}
+
+static inline pcontext_t *batch_pcontext(pn_event_batch_t *batch) {
+  pconnection_t *pc = batch_pconnection(batch);
+  if (pc) return &pc->context;
+  pn_listener_t *l = batch_listener(batch);
+  return l ? &l->context : NULL;
+}
+
+static pn_event_t *log_event(void* p, pn_event_t *e) {
+  if (e) {
+    PN_LOG_DEFAULT(PN_SUBSYSTEM_EVENT, PN_LEVEL_DEBUG, "[%p]:(%s)", (void*)p, pn_event_type_name(pn_event_type(e)));
+  }
+  return e;
+}
+
+static inline bool is_inactive(pn_proactor_t *p) {
+  return (!p->contexts && !p->timeout_set && !p->shutting_down);
+}
+
+/* Call with the proactor mutex held.  Return true if the caller must wake the leader */
+static bool proactor_notify_lh(pn_proactor_t *p) {
+  if (p->leader_waiting && !p->wake_pending) {
+    p->wake_pending = true;
+    return true;
+  }
+  return false;
+}
+
+/* Wake the leader from io_uring_enter() */
+static void proactor_notify(pn_proactor_t *p) {
+  uint64_t increment = 1;
+  if (write(p->wakefd, &increment, sizeof(uint64_t)) != sizeof(uint64_t))
+    URING_FATAL(setting eventfd, errno);
+}
+
+/* Notify that this context needs attention from the leader at the next opportunity */
+static void work_notify(pcontext_t *ctx) {
+  pn_proactor_t *p = ctx->proactor;
+  lock(&p->mutex);
+  if (!ctx->working && !ctx->queued) pcontext_push(&p->leader_q, ctx);
+  bool notify = proactor_notify_lh(p);
+  unlock(&p->mutex);
+  if (notify) proactor_notify(p);
+}
+
+/* Add a new context and hand it to the leader */
+static void proactor_add(pcontext_t *ctx) {
+  pn_proactor_t *p = ctx->proactor;
+  lock(&p->mutex);
+  ctx->prev = NULL;
+  ctx->next = p->contexts;
+  if (p->contexts) p->contexts->prev = ctx;
+  p->contexts = ctx;
+  pcontext_push(&p->leader_q, ctx);
+  bool notify = proactor_notify_lh(p);
+  unlock(&p->mutex);
+  if (notify) proactor_notify(p);
+}
+
+/* Remove a context that is about to be freed */
+static void proactor_remove(pcontext_t *ctx) {
+  pn_proactor_t *p = ctx->proactor;
+  lock(&p->mutex);
+  if (ctx->prev) ctx->prev->next = ctx->next;
+  else p->contexts = ctx->next;
+  if (ctx->next) ctx->next->prev = ctx->prev;
+  if (ctx->queued) pcontext_unqueue(&p->leader_q, ctx);
+  if (is_inactive(p)) p->need_inactive = true;
+  unlock(&p->mutex);
+}
+
+// ========================================================================
+// Leader: submitting and completing operations
+// ========================================================================
+
+static void leader_submit(pn_proactor_t *p, uring_op_t *op, struct io_uring_sqe *sqe) {
+  assert(!op->pending);
+  sqe->user_data = (uint64_t)(uintptr_t)op;
+  op->pending = true;
+  op->cancelled = false;
+  ++p->ops_pending;
+  uring_push(&p->ring, sqe);
+}
+
+static void leader_cancel(pn_proactor_t *p, uring_op_t *op) {
+  if (op->pending && !op->cancelled) {
+    struct io_uring_sqe sqe;
+    sqe_init(&sqe, IORING_OP_ASYNC_CANCEL, -1);
+    sqe.addr = (uint64_t)(uintptr_t)op;
+    op->cancelled = true;
+    uring_push(&p->ring, &sqe);
+  }
+}
+
+static void leader_timer_set(pn_proactor_t *p, ptimer_t *pt, uint64_t deadline) {
+  if (pt->op.pending) {
+    if (!deadline || deadline < pt->armed) leader_cancel(p, &pt->op);
+  } else if (deadline) {
+    struct io_uring_sqe sqe;
+    sqe_init(&sqe, IORING_OP_TIMEOUT, -1);
+    pt->ts.tv_sec = (int64_t)(deadline / 1000);
+    pt->ts.tv_nsec = (long long)(deadline % 1000) * 1000000;
+    sqe.addr = (uint64_t)(uintptr_t)&pt->ts;
+    sqe.len = 1;
+    sqe.timeout_flags = IORING_TIMEOUT_ABS;
+    pt->armed = deadline;
+    leader_submit(p, &pt->op, &sqe);
+  }
+}
+
+static void leader_read_eventfd(pn_proactor_t *p, uring_op_t *op, int fd, uint64_t *buf) {
+  struct io_uring_sqe sqe;
+  sqe_init(&sqe, IORING_OP_READ, fd);
+  sqe.addr = (uint64_t)(uintptr_t)buf;
+  sqe.len = sizeof(uint64_t);
+  leader_submit(p, op, &sqe);
+}
+
+static void leader_accept(pn_proactor_t *p, acceptor_t *a) {
+  struct io_uring_sqe sqe;
+  sqe_init(&sqe, IORING_OP_ACCEPT, a->fd);
+#ifdef IORING_ACCEPT_MULTISHOT
+  if (p->accept_multishot) sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+#endif
+  leader_submit(p, &a->accept_op, &sqe);
+}
+
+static void read_pool_init(pn_proactor_t *p) {
+  size_t size = (size_t)PROACTOR_READ_BUFFER_SIZE * PROACTOR_READ_BUFFERS;
+  void *mem = NULL;
+  if (posix_memalign(&mem, (size_t)sysconf(_SC_PAGESIZE), size)) return;
+  struct iovec iov;
+  iov.iov_base = mem;
+  iov.iov_len = size;
+  if (uring_register(p->ring.fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0) {
+    free(mem);                  /* Probably RLIMIT_MEMLOCK, do without */
+    return;
+  }
+  p->rpool = (char*)mem;
+  for (int i = PROACTOR_READ_BUFFERS - 1; i >= 0; --i) {
+    p->rpool_free[p->rpool_free_count++] = i;
+  }
+}
+
+static bool pconnection_rbuf_acquire(pconnection_t *pc) {
+  pn_proactor_t *p = pc->context.proactor;
+  if (p->rpool_free_count) {
+    pc->rbuf = p->rpool + (size_t)p->rpool_free[--p->rpool_free_count] * PROACTOR_READ_BUFFER_SIZE;
+    pc->rbuf_registered = true;
+  } else {
+    pc->rbuf = (char*)malloc(PROACTOR_READ_BUFFER_SIZE);
+    pc->rbuf_registered = false;
+  }
+  return pc->rbuf;
+}
+
+static void pconnection_rbuf_release(pconnection_t *pc) {
+  pn_proactor_t *p = pc->context.proactor;
+  if (pc->rbuf_registered) {
+    p->rpool_free[p->rpool_free_count++] = (int)((pc->rbuf - p->rpool) / PROACTOR_READ_BUFFER_SIZE);
+  } else {
+    free(pc->rbuf);
+  }
+  pc->rbuf = NULL;
+  pc->rbuf_len = 0;
+}
+
+/* A file descriptor was closed, acceptors that ran out can try again */
+static void leader_overflow_retry(pn_proactor_t *p) {
+  while (p->overflow) {
+    acceptor_t *a = p->overflow;
+    p->overflow = a->overflow_next;
+    a->overflow_next = NULL;
+    a->overflowed = false;
+    work_notify(&a->listener->context);
+  }
+}
+
+static void leader_overflow_remove(pn_proactor_t *p, pn_listener_t *l) {
+  for (acceptor_t **ap = &p->overflow; *ap;) {
+    acceptor_t *a = *ap;
+    if (a->listener == l) {
+      *ap = a->overflow_next;
+      a->overflow_next = NULL;
+      a->overflowed = false;
+    } else {
+      ap = &a->overflow_next;
+    }
+  }
+}
+
+static bool listener_push_accepted_lh(pn_listener_t *l, int fd) {
+  if (l->accepted_count == l->accepted_capacity) {
+    size_t capacity = l->accepted_capacity ? 2 * l->accepted_capacity : 4;
+    int *accepted = (int*)malloc(capacity * sizeof(int));
+    if (!accepted) return false;
+    for (size_t i = 0; i < l->accepted_count; ++i) {
+      accepted[i] = l->accepted[(l->accepted_start + i) % l->accepted_capacity];
+    }
+    free(l->accepted);
+    l->accepted = accepted;
+    l->accepted_start = 0;
+    l->accepted_capacity = capacity;
+  }
+  l->accepted[(l->accepted_start + l->accepted_count++) % l->accepted_capacity] = fd;
+  return true;
+}
+
+static int listener_pop_accepted_lh(pn_listener_t *l) {
+  if (!l->accepted_count) return -1;
+  int fd = l->accepted[l->accepted_start];
+  l->accepted_start = (l->accepted_start + 1) % l->accepted_capacity;
+  --l->accepted_count;
+  return fd;
+}
+
+static void listener_begin_close_lh(pn_listener_t* l);
+
+static void leader_accepted(pn_proactor_t *p, acceptor_t *a, int res) {
+  pn_listener_t *l = a->listener;
+  lock(&l->context.mutex);
+  if (res >= 0) {
+    if (l->context.closing || !listener_push_accepted_lh(l, res)) close(res);
+  } else if (res == -EMFILE || res == -ENFILE) {
+    if (!a->overflowed) {
+      a->overflowed = true;
+      a->overflow_next = p->overflow;
+      p->overflow = a;
+    }
+  } else if (res == -EINVAL && p->accept_multishot) {
+    p->accept_multishot = false; /* Older kernel, re-armed as single shot */
+  } else if (res != -ECANCELED && !l->context.closing) {
+    strerrorbuf msg;
+    pstrerror(-res, msg);
+    pni_proactor_set_cond(l->condition, "accept", l->host, l->port, msg);
+    listener_begin_close_lh(l);
+  }
+  unlock(&l->context.mutex);
+  work_notify(&l->context);
+}
+
+static void leader_complete(pn_proactor_t *p, const struct io_uring_cqe *cqe) {
+  uring_op_t *op = (uring_op_t*)(uintptr_t)cqe->user_data;
+  if (!op) return;              /* Cancel */
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    op->pending = false;
+    --p->ops_pending;
+  }
+  if (p->shutting_down) {
+    if (op->type == OP_ACCEPT && cqe->res >= 0) close(cqe->res);
+    return;
+  }
+  switch (op->type) {
+   case OP_WAKE:
+    lock(&p->mutex);
+    p->wake_pending = false;
+    unlock(&p->mutex);
+    leader_read_eventfd(p, op, p->wakefd, &p->wake_buf);
+    break;
+   case OP_INTERRUPT:
+    lock(&p->mutex);
+    p->need_interrupt = true;
+    unlock(&p->mutex);
+    leader_read_eventfd(p, op, p->interruptfd, &p->interrupt_buf);
+    break;
+   case OP_PROACTOR_TIMER:
+    p->timer.armed = 0;
+    lock(&p->mutex);
+    if (p->timeout_set && (uint64_t)pn_proactor_now_64() >= p->timeout_deadline)
+      p->need_timeout = true;
+    unlock(&p->mutex);
+    break;
+   case OP_READ: {
+     pconnection_t *pc = (pconnection_t*)op->owner;
+     pc->read_result = cqe->res;
+     pc->read_completed = true;
+     work_notify(&pc->context);
+     break;
+   }
+   case OP_SEND: {
+     pconnection_t *pc = (pconnection_t*)op->owner;
+     pc->send_result = cqe->res;
+     pc->send_completed = true;
+     work_notify(&pc->context);
+     break;
+   }
+   case OP_WRITE: {
+     pconnection_t *pc = (pconnection_t*)op->owner;
+     pc->write_result = cqe->res;
+     pc->write_completed = true;
+     work_notify(&pc->context);
+     break;
+   }
+   case OP_CONNECT: {
+     pconnection_t *pc = (pconnection_t*)op->owner;
+     pc->connect_result = cqe->res;
+     pc->connect_completed = true;
+     work_notify(&pc->context);
+     break;
+   }
+   case OP_CONNECTION_TIMER: {
+     pconnection_t *pc = (pconnection_t*)op->owner;
+     pc->timer.armed = 0;
+     pc->tick_pending = true;
+     work_notify(&pc->context);
+     break;
+   }
+   case OP_ACCEPT:
+    leader_accepted(p, (acceptor_t*)op->owner, cqe->res);
+    break;
+  }
+}
+
+static void leader_reap(pn_proactor_t *p) {
+  struct io_uring_cqe cqe;
+  while (uring_pop(&p->ring, &cqe)) {
+    leader_complete(p, &cqe);
+  }
+}
+
+// ========================================================================
+// pconnection
+// ========================================================================
+
+static void pconnection_error_str(pconnection_t *pc, const char *msg, const char* what) {
+  pn_connection_driver_t *driver = &pc->driver;
+  pn_connection_driver_bind(driver); /* Bind so errors will be reported */
+  pni_proactor_set_cond(pn_transport_condition(driver->transport), what, pc->host, pc->port, msg);
+  pn_connection_driver_close(driver);
+}
+
+static void pconnection_error(pconnection_t *pc, int err, const char* what) {
+  strerrorbuf msg;
+  pstrerror(err, msg);
+  pconnection_error_str(pc, msg, what);
+}
+
+static const char *pconnection_setup(pconnection_t *pc, pn_proactor_t *p, pn_connection_t *c, pn_transport_t *t, bool server, const char *addr)
+{
+  memset(pc, 0, sizeof(*pc));
+
+  if (pn_connection_driver_init(&pc->driver, c, t) != 0) {
+    free(pc);
+    return "pn_connection_driver_init failure";
+  }
+  pcontext_init(&pc->context, PCONNECTION, p, pc);
+  pc->sockfd = -1;
+  pni_parse_addr(addr, pc->addr_buf, sizeof(pc->addr_buf), &pc->host, &pc->port);
+  uring_op_init(&pc->read_op, OP_READ, pc);
+  uring_op_init(&pc->send_op, OP_SEND, pc);
+  uring_op_init(&pc->write_op, OP_WRITE, pc);
+  uring_op_init(&pc->connect_op, OP_CONNECT, pc);
+  uring_op_init(&pc->timer.op, OP_CONNECTION_TIMER, pc);
+  pc->batch.next_event = pconnection_batch_next;
+  if (server) {
+    pn_transport_set_server(pc->driver.transport);
+  }
+  set_pconnection(pc->driver.connection, pc);
+  return NULL;
+}
+
+/* Only called when no operations are pending, or by pn_proactor_free() after they completed */
+static void pconnection_final_free(pconnection_t *pc) {
+  pn_proactor_t *p = pc->context.proactor;
+  if (pc->sockfd >= 0) {
+    close(pc->sockfd);
+    pc->sockfd = -1;
+    if (!p->shutting_down) leader_overflow_retry(p);
+  }
+  if (pc->rbuf) pconnection_rbuf_release(pc);
+  if (pc->addrinfo) freeaddrinfo(pc->addrinfo);
+  proactor_remove(&pc->context);
+  if (pc->driver.connection) {
+    set_pconnection(pc->driver.connection, NULL);
+  }
+  /* Let a concurrent pn_connection_wake() that found pc finish with it */
+  lock(&pc->context.mutex);
+  unlock(&pc->context.mutex);
+  pn_connection_driver_destroy(&pc->driver);
+  pcontext_finalize(&pc->context);
+  free(pc);
+}
+
+static pn_event_t *pconnection_batch_next(pn_event_batch_t *batch) {
+  pconnection_t *pc = batch_pconnection(batch);
+  if (!pc->driver.connection) return NULL;
+  return pn_connection_driver_next_event(&pc->driver);
+}
+
+static inline bool pconnection_rclosed(pconnection_t  *pc) {
+  return pn_connection_driver_read_closed(&pc->driver);
+}
+
+static inline bool pconnection_wclosed(pconnection_t  *pc) {
+  return pn_connection_driver_write_closed(&pc->driver);
+}
+
+static void pconnection_tick(pconnection_t *pc) {
+  pn_transport_t *t = pc->driver.transport;
+  if (pn_transport_get_idle_timeout(t) || pn_transport_get_remote_idle_timeout(t) ||
+      pn_transport_get_buffer_release_timeout(t)) {
+    pc->tick_deadline = pn_transport_tick(t, pn_proactor_now_64());
+  }
+}
+
+static void configure_socket(int sock) {
+  int tcp_nodelay = 1;
+  (void)setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (void*) &tcp_nodelay, sizeof(tcp_nodelay));
+}
+
+static void pconnection_connected(pconnection_t *pc) {
+  pc->connecting = false;
+  pc->connected = true;
+  if (pc->addrinfo) {
+    freeaddrinfo(pc->addrinfo);
+    pc->addrinfo = NULL;
+  }
+  pc->ai = NULL;
+  socklen_t len = sizeof(pc->local.ss);
+  (void)getsockname(pc->sockfd, (struct sockaddr*)&pc->local.ss, &len);
+  len = sizeof(pc->remote.ss);
+  (void)getpeername(pc->sockfd, (struct sockaddr*)&pc->remote.ss, &len);
+}
+
+/* Start a connect to the next address, or report the failure if there are none left */
+static void leader_connect(pconnection_t *pc) {
+  pn_proactor_t *p = pc->context.proactor;
+  int err = pc->connect_error;
+  while (pc->ai) {
+    struct addrinfo *ai = pc->ai;
+    pc->ai = ai->ai_next;       /* Move to next address in case this fails */
+    int fd = socket(ai->ai_family, SOCK_STREAM, 0);
+    if (fd >= 0) {
+      configure_socket(fd);
+      pc->sockfd = fd;
+      struct io_uring_sqe sqe;
+      sqe_init(&sqe, IORING_OP_CONNECT, fd);
+      sqe.addr = (uint64_t)(uintptr_t)ai->ai_addr;
+      sqe.off = ai->ai_addrlen;
+      leader_submit(p, &pc->connect_op, &sqe);
+      return;
+    }
+    err = errno;
+  }
+  pc->connecting = false;
+  freeaddrinfo(pc->addrinfo);
+  pc->addrinfo = NULL;
+  pconnection_error(pc, err ? err : ENOTCONN, "on connect");
+}
+
+static void leader_read(pconnection_t *pc) {
+  if (!pc->rbuf && !pconnection_rbuf_acquire(pc)) {
+    pconnection_error(pc, ENOMEM, "on read from");
+    return;
+  }
+  struct io_uring_sqe sqe;
+  if (pc->rbuf_registered) {
+    sqe_init(&sqe, IORING_OP_READ_FIXED, pc->sockfd);
+    sqe.buf_index = 0;
+  } else {
+    sqe_init(&sqe, IORING_OP_RECV, pc->sockfd);
+  }
+  sqe.addr = (uint64_t)(uintptr_t)pc->rbuf;
+  sqe.len = PROACTOR_READ_BUFFER_SIZE;
+  leader_submit(pc->context.proactor, &pc->read_op, &sqe);
+}
+
+/* Send the transport's output, or poll for POLLOUT if the socket was full */
+static void leader_write(pconnection_t *pc) {
+  pn_proactor_t *p = pc->context.proactor;
+  pn_connection_driver_t *d = &pc->driver;
+  struct io_uring_sqe sqe;
+  if (pc->send_full) {
+    pc->send_full = false;
+    sqe_init(&sqe, IORING_OP_POLL_ADD, pc->sockfd);
+    sqe.poll_events = POLLOUT;
+    leader_submit(p, &pc->write_op, &sqe);
+    return;
+  }
+  pn_bytes_t wbufs[PCONNECTION_WRITE_BUFFERS];
+  size_t count = pn_connection_driver_write_buffers(d, wbufs, PCONNECTION_WRITE_BUFFERS);
+  if (!count) {
+    if (pconnection_wclosed(pc) && !pc->wshutdown) {
+      pc->wshutdown = true;
+      shutdown(pc->sockfd, SHUT_WR);
+    }
+    return;
+  }
+  pc->send_size = 0;
+  for (size_t i = 0; i < count; ++i) {
+    pc->send_iov[i].iov_base = (void*)wbufs[i].start;
+    pc->send_iov[i].iov_len = wbufs[i].size;
+    pc->send_size += wbufs[i].size;
+  }
+  memset(&pc->send_msg, 0, sizeof(pc->send_msg));
+  pc->send_msg.msg_iov = pc->send_iov;
+  pc->send_msg.msg_iovlen = count;
+  sqe_init(&sqe, IORING_OP_SENDMSG, pc->sockfd);
+  sqe.addr = (uint64_t)(uintptr_t)&pc->send_msg;
+  sqe.len = 1;
+  /* MSG_DONTWAIT: a full socket ends the send with what fitted, rather than leaving it in flight */
+  sqe.msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+  leader_submit(p, &pc->send_op, &sqe);
+}
+
+/* Give received bytes to the transport, as many as it will take */
+static void pconnection_input(pconnection_t *pc) {
+  bool read = false;
+  while (pc->rbuf_len && !pconnection_rclosed(pc)) {
+    pn_rwbytes_t rbuf = pn_connection_driver_read_buffer(&pc->driver);
+    if (!rbuf.size) break;
+    size_t n = rbuf.size < pc->rbuf_len ? rbuf.size : pc->rbuf_len;
+    memcpy(rbuf.start, pc->rbuf + pc->rbuf_start, n);
+    pn_connection_driver_read_done(&pc->driver, n);
+    pc->rbuf_start += n;
+    pc->rbuf_len -= n;
+    read = true;
+  }
+  if (pconnection_rclosed(pc)) pc->rbuf_len = 0;
+  if (read) pconnection_tick(pc);
+}
+
+static void leader_pconnection_results(pconnection_t *pc) {
+  pn_connection_driver_t *d = &pc->driver;
+  if (pc->connect_completed) {
+    pc->connect_completed = false;
+    if (!pc->connect_result) {
+      pconnection_connected(pc);
+    } else {
+      close(pc->sockfd);
+      pc->sockfd = -1;
+      if (pc->connect_result != -ECANCELED) pc->connect_error = -pc->connect_result;
+    }
+  }
+  if (pc->read_completed) {
+    pc->read_completed = false;
+    int res = pc->read_result;
+    if (res > 0) {
+      pc->rbuf_start = 0;
+      pc->rbuf_len = (size_t)res;
+    } else if (res == 0) {
+      pn_connection_driver_read_close(d);
+    } else if (res != -ECANCELED && !pc->context.closing) {
+      pconnection_error(pc, -res, "on read from");
+    }
+  }
+  if (pc->send_completed) {
+    pc->send_completed = false;
+    int res = pc->send_result;
+    if (res > 0) pn_connection_driver_write_done(d, (size_t)res); /* May generate transport events */
+    if (res == -EAGAIN || (res >= 0 && (size_t)res < pc->send_size)) {
+      pc->send_full = true;
+    } else if (res < 0 && res != -ECANCELED && !pc->context.closing) {
+      pconnection_error(pc, -res, "on write to");
+    }
+  }
+  if (pc->write_completed) {
+    pc->write_completed = false;
+    int res = pc->write_result;
+    if (res < 0 && res != -ECANCELED && !pc->context.closing) pconnection_error(pc, -res, "on write to");
+  }
+}
+
+/* Return true if the connection has events for a worker.  May free pc and return false. */
+static bool leader_process_pconnection(pconnection_t *pc, bool disconnect) {
+  pn_proactor_t *p = pc->context.proactor;
+  pn_connection_driver_t *d = &pc->driver;
+
+  if (pc->send_op.pending) {
+    /* The kernel may be reading the transport's buffers, come back when the send completes */
+    if (disconnect) {
+      lock(&p->mutex);
+      pc->context.disconnect = true;
+      unlock(&p->mutex);
+    }
+    return false;
+  }
+  if (disconnect && !pc->context.closing) {
+    lock(&p->mutex);
+    if (pn_condition_is_set(p->disconnect_cond)) {
+      pn_condition_copy(pn_transport_condition(d->transport), p->disconnect_cond);
+    }
+    unlock(&p->mutex);
+    pn_connection_driver_close(d);
+  }
+  leader_pconnection_results(pc);
+  if (!pc->context.closing) {
+    if (pc->connecting && !pc->connect_op.pending) leader_connect(pc);
+
+    bool closed = pconnection_rclosed(pc) && pconnection_wclosed(pc);
+    lock(&pc->context.mutex);
+    bool waking = pc->wake_pending && !closed;
+    pc->wake_pending = false;
+    unlock(&pc->context.mutex);
+    if (waking) {
+      pn_connection_t *c = d->connection;
+      pn_collector_put(pn_connection_collector(c), PN_OBJECT, c, PN_CONNECTION_WAKE);
+    }
+    pconnection_input(pc);
+    if (pc->tick_pending) {
+      pc->tick_pending = false;
+      if (!closed) pconnection_tick(pc);
+    }
+  }
+
+  if (pn_connection_driver_finished(d)) {
+    if (!pc->context.closing) {
+      lock(&pc->context.mutex);
+      pc->context.closing = true;
+      unlock(&pc->context.mutex);
+    }
+    leader_cancel(p, &pc->write_op);
+    leader_cancel(p, &pc->read_op);
+    leader_cancel(p, &pc->connect_op);
+    leader_timer_set(p, &pc->timer, 0);
+    if (!pc->read_op.pending && !pc->write_op.pending && !pc->connect_op.pending && !pc->timer.op.pending) {
+      pconnection_final_free(pc);
+    }
+    return false;
+  }
+
+  if (pc->connected) {
+    if (!pc->write_op.pending) leader_write(pc); /* May generate transport events */
+    if (!pc->read_op.pending && !pc->rbuf_len && !pconnection_rclosed(pc)) leader_read(pc);
+  }
+  leader_timer_set(p, &pc->timer, pc->tick_deadline);
+  return !pc->send_op.pending && pn_connection_driver_has_event(d);
+}
+
+static int pgetaddrinfo(const char *host, const char *port, int flags, struct addrinfo **res)
+{
+  struct addrinfo hints = { 0 };
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_V4MAPPED | AI_ADDRCONFIG | flags;
+  return getaddrinfo(host, port, &hints, res);
+}
+
+void pn_proactor_connect2(pn_proactor_t *p, pn_connection_t *c, pn_transport_t *t, const char *addr) {
+  pconnection_t *pc = (pconnection_t*) calloc(1, sizeof(pconnection_t));
+  const char *err = pc ? pconnection_setup(pc, p, c, t, false, addr) : "out of memory";
+  if (err) {    /* No driver, so no connection to report the error on */
+    PN_LOG_DEFAULT(PN_SUBSYSTEM_EVENT, PN_LEVEL_ERROR, "pn_proactor_connect failure: %s", err);
+    return;
+  }
+
+  pn_connection_open(pc->driver.connection); /* Auto-open */
+
+  int gai_error = pgetaddrinfo(pc->host, pc->port, 0, &pc->addrinfo);
+  if (!gai_error) {
+    pc->ai = pc->addrinfo;
+    pc->connecting = true;      /* The leader starts the connect */
+  } else {
+    pconnection_error_str(pc, gai_strerror(gai_error), "connect to ");
+  }
+  proactor_add(&pc->context);
+}
+
+void pn_connection_wake(pn_connection_t* c) {
+  pconnection_t *pc = get_pconnection(c);
+  if (pc) {
+    lock(&pc->context.mutex);
+    if (!pc->context.closing) {
+      pc->wake_pending = true;
+      work_notify(&pc->context);
+    }
+    unlock(&pc->context.mutex);
+  }
+}
+
+void pn_proactor_release_connection(pn_connection_t *c) {
+  pconnection_t *pc = get_pconnection(c);
+  if (pc) {
+    set_pconnection(c, NULL);
+    lock(&pc->context.mutex);
+    pn_connection_driver_release_connection(&pc->driver);
+    unlock(&pc->context.mutex);
+    work_notify(&pc->context);
+  }
+}
+
+// ========================================================================
+// listener
+// ========================================================================
+
+pn_listener_t *pn_event_listener(pn_event_t *e) {
+  return (pn_event_class(e) == PN_CLASSCLASS(pn_listener)) ? (pn_listener_t*)pn_event_context(e) : NULL;
+}
+
+pn_listener_t *pn_listener() {
+  pn_listener_t *l = (pn_listener_t*)calloc(1, sizeof(pn_listener_t));
+  if (l) {
+    l->batch.next_event = listener_batch_next;
+    l->collector = pn_collector();
+    l->condition = pn_condition();
+    l->attachments = pn_record();
+    pn_proactor_t *unknown = NULL;  // won't know until pn_proactor_listen
+    pcontext_init(&l->context, LISTENER, unknown, l);
+    if (!l->condition || !l->collector || !l->attachments) {
+      pn_listener_free(l);
+      return NULL;
+    }
+  }
+  return l;
+}
+
+void pn_proactor_listen(pn_proactor_t *p, pn_listener_t *l, const char *addr, int backlog)
+{
+  lock(&l->context.mutex);
+  if (l->context.proactor) {    /* Already listening, for this or another proactor */
+    unlock(&l->context.mutex);
+    PN_LOG_DEFAULT(PN_SUBSYSTEM_EVENT, PN_LEVEL_ERROR, "pn_proactor_listen failure: listener in use");
+    return;
+  }
+  l->context.proactor = p;
+  l->backlog = backlog;
+  pni_parse_addr(addr, l->addr_buf, PN_MAX_ADDR, &l->host, &l->port);
+
+  struct addrinfo *addrinfo = NULL;
+  int gai_err = pgetaddrinfo(l->host, l->port, AI_PASSIVE | AI_ALL, &addrinfo);
+  int err = 0;
+  if (!gai_err) {
+    /* Count addresses, allocate enough space for sockets */
+    size_t len = 0;
+    for (struct addrinfo *ai = addrinfo; ai; ai = ai->ai_next) {
+      ++len;
+    }
+    assert(len > 0);            /* guaranteed by getaddrinfo */
+    l->acceptors = (acceptor_t*)calloc(len, sizeof(acceptor_t));
+    if (!l->acceptors) err = ENOMEM;
+    l->acceptors_size = 0;
+    uint16_t dynamic_port = 0;  /* Record dynamic port from first bind(0) */
+    /* Find working listen addresses */
+    for (struct addrinfo *ai = l->acceptors ? addrinfo : NULL; ai; ai = ai->ai_next) {
+      if (dynamic_port) set_port(ai->ai_addr, dynamic_port);
+      int fd = socket(ai->ai_family, SOCK_STREAM, ai->ai_protocol);
+      static int on = 1;
+      if (fd >= 0) {
+        if (!setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) &&
+            /* We listen to v4/v6 on separate sockets, don't let v6 listen for v4 */
+            (ai->ai_family != AF_INET6 ||
+             !setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on))) &&
+            !bind(fd, ai->ai_addr, ai->ai_addrlen) &&
+            !listen(fd, backlog))
+        {
+          acceptor_t *acceptor = &l->acceptors[l->acceptors_size++];
+          /* Get actual address */
+          socklen_t len = pn_netaddr_socklen(&acceptor->addr);
+          (void)getsockname(fd, (struct sockaddr*)(&acceptor->addr.ss), &len);
+          if (acceptor == l->acceptors) { /* First acceptor, check for dynamic port */
+            dynamic_port = check_dynamic_port(ai->ai_addr, pn_netaddr_sockaddr(&acceptor->addr));
+          } else {              /* Link addr to previous addr */
+            (acceptor-1)->addr.next = &acceptor->addr;
+          }
+          acceptor->fd = fd;
+          acceptor->listener = l;
+          uring_op_init(&acceptor->accept_op, OP_ACCEPT, acceptor);
+        } else {
+          err = errno;
+          close(fd);
+        }
+      } else {
+        err = errno;
+      }
+    }
+  }
+  if (addrinfo) {
+    freeaddrinfo(addrinfo);
+  }
+
+  if (l->acceptors_size == 0) { /* All failed */
+    if (gai_err) {
+      pni_proactor_set_cond(l->condition, "listen on", l->host, l->port, gai_strerror(gai_err));
+    } else {
+      strerrorbuf msg;
+      pstrerror(err, msg);
+      pni_proactor_set_cond(l->condition, "listen on", l->host, l->port, msg);
+    }
+    listener_begin_close_lh(l);
+  } else {
+    pn_collector_put(l->collector, PN_CLASSCLASS(pn_listener), l, PN_LISTENER_OPEN);
+  }
+  proactor_add(&l->context);
+  unlock(&l->context.mutex);
+}
+
+void pn_listener_free(pn_listener_t *l) {
+  /* Freed by the user if it was never used, otherwise by the leader once closed */
+  if (l) {
+    if (l->context.proactor) proactor_remove(&l->context);
+    if (l->collector) pn_collector_free(l->collector);
+    if (l->condition) pn_condition_free(l->condition);
+    if (l->attachments) pn_free(l->attachments);
+    for (int fd = listener_pop_accepted_lh(l); fd >= 0; fd = listener_pop_accepted_lh(l)) {
+      close(fd);
+    }
+    free(l->accepted);
+    free(l->acceptors);
+    pcontext_finalize(&l->context);
+    free(l);
+  }
+}
+
+/* Call with context.mutex held */
+static void listener_begin_close_lh(pn_listener_t* l) {
+  if (!l->context.closing) {
+    l->context.closing = true;
+    /* Close sockets that were accepted but not claimed, the leader closes the listening sockets */
+    for (int fd = listener_pop_accepted_lh(l); fd >= 0; fd = listener_pop_accepted_lh(l)) {
+      close(fd);
+    }
+    pn_collector_put(l->collector, PN_CLASSCLASS(pn_listener), l, PN_LISTENER_CLOSE);
+  }
+}
+
+void pn_listener_close(pn_listener_t* l) {
+  lock(&l->context.mutex);
+  listener_begin_close_lh(l);
+  if (l->context.proactor) work_notify(&l->context);
+  unlock(&l->context.mutex);
+}
+
+/* Call with context.mutex held */
+static inline bool listener_has_event_lh(pn_listener_t *l) {
+  return pn_collector_peek(l->collector) ||
+    (l->accepted_count && !l->unclaimed && !l->context.closing);
+}
+
+/* Return true if the listener has events for a worker.  May free l and return false. */
+static bool leader_process_listener(pn_listener_t *l, bool disconnect) {
+  pn_proactor_t *p = l->context.proactor;
+  if (disconnect) {
+    lock(&l->context.mutex);
+    if (!l->context.closing) {
+      lock(&p->mutex);
+      if (pn_condition_is_set(p->disconnect_cond)) {
+        pn_condition_copy(l->condition, p->disconnect_cond);
+      }
+      unlock(&p->mutex);
+      listener_begin_close_lh(l);
+    }
+    unlock(&l->context.mutex);
+  }
+  lock(&l->context.mutex);
+  bool closing = l->context.closing;
+  bool has_event = listener_has_event_lh(l);
+  bool close_dispatched = l->close_dispatched;
+  unlock(&l->context.mutex);
+
+  bool accepting = false;
+  for (size_t i = 0; i < l->acceptors_size; ++i) {
+    acceptor_t *a = &l->acceptors[i];
+    if (closing) {
+      leader_cancel(p, &a->accept_op);
+      if (!a->accept_op.pending && a->fd >= 0) {
+        close(a->fd);
+        a->fd = -1;
+      }
+    } else if (!a->accept_op.pending && !a->overflowed) {
+      leader_accept(p, a);
+    }
+    accepting = accepting || a->accept_op.pending;
+  }
+  if (closing) leader_overflow_remove(p, l);
+  if (close_dispatched && !accepting && !has_event) {
+    pn_listener_free(l);
+    return false;
+  }
+  return has_event;
+}
+
+static pn_event_t *listener_batch_next(pn_event_batch_t *batch) {
+  pn_listener_t *l = batch_listener(batch);
+  lock(&l->context.mutex);
+  pn_event_t *e = pn_collector_next(l->collector);
+  if (!e && l->accepted_count && !l->unclaimed && !l->context.closing) {
+    // empty collector means pn_collector_put() will not coalesce
+    pn_collector_put(l->collector, PN_CLASSCLASS(pn_listener), l, PN_LISTENER_ACCEPT);
+    l->unclaimed = true;
+    e = pn_collector_next(l->collector);
+  }
+  if (e && pn_event_type(e) == PN_LISTENER_CLOSE)
+    l->close_dispatched = true;
+  unlock(&l->context.mutex);
+  return log_event(l, e);
+}
+
+pn_proactor_t *pn_listener_proactor(pn_listener_t* l) {
+  return l ? l->context.proactor : NULL;
+}
+
+pn_condition_t* pn_listener_condition(pn_listener_t* l) {
+  return l->condition;
+}
+
+void *pn_listener_get_context(pn_listener_t *l) {
+  return l->listener_context;
+}
+
+void pn_listener_set_context(pn_listener_t *l, void *context) {
+  l->listener_context = context;
+}
+
+pn_record_t *pn_listener_attachments(pn_listener_t *l) {
+  return l->attachments;
+}
+
+void pn_listener_accept2(pn_listener_t *l, pn_connection_t *c, pn_transport_t *t) {
+  pconnection_t *pc = (pconnection_t*) calloc(1, sizeof(pconnection_t));
+  const char *err = pc ? pconnection_setup(pc, pn_listener_proactor(l), c, t, true, "") : "out of memory";
+  if (err) {
+    PN_LOG_DEFAULT(PN_SUBSYSTEM_EVENT, PN_LEVEL_ERROR, "pn_listener_accept failure: %s", err);
+    return;
+  }
+
+  int err2 = 0;
+  int fd = -1;
+  lock(&l->context.mutex);
+  if (l->context.closing)
+    err2 = EBADF;
+  else if (l->unclaimed) {
+    l->unclaimed = false;
+    fd = listener_pop_accepted_lh(l);
+    assert(fd >= 0);
+  }
+  else err2 = EWOULDBLOCK;
+  unlock(&l->context.mutex);
+
+  if (fd >= 0) {
+    configure_socket(fd);
+    pc->sockfd = fd;
+    pconnection_connected(pc);
+  } else {
+    pconnection_error(pc, err2, "pn_listener_accept");
+  }
+  proactor_add(&pc->context);
+}
+
+// ========================================================================
+// proactor
+// ========================================================================
+
+pn_proactor_t *pn_proactor() {
+  pn_proactor_t *p = (pn_proactor_t*)calloc(1, sizeof(*p));
+  if (!p) return NULL;
+  p->ring.fd = p->wakefd = p->interruptfd = -1;
+  pmutex_init(&p->mutex);
+  pthread_cond_init(&p->cond, NULL);
+  p->batch.next_event = &proactor_batch_next;
+  uring_op_init(&p->wake_op, OP_WAKE, p);
+  uring_op_init(&p->interrupt_op, OP_INTERRUPT, p);
+  uring_op_init(&p->timer.op, OP_PROACTOR_TIMER, p);
+  if (uring_init(&p->ring, PROACTOR_URING_ENTRIES) == 0 &&
+      (p->ring.features & IORING_FEAT_NODROP)) {
+    if ((p->wakefd = eventfd(0, 0)) >= 0 &&
+        (p->interruptfd = eventfd(0, 0)) >= 0 &&
+        (p->collector = pn_collector()) != NULL &&
+        (p->disconnect_cond = pn_condition()) != NULL) {
+      read_pool_init(p);
+      p->accept_multishot = true;
+      leader_read_eventfd(p, &p->wake_op, p->wakefd, &p->wake_buf);
+      leader_read_eventfd(p, &p->interrupt_op, p->interruptfd, &p->interrupt_buf);
+      return p;
+    }
+  }
+  if (p->disconnect_cond) pn_condition_free(p->disconnect_cond);
+  if (p->collector) pn_collector_free(p->collector);
+  if (p->interruptfd >= 0) close(p->interruptfd);
+  if (p->wakefd >= 0) close(p->wakefd);
+  if (p->ring.fd >= 0) uring_finalize(&p->ring);
+  pthread_cond_destroy(&p->cond);
+  pmutex_finalize(&p->mutex);
+  free(p);
+  return NULL;
+}
+
+void pn_proactor_free(pn_proactor_t *p) {
+  /* No competing threads, cancel everything and wait till the kernel is done with our buffers */
+  p->shutting_down = true;
+  leader_cancel(p, &p->wake_op);
+  leader_cancel(p, &p->interrupt_op);
+  leader_cancel(p, &p->timer.op);
+  for (pcontext_t *ctx = p->contexts; ctx; ctx = ctx->next) {
+    pconnection_t *pc = pcontext_pconnection(ctx);
+    if (pc) {
+      leader_cancel(p, &pc->read_op);
+      leader_cancel(p, &pc->send_op);
+      leader_cancel(p, &pc->write_op);
+      leader_cancel(p, &pc->connect_op);
+      leader_cancel(p, &pc->timer.op);
+    } else {
+      pn_listener_t *l = pcontext_listener(ctx);
+      for (size_t i = 0; i < l->acceptors_size; ++i) {
+        leader_cancel(p, &l->acceptors[i].accept_op);
+      }
+    }
+  }
+  while (p->ops_pending) {
+    uring_submit(&p->ring, true);
+    leader_reap(p);
+  }
+
+  while (p->contexts) {
+    pcontext_t *ctx = p->contexts;
+    pconnection_t *pc = pcontext_pconnection(ctx);
+    if (pc) {
+      pn_collector_release(pc->driver.collector);
+      pconnection_final_free(pc);
+    } else {
+      pn_listener_t *l = pcontext_listener(ctx);
+      pn_collector_release(l->collector);
+      for (size_t i = 0; i < l->acceptors_size; ++i) {
+        if (l->acceptors[i].fd >= 0) close(l->acceptors[i].fd);
+      }
+      pn_listener_free(l);
+    }
+  }
+
+  uring_finalize(&p->ring);
+  free(p->rpool);               /* Unregistered with the ring */
+  close(p->wakefd);
+  close(p->interruptfd);
+  pn_collector_free(p->collector);
+  pn_condition_free(p->disconnect_cond);
+  pthread_cond_destroy(&p->cond);
+  pmutex_finalize(&p->mutex);
+  free(p);
+}
+
+pn_proactor_t *pn_event_proactor(pn_event_t *e) {
+  if (pn_event_class(e) == PN_CLASSCLASS(pn_proactor)) return (pn_proactor_t*)pn_event_context(e);
+  pn_listener_t *l = pn_event_listener(e);
+  if (l) return l->context.proactor;
+  pn_connection_t *c = pn_event_connection(e);
+  if (c) return pn_connection_proactor(c);
+  return NULL;
+}
+
+static void proactor_add_event(pn_proactor_t *p, pn_event_type_t t) {
+  pn_collector_put(p->collector, PN_CLASSCLASS(pn_proactor), p, t);
+}
+
+// Call with lock held.  Leave unchanged if events pending.
+// There can be multiple interrupts but only one inside the collector to avoid coalescing.
+// Return true if there is an event in the collector.
+static bool proactor_update_batch(pn_proactor_t *p) {
+  if (pn_collector_peek(p->collector))
+    return true;
+
+  if (p->need_timeout) {
+    p->need_timeout = false;
+    p->timeout_set = false;
+    proactor_add_event(p, PN_PROACTOR_TIMEOUT);
+    return true;
+  }
+  if (p->need_interrupt) {
+    p->need_interrupt = false;
+    proactor_add_event(p, PN_PROACTOR_INTERRUPT);
+    return true;
+  }
+  if (p->need_inactive) {
+    p->need_inactive = false;
+    proactor_add_event(p, PN_PROACTOR_INACTIVE);
+    return true;
+  }
+  return false;
+}
+
+static pn_event_t *proactor_batch_next(pn_event_batch_t *batch) {
+  pn_proactor_t *p = batch_proactor(batch);
+  lock(&p->mutex);
+  proactor_update_batch(p);
+  pn_event_t *e = pn_collector_next(p->collector);
+  if (e && pn_event_type(e) == PN_PROACTOR_TIMEOUT)
+    p->timeout_processed = true;
+  unlock(&p->mutex);
+  return log_event(p, e);
+}
+
+static pn_event_batch_t *get_batch_lh(pn_proactor_t *p) {
+  if (!p->batch_working && proactor_update_batch(p)) {
+    p->batch_working = true;
+    return &p->batch;
+  }
+  pcontext_t *ctx = pcontext_pop(&p->worker_q);
+  if (ctx) {
+    assert(ctx->working);
+    pconnection_t *pc = pcontext_pconnection(ctx);
+    return pc ? &pc->batch : &pcontext_listener(ctx)->batch;
+  }
+  return NULL;
+}
+
+/* Process the contexts on the leader queue, move those with events to the worker queue */
+static void leader_process_lh(pn_proactor_t *p) {
+  for (pcontext_t *ctx = pcontext_pop(&p->leader_q); ctx; ctx = pcontext_pop(&p->leader_q)) {
+    assert(!ctx->working);
+    bool disconnect = ctx->disconnect;
+    ctx->disconnect = false;
+    unlock(&p->mutex);          /* Unlock to process each item, may add more items to leader_q */
+    pconnection_t *pc = pcontext_pconnection(ctx);
+    bool has_work = pc ?
+      leader_process_pconnection(pc, disconnect) :
+      leader_process_listener(pcontext_listener(ctx), disconnect);
+    lock(&p->mutex);
+    if (has_work && !ctx->queued) {
+      ctx->working = true;
+      pcontext_push(&p->worker_q, ctx);
+    }
+  }
+}
+
+static pn_event_batch_t *leader_lead_lh(pn_proactor_t *p, bool can_block) {
+  leader_process_lh(p);
+  pn_event_batch_t *batch = get_batch_lh(p);
+  if (!batch) {
+    leader_timer_set(p, &p->timer, (p->timeout_set && !p->need_timeout) ? p->timeout_deadline : 0);
+    bool wait = can_block && !p->leader_q.front;
+    p->leader_waiting = wait;
+    unlock(&p->mutex);          /* Unlock to submit and wait */
+    uring_submit(&p->ring, wait);
+    leader_reap(p);
+    lock(&p->mutex);
+    p->leader_waiting = false;
+    leader_process_lh(p);
+    batch = get_batch_lh(p);
+  }
+  if (p->ring.sq_unsubmitted) {
+    unlock(&p->mutex);          /* Submit what processing queued, sends in particular */
+    uring_submit(&p->ring, false);
+    lock(&p->mutex);
+  }
+  return batch;
+}
+
+pn_event_batch_t *pn_proactor_get(struct pn_proactor_t* p) {
+  lock(&p->mutex);
+  pn_event_batch_t *batch = get_batch_lh(p);
+  if (batch == NULL && !p->has_leader) {
+    /* Try a non-blocking lead to generate some work */
+    p->has_leader = true;
+    batch = leader_lead_lh(p, false);
+    p->has_leader = false;
+    pthread_cond_broadcast(&p->cond);   /* Signal followers for possible work */
+  }
+  unlock(&p->mutex);
+  return batch;
+}
+
+pn_event_batch_t *pn_proactor_wait(struct pn_proactor_t* p) {
+  lock(&p->mutex);
+  pn_event_batch_t *batch = get_batch_lh(p);
+  while (!batch && p->has_leader) {
+    pthread_cond_wait(&p->cond, &p->mutex); /* Follow the leader */
+    batch = get_batch_lh(p);
+  }
+  if (!batch) {                 /* Become leader */
+    p->has_leader = true;
+    do {
+      batch = leader_lead_lh(p, true);
+    } while (!batch);
+    p->has_leader = false;
+    pthread_cond_broadcast(&p->cond); /* Signal a followers. One takes over, many can work. */
+  }
+  unlock(&p->mutex);
+  return batch;
+}
+
+void pn_proactor_done(pn_proactor_t *p, pn_event_batch_t *batch) {
+  if (!batch) return;
+  pcontext_t *ctx = batch_pcontext(batch);
+  lock(&p->mutex);
+  if (ctx) {
+    assert(ctx->working);
+    ctx->working = false;
+    if (!ctx->queued) pcontext_push(&p->leader_q, ctx);
+  } else if (batch_proactor(batch) == p) {
+    p->batch_working = false;
+    if (p->timeout_processed) {
+      p->timeout_processed = false;
+      if (is_inactive(p)) p->need_inactive = true;
+    }
+  }
+  bool notify = proactor_notify_lh(p);
+  unlock(&p->mutex);
+  if (notify) proactor_notify(p);
+}
+
+void pn_proactor_interrupt(pn_proactor_t *p) {
+  if (p->interruptfd == -1)
+    return;
+  uint64_t increment = 1;
+  if (write(p->interruptfd, &increment, sizeof(uint64_t)) != sizeof(uint64_t))
+    URING_FATAL(setting eventfd, errno);
+}
+
+void pn_proactor_set_timeout(pn_proactor_t *p, pn_millis_t t) {
+  lock(&p->mutex);
+  p->timeout_set = true;
+  p->need_timeout = (t == 0);
+  p->timeout_deadline = (uint64_t)pn_proactor_now_64() + t;
+  bool notify = proactor_notify_lh(p);
+  unlock(&p->mutex);
+  if (notify) proactor_notify(p);
+}
+
+void pn_proactor_cancel_timeout(pn_proactor_t *p) {
+  lock(&p->mutex);
+  p->timeout_set = false;
+  p->need_timeout = false;
+  if (is_inactive(p)) p->need_inactive = true;
+  bool notify = proactor_notify_lh(p);
+  unlock(&p->mutex);
+  if (notify) proactor_notify(p);
+}
+
+pn_proactor_t *pn_connection_proactor(pn_connection_t* c) {
+  pconnection_t *pc = get_pconnection(c);
+  return pc ? pc->context.proactor : NULL;
+}
+
+void pn_proactor_connection_memory_usage(pn_connection_t *c, pn_connection_memory_t *usage) {
+  pn_connection_memory_usage(c, usage);
+  if (get_pconnection(c)) {
+    usage->io = sizeof(pconnection_t);
+    usage->total += usage->io;
+  }
+}
+
+void pn_proactor_disconnect(pn_proactor_t *p, pn_condition_t *cond) {
+  lock(&p->mutex);
+  if (cond) {
+    pn_condition_copy(p->disconnect_cond, cond);
+  } else {
+    pn_condition_clear(p->disconnect_cond);
+  }
+  /* The leader closes each context when it is not owned by a worker */
+  for (pcontext_t *ctx = p->contexts; ctx; ctx = ctx->next) {
+    ctx->disconnect = true;
+    if (!ctx->working && !ctx->queued) pcontext_push(&p->leader_q, ctx);
+  }
+  if (is_inactive(p)) p->need_inactive = true;
+  bool notify = proactor_notify_lh(p);
+  unlock(&p->mutex);
+  if (notify) proactor_notify(p);
+}
+
+const pn_netaddr_t *pn_transport_local_addr(pn_transport_t *t) {
+  pconnection_t *pc = get_pconnection(pn_transport_connection(t));
+  return pc? &pc->local : NULL;
+}
+
+const pn_netaddr_t *pn_transport_remote_addr(pn_transport_t *t) {
+  pconnection_t *pc = get_pconnection(pn_transport_connection(t));
+  return pc ? &pc->remote : NULL;
+}
+
+const pn_netaddr_t *pn_listener_addr(pn_listener_t *l) {
+  return l->acceptors_size > 0 ? &l->acceptors[0].addr : NULL;
+}
+
+pn_millis_t pn_proactor_now(void) {
+  return (pn_millis_t) pn_proactor_now_64();
+}
+
+int64_t pn_proactor_now_64(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
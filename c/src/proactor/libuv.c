@@ -1241,6 +1241,14 @@ pn_proactor_t *pn_connection_proactor(pn_connection_t* c) {
   return pc ? pc->work.proactor : NULL;
 }
 
+void pn_proactor_connection_memory_usage(pn_connection_t *c, pn_connection_memory_t *usage) {
+  pn_connection_memory_usage(c, usage);
+  if (get_pconnection(c)) {
+    usage->io = sizeof(pconnection_t);
+    usage->total += usage->io;
+  }
+}
+
 void pn_connection_wake(pn_connection_t* c) {
   /* May be called from any thread */
   pconnection_t *pc = get_pconnection(c);
@@ -2129,7 +2129,8 @@ VOID CALLBACK tick_timer_cb(PVOID arg, BOOLEAN /* ignored*/ ) {
 // Call with no lock held or stop_timer and callback may deadlock
 static void pconnection_tick(pconnection_t *pc) {
   pn_transport_t *t = pc->driver.transport;
-  if (pn_transport_get_idle_timeout(t) || pn_transport_get_remote_idle_timeout(t)) {
+  if (pn_transport_get_idle_timeout(t) || pn_transport_get_remote_idle_timeout(t) ||
+      pn_transport_get_buffer_release_timeout(t)) {
     if(!stop_timer(pc->context.proactor->timer_queue, &pc->tick_timer)) {
       // TODO: handle error
     }
@@ -2963,6 +2964,14 @@ pn_proactor_t *pn_connection_proactor(pn_connection_t* c) {
   return pc ? pc->context.proactor : NULL;
 }
 
+void pn_proactor_connection_memory_usage(pn_connection_t *c, pn_connection_memory_t *usage) {
+  pn_connection_memory_usage(c, usage);
+  if (get_pconnection(c)) {
+    usage->io = sizeof(pconnection_t);
+    usage->total += usage->io;
+  }
+}
+
 void pn_connection_wake(pn_connection_t* c) {
   pconnection_t *pc = get_pconnection(c);
   csguard g(&pc->context.cslock);
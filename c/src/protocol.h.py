@@ -58,6 +58,14 @@ for type in TYPES:
   fields[code] = (type["@name"], [f["@name"] for f in type.query["field"]])
   idx += 1
 
+print()
+print("/* X(NAME, symbol) for each descriptor, NAME is also its code */")
+print("#define PN_DESCRIPTOR_SYMBOLS(X) \\")
+for type in TYPES:
+  name = type["@name"].upper().replace("-", "_")
+  print("  X(%s, \"%s\") \\" % (name, type["descriptor"]["@name"]))
+print()
+
 print("""
 #include <stddef.h>
 
@@ -24,8 +24,10 @@
 #include "core/autodetect.h"
 #include "core/dispatch_actions.h"
 #include "core/engine-internal.h"
+#include "core/memory.h"
 #include "core/util.h"
 #include "platform/platform_fmt.h"
+#include "performatives.h"
 #include "protocol.h"
 
 #include "proton/ssl.h"
@@ -463,8 +465,8 @@ static void pni_post_sasl_frame(pn_transport_t *transport)
   while (sasl->desired_state > sasl->last_state) {
     switch (desired_state) {
     case SASL_POSTED_INIT:
-      pn_post_frame(transport, SASL_FRAME_TYPE, 0, "DL[szS]", SASL_INIT, sasl->selected_mechanism,
-                    out.size, out.start, sasl->local_fqdn);
+      pn_post_frame(transport, SASL_FRAME_TYPE, 0,
+                    pn_amqp_encode_sasl_init(&transport->frame, sasl->selected_mechanism, out, sasl->local_fqdn));
       pni_emit(transport);
       break;
     case SASL_POSTED_MECHANISMS: {
@@ -477,14 +479,15 @@ static void pni_post_sasl_frame(pn_transport_t *transport)
         pni_split_mechs(mechlist, sasl->included_mechanisms, mechs, &count);
       }
 
-      pn_post_frame(transport, SASL_FRAME_TYPE, 0, "DL[@T[*s]]", SASL_MECHANISMS, PN_SYMBOL, count, mechs);
+      pn_post_frame(transport, SASL_FRAME_TYPE, 0,
+                    pn_amqp_encode_sasl_mechanisms(&transport->frame, count, mechs));
       free(mechlist);
       pni_emit(transport);
       break;
     }
     case SASL_POSTED_RESPONSE:
       if (sasl->last_state != SASL_POSTED_RESPONSE) {
-        pn_post_frame(transport, SASL_FRAME_TYPE, 0, "DL[Z]", SASL_RESPONSE, out.size, out.start);
+        pn_post_frame(transport, SASL_FRAME_TYPE, 0, pn_amqp_encode_sasl_response(&transport->frame, out));
         pni_emit(transport);
       }
       break;
@@ -493,7 +496,7 @@ static void pni_post_sasl_frame(pn_transport_t *transport)
         desired_state = SASL_POSTED_MECHANISMS;
         continue;
       } else if (sasl->last_state != SASL_POSTED_CHALLENGE) {
-        pn_post_frame(transport, SASL_FRAME_TYPE, 0, "DL[Z]", SASL_CHALLENGE, out.size, out.start);
+        pn_post_frame(transport, SASL_FRAME_TYPE, 0, pn_amqp_encode_sasl_challenge(&transport->frame, out));
         pni_emit(transport);
       }
       break;
@@ -502,7 +505,7 @@ static void pni_post_sasl_frame(pn_transport_t *transport)
         desired_state = SASL_POSTED_MECHANISMS;
         continue;
       }
-      pn_post_frame(transport, SASL_FRAME_TYPE, 0, "DL[B]", SASL_OUTCOME, sasl->outcome);
+      pn_post_frame(transport, SASL_FRAME_TYPE, 0, pn_amqp_encode_sasl_outcome(&transport->frame, sasl->outcome));
       pni_emit(transport);
       if (sasl->outcome!=PN_SASL_OK) {
         pn_do_error(transport, "amqp:unauthorized-access", "Failed to authenticate client [mech=%s]",
@@ -750,6 +753,19 @@ pn_sasl_t *pn_sasl(pn_transport_t *transport)
   return (pn_sasl_t *)transport;
 }
 
+// The bytes held by the SASL layer of transport, not counting the mechanism
+// implementation's own
+size_t pni_sasl_memory(pn_transport_t *transport)
+{
+  pni_sasl_t *sasl = transport->sasl;
+  if (!sasl) return 0;
+  return pni_mem_size(sasl, sizeof(pni_sasl_t)) +
+    pni_mem_string_size(sasl->selected_mechanism) + pni_mem_string_size(sasl->included_mechanisms) +
+    pni_mem_string_size(sasl->password) + pni_mem_string_size(sasl->external_auth) +
+    pni_mem_string_size(sasl->local_fqdn) +
+    pni_buffer_memory(sasl->decoded_buffer) + pni_buffer_memory(sasl->encoded_buffer);
+}
+
 void pn_sasl_free(pn_transport_t *transport)
 {
   if (transport) {
@@ -845,7 +861,7 @@ pn_sasl_outcome_t pn_sasl_outcome(pn_sasl_t *sasl0)
 }
 
 // Received Server side
-int pn_do_init(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_init(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   pni_sasl_t *sasl = transport->sasl;
 
@@ -877,7 +893,7 @@ int pn_do_init(pn_transport_t *transport, uint8_t frame_type, uint16_t channel,
 }
 
 // Received client side
-int pn_do_mechanisms(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_mechanisms(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   pni_sasl_t *sasl = transport->sasl;
 
@@ -902,7 +918,7 @@ int pn_do_mechanisms(pn_transport_t *transport, uint8_t frame_type, uint16_t cha
     while(pn_data_next(args)) {
       pn_bytes_t s = pn_data_get_symbol(args);
       if (pni_sasl_client_included_mech(sasl->included_mechanisms, s)) {
-        pn_string_addf(mechs, "%*s ", (int)s.size, s.start);
+        pn_string_addf(mechs, "%.*s ", (int)s.size, s.start);
       }
     }
 
@@ -933,7 +949,7 @@ int pn_do_mechanisms(pn_transport_t *transport, uint8_t frame_type, uint16_t cha
 }
 
 // Received client side
-int pn_do_challenge(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_challenge(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   pni_sasl_t *sasl = transport->sasl;
 
@@ -954,7 +970,7 @@ int pn_do_challenge(pn_transport_t *transport, uint8_t frame_type, uint16_t chan
 }
 
 // Received server side
-int pn_do_response(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_response(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   pni_sasl_t *sasl = transport->sasl;
 
@@ -975,7 +991,7 @@ int pn_do_response(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
 }
 
 // Received client side
-int pn_do_outcome(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_outcome(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, pn_bytes_t performative, const pn_bytes_t *payload)
 {
   pni_sasl_t *sasl = transport->sasl;
 
@@ -23,6 +23,7 @@
 #include "platform/platform_fmt.h"
 #include "core/engine-internal.h"
 #include "core/logger_private.h"
+#include "core/memory.h"
 #include "core/util.h"
 
 #include <proton/ssl.h>
@@ -838,6 +839,16 @@ const pn_io_layer_t ssl_closed_layer = {
 static pn_ssl_domain_t default_client_domain = {0};
 static pn_ssl_domain_t default_server_domain = {0};
 
+size_t pni_ssl_memory(pn_transport_t *transport)
+{
+  pni_ssl_t *ssl = transport->ssl;
+  if (!ssl) return 0;
+  return pni_mem_size(ssl, sizeof(pni_ssl_t)) +
+    pni_mem_size(ssl->outbuf, ssl->out_size) + pni_mem_size(ssl->inbuf, ssl->in_size) +
+    pni_mem_string_size(ssl->session_id) + pni_mem_string_size(ssl->peer_hostname) +
+    pni_mem_string_size(ssl->subject);
+}
+
 int pn_ssl_init(pn_ssl_t *ssl0, pn_ssl_domain_t *domain, const char *session_id)
 {
   pn_transport_t *transport = get_transport_internal(ssl0);
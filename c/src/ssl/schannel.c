@@ -35,6 +35,7 @@
 #include "core/autodetect.h"
 #include "core/engine-internal.h"
 #include "core/logger_private.h"
+#include "core/memory.h"
 #include "core/util.h"
 
 #include "platform/platform.h"
@@ -791,6 +792,17 @@ bool pn_ssl_get_protocol_name(pn_ssl_t *ssl0, char *buffer, size_t size )
 }
 
 
+size_t pni_ssl_memory(pn_transport_t *transport)
+{
+  pni_ssl_t *ssl = transport->ssl;
+  if (!ssl) return 0;
+  return pni_mem_size(ssl, sizeof(pni_ssl_t)) +
+    pni_mem_size(ssl->sc_outbuf, ssl->sc_out_size) + pni_mem_size(ssl->sc_inbuf, ssl->sc_in_size) +
+    pni_buffer_memory(ssl->inbuf2) +
+    pni_mem_string_size(ssl->session_id) + pni_mem_string_size(ssl->peer_hostname) +
+    pni_mem_string_size(ssl->subject);
+}
+
 void pn_ssl_free( pn_transport_t *transport)
 {
   pni_ssl_t *ssl = transport->ssl;
@@ -33,4 +33,7 @@
 // release the SSL context
 void pn_ssl_free(pn_transport_t *transport);
 
+// the bytes held by the SSL layer of transport, not counting the SSL library's own
+size_t pni_ssl_memory(pn_transport_t *transport);
+
 #endif /* ssl-internal.h */
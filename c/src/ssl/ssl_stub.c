@@ -52,6 +52,11 @@ void pn_ssl_free(pn_transport_t *transport)
 {
 }
 
+size_t pni_ssl_memory(pn_transport_t *transport)
+{
+  return 0;
+}
+
 void pn_ssl_trace(pn_ssl_t *ssl, pn_trace_t trace)
 {
 }
@@ -19,6 +19,8 @@
 
 #include "./pn_test.hpp"
 
+#include "core/engine-internal.h"
+
 #include <proton/codec.h>
 #include <proton/connection.h>
 #include <proton/connection_driver.h>
@@ -28,7 +30,9 @@
 #include <proton/session.h>
 #include <proton/transport.h>
 
+#include <algorithm>
 #include <string.h>
+#include <time.h>
 
 using Catch::Matchers::EndsWith;
 using Catch::Matchers::Equals;
@@ -231,6 +235,880 @@ TEST_CASE("driver_message_stream") {
   free(buf2.start);
 }
 
+/* Send messages bigger than the max frame on two links, so transfers are split
+   and the more flag changes part way through a delivery */
+TEST_CASE("driver_message_transfer_frames") {
+  open_handler client;
+  delivery_handler server;
+  pn_test::driver_pair d(client, server);
+  pn_transport_set_max_frame(d.server.transport, 512);
+
+  pn_connection_open(d.client.connection);
+  pn_session_t *ssn = pn_session(d.client.connection);
+  pn_session_open(ssn);
+  pn_link_t *snd[2] = {pn_sender(ssn, "x"), pn_sender(ssn, "y")};
+  pn_link_open(snd[0]);
+  pn_link_open(snd[1]);
+  d.run();
+  for (pn_link_t *l = pn_link_head(d.server.connection, 0); l;
+       l = pn_link_next(l, 0)) {
+    pn_link_flow(l, 1);
+  }
+  d.run();
+
+  char body[2000];
+  for (size_t i = 0; i < sizeof(body); ++i)
+    body[i] = (char)i;
+  // the second tag is too long for a vbin8
+  std::string tags[2] = {"a", std::string(300, 'b')};
+  for (int i = 0; i < 2; ++i) {
+    pn_delivery(snd[i], pn_bytes(tags[i].size(), tags[i].data()));
+    CHECK(ssize_t(sizeof(body)) == pn_link_send(snd[i], body, sizeof(body)));
+    CHECK(pn_link_advance(snd[i]));
+  }
+
+  for (int i = 0; i < 2; ++i) {
+    server.delivery = NULL;
+    while (d.run() == PN_DELIVERY && pn_delivery_partial(server.delivery))
+      ;
+    pn_delivery_t *dlv = server.delivery;
+    REQUIRE(dlv);
+    CHECK_THAT(pn_link_name(snd[i]),
+               Equals(pn_link_name(pn_delivery_link(dlv))));
+    pn_delivery_tag_t tag = pn_delivery_tag(dlv);
+    CHECK(tags[i] == std::string(tag.start, tag.size));
+    char buf[sizeof(body) + 1];
+    CHECK(ssize_t(sizeof(body)) ==
+          pn_link_recv(pn_delivery_link(dlv), buf, sizeof(buf)));
+    CHECK(!memcmp(body, buf, sizeof(body)));
+    pn_delivery_settle(dlv);
+  }
+}
+
+namespace {
+std::string write_buffers_string(pn_connection_driver_t *d) {
+  pn_bytes_t wbs[4];
+  size_t count = pn_connection_driver_write_buffers(d, wbs, 4);
+  std::string s;
+  for (size_t i = 0; i < count; ++i)
+    s.append(wbs[i].start, wbs[i].size);
+  return s;
+}
+} // namespace
+
+/* The gathered write buffers hold the same bytes as the single write buffer,
+   and can be consumed in any mix with it */
+TEST_CASE("driver_write_buffers") {
+  send_client_handler client;
+  delivery_handler server;
+  pn_test::driver_pair d(client, server);
+
+  d.run();
+  pn_link_t *rcv = server.link;
+  pn_link_t *snd = client.link;
+  pn_link_flow(rcv, 1);
+  d.run();
+
+  std::string body(100000, 'x');
+  pn_delivery(snd, pn_bytes("x"));
+  CHECK(ssize_t(body.size()) == pn_link_send(snd, body.data(), body.size()));
+  CHECK(pn_link_advance(snd));
+
+  std::string gathered = write_buffers_string(&d.client);
+  CHECK(gathered.size() > body.size());
+  pn_connection_driver_write_done(&d.client, 10);
+  pn_bytes_t wb = pn_connection_driver_write_buffer(&d.client);
+  REQUIRE(wb.size > 0);
+  CHECK(gathered.substr(10, wb.size) == std::string(wb.start, wb.size));
+  CHECK(gathered.substr(10) == write_buffers_string(&d.client));
+
+  /* Deliver what was consumed above, then the rest */
+  pn_rwbytes_t rb = pn_connection_driver_read_buffer(&d.server);
+  REQUIRE(rb.size >= 10);
+  std::copy(gathered.begin(), gathered.begin() + 10, rb.start);
+  pn_connection_driver_read_done(&d.server, 10);
+  while (d.run() == PN_DELIVERY && pn_delivery_partial(server.delivery))
+    ;
+  pn_delivery_t *dlv = server.delivery;
+  REQUIRE(dlv);
+  std::string received(body.size(), 0);
+  CHECK(ssize_t(body.size()) ==
+        pn_link_recv(pn_delivery_link(dlv), &received[0], received.size()));
+  CHECK(body == received);
+}
+
+/* Read received data in place and consume it in pieces */
+TEST_CASE("driver_recv_buffers") {
+  send_client_handler client;
+  delivery_handler server;
+  pn_test::driver_pair d(client, server);
+
+  d.run();
+  pn_link_t *rcv = server.link;
+  pn_link_t *snd = client.link;
+  pn_link_flow(rcv, 1);
+  d.run();
+
+  pn_bytes_t bufs[2];
+  CHECK(PN_STATE_ERR == pn_link_recv_buffers(rcv, bufs, 2));
+
+  std::string body(1000, 'x');
+  for (size_t i = 0; i < body.size(); ++i)
+    body[i] = (char)i;
+  pn_delivery(snd, pn_bytes("x"));
+  CHECK(600 == pn_link_send(snd, body.data(), 600));
+  d.run();
+  pn_delivery_t *dlv = server.delivery;
+  REQUIRE(dlv);
+  REQUIRE(pn_link_current(rcv) == dlv);
+
+  std::string received;
+  ssize_t n = pn_link_recv_buffers(rcv, bufs, 2);
+  REQUIRE(n > 0);
+  for (ssize_t i = 0; i < n; ++i)
+    received.append(bufs[i].start, bufs[i].size);
+  CHECK(received == body.substr(0, 600));
+  pn_link_recv_done(rcv, 100);
+  CHECK(500 == pn_delivery_pending(dlv));
+  REQUIRE(1 == pn_link_recv_buffers(rcv, bufs, 1));
+  CHECK(std::string(bufs[0].start, bufs[0].size) ==
+        body.substr(100, bufs[0].size));
+  pn_link_recv_done(rcv, 500);
+  CHECK(0 == pn_link_recv_buffers(rcv, bufs, 2));
+
+  CHECK(400 == pn_link_send(snd, body.data() + 600, 400));
+  CHECK(pn_link_advance(snd));
+  d.run();
+  received.clear();
+  n = pn_link_recv_buffers(rcv, bufs, 2);
+  REQUIRE(n > 0);
+  for (ssize_t i = 0; i < n; ++i)
+    received.append(bufs[i].start, bufs[i].size);
+  CHECK(received == body.substr(600));
+  pn_link_recv_done(rcv, received.size());
+  CHECK(!pn_delivery_partial(dlv));
+  CHECK(PN_EOS == pn_link_recv_buffers(rcv, bufs, 2));
+}
+
+/* Stream a delivery bigger than the delivery windows at both ends, the data
+   buffered for it at either end stays bounded */
+TEST_CASE("driver_delivery_window") {
+  send_client_handler client;
+  delivery_handler server;
+  pn_test::driver_pair d(client, server);
+  pn_transport_set_max_frame(d.server.transport, 512);
+
+  d.run();
+  pn_link_t *rcv = server.link;
+  pn_link_t *snd = client.link;
+  pn_link_set_delivery_window(snd, 1000);
+  pn_link_set_delivery_window(rcv, 2000);
+  CHECK(1000 == pn_link_delivery_window(snd));
+  pn_link_flow(rcv, 1);
+  d.run();
+
+  CHECK(0 == pn_link_send_space(snd));
+  std::string body(20000, 0);
+  for (size_t i = 0; i < body.size(); ++i)
+    body[i] = (char)i;
+  pn_delivery(snd, pn_bytes("x"));
+  size_t sent = 0;
+  std::string received;
+  for (int i = 0; received.size() < body.size(); ++i) {
+    REQUIRE(i < 1000);
+    if (sent < body.size()) {
+      size_t space = pn_link_send_space(snd);
+      CHECK(space <= 1000);
+      ssize_t n = pn_link_send(snd, body.data() + sent, body.size() - sent);
+      REQUIRE(n >= 0);
+      CHECK(size_t(n) == std::min(space, body.size() - sent));
+      sent += n;
+      if (sent == body.size())
+        CHECK(pn_link_advance(snd));
+    }
+    d.run();
+    pn_delivery_t *dlv = server.delivery;
+    if (dlv) {
+      size_t pending = pn_delivery_pending(dlv);
+      CHECK(pending <= 2000 + 512);
+      if (i % 10 != 9 && sent < body.size())
+        continue; /* Let data build up for a while */
+      std::string buf(pending, 0);
+      if (pending)
+        CHECK(ssize_t(pending) == pn_link_recv(rcv, &buf[0], pending));
+      received += buf;
+    }
+  }
+  CHECK(body == received);
+  CHECK(!pn_delivery_partial(server.delivery));
+}
+
+/* With no max frame a message goes as one big transfer frame, the receiver
+   must take it in as it arrives and not hold the whole frame */
+TEST_CASE("driver_transfer_frame_streamed") {
+  send_client_handler client;
+  delivery_handler server;
+  pn_test::driver_pair d(client, server);
+  pn_transport_set_max_frame(d.server.transport, 0);
+
+  d.run();
+  pn_link_t *rcv = server.link;
+  pn_link_t *snd = client.link;
+  pn_link_flow(rcv, 1);
+  d.run();
+
+  std::string body(1024 * 1024, 0);
+  for (size_t i = 0; i < body.size(); ++i)
+    body[i] = (char)i;
+  pn_delivery(snd, pn_bytes("x"));
+  CHECK(ssize_t(body.size()) == pn_link_send(snd, body.data(), body.size()));
+  CHECK(pn_link_advance(snd));
+  uint64_t frames = pn_transport_get_frames_input(d.server.transport);
+  int events = 0;
+  do {
+    REQUIRE(++events < 1000);
+    d.run();
+    /* The input buffer never has to grow */
+    CHECK(pn_transport_capacity(d.server.transport) <= 8 * 1024);
+  } while (!server.delivery || pn_delivery_partial(server.delivery));
+  CHECK(events > 1);
+  CHECK(frames + 1 == pn_transport_get_frames_input(d.server.transport));
+  pn_delivery_t *dlv = server.delivery;
+  std::string received(pn_delivery_pending(dlv), 0);
+  CHECK(ssize_t(received.size()) ==
+        pn_link_recv(rcv, &received[0], received.size()));
+  CHECK(body == received);
+}
+
+/* With no max frame the delivery window can't be kept by holding back whole
+   frames, input stops part way through the frame instead */
+TEST_CASE("driver_delivery_window_no_max_frame") {
+  send_client_handler client;
+  delivery_handler server;
+  pn_test::driver_pair d(client, server);
+  pn_transport_set_max_frame(d.server.transport, 0);
+
+  d.run();
+  pn_link_t *rcv = server.link;
+  pn_link_t *snd = client.link;
+  pn_link_set_delivery_window(rcv, 2000);
+  pn_link_flow(rcv, 1);
+  d.run();
+
+  std::string body(100000, 0);
+  for (size_t i = 0; i < body.size(); ++i)
+    body[i] = (char)i;
+  pn_delivery(snd, pn_bytes("x"));
+  CHECK(ssize_t(body.size()) == pn_link_send(snd, body.data(), body.size()));
+  CHECK(pn_link_advance(snd));
+  std::string received;
+  for (int i = 0; received.size() < body.size(); ++i) {
+    REQUIRE(i < 1000);
+    d.run();
+    pn_delivery_t *dlv = server.delivery;
+    if (dlv) {
+      size_t pending = pn_delivery_pending(dlv);
+      /* At most one read of input past the window */
+      CHECK(pending <= 2000 + PN_TRANSPORT_INITIAL_BUFFER_SIZE);
+      if (i % 10 != 9)
+        continue; /* Let data build up for a while */
+      std::string buf(pending, 0);
+      if (pending)
+        CHECK(ssize_t(pending) == pn_link_recv(rcv, &buf[0], pending));
+      received += buf;
+    }
+  }
+  CHECK(body == received);
+  CHECK(!pn_delivery_partial(server.delivery));
+}
+
+/* Release the buffers of an idle transport and carry on using it */
+TEST_CASE("driver_buffer_release") {
+  send_client_handler client;
+  delivery_handler server;
+  pn_test::driver_pair d(client, server);
+  pn_transport_t *t = d.server.transport;
+  pn_transport_set_buffer_release_timeout(t, 1000);
+  CHECK(1000 == pn_transport_get_buffer_release_timeout(t));
+
+  d.run();
+  pn_link_t *rcv = server.link;
+  pn_link_t *snd = client.link;
+  CHECK(2000 == pn_transport_tick(t, 1000));
+  CHECK(2000 == pn_transport_tick(t, 1500));
+  CHECK(0 == pn_transport_tick(t, 2000)); /* Released, nothing more to do */
+  CHECK(0 == pn_transport_tick(t, 3000));
+
+  /* Asking for output when there is none doesn't allocate a buffer again */
+  pn_connection_memory_t released, asked;
+  pn_connection_memory_usage(d.server.connection, &released);
+  CHECK(0 == pn_transport_pending(t));
+  pn_connection_memory_usage(d.server.connection, &asked);
+  CHECK(released.transport_buffers == asked.transport_buffers);
+
+  pn_link_flow(rcv, 1);
+  pn_delivery(snd, pn_bytes("x"));
+  CHECK(3 == pn_link_send(snd, "abc", 3));
+  CHECK(pn_link_advance(snd));
+  d.run();
+  pn_delivery_t *dlv = server.delivery;
+  REQUIRE(dlv);
+  char buf[3];
+  CHECK(3 == pn_link_recv(rcv, buf, sizeof(buf)));
+  CHECK(std::string("abc") == std::string(buf, 3));
+  CHECK(5000 == pn_transport_tick(t, 4000)); /* Active again */
+}
+
+static size_t memory_sum(const pn_connection_memory_t &m) {
+  return m.connection + m.transport + m.transport_buffers + m.codec + m.scratch +
+    m.sessions + m.links + m.deliveries + m.ssl + m.sasl + m.io;
+}
+
+TEST_CASE("driver_memory_usage") {
+  send_client_handler client;
+  delivery_handler server;
+  pn_test::driver_pair d(client, server);
+  pn_transport_set_buffer_release_timeout(d.client.transport, 1000);
+
+  d.run();
+  pn_connection_memory_t m;
+  pn_connection_memory_usage(d.client.connection, &m);
+  CHECK(m.total == memory_sum(m));
+  CHECK(m.connection > sizeof(pn_connection_memory_t));
+  CHECK(m.transport > 0);
+  CHECK(m.transport_buffers > 0);
+  CHECK(m.codec > 0);
+  CHECK(m.scratch > 0);
+  CHECK(m.sessions > 0);
+  CHECK(m.links > 0);
+  CHECK(0 == m.ssl);
+  CHECK(0 == m.io);
+
+  /* An unsettled delivery is counted */
+  pn_link_t *snd = client.link;
+  pn_link_flow(server.link, 1);
+  d.run();
+  pn_delivery(snd, pn_bytes("x"));
+  CHECK(3 == pn_link_send(snd, "abc", 3));
+  CHECK(pn_link_advance(snd));
+  d.run();
+  pn_connection_memory_t m2;
+  pn_connection_memory_usage(d.client.connection, &m2);
+  CHECK(m2.total == memory_sum(m2));
+  CHECK(m2.deliveries > m.deliveries);
+
+  /* Released buffers are not */
+  CHECK(2000 == pn_transport_tick(d.client.transport, 1000));
+  CHECK(0 == pn_transport_tick(d.client.transport, 2000));
+  pn_connection_memory_usage(d.client.connection, &m);
+  CHECK(m.transport_buffers < m2.transport_buffers);
+}
+
+// Not run by default: c-core-test "[benchmark]"
+TEST_CASE("driver_benchmark_memory", "[benchmark][.]") {
+  send_client_handler client;
+  delivery_handler server;
+  pn_test::driver_pair d(client, server);
+  d.run();
+  pn_link_flow(server.link, 1);
+  d.run();
+  pn_delivery(client.link, pn_bytes("x"));
+  pn_link_send(client.link, "abc", 3);
+  pn_link_advance(client.link);
+  d.run();
+
+  pn_connection_memory_t m;
+  pn_connection_memory_usage(d.client.connection, &m);
+  printf("driver_benchmark_memory: one session, one link, one unsettled delivery\n"
+         "  connection %zu\n  transport %zu\n  transport_buffers %zu\n  codec %zu\n"
+         "  scratch %zu\n  sessions %zu\n  links %zu\n  deliveries %zu\n"
+         "  ssl %zu\n  sasl %zu\n  total %zu bytes\n",
+         m.connection, m.transport, m.transport_buffers, m.codec, m.scratch,
+         m.sessions, m.links, m.deliveries, m.ssl, m.sasl, m.total);
+}
+
+// Not run by default: c-core-test "[benchmark]"
+TEST_CASE("driver_benchmark_links", "[benchmark][.]") {
+  const int sessions = 1000;
+  const int links_per_session = 10;
+  const int rounds = 1000;
+  open_handler client, server;
+  pn_test::driver_pair d(client, server);
+  std::vector<pn_session_t *> ssns;
+  std::vector<pn_link_t *> links;
+
+  clock_t start = clock();
+  for (int i = 0; i < sessions; ++i) {
+    pn_session_t *ssn = pn_session(d.client.connection);
+    pn_session_open(ssn);
+    ssns.push_back(ssn);
+    for (int j = 0; j < links_per_session; ++j) {
+      char name[32];
+      snprintf(name, sizeof(name), "link-%d-%d", i, j);
+      pn_link_t *l = pn_receiver(ssn, name);
+      pn_link_open(l);
+      links.push_back(l);
+    }
+  }
+  d.run();
+  double open = double(clock() - start) / CLOCKS_PER_SEC;
+
+  // Credit for one link at a time, with all the others idle
+  start = clock();
+  for (int i = 0; i < rounds; ++i) {
+    pn_link_flow(links[i * links.size() / rounds], 1);
+    d.run();
+  }
+  double one = double(clock() - start) / CLOCKS_PER_SEC;
+
+  // Credit for every link at once
+  start = clock();
+  for (size_t i = 0; i < links.size(); ++i) {
+    pn_link_flow(links[i], 1);
+  }
+  d.run();
+  double all = double(clock() - start) / CLOCKS_PER_SEC;
+
+  // End every session
+  start = clock();
+  for (size_t i = 0; i < ssns.size(); ++i) {
+    pn_session_close(ssns[i]);
+  }
+  d.run();
+  double end = double(clock() - start) / CLOCKS_PER_SEC;
+
+  printf("driver_benchmark_links: %d links in %d sessions, open %.1f ms, "
+         "flow one link %.1f us, flow all links %.1f ms, end all sessions %.1f ms\n",
+         (int) links.size(), sessions, open * 1e3, one * 1e6 / rounds, all * 1e3, end * 1e3);
+}
+
+// Local handles and channels given back are handed out again, the most
+// recently given back first
+TEST_CASE("driver_alias_reuse") {
+  open_close_handler client, server;
+  pn_test::driver_pair d(client, server);
+  pn_session_t *ssn = pn_session(d.client.connection);
+  pn_session_open(ssn);
+  pn_link_t *links[3];
+  for (int i = 0; i < 3; ++i) {
+    links[i] = pn_sender(ssn, std::string(1, 'a' + i).c_str());
+    pn_link_open(links[i]);
+  }
+  d.run();
+  for (int i = 0; i < 3; ++i) CHECK(i == (int) links[i]->state.local_handle);
+
+  pn_link_close(links[1]);
+  d.run();
+  pn_link_t *l = pn_sender(ssn, "d");
+  pn_link_open(l);
+  d.run();
+  CHECK(1 == l->state.local_handle);
+  CHECK((pn_link_state(l) & PN_REMOTE_ACTIVE));
+
+  pn_link_close(links[0]);
+  pn_link_close(links[2]);
+  d.run();
+  pn_link_t *l2 = pn_sender(ssn, "e");
+  pn_link_open(l2);
+  pn_link_t *l3 = pn_sender(ssn, "f");
+  pn_link_open(l3);
+  pn_link_t *l4 = pn_sender(ssn, "g");
+  pn_link_open(l4);
+  d.run();
+  CHECK(2 == l2->state.local_handle);
+  CHECK(0 == l3->state.local_handle);
+  CHECK(3 == l4->state.local_handle);
+  CHECK((pn_link_state(l3) & PN_REMOTE_ACTIVE));
+
+  pn_session_t *ssn2 = pn_session(d.client.connection);
+  pn_session_open(ssn2);
+  d.run();
+  CHECK(1 == ssn2->state.local_channel);
+  pn_session_close(ssn);
+  d.run();
+  pn_session_t *ssn3 = pn_session(d.client.connection);
+  pn_session_open(ssn3);
+  d.run();
+  CHECK(0 == ssn3->state.local_channel);
+  CHECK((pn_session_state(ssn3) & PN_REMOTE_ACTIVE));
+}
+
+namespace {
+pn_link_t *link_named(pn_connection_t *c, const char *name) {
+  for (pn_link_t *l = pn_link_head(c, 0); l; l = pn_link_next(l, 0)) {
+    if (!strcmp(pn_link_name(l), name)) return l;
+  }
+  return NULL;
+}
+} // namespace
+
+// A peer's channels and handles need not be contiguous, and big ones are
+// kept out of the tables
+TEST_CASE("driver_alias_sparse") {
+  open_close_handler client, server;
+  pn_test::driver_pair d(client, server);
+  pn_session_t *ssn = pn_session(d.client.connection);
+  pn_session_open(ssn);
+  d.run();
+  // Have the client hand out a big channel and spread out handles
+  d.client.transport->local_channels.next = 1000;
+  pn_session_t *ssn2 = pn_session(d.client.connection);
+  pn_session_open(ssn2);
+  const char *names[] = {"a", "b", "c"};
+  const uint32_t handles[] = {0, 40, 60000};
+  for (int i = 0; i < 3; ++i) {
+    ssn2->state.local_handles.next = handles[i];
+    pn_link_open(pn_sender(ssn2, names[i]));
+    d.run();
+  }
+  CHECK(1000 == ssn2->state.local_channel);
+  pn_session_t *remote_ssn2 = pn_session_head(d.server.connection, PN_REMOTE_ACTIVE);
+  while (remote_ssn2 && remote_ssn2->state.remote_channel != 1000) {
+    remote_ssn2 = pn_session_next(remote_ssn2, PN_REMOTE_ACTIVE);
+  }
+  REQUIRE(remote_ssn2);
+
+  pni_alias_map_t *channels = &d.server.transport->remote_channels;
+  CHECK(channels->capacity < 1000);
+  CHECK(1 == pn_hash_size(channels->sparse));
+  pni_alias_map_t *remote = &remote_ssn2->state.remote_handles;
+  CHECK(remote->capacity < 40);
+  CHECK(2 == pn_hash_size(remote->sparse));
+  CHECK(ssn2->state.local_handles.capacity < 40);
+
+  // Deliveries reach the link with the peer's handle
+  for (int i = 0; i < 3; ++i) {
+    pn_link_t *rcv = link_named(d.server.connection, names[i]);
+    REQUIRE(rcv);
+    CHECK(handles[i] == rcv->state.remote_handle);
+    pn_link_flow(rcv, 1);
+  }
+  d.run();
+  for (int i = 0; i < 3; ++i) {
+    pn_link_t *snd = link_named(d.client.connection, names[i]);
+    pn_delivery(snd, pn_dtag(names[i], 1));
+    pn_link_send(snd, names[i], 1);
+    pn_link_advance(snd);
+  }
+  d.run();
+  for (int i = 0; i < 3; ++i) {
+    pn_delivery_t *dlv = pn_link_current(link_named(d.server.connection, names[i]));
+    REQUIRE(dlv);
+    CHECK(std::string(names[i]) == std::string(pn_delivery_tag(dlv).start, 1));
+  }
+
+  // Detaching takes the peer's handle out of the hash
+  pn_link_close(link_named(d.client.connection, "b"));
+  d.run();
+  CHECK(1 == pn_hash_size(remote->sparse));
+  CHECK(NULL == pni_alias_map_get(remote, 40));
+  CHECK(pni_alias_map_get(remote, 60000) == link_named(d.server.connection, "c"));
+
+  // Ending the session takes the peer's channel out of the hash
+  pn_session_close(ssn2);
+  d.run();
+  CHECK(0 == pn_hash_size(channels->sparse));
+  CHECK((pn_session_state(ssn) & PN_REMOTE_ACTIVE));
+}
+
+// Not run by default: c-core-test "[benchmark]"
+TEST_CASE("driver_benchmark_link_churn", "[benchmark][.]") {
+  const int open_links = 10000;
+  const int rounds = 10000;
+  open_close_handler client, server;
+  pn_test::driver_pair d(client, server);
+  pn_session_t *ssn = pn_session(d.client.connection);
+  pn_session_open(ssn);
+  for (int i = 0; i < open_links; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "open-%d", i);
+    pn_link_open(pn_sender(ssn, name));
+  }
+  d.run();
+
+  // Attach and detach a link at a time next to all the open ones
+  clock_t start = clock();
+  for (int i = 0; i < rounds; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "churn-%d", i);
+    pn_link_t *l = pn_sender(ssn, name);
+    pn_link_open(l);
+    d.run();
+    REQUIRE((pn_link_state(l) & PN_REMOTE_ACTIVE));
+    pn_link_close(l);
+    d.run();
+    pn_link_free(l);
+  }
+  double churn = double(clock() - start) / CLOCKS_PER_SEC;
+
+  printf("driver_benchmark_link_churn: %d links open, attach and detach %.1f us\n",
+         open_links, churn * 1e6 / rounds);
+}
+
+// All the output of a driver
+static std::string take_output(pn_connection_driver_t &d) {
+  std::string out;
+  pn_bytes_t wb;
+  while ((wb = pn_connection_driver_write_buffer(&d)).size) {
+    out.append(wb.start, wb.size);
+    pn_connection_driver_write_done(&d, wb.size);
+  }
+  return out;
+}
+
+// Seconds taken by a driver to read bytes and handle the events they cause
+static double time_input(pn_test::driver &d, const std::string &bytes) {
+  clock_t start = clock();
+  for (size_t done = 0; done < bytes.size();) {
+    pn_rwbytes_t rb = pn_connection_driver_read_buffer(&d);
+    size_t n = std::min(rb.size, bytes.size() - done);
+    memcpy(rb.start, bytes.data() + done, n);
+    pn_connection_driver_read_done(&d, n);
+    d.run();
+    done += n;
+  }
+  return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+// Not run by default: c-core-test "[benchmark]"
+TEST_CASE("driver_benchmark_dispositions", "[benchmark][.]") {
+  const int count = 100000;
+  send_client_handler client;
+  open_handler server;
+  pn_test::driver_pair d(client, server);
+  d.run();
+  pn_link_t *snd = client.link;
+  pn_link_t *rcv = server.link;
+  pn_link_flow(rcv, count);
+  d.run();
+  for (int i = 0; i < count; ++i) {
+    pn_delivery(snd, pn_dtag((const char *) &i, sizeof(i)));
+    pn_link_send(snd, "x", 1);
+    pn_link_advance(snd);
+  }
+  d.run();
+  std::vector<pn_delivery_t *> dlvs;
+  for (pn_delivery_t *dlv = pn_unsettled_head(rcv); dlv; dlv = pn_unsettled_next(dlv)) {
+    dlvs.push_back(dlv);
+  }
+  REQUIRE(count == (int) dlvs.size());
+  REQUIRE(count == (int) pn_link_unsettled(snd));
+  pn_connection_memory_t m;
+  pn_connection_memory_usage(d.client.connection, &m);
+
+  // The first half settled in order, sent as one range
+  for (int i = 0; i < count / 2; ++i) {
+    pn_delivery_update(dlvs[i], PN_ACCEPTED);
+    pn_delivery_settle(dlvs[i]);
+  }
+  double ranges = time_input(d.client, take_output(d.server));
+
+  // The rest settled every other one, sent singly
+  for (int j = 0; j < 2; ++j) {
+    for (int i = count / 2 + j; i < count; i += 2) {
+      pn_delivery_update(dlvs[i], PN_ACCEPTED);
+      pn_delivery_settle(dlvs[i]);
+    }
+  }
+  double singles = time_input(d.client, take_output(d.server));
+
+  int settled = 0;
+  for (pn_delivery_t *dlv = pn_unsettled_head(snd); dlv; dlv = pn_unsettled_next(dlv)) {
+    if (pn_delivery_settled(dlv) && pn_delivery_remote_state(dlv) == PN_ACCEPTED) ++settled;
+  }
+  CHECK(count == settled);
+
+  printf("driver_benchmark_dispositions: %d unsettled deliveries, sender session %zu bytes, "
+         "handles range dispositions in %.3f us per delivery, single ones in %.3f us per delivery\n",
+         count, m.sessions, ranges * 1e6 / (count / 2), singles * 1e6 / (count / 2));
+}
+
+namespace {
+// Open a sender and receiver, send count deliveries and return the receiver's
+std::vector<pn_delivery_t *> send_unsettled(pn_test::driver_pair &d, pn_link_t *snd,
+                                            pn_link_t *rcv, int count) {
+  pn_link_flow(rcv, count);
+  d.run();
+  for (int i = 0; i < count; ++i) {
+    pn_delivery(snd, pn_dtag((const char *) &i, sizeof(i)));
+    pn_link_send(snd, "x", 1);
+    pn_link_advance(snd);
+  }
+  d.run();
+  std::vector<pn_delivery_t *> dlvs;
+  for (pn_delivery_t *dlv = pn_unsettled_head(rcv); dlv; dlv = pn_unsettled_next(dlv)) {
+    dlvs.push_back(dlv);
+  }
+  return dlvs;
+}
+
+void accept_settle(pn_delivery_t *dlv) {
+  pn_delivery_update(dlv, PN_ACCEPTED);
+  pn_delivery_settle(dlv);
+}
+
+// The tags, as sent by send_unsettled(), of the sender's remotely settled deliveries
+std::vector<int> remote_settled(pn_link_t *snd) {
+  std::vector<int> tags;
+  for (pn_delivery_t *dlv = pn_unsettled_head(snd); dlv; dlv = pn_unsettled_next(dlv)) {
+    if (pn_delivery_settled(dlv) && pn_delivery_remote_state(dlv) == PN_ACCEPTED) {
+      int tag;
+      memcpy(&tag, pn_delivery_tag(dlv).start, sizeof(tag));
+      tags.push_back(tag);
+    }
+  }
+  std::sort(tags.begin(), tags.end());
+  return tags;
+}
+
+// Settle all the sender's deliveries
+void settle_all(pn_link_t *snd) {
+  std::vector<pn_delivery_t *> dlvs;
+  for (pn_delivery_t *dlv = pn_unsettled_head(snd); dlv; dlv = pn_unsettled_next(dlv)) {
+    dlvs.push_back(dlv);
+  }
+  for (size_t i = 0; i < dlvs.size(); ++i) pn_delivery_settle(dlvs[i]);
+}
+
+std::vector<int> range(int first, int end, int step = 1) {
+  std::vector<int> v;
+  for (int i = first; i < end; i += step) v.push_back(i);
+  return v;
+}
+} // namespace
+
+// Dispositions for deliveries settled with gaps between them
+TEST_CASE("driver_dispositions_gaps") {
+  send_client_handler client;
+  open_handler server;
+  pn_test::driver_pair d(client, server);
+  d.run();
+  std::vector<pn_delivery_t *> dlvs = send_unsettled(d, client.link, server.link, 40);
+  REQUIRE(40 == dlvs.size());
+
+  for (int i = 0; i < 40; i += 2) accept_settle(dlvs[i]);
+  d.run();
+  CHECK_THAT(range(0, 40, 2), Equals(remote_settled(client.link)));
+
+  for (int i = 1; i < 40; i += 2) accept_settle(dlvs[i]);
+  d.run();
+  CHECK_THAT(range(0, 40), Equals(remote_settled(client.link)));
+}
+
+// Dispositions for deliveries settled newest first
+TEST_CASE("driver_dispositions_out_of_order") {
+  send_client_handler client;
+  open_handler server;
+  pn_test::driver_pair d(client, server);
+  d.run();
+  std::vector<pn_delivery_t *> dlvs = send_unsettled(d, client.link, server.link, 40);
+  REQUIRE(40 == dlvs.size());
+
+  for (int i = 39; i >= 20; --i) accept_settle(dlvs[i]);
+  d.run();
+  CHECK_THAT(range(20, 40), Equals(remote_settled(client.link)));
+
+  accept_settle(dlvs[0]);
+  d.run();
+  std::vector<int> expect = range(20, 40);
+  expect.insert(expect.begin(), 0);
+  CHECK_THAT(expect, Equals(remote_settled(client.link)));
+
+  for (int i = 19; i >= 1; --i) accept_settle(dlvs[i]);
+  d.run();
+  CHECK_THAT(range(0, 40), Equals(remote_settled(client.link)));
+}
+
+// Delivery ids that wrap around past 2^32 - 1
+TEST_CASE("driver_dispositions_wraparound") {
+  send_client_handler client;
+  open_handler server;
+  pn_test::driver_pair d(client, server);
+  d.run();
+  pn_delivery_map_t *outgoing = &pn_link_session(client.link)->state.outgoing;
+  REQUIRE(0 == outgoing->size);
+  outgoing->first = outgoing->next = 0xFFFFFFF0;
+  std::vector<pn_delivery_t *> dlvs = send_unsettled(d, client.link, server.link, 32);
+  REQUIRE(32 == dlvs.size());
+  pn_delivery_map_t *incoming = &pn_link_session(server.link)->state.incoming;
+  CHECK(0xFFFFFFF0 == incoming->first);
+  CHECK(0x10 == incoming->next);
+
+  // A range either side of the wrap
+  for (int i = 8; i < 24; ++i) accept_settle(dlvs[i]);
+  d.run();
+  CHECK_THAT(range(8, 24), Equals(remote_settled(client.link)));
+
+  for (int i = 31; i >= 24; i -= 2) accept_settle(dlvs[i]);
+  for (int i = 0; i < 8; i += 2) accept_settle(dlvs[i]);
+  d.run();
+  std::vector<int> expect = range(0, 8, 2);
+  std::vector<int> mid = range(8, 24), odd = range(25, 32, 2);
+  expect.insert(expect.end(), mid.begin(), mid.end());
+  expect.insert(expect.end(), odd.begin(), odd.end());
+  CHECK_THAT(expect, Equals(remote_settled(client.link)));
+
+  for (int i = 1; i < 8; i += 2) accept_settle(dlvs[i]);
+  for (int i = 24; i < 32; i += 2) accept_settle(dlvs[i]);
+  d.run();
+  CHECK_THAT(range(0, 32), Equals(remote_settled(client.link)));
+  CHECK(0 == incoming->size);
+  settle_all(client.link);
+  d.run();
+  CHECK(0 == outgoing->size);
+}
+
+// A delivery left unsettled while many more are sent and settled after it
+// does not make the delivery maps grow without bound
+TEST_CASE("driver_dispositions_unsettled_oldest") {
+  send_client_handler client;
+  open_handler server;
+  pn_test::driver_pair d(client, server);
+  d.run();
+  pn_link_t *snd = client.link;
+  pn_link_t *rcv = server.link;
+  pn_delivery_map_t *outgoing = &pn_link_session(snd)->state.outgoing;
+  pn_delivery_map_t *incoming = &pn_link_session(rcv)->state.incoming;
+  const int batch = PNI_DELIVERY_MAP_MAX_CAPACITY / 2;
+  std::vector<pn_delivery_t *> dlvs = send_unsettled(d, snd, rcv, batch);
+  REQUIRE(batch == (int) dlvs.size());
+  pn_delivery_t *oldest = dlvs[0];
+  pn_delivery_t *oldest_sent = pn_unsettled_head(snd);
+
+  for (int j = 0; j < 8; ++j) {
+    for (size_t i = (j == 0); i < dlvs.size(); ++i) accept_settle(dlvs[i]);
+    d.run();
+    int accepted = 0;
+    for (pn_delivery_t *dlv = pn_unsettled_next(oldest_sent); dlv;) {
+      pn_delivery_t *next = pn_unsettled_next(dlv);
+      if (pn_delivery_remote_state(dlv) == PN_ACCEPTED) ++accepted;
+      pn_delivery_settle(dlv);
+      dlv = next;
+    }
+    CHECK((j ? batch : batch - 1) == accepted);
+    d.run();
+    dlvs = send_unsettled(d, snd, rcv, batch);
+    dlvs.erase(std::remove(dlvs.begin(), dlvs.end(), oldest), dlvs.end());
+    REQUIRE(batch == (int) dlvs.size());
+  }
+  CHECK(outgoing->capacity <= PNI_DELIVERY_MAP_MAX_CAPACITY);
+  CHECK(incoming->capacity <= PNI_DELIVERY_MAP_MAX_CAPACITY);
+  CHECK(1 == pn_hash_size(outgoing->spilled));
+  CHECK(1 == pn_hash_size(incoming->spilled));
+
+  // The oldest is still found, by a disposition spanning it and newer ones
+  for (size_t i = 0; i < dlvs.size(); ++i) accept_settle(dlvs[i]);
+  accept_settle(oldest);
+  d.run();
+  CHECK(pn_delivery_remote_state(oldest_sent) == PN_ACCEPTED);
+  CHECK(pn_delivery_settled(oldest_sent));
+  CHECK(0 == pn_hash_size(incoming->spilled));
+  settle_all(snd);
+  d.run();
+  CHECK(0 == outgoing->size);
+  CHECK(0 == pn_hash_size(outgoing->spilled));
+}
+
 // Test aborting a delivery
 TEST_CASE("driver_message_abort") {
   send_client_handler client;
@@ -443,12 +1321,14 @@ TEST_CASE("driver_session_flow_control") {
     CHECK_THAT("foo", Equals(pn_message_get_address(m)));
   }
 
-  /* Capacity smaller than frame size is an error */
+  /* Capacity smaller than frame size is taken as one frame */
   set_capacity_and_max_frame(1234, 12345, d, "foo");
-  CHECK_THAT(
-      *client.last_condition,
-      cond_matches("amqp:internal-error",
-                   "session capacity 1234 is less than frame size 12345"));
+  CHECK(!pn_transport_closed(d.client.transport));
+  dlv = server.delivery;
+  CHECKED_IF(dlv) {
+    message_decode(m, dlv, &buf);
+    CHECK_THAT("foo", Equals(pn_message_get_address(m)));
+  }
   free(buf.start);
 }
 
@@ -484,6 +1364,50 @@ TEST_CASE("driver_duplicate_link_server") {
    * transport_unbind with the bug */
 }
 
+/* An attach finds the link of its name and kind that is still usable, among
+   enough links in the session to grow the name index */
+TEST_CASE("driver_link_attach_by_name") {
+  open_close_handler client, server;
+  pn_test::driver_pair d(client, server);
+
+  pn_session_t *ssn = pn_session(d.client.connection);
+  pn_session_open(ssn);
+  for (int i = 0; i < 100; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "link-%d", i);
+    pn_link_open(pn_sender(ssn, name));
+  }
+  d.run();
+
+  /* A link made locally is used by the attach of its name */
+  pn_link_t *pre = pn_receiver(server.session, "pre");
+  pn_link_open(pn_sender(ssn, "pre"));
+  d.run();
+  CHECK(pre == server.link);
+
+  /* A remotely closed link is not reused */
+  pn_link_t *x = pn_sender(ssn, "x");
+  pn_link_open(x);
+  d.run();
+  pn_link_t *old = server.link;
+  pn_link_close(x);
+  d.run();
+  CHECK((pn_link_state(old) & PN_REMOTE_CLOSED));
+  pn_link_open(pn_sender(ssn, "x"));
+  d.run();
+  CHECK(old != server.link);
+  CHECK(pn_link_is_receiver(server.link));
+
+  /* Nor is a link of the other kind */
+  pn_link_t *rx = server.link;
+  pn_link_open(pn_receiver(ssn, "x"));
+  d.run();
+  CHECK(rx != server.link);
+  CHECK(pn_link_is_sender(server.link));
+  CHECK_THAT("x", Equals(pn_link_name(server.link)));
+  CHECK_THAT(*pn_transport_condition(d.server.transport), cond_empty());
+}
+
 /* Reproducer test for https://issues.apache.org/jira/browse/PROTON-1832.
    Make sure the client does not generate an illegal "attach; attach; detach"
    sequence from a legal "pn_link_open(); pn_link_close(); pn_link_open()"
@@ -22,12 +22,22 @@
 #include "./pn_test.hpp"
 
 #include "core/data.h"
+#include "core/symbols.h"
+#include "performatives.h"
 
 #include <proton/codec.h>
 #include <proton/error.h>
 
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
 using namespace pn_test;
 
+#ifndef PNI_DATA_NID32
 // Make sure we can grow the capacity of a pn_data_t all the way to the max and
 // we stop there.
 TEST_CASE("data_grow") {
@@ -43,6 +53,42 @@ TEST_CASE("data_grow") {
   CHECK(code == PN_OUT_OF_MEMORY);
   CHECK(pn_data_size(data) == PNI_NID_MAX);
 }
+#endif
+
+static void fill_body(pn_data_t *data, size_t entries);
+
+// Bodies with more values than 16 bit node ids allow must decode with 32 bit
+// ids and fail cleanly otherwise.
+TEST_CASE("data_large") {
+  // Too big to build without large ids, so encode it by hand: a list of
+  // 70000 smalluint elements.
+  const uint32_t count = 70000;
+  std::vector<char> buf(9 + 2*count);
+  buf[0] = (char) 0xd0;
+  uint32_t size = 4 + 2*count;
+  for (int i = 0; i < 4; ++i) {
+    buf[1+i] = (char) (size >> (24 - 8*i));
+    buf[5+i] = (char) (count >> (24 - 8*i));
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    buf[9 + 2*i] = (char) 0x52;
+    buf[10 + 2*i] = (char) i;
+  }
+  auto_free<pn_data_t, pn_data_free> data(pn_data(0));
+  ssize_t n = pn_data_decode(data, &buf[0], buf.size());
+  if (PNI_NID_MAX > count) {
+    CHECK(n == (ssize_t) buf.size());
+    CHECK(pn_data_size(data) == count + 1);
+    pn_data_rewind(data);
+    REQUIRE(pn_data_next(data));
+    CHECK(pn_data_get_list(data) == count);
+    std::vector<char> out(buf.size());
+    CHECK(pn_data_encode(data, &out[0], out.size()) == (ssize_t) buf.size());
+    CHECK(out == buf);
+  } else {
+    CHECK(n == PN_OUT_OF_MEMORY);
+  }
+}
 
 TEST_CASE("data_multiple") {
   auto_free<pn_data_t, pn_data_free> data(pn_data(1));
@@ -105,3 +151,519 @@ TEST_CASE("data_multiple") {
   pn_data_fill(data, "{S[iii]SI}", "foo", 1, 987, 3, "bar", 965);
   CHECK("{\"foo\"=[1, 987, 3], \"bar\"=965}" == inspect(data));
 }
+
+static std::string encode_filled(const char *fmt, ...) {
+  auto_free<pn_data_t, pn_data_free> data(pn_data(0));
+  va_list ap;
+  va_start(ap, fmt);
+  pn_data_vfill(data, fmt, ap);
+  va_end(ap);
+  char buf[1024];
+  ssize_t size = pn_data_encode(data, buf, sizeof(buf));
+  REQUIRE(size > 0);
+  return std::string(buf, size);
+}
+
+static std::string str(pn_bytes_t b) { return std::string(b.start, b.size); }
+
+// The generated performative encoders must produce exactly the same bytes as
+// filling and encoding a pn_data_t.
+TEST_CASE("data_performative_encoders") {
+  pn_rwbytes_t buf = pn_rwbytes(0, NULL); // Start empty to exercise growth
+  auto_free<pn_data_t, pn_data_free> props(pn_data(0));
+  pn_data_fill(props.get(), "{sI}", "foo", 12);
+  auto_free<pn_data_t, pn_data_free> caps(pn_data(0));
+  pn_data_put_array(caps, false, PN_SYMBOL);
+  pn_data_enter(caps);
+  pn_data_put_symbol(caps, pn_bytes("one"));
+
+  CHECK(encode_filled("DL[SS?I?H?InnMMC]", OPEN, "c1", "host", true, 1024, false, 0, true, 0, NULL, caps.get(), props.get()) ==
+        str(pn_amqp_encode_open(&buf, "c1", "host", true, 1024, false, 0, true, 0, NULL, caps.get(), props.get())));
+  CHECK(encode_filled("DL[S]", OPEN, "") ==
+        str(pn_amqp_encode_open(&buf, "", NULL, false, 0, false, 0, false, 0, NULL, NULL, NULL)));
+  CHECK(encode_filled("DL[?HIII]", BEGIN, false, 0, 1, 300, 2147483647) ==
+        str(pn_amqp_encode_begin(&buf, false, 0, 1, 300, 2147483647)));
+  CHECK(encode_filled("DL[?IIII?I?I?In?o]", FLOW, true, 7, 10, 0, 70000, true, 1, true, 5, true, 10, true, true) ==
+        str(pn_amqp_encode_flow(&buf, true, 7, 10, 0, 70000, true, 1, true, 5, true, 10, true, true)));
+  CHECK(encode_filled("DL[IIzI?o?on?DLC?o?o?o]", TRANSFER, 0, 1, (size_t) 3, "tag", 0, true, false, false, true, false, 0, NULL, false, false, false, false, false, false) ==
+        str(pn_amqp_encode_transfer(&buf, 0, 1, pn_bytes(3, "tag"), 0, true, false, false, true, false, 0, NULL, false, false, false, false, false, false)));
+  CHECK(encode_filled("DL[oI?I?o?DL[]]", DISPOSITION, true, 4, true, 9, true, true, true, ACCEPTED) ==
+        str(pn_amqp_encode_disposition_range(&buf, true, 4, true, 9, true, true, true, ACCEPTED)));
+  CHECK(encode_filled("DL[I?o?DL[sSC]]", DETACH, 3, true, true, true, ERROR, "amqp:internal-error", "oops", props.get()) ==
+        str(pn_amqp_encode_detach(&buf, 3, true, true, true, ERROR, "amqp:internal-error", "oops", props.get())));
+  CHECK(encode_filled("DL[?DL[sSC]]", CLOSE, false, ERROR, NULL, NULL, NULL) ==
+        str(pn_amqp_encode_close(&buf, false, ERROR, NULL, NULL, NULL)));
+
+  char *mechs[] = {(char *) "PLAIN", (char *) "ANONYMOUS"};
+  CHECK(encode_filled("DL[@T[*s]]", SASL_MECHANISMS, PN_SYMBOL, 2, mechs) ==
+        str(pn_amqp_encode_sasl_mechanisms(&buf, 2, mechs)));
+  CHECK(encode_filled("DL[szS]", SASL_INIT, "PLAIN", (size_t) 0, NULL, "host") ==
+        str(pn_amqp_encode_sasl_init(&buf, "PLAIN", pn_bytes_null, "host")));
+  free(buf.start);
+}
+
+// The generated performative decoders must read back what the encoders wrote
+TEST_CASE("data_performative_decoders") {
+  pn_rwbytes_t buf = pn_rwbytes(0, NULL);
+  auto_free<pn_data_t, pn_data_free> state(pn_data(0));
+  pn_data_fill(state, "[I]", 42);
+
+  pn_bytes_t transfer = pn_amqp_encode_transfer(&buf, 7, 3, pn_bytes(3, "tag"), 0, true, true, true, true,
+                                                true, RECEIVED, state.get(), false, false, true, true, false, false);
+  uint32_t handle, id;
+  pn_bytes_t tag;
+  bool id_present = false, settled_set = false, settled = false, more = false, has_state = false;
+  bool resume = false, aborted = false, batchable = false;
+  uint64_t code;
+  auto_free<pn_data_t, pn_data_free> decoded(pn_data(0));
+  REQUIRE(0 == pn_amqp_decode_transfer(transfer, &handle, &id_present, &id, &tag, &settled_set, &settled, &more,
+                                       &has_state, &code, decoded.get(), &resume, &aborted, &batchable));
+  CHECK(handle == 7);
+  CHECK(id_present);
+  CHECK(id == 3);
+  CHECK("tag" == str(tag));
+  CHECK(settled_set);
+  CHECK(settled);
+  CHECK(more);
+  CHECK(has_state);
+  CHECK(code == RECEIVED);
+  CHECK("[42]" == inspect(decoded));
+  CHECK(!resume);
+  CHECK(aborted);
+  CHECK(!batchable);
+
+  // Trailing fields are elided by the encoder and must read as absent
+  pn_bytes_t flow = pn_amqp_encode_flow(&buf, false, 0, 10, 1, 20, false, 0, false, 0, false, 0, false, false);
+  bool inext_init = false, handle_init = false, dcount_init = false, drain = false;
+  uint32_t inext, iwin, onext, owin, dcount, credit;
+  REQUIRE(0 == pn_amqp_decode_flow(flow, &inext_init, &inext, &iwin, &onext, &owin, &handle_init, &handle,
+                                   &dcount_init, &dcount, &credit, &drain));
+  CHECK(!inext_init);
+  CHECK(iwin == 10);
+  CHECK(onext == 1);
+  CHECK(owin == 20);
+  CHECK(!handle_init);
+  CHECK(handle == 0);
+  CHECK(!dcount_init);
+  CHECK(credit == 0);
+  CHECK(!drain);
+
+  pn_data_clear(decoded);
+  pn_bytes_t disposition = pn_amqp_encode_disposition_range(&buf, true, 4, true, 9, false, false, true, ACCEPTED);
+  bool role = false, last_init = false;
+  uint32_t first, last;
+  REQUIRE(0 == pn_amqp_decode_disposition(disposition, &role, &first, &last_init, &last, &settled,
+                                          &has_state, &code, decoded.get()));
+  CHECK(role);
+  CHECK(first == 4);
+  CHECK(last_init);
+  CHECK(last == 9);
+  CHECK(!settled);
+  CHECK(has_state);
+  CHECK(code == ACCEPTED);
+  CHECK("[]" == inspect(decoded));
+  free(buf.start);
+}
+
+// Peers may send descriptors as symbols rather than codes
+TEST_CASE("data_symbolic_descriptors") {
+  auto_free<pn_data_t, pn_data_free> data(pn_data(0));
+  pn_data_fill(data, "Ds[oI?I?oDs[]]", "amqp:disposition:list", true, 4, false, 0, true, true, "amqp:accepted:list");
+  char buf[128];
+  ssize_t size = pn_data_encode(data, buf, sizeof(buf));
+  REQUIRE(size > 0);
+
+  pni_consumer_t consumer = pni_consumer(pn_bytes(size, buf));
+  bool described;
+  uint64_t code;
+  REQUIRE(pni_consume_descriptor(&consumer, &described, &code));
+  CHECK(described);
+  CHECK(DISPOSITION == code);
+  CHECK((size_t) size == consumer.position);
+
+  bool role = false, last_init = true, settled = false, has_state = false;
+  uint32_t first, last;
+  auto_free<pn_data_t, pn_data_free> state(pn_data(0));
+  REQUIRE(0 == pn_amqp_decode_disposition(pn_bytes(size, buf), &role, &first, &last_init, &last, &settled,
+                                          &has_state, &code, state.get()));
+  CHECK(role);
+  CHECK(first == 4);
+  CHECK(!last_init);
+  CHECK(settled);
+  CHECK(has_state);
+  CHECK(ACCEPTED == code);
+
+  // Symbols that aren't descriptors are skipped
+  pn_data_clear(data);
+  pn_data_fill(data, "Ds[]", "x-opt-unknown:list");
+  size = pn_data_encode(data, buf, sizeof(buf));
+  consumer = pni_consumer(pn_bytes(size, buf));
+  REQUIRE(pni_consume_descriptor(&consumer, &described, &code));
+  CHECK(!described);
+  CHECK((size_t) size == consumer.position);
+}
+
+TEST_CASE("data_decode_borrowed") {
+  auto_free<pn_data_t, pn_data_free> src(pn_data(0));
+  pn_data_fill(src, "[zSs]", (size_t) 3, "bin", "string", "symbol");
+  char buf[64];
+  ssize_t size = pn_data_encode(src, buf, sizeof(buf));
+  REQUIRE(size > 0);
+
+  auto_free<pn_data_t, pn_data_free> data(pn_data(0));
+  REQUIRE(size == pn_data_decode_borrowed(data, buf, size));
+  CHECK("[b\"bin\", \"string\", :symbol]" == inspect(data));
+  pn_bytes_t string;
+  REQUIRE(0 == pn_data_scan(data, "[.S]", &string));
+  // Refers to the input rather than a copy of it
+  CHECK(string.start >= buf);
+  CHECK(string.start < buf + size);
+
+  // Values no longer refer to the input once materialized
+  REQUIRE(0 == pn_data_materialize(data));
+  memset(buf, 0, sizeof(buf));
+  CHECK("[b\"bin\", \"string\", :symbol]" == inspect(data));
+  REQUIRE(0 == pn_data_scan(data, "[.S]", &string));
+  CHECK((string.start < buf || string.start >= buf + sizeof(buf)));
+}
+
+TEST_CASE("data_interned_symbols") {
+  for (int i = 1; i < PNI_SYM_COUNT; ++i) {
+    pni_symbol_t sym = (pni_symbol_t) i;
+    pn_bytes_t bytes = pni_symbol_bytes(sym);
+    INFO(std::string(bytes.start, bytes.size));
+    CHECK(sym == pni_symbol_lookup(pn_bytes(std::string(bytes.start, bytes.size))));
+  }
+  CHECK(ACCEPTED == pni_symbol_descriptor(pni_symbol_lookup(pn_bytes("amqp:accepted:list"))));
+  CHECK(0 == pni_symbol_descriptor(PNI_SYM_SHARED));
+  CHECK(PNI_SYM_NONE == pni_symbol_lookup(pn_bytes("not-interned")));
+  CHECK(PNI_SYM_NONE == pni_symbol_lookup(pn_bytes("share")));
+
+  // Decoded symbols refer to the interned ones, others are copied as usual
+  auto_free<pn_data_t, pn_data_free> src(pn_data(0));
+  pn_data_fill(src, "[ss]", "shared", "not-interned");
+  char buf[64];
+  ssize_t size = pn_data_encode(src, buf, sizeof(buf));
+  REQUIRE(size > 0);
+  for (bool borrow : {false, true}) {
+    auto_free<pn_data_t, pn_data_free> data(pn_data(0));
+    REQUIRE(size == (borrow ? pn_data_decode_borrowed(data, buf, size) : pn_data_decode(data, buf, size)));
+    pn_bytes_t shared, other;
+    REQUIRE(0 == pn_data_scan(data, "[ss]", &shared, &other));
+    CHECK(shared.start == pni_symbol_bytes(PNI_SYM_SHARED).start);
+    CHECK(!pni_symbol_is_interned(other.start));
+    REQUIRE(0 == pn_data_materialize(data));
+    CHECK("[:shared, :\"not-interned\"]" == inspect(data));
+  }
+}
+
+static pn_atom_t text_key(pn_type_t type, const char *s) {
+  pn_atom_t key;
+  key.type = type;
+  key.u.as_bytes = pn_bytes(strlen(s), s);
+  return key;
+}
+
+static pn_atom_t symbol_key(const char *s) { return text_key(PN_SYMBOL, s); }
+
+// Fill a map of "key<i>" to i, with an extra ulong key
+static void fill_map(pn_data_t *data, int entries) {
+  pn_data_put_map(data);
+  pn_data_enter(data);
+  for (int i = 0; i < entries; ++i) {
+    std::string key = "key" + std::to_string(i);
+    pn_data_put_symbol(data, pn_bytes(key.size(), key.data()));
+    pn_data_put_int(data, i);
+  }
+  pn_data_put_ulong(data, 99);
+  pn_data_put_string(data, pn_bytes("ulong"));
+  pn_data_exit(data);
+}
+
+TEST_CASE("data_find") {
+  // Small maps are searched, bigger ones indexed
+  for (int entries : {3, 100}) {
+    INFO("entries=" << entries);
+    auto_free<pn_data_t, pn_data_free> data(pn_data(0));
+    fill_map(data, entries);
+    pn_data_rewind(data);
+    REQUIRE(pn_data_next(data));
+    REQUIRE(pn_data_enter(data));
+    for (int i = entries - 1; i >= 0; --i) {
+      std::string key = "key" + std::to_string(i);
+      REQUIRE(pn_data_find(data, symbol_key(key.c_str())));
+      CHECK(i == pn_data_get_int(data));
+    }
+    pn_atom_t key;
+    key.type = PN_ULONG;
+    key.u.as_ulong = 99;
+    REQUIRE(pn_data_find(data, key));
+    CHECK("ulong" == std::string(pn_data_get_string(data).start));
+    key.type = PN_LONG;
+    CHECK(!pn_data_find(data, key));
+    // Keys of another type never match, not even a string for a symbol
+    CHECK(!pn_data_find(data, text_key(PN_STRING, "key0")));
+    CHECK(!pn_data_find(data, text_key(PN_BINARY, "key0")));
+    CHECK(!pn_data_find(data, symbol_key("missing")));
+    CHECK(PN_STRING == pn_data_type(data)); // Unchanged
+
+    // The index follows changes to the map
+    pn_data_exit(data);
+    REQUIRE(pn_data_enter(data));
+    pn_data_put_symbol(data, pn_bytes("changed"));
+    CHECK(pn_data_find(data, symbol_key("changed")));
+    CHECK(!pn_data_find(data, symbol_key("key0")));
+    pn_data_clear(data);
+    CHECK(!pn_data_find(data, symbol_key("changed")));
+  }
+}
+
+// Not run by default: c-core-test "[benchmark]"
+TEST_CASE("data_benchmark_find", "[benchmark][.]") {
+  const int entries = 64;
+  const int loops = 100000;
+  auto_free<pn_data_t, pn_data_free> data(pn_data(0));
+  fill_map(data, entries);
+  pn_data_rewind(data);
+  pn_data_next(data);
+  pn_data_enter(data);
+
+  clock_t start = clock();
+  for (int i = 0; i < loops; ++i) {
+    pn_data_rewind(data);
+    pn_data_next(data);
+    pn_data_enter(data);
+    REQUIRE(pn_data_lookup(data, "key63"));
+  }
+  double lookup = double(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for (int i = 0; i < loops; ++i) {
+    REQUIRE(pn_data_find(data, symbol_key("key63")));
+  }
+  double find = double(clock() - start) / CLOCKS_PER_SEC;
+  printf("data_benchmark_find: %d entries, lookup %.0f ns, find %.0f ns\n",
+         entries, lookup * 1e9 / loops, find * 1e9 / loops);
+}
+
+// Build a message body like structure: a list of maps of string to int/string
+static void fill_body(pn_data_t *data, size_t entries) {
+  pn_data_put_list(data);
+  pn_data_enter(data);
+  for (size_t i = 0; i < entries; ++i) {
+    pn_data_put_map(data);
+    pn_data_enter(data);
+    pn_data_put_string(data, pn_bytes("id"));
+    pn_data_put_int(data, (int32_t) i);
+    pn_data_put_string(data, pn_bytes("name"));
+    pn_data_put_string(data, pn_bytes("some-name"));
+    pn_data_exit(data);
+  }
+  pn_data_exit(data);
+}
+
+// Not run by default: c-core-test "[benchmark]"
+TEST_CASE("data_benchmark_decode", "[benchmark][.]") {
+  const size_t entries = 10000;   // 5 nodes per entry
+  const int loops = 200;
+  auto_free<pn_data_t, pn_data_free> src(pn_data(0));
+  fill_body(src, entries);
+  std::vector<char> buf(pn_data_encoded_size(src));
+  REQUIRE(pn_data_encode(src, &buf[0], buf.size()) == (ssize_t) buf.size());
+
+  auto_free<pn_data_t, pn_data_free> data(pn_data(0));
+  clock_t start = clock();
+  for (int i = 0; i < loops; ++i) {
+    pn_data_clear(data);
+    REQUIRE(pn_data_decode(data, &buf[0], buf.size()) == (ssize_t) buf.size());
+  }
+  double secs = double(clock() - start) / CLOCKS_PER_SEC;
+  size_t nodes = pn_data_size(data);
+  printf("data_benchmark_decode: %u bytes/node, %u nodes, %.1f ns/node\n",
+         (unsigned) sizeof(pni_node_t), (unsigned) nodes, secs * 1e9 / (double(nodes) * loops));
+}
+
+// pn_data_encode2 grows the buffer while encoding, the result must be the
+// same as encoding into a big enough buffer.
+TEST_CASE("data_encode2") {
+  auto_free<pn_data_t, pn_data_free> data(pn_data(0));
+  fill_body(data, 100);
+  std::vector<char> expect(pn_data_encoded_size(data));
+  REQUIRE(pn_data_encode(data, &expect[0], expect.size()) == (ssize_t) expect.size());
+
+  // Start with no buffer at all
+  pn_rwbytes_t buf = {0, NULL};
+  REQUIRE(pn_data_encode2(data, &buf) == (ssize_t) expect.size());
+  CHECK(buf.size >= expect.size());
+  CHECK(std::vector<char>(buf.start, buf.start + expect.size()) == expect);
+  free(buf.start);
+
+  // Start with a buffer that is too small, even for the first list header
+  buf = pn_rwbytes(3, (char *) malloc(3));
+  REQUIRE(pn_data_encode2(data, &buf) == (ssize_t) expect.size());
+  CHECK(std::vector<char>(buf.start, buf.start + expect.size()) == expect);
+
+  // A buffer that is big enough is not reallocated
+  char *start = buf.start;
+  size_t size = buf.size;
+  REQUIRE(pn_data_encode2(data, &buf) == (ssize_t) expect.size());
+  CHECK(buf.start == start);
+  CHECK(buf.size == size);
+  free(buf.start);
+}
+
+static std::vector<char> encode_all(pn_data_t *data) {
+  pn_rwbytes_t buf = {0, NULL};
+  ssize_t size = pn_data_encode2(data, &buf);
+  std::vector<char> result(buf.start, buf.start + (size > 0 ? size : 0));
+  free(buf.start);
+  return result;
+}
+
+// Arrays put in bulk or decoded are a single packed node, but encode,
+// inspect and navigate just like arrays built element by element.
+TEST_CASE("data_array_bulk") {
+  const size_t count = 37;      // Not a multiple of any vector width
+  std::vector<double> values;
+  for (size_t i = 0; i < count; ++i) values.push_back(i * 1.5 - 7);
+
+  auto_free<pn_data_t, pn_data_free> nodes(pn_data(0));
+  pn_data_put_array(nodes, false, PN_DOUBLE);
+  pn_data_enter(nodes);
+  for (size_t i = 0; i < count; ++i) pn_data_put_double(nodes, values[i]);
+  pn_data_exit(nodes);
+  std::vector<char> expect = encode_all(nodes);
+
+  auto_free<pn_data_t, pn_data_free> data(pn_data(0));
+  REQUIRE(0 == pn_data_put_array_bulk(data, PN_DOUBLE, &values[0], count));
+  CHECK(1 == pn_data_size(data));
+  CHECK(count == pn_data_get_array(data));
+  CHECK(PN_DOUBLE == pn_data_get_array_type(data));
+  CHECK(expect == encode_all(data));
+  CHECK(inspect(nodes) == inspect(data));
+
+  // Decoding keeps the array packed
+  pn_data_clear(data);
+  REQUIRE((ssize_t) expect.size() == pn_data_decode(data, &expect[0], expect.size()));
+  CHECK(1 == pn_data_size(data));
+  pn_data_rewind(data);
+  REQUIRE(pn_data_next(data));
+  std::vector<double> got(count);
+  CHECK(count == pn_data_get_array_bulk(data, PN_DOUBLE, &got[0], count));
+  CHECK(values == got);
+  CHECK(0 == pn_data_get_array_bulk(data, PN_FLOAT, &got[0], count));
+
+  // Copies stay packed
+  auto_free<pn_data_t, pn_data_free> copy(pn_data(0));
+  REQUIRE(0 == pn_data_copy(copy, data));
+  CHECK(1 == pn_data_size(copy));
+  CHECK(expect == encode_all(copy));
+
+  // Entering the array creates the element nodes
+  REQUIRE(pn_data_enter(data));
+  for (size_t i = 0; i < count; ++i) {
+    REQUIRE(pn_data_next(data));
+    CHECK(values[i] == pn_data_get_double(data));
+  }
+  CHECK(!pn_data_next(data));
+  pn_data_exit(data);
+  CHECK(count + 1 == pn_data_size(data));
+  std::fill(got.begin(), got.end(), 0);
+  CHECK(count == pn_data_get_array_bulk(data, PN_DOUBLE, &got[0], count));
+  CHECK(values == got);
+  CHECK(expect == encode_all(data));
+}
+
+TEST_CASE("data_array_bulk_types") {
+  int32_t ints[] = {0, -1, 1, 0x12345678, -0x7fffffff};
+  int64_t longs[] = {0, -1, 1, 0x123456789abcdefLL};
+  uint16_t shorts[] = {0, 1, 0xfedc};
+  auto_free<pn_data_t, pn_data_free> data(pn_data(0));
+  pn_data_put_list(data);
+  pn_data_enter(data);
+  REQUIRE(0 == pn_data_put_array_bulk(data, PN_INT, ints, 5));
+  REQUIRE(0 == pn_data_put_array_bulk(data, PN_LONG, longs, 4));
+  REQUIRE(0 == pn_data_put_array_bulk(data, PN_USHORT, shorts, 3));
+  REQUIRE(0 == pn_data_put_array_bulk(data, PN_TIMESTAMP, NULL, 0));
+  CHECK(PN_ARG_ERR == pn_data_put_array_bulk(data, PN_STRING, NULL, 0));
+  pn_data_exit(data);
+  CHECK("[@PN_INT[0, -1, 1, 305419896, -2147483647], @PN_LONG[0, -1, 1, 81985529216486895], "
+        "@PN_USHORT[0, 1, 65244], @PN_TIMESTAMP[]]" == inspect(data));
+
+  // Borrowed decoding refers to the input until materialized
+  std::vector<char> encoded = encode_all(data);
+  auto_free<pn_data_t, pn_data_free> borrowed(pn_data(0));
+  REQUIRE((ssize_t) encoded.size() == pn_data_decode_borrowed(borrowed, &encoded[0], encoded.size()));
+  REQUIRE(0 == pn_data_materialize(borrowed));
+  std::fill(encoded.begin(), encoded.end(), 0);
+  CHECK(inspect(data) == inspect(borrowed));
+
+  // Compact element encodings from other encoders still decode to nodes
+  const char smallints[] = {(char) 0xe0, 5, 3, 0x54, 1, 2, 3};
+  pn_data_clear(data);
+  REQUIRE(7 == pn_data_decode(data, smallints, sizeof(smallints)));
+  CHECK(4 == pn_data_size(data));
+  CHECK("@PN_INT[1, 2, 3]" == inspect(data));
+  pn_data_rewind(data);
+  REQUIRE(pn_data_next(data));
+  int32_t got[3] = {0};
+  CHECK(3 == pn_data_get_array_bulk(data, PN_INT, got, 3));
+  CHECK(3 == got[2]);
+}
+
+// Not run by default: c-core-test "[benchmark]"
+TEST_CASE("data_benchmark_array", "[benchmark][.]") {
+  const size_t count = 10000;
+  const int loops = 500;
+  std::vector<double> values(count, 1.25);
+  std::vector<double> got(count);
+  auto_free<pn_data_t, pn_data_free> data(pn_data(0));
+  pn_rwbytes_t buf = {0, NULL};
+
+  clock_t start = clock();
+  for (int i = 0; i < loops; ++i) {
+    pn_data_clear(data);
+    pn_data_put_array(data, false, PN_DOUBLE);
+    pn_data_enter(data);
+    for (size_t j = 0; j < count; ++j) pn_data_put_double(data, values[j]);
+    pn_data_exit(data);
+    REQUIRE(pn_data_encode2(data, &buf) > 0);
+  }
+  double nodes_encode = double(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  ssize_t size = 0;
+  for (int i = 0; i < loops; ++i) {
+    pn_data_clear(data);
+    pn_data_put_array_bulk(data, PN_DOUBLE, &values[0], count);
+    size = pn_data_encode2(data, &buf);
+    REQUIRE(size > 0);
+  }
+  double bulk_encode = double(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for (int i = 0; i < loops; ++i) {
+    pn_data_clear(data);
+    REQUIRE(pn_data_decode(data, buf.start, size) == size);
+    pn_data_rewind(data);
+    pn_data_next(data);
+    pn_data_enter(data);
+    for (size_t j = 0; j < count && pn_data_next(data); ++j) got[j] = pn_data_get_double(data);
+  }
+  double nodes_decode = double(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for (int i = 0; i < loops; ++i) {
+    pn_data_clear(data);
+    REQUIRE(pn_data_decode(data, buf.start, size) == size);
+    pn_data_rewind(data);
+    pn_data_next(data);
+    REQUIRE(pn_data_get_array_bulk(data, PN_DOUBLE, &got[0], count) == count);
+  }
+  double bulk_decode = double(clock() - start) / CLOCKS_PER_SEC;
+  free(buf.start);
+
+  double n = double(count) * loops;
+  printf("data_benchmark_array: encode %.2f ns/element (%.2f bulk), decode %.2f ns/element (%.2f bulk)\n",
+         nodes_encode * 1e9 / n, bulk_encode * 1e9 / n, nodes_decode * 1e9 / n, bulk_decode * 1e9 / n);
+}
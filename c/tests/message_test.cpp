@@ -21,9 +21,17 @@
 
 #include "./pn_test.hpp"
 
+#include "core/message-internal.h"
+
 #include <proton/error.h>
 #include <proton/message.h>
+#include <proton/object.h>
 #include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <string>
 
 using namespace pn_test;
 
@@ -46,6 +54,28 @@ static void recode(pn_message_t *dst, pn_message_t *src) {
   free(buf.start);
 }
 
+TEST_CASE("message_encode2_grow") {
+  pn_message_t *src = pn_message();
+  pn_message_t *dst = pn_message();
+  std::string big(10000, 'x');
+  pn_data_put_string(pn_message_body(src), pn_bytes(big.size(), big.data()));
+
+  // Encode into a buffer that is much too small, it is grown as needed
+  pn_rwbytes_t buf = pn_rwbytes(16, (char *) malloc(16));
+  ssize_t size = pn_message_encode2(src, &buf);
+  REQUIRE(size > (ssize_t) big.size());
+  CHECK((size_t) size <= buf.size);
+  REQUIRE(0 == pn_message_decode(dst, buf.start, size));
+  pn_data_t *body_data = pn_message_body(dst);
+  pn_data_rewind(body_data);
+  REQUIRE(pn_data_next(body_data));
+  pn_bytes_t body = pn_data_get_string(body_data);
+  CHECK(std::string(body.start, body.size) == big);
+  free(buf.start);
+  pn_message_free(src);
+  pn_message_free(dst);
+}
+
 TEST_CASE("message_inferred") {
   pn_message_t *src = pn_message();
   pn_message_t *dst = pn_message();
@@ -82,3 +112,425 @@ TEST_CASE("message_inferred") {
   pn_message_free(src);
   pn_message_free(dst);
 }
+
+static std::string encode_message(pn_message_t *msg) {
+  pn_rwbytes_t buf = {0};
+  ssize_t size = pn_message_encode2(msg, &buf);
+  REQUIRE(size > 0);
+  std::string result(buf.start, size);
+  free(buf.start);
+  return result;
+}
+
+static std::string inspect_message(void *msg) {
+  pn_string_t *s = pn_string(NULL);
+  pn_inspect(msg, s);
+  std::string result(pn_string_get(s));
+  pn_free(s);
+  return result;
+}
+
+static void fill_message(pn_message_t *msg, size_t body_entries) {
+  pn_message_set_address(msg, "queue");
+  pn_message_set_subject(msg, "subject");
+  pn_message_set_ttl(msg, 1000);
+  pn_message_set_priority(msg, 7);
+  pn_data_t *annotations = pn_message_annotations(msg);
+  pn_data_put_map(annotations);
+  pn_data_enter(annotations);
+  pn_data_put_symbol(annotations, pn_bytes("x-opt-key"));
+  pn_data_put_string(annotations, pn_bytes("value"));
+  pn_data_exit(annotations);
+  pn_data_t *properties = pn_message_properties(msg);
+  pn_data_put_map(properties);
+  pn_data_enter(properties);
+  pn_data_put_string(properties, pn_bytes("count"));
+  pn_data_put_int(properties, 42);
+  pn_data_exit(properties);
+  pn_data_t *body = pn_message_body(msg);
+  pn_data_put_list(body);
+  pn_data_enter(body);
+  for (size_t i = 0; i < body_entries; ++i) {
+    pn_data_put_string(body, pn_bytes("body entry"));
+    pn_data_put_long(body, i);
+  }
+  pn_data_exit(body);
+}
+
+TEST_CASE("message_decode_lazy") {
+  pn_message_t *src = pn_message();
+  pn_message_t *eager = pn_message();
+  pn_message_t *lazy = pn_message();
+  fill_message(src, 10);
+  std::string encoded = encode_message(src);
+
+  REQUIRE(0 == pn_message_decode(eager, encoded.data(), encoded.size()));
+  REQUIRE(0 == pn_message_decode_lazy(lazy, encoded.data(), encoded.size()));
+  CHECK(std::string("queue") == pn_message_get_address(lazy));
+  CHECK(inspect_message(eager) == inspect_message(lazy));
+  CHECK(encode_message(eager) == encode_message(lazy));
+
+  // Setting a field doesn't lose the rest of its section
+  REQUIRE(0 == pn_message_decode_lazy(lazy, encoded.data(), encoded.size()));
+  pn_message_set_priority(lazy, 3);
+  CHECK(1000 == pn_message_get_ttl(lazy));
+  CHECK(3 == pn_message_get_priority(lazy));
+
+  // Nor does setting inferred before the body is loaded
+  REQUIRE(0 == pn_message_decode_lazy(lazy, encoded.data(), encoded.size()));
+  CHECK(!pn_message_is_inferred(lazy));
+  pn_message_set_inferred(lazy, true);
+  CHECK(pn_data_size(pn_message_body(lazy)) > 0);
+  CHECK(pn_message_is_inferred(lazy));
+
+  // The copy is independent of the caller's bytes
+  REQUIRE(0 == pn_message_decode_lazy(lazy, encoded.data(), encoded.size()));
+  encoded.assign(encoded.size(), '\0');
+  CHECK(std::string("subject") == pn_message_get_subject(lazy));
+
+  // A much smaller message after a large one gets a copy of its own, and
+  // clearing drops the copy
+  pn_message_clear(src);
+  fill_message(src, 1000);
+  std::string large = encode_message(src);
+  REQUIRE(0 == pn_message_decode_lazy(lazy, large.data(), large.size()));
+  CHECK(encode_message(lazy) == large);
+  encoded = encode_message(eager);
+  REQUIRE(0 == pn_message_decode_lazy(lazy, encoded.data(), encoded.size()));
+  CHECK(encode_message(lazy) == encoded);
+  pn_message_clear(lazy);
+  CHECK(pn_message_get_address(lazy) == NULL);
+  CHECK(encode_message(lazy) != encoded);
+
+  pn_message_free(src);
+  pn_message_free(eager);
+  pn_message_free(lazy);
+}
+
+TEST_CASE("message_decode_borrowed") {
+  pn_message_t *src = pn_message();
+  pn_message_t *msg = pn_message();
+  fill_message(src, 10);
+  std::string encoded = encode_message(src);
+
+  // The message reads the caller's bytes where they are
+  REQUIRE(0 == pni_message_decode_borrowed(msg, encoded.data(), encoded.size()));
+  encoded.replace(encoded.find("subject"), 7, "SUBJECT");
+  CHECK(std::string("SUBJECT") == pn_message_get_subject(msg));
+  CHECK(std::string("queue") == pn_message_get_address(msg));
+  CHECK(encode_message(msg) == encoded);
+
+  // Once cleared the message no longer refers to them
+  pn_message_clear(msg);
+  encoded.assign(encoded.size(), '\0');
+  CHECK(pn_message_get_address(msg) == NULL);
+  pn_message_clear(src);
+  CHECK(encode_message(msg) == encode_message(src));
+
+  pn_message_free(src);
+  pn_message_free(msg);
+}
+
+TEST_CASE("message_own") {
+  pn_message_t *src = pn_message();
+  pn_message_t *msg = pn_message();
+  fill_message(src, 10);
+  std::string encoded = encode_message(src);
+  std::string expect = encoded;
+
+  // Once owned the message no longer refers to the bytes it borrowed
+  REQUIRE(0 == pni_message_decode_borrowed(msg, encoded.data(), encoded.size()));
+  REQUIRE(0 == pni_message_own(msg));
+  encoded.assign(encoded.size(), '\0');
+  CHECK(std::string("queue") == pn_message_get_address(msg));
+  CHECK(encode_message(msg) == expect);
+
+  // A message that owns its bytes already is left as it is
+  REQUIRE(0 == pni_message_own(msg));
+  CHECK(encode_message(msg) == expect);
+
+  pn_message_free(src);
+  pn_message_free(msg);
+}
+
+TEST_CASE("message_decode_lazy_skips_body") {
+  const char encoded[] = {
+    // properties: to="abc"
+    0x00, 0x53, 0x73, (char) 0xc0, 0x08, 0x03, 0x40, 0x40, (char) 0xa1, 0x03, 'a', 'b', 'c',
+    // amqp-value: a list holding an invalid type code
+    0x00, 0x53, 0x77, (char) 0xc0, 0x03, 0x01, 0x01, 0x02
+  };
+  pn_message_t *msg = pn_message();
+  CHECK(0 != pn_message_decode(msg, encoded, sizeof(encoded)));
+  pn_message_free(msg);
+
+  msg = pn_message();
+  REQUIRE(0 == pn_message_decode_lazy(msg, encoded, sizeof(encoded)));
+  CHECK(std::string("abc") == pn_message_get_address(msg));
+  CHECK(0 == pn_message_errno(msg));
+  pn_message_body(msg);
+  CHECK(0 != pn_message_errno(msg));
+
+  // A truncated section is found straight away
+  CHECK(0 != pn_message_decode_lazy(msg, encoded, sizeof(encoded) - 1));
+  pn_message_free(msg);
+}
+
+// A setter fails on a section that can't be loaded, and leaves it unchanged
+TEST_CASE("message_set_malformed_section") {
+  const char encoded[] = {
+    // properties: a list holding an invalid type code
+    0x00, 0x53, 0x73, (char) 0xc0, 0x03, 0x01, 0x01, 0x02
+  };
+  pn_message_t *msg = pn_message();
+  REQUIRE(0 == pn_message_decode_lazy(msg, encoded, sizeof(encoded)));
+  CHECK(0 != pn_message_set_address(msg, "abc"));
+  CHECK(0 != pn_message_errno(msg));
+  CHECK(0 != pn_message_set_subject(msg, "abc"));
+  // The properties are still encoded by copying them
+  CHECK(std::string::npos != encode_message(msg).find(std::string(encoded, sizeof(encoded))));
+  pn_message_free(msg);
+}
+
+// Sections that haven't changed since decoding are encoded by copying them
+TEST_CASE("message_encode_reuses_sections") {
+  const char header[] = {
+    // header: durable=true, as a list32 which is never what the encoder writes
+    0x00, 0x53, 0x70, (char) 0xd0, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x01, 0x41
+  };
+  const char body[] = {
+    // amqp-value: a list holding an invalid type code
+    0x00, 0x53, 0x77, (char) 0xc0, 0x03, 0x01, 0x01, 0x02
+  };
+  const char properties[] = {
+    // properties: to="abc"
+    0x00, 0x53, 0x73, (char) 0xc0, 0x08, 0x03, 0x40, 0x40, (char) 0xa1, 0x03, 'a', 'b', 'c'
+  };
+  std::string encoded = std::string(header, sizeof(header)) + std::string(properties, sizeof(properties)) +
+    std::string(body, sizeof(body));
+  pn_message_t *msg = pn_message();
+
+  REQUIRE(0 == pn_message_decode_lazy(msg, encoded.data(), encoded.size()));
+  CHECK(std::string("abc") == pn_message_get_address(msg));
+  CHECK(pn_message_is_durable(msg));
+  CHECK(encode_message(msg) == encoded);
+
+  // Too small a buffer still overflows
+  std::string small(encoded.size() - 1, '\0');
+  size_t size = small.size();
+  CHECK(PN_OVERFLOW == pn_message_encode(msg, &small[0], &size));
+  std::string exact(encoded.size(), '\0');
+  size = exact.size();
+  CHECK(0 == pn_message_encode(msg, &exact[0], &size));
+  CHECK(exact == encoded);
+
+  // Only changed sections are encoded again
+  pn_message_set_subject(msg, "subject");
+  pn_data_t *annotations = pn_message_annotations(msg);
+  pn_data_put_map(annotations);
+  pn_data_enter(annotations);
+  pn_data_put_symbol(annotations, pn_bytes("x-opt-key"));
+  pn_data_put_int(annotations, 1);
+  pn_data_exit(annotations);
+  std::string forwarded = encode_message(msg);
+  CHECK(forwarded.compare(0, sizeof(header), header, sizeof(header)) == 0);
+  CHECK(forwarded.compare(forwarded.size() - sizeof(body), sizeof(body), body, sizeof(body)) == 0);
+
+  pn_message_t *check = pn_message();
+  REQUIRE(0 == pn_message_decode_lazy(check, forwarded.data(), forwarded.size()));
+  CHECK(std::string("abc") == pn_message_get_address(check));
+  CHECK(std::string("subject") == pn_message_get_subject(check));
+  CHECK(pn_message_is_durable(check));
+  CHECK(inspect_message(annotations) == inspect_message(pn_message_annotations(check)));
+  pn_message_free(check);
+
+  pn_message_free(msg);
+}
+
+TEST_CASE("message_encode_changed_body") {
+  pn_message_t *src = pn_message();
+  pn_message_t *msg = pn_message();
+  pn_message_t *expect = pn_message();
+  pn_data_put_binary(pn_message_body(src), pn_bytes("hello"));
+  std::string encoded = encode_message(src);
+
+  // Changing inferred changes the body's descriptor
+  REQUIRE(0 == pn_message_decode_lazy(msg, encoded.data(), encoded.size()));
+  pn_message_set_inferred(msg, true);
+  pn_message_set_inferred(src, true);
+  CHECK(encode_message(msg) == encode_message(src));
+
+  // A body that isn't a body section is encoded as an amqp-value
+  const char described[] = { 0x00, 0x53, 0x01, 0x41 };
+  REQUIRE(0 == pn_message_decode_lazy(msg, described, sizeof(described)));
+  REQUIRE(0 == pn_message_decode(expect, described, sizeof(described)));
+  CHECK(encode_message(msg) == encode_message(expect));
+  CHECK(encode_message(msg).find(std::string(described, sizeof(described))) != std::string::npos);
+
+  pn_message_free(src);
+  pn_message_free(msg);
+  pn_message_free(expect);
+}
+
+TEST_CASE("message_peek") {
+  pn_message_t *msg = pn_message();
+  fill_message(msg, 10);
+  pn_message_set_durable(msg, true);
+  pn_data_t *annotations = pn_message_annotations(msg);
+  pn_data_enter(annotations);
+  pn_data_next(annotations);
+  pn_data_next(annotations);
+  pn_data_put_symbol(annotations, pn_bytes("x-opt-list"));
+  pn_data_put_list(annotations);
+  pn_data_enter(annotations);
+  pn_data_put_int(annotations, 1);
+  pn_data_exit(annotations);
+  std::string encoded = encode_message(msg);
+
+  pn_message_peek_t fields;
+  REQUIRE(0 == pn_message_peek(encoded.data(), encoded.size(), &fields));
+  CHECK(std::string("queue") == std::string(fields.address.start, fields.address.size));
+  CHECK(std::string("subject") == std::string(fields.subject.start, fields.subject.size));
+  CHECK(7 == fields.priority);
+  CHECK(1000 == fields.ttl);
+  CHECK(fields.durable);
+
+  pn_atom_t value;
+  REQUIRE(0 == pn_message_peek_annotation(encoded.data(), encoded.size(), "x-opt-key", &value));
+  CHECK(PN_STRING == value.type);
+  CHECK(std::string("value") == std::string(value.u.as_bytes.start, value.u.as_bytes.size));
+  REQUIRE(0 == pn_message_peek_annotation(encoded.data(), encoded.size(), "x-opt-list", &value));
+  CHECK(PN_LIST == value.type);
+  pn_data_t *list = pn_data(0);
+  CHECK((ssize_t) value.u.as_bytes.size == pn_data_decode(list, value.u.as_bytes.start, value.u.as_bytes.size));
+  CHECK("[1]" == inspect_message(list));
+  pn_data_free(list);
+  REQUIRE(0 == pn_message_peek_annotation(encoded.data(), encoded.size(), "x-opt", &value));
+  CHECK(PN_INVALID == value.type);
+  REQUIRE(0 == pn_message_peek_property(encoded.data(), encoded.size(), "count", &value));
+  CHECK(PN_INT == value.type);
+  CHECK(42 == value.u.as_int);
+  REQUIRE(0 == pn_message_peek_property(encoded.data(), encoded.size(), "x-opt-key", &value));
+  CHECK(PN_INVALID == value.type);
+
+  CHECK(0 != pn_message_peek(encoded.data(), encoded.size() - 1, &fields));
+  CHECK(0 != pn_message_peek_property(encoded.data(), encoded.size() - 1, "count", &value));
+
+  // Fields that aren't there have their defaults
+  pn_message_clear(msg);
+  pn_data_put_int(pn_message_body(msg), 1);
+  pn_rwbytes_t buf = {0};
+  ssize_t size = pn_message_encode2(msg, &buf);
+  REQUIRE(size > 0);
+  const char body_only[] = { 0x00, 0x53, 0x77, 0x54, 0x01 };
+  REQUIRE(0 == pn_message_peek(body_only, sizeof(body_only), &fields));
+  CHECK(!fields.address.start);
+  CHECK(!fields.subject.start);
+  CHECK(PN_DEFAULT_PRIORITY == fields.priority);
+  CHECK(0 == fields.ttl);
+  CHECK(!fields.durable);
+  REQUIRE(0 == pn_message_peek(buf.start, size, &fields));
+  CHECK(!fields.address.start);
+  CHECK(PN_DEFAULT_PRIORITY == fields.priority);
+  free(buf.start);
+  pn_message_free(msg);
+}
+
+// Not run by default: c-core-test "[benchmark]"
+TEST_CASE("message_benchmark_decode_address", "[benchmark][.]") {
+  const int loops = 200;
+  pn_message_t *src = pn_message();
+  pn_message_t *msg = pn_message();
+  fill_message(src, 10000);
+  std::string encoded = encode_message(src);
+
+  clock_t start = clock();
+  for (int i = 0; i < loops; ++i) {
+    REQUIRE(0 == pn_message_decode(msg, encoded.data(), encoded.size()));
+    REQUIRE(pn_message_get_address(msg));
+  }
+  double eager = double(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for (int i = 0; i < loops; ++i) {
+    REQUIRE(0 == pn_message_decode_lazy(msg, encoded.data(), encoded.size()));
+    REQUIRE(pn_message_get_address(msg));
+  }
+  double lazy = double(clock() - start) / CLOCKS_PER_SEC;
+
+  printf("message_benchmark_decode_address: %u bytes, eager %.1f us/msg, lazy %.1f us/msg\n",
+         (unsigned) encoded.size(), eager * 1e6 / loops, lazy * 1e6 / loops);
+  pn_message_free(src);
+  pn_message_free(msg);
+}
+
+// Not run by default: c-core-test "[benchmark]"
+TEST_CASE("message_benchmark_forward", "[benchmark][.]") {
+  const int loops = 200;
+  pn_message_t *src = pn_message();
+  pn_message_t *msg = pn_message();
+  fill_message(src, 10000);
+  std::string encoded = encode_message(src);
+  pn_rwbytes_t buf = {0};
+
+  // Every section changed, as when the message is forwarded after reading
+  // all of it through pn_message_data
+  clock_t start = clock();
+  for (int i = 0; i < loops; ++i) {
+    REQUIRE(0 == pn_message_decode(msg, encoded.data(), encoded.size()));
+    pn_message_instructions(msg);
+    pn_message_annotations(msg);
+    pn_message_properties(msg);
+    pn_message_body(msg);
+    pn_message_set_priority(msg, 1);
+    pn_message_set_address(msg, "queue");
+    REQUIRE(pn_message_encode2(msg, &buf) > 0);
+  }
+  double all = double(clock() - start) / CLOCKS_PER_SEC;
+
+  // Only the header changed
+  start = clock();
+  for (int i = 0; i < loops; ++i) {
+    REQUIRE(0 == pn_message_decode_lazy(msg, encoded.data(), encoded.size()));
+    pn_message_set_priority(msg, 1);
+    REQUIRE(pn_message_encode2(msg, &buf) > 0);
+  }
+  double header = double(clock() - start) / CLOCKS_PER_SEC;
+
+  printf("message_benchmark_forward: %u bytes, re-encoded %.1f us/msg, header changed %.1f us/msg\n",
+         (unsigned) encoded.size(), all * 1e6 / loops, header * 1e6 / loops);
+  free(buf.start);
+  pn_message_free(src);
+  pn_message_free(msg);
+}
+
+// Not run by default: c-core-test "[benchmark]"
+TEST_CASE("message_benchmark_peek", "[benchmark][.]") {
+  const int loops = 100000;
+  pn_message_t *src = pn_message();
+  pn_message_t *msg = pn_message();
+  fill_message(src, 100);
+  std::string encoded = encode_message(src);
+
+  clock_t start = clock();
+  for (int i = 0; i < loops; ++i) {
+    REQUIRE(0 == pn_message_decode_lazy(msg, encoded.data(), encoded.size()));
+    REQUIRE(pn_message_get_address(msg));
+    REQUIRE(pn_data_size(pn_message_annotations(msg)));
+  }
+  double lazy = double(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for (int i = 0; i < loops; ++i) {
+    pn_message_peek_t fields;
+    pn_atom_t value;
+    REQUIRE(0 == pn_message_peek(encoded.data(), encoded.size(), &fields));
+    REQUIRE(0 == pn_message_peek_annotation(encoded.data(), encoded.size(), "x-opt-key", &value));
+  }
+  double peek = double(clock() - start) / CLOCKS_PER_SEC;
+
+  printf("message_benchmark_peek: %u bytes, lazy decode %.0f ns/msg, peek %.0f ns/msg\n",
+         (unsigned) encoded.size(), lazy * 1e9 / loops, peek * 1e9 / loops);
+  pn_message_free(src);
+  pn_message_free(msg);
+}
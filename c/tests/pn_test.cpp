@@ -19,6 +19,8 @@
 
 #include "./pn_test.hpp"
 
+#include <algorithm>
+
 #include <proton/condition.h>
 #include <proton/connection.h>
 #include <proton/delivery.h>
@@ -142,11 +144,16 @@ driver_pair::driver_pair(handler &ch, handler &sh) : client(ch), server(sh) {
 }
 
 size_t driver::read(pn_connection_driver_t &src) {
-  pn_bytes_t wb = pn_connection_driver_write_buffer(&src);
+  pn_bytes_t wbs[4];
+  size_t count = pn_connection_driver_write_buffers(&src, wbs, 4);
   pn_rwbytes_t rb = pn_connection_driver_read_buffer(this);
-  size_t size = rb.size < wb.size ? rb.size : wb.size;
+  size_t size = 0;
+  for (size_t i = 0; i < count && size < rb.size; ++i) {
+    size_t n = std::min(rb.size - size, wbs[i].size);
+    std::copy(wbs[i].start, wbs[i].start + n, rb.start + size);
+    size += n;
+  }
   if (size) {
-    std::copy(wb.start, wb.start + size, rb.start);
     pn_connection_driver_write_done(&src, size);
     pn_connection_driver_read_done(this, size);
   }
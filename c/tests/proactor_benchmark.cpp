@@ -0,0 +1,188 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/* Proactor benchmarks, built as c-proactor-benchmark and not run as tests.
+   They count system calls by wrapping libc functions, which in c-proactor-test
+   would wrap them for every test and get in the way of valgrind and ASAN. */
+
+#include "./pn_test_proactor.hpp"
+
+#include <proton/connection.h>
+#include <proton/delivery.h>
+#include <proton/event.h>
+#include <proton/link.h>
+#include <proton/listener.h>
+#include <proton/proactor.h>
+#include <proton/session.h>
+
+#include <stdio.h>
+#include <time.h>
+
+#include <map>
+
+#include <dlfcn.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace pn_test;
+
+/* Count the system calls the proactor makes per message, by wrapping the libc
+   functions it calls. Counting is only turned on by the benchmark below. */
+namespace {
+bool count_syscalls;
+long epoll_waits, other_syscalls;
+
+template <class F> F next_function(const char *name) {
+  return reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+}
+} // namespace
+
+#pragma GCC visibility push(default) /* Must override the libc functions */
+extern "C" {
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+               int timeout) {
+  static int (*f)(int, struct epoll_event *, int, int) =
+      next_function<int (*)(int, struct epoll_event *, int, int)>("epoll_wait");
+  if (count_syscalls) ++epoll_waits;
+  return f(epfd, events, maxevents, timeout);
+}
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) __THROW {
+  static int (*f)(int, int, int, struct epoll_event *) =
+      next_function<int (*)(int, int, int, struct epoll_event *)>("epoll_ctl");
+  if (count_syscalls) ++other_syscalls;
+  return f(epfd, op, fd, event);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+  static ssize_t (*f)(int, void *, size_t) =
+      next_function<ssize_t (*)(int, void *, size_t)>("read");
+  if (count_syscalls) ++other_syscalls;
+  return f(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+  static ssize_t (*f)(int, const void *, size_t) =
+      next_function<ssize_t (*)(int, const void *, size_t)>("write");
+  if (count_syscalls) ++other_syscalls;
+  return f(fd, buf, count);
+}
+
+ssize_t sendmsg(int fd, const struct msghdr *msg, int flags) {
+  static ssize_t (*f)(int, const struct msghdr *, int) =
+      next_function<ssize_t (*)(int, const struct msghdr *, int)>("sendmsg");
+  if (count_syscalls) ++other_syscalls;
+  return f(fd, msg, flags);
+}
+}
+#pragma GCC visibility pop
+
+namespace {
+/* Stream pre-settled deliveries over every connection, keeping credit up */
+struct stream_handler : public handler {
+  int per_link, received, total;
+  std::map<pn_link_t *, int> sent;
+
+  stream_handler(int per_link_, int total_)
+      : per_link(per_link_), received(), total(total_) {}
+
+  void send(pn_link_t *snd) {
+    static const char body[100] = {0};
+    int &n = sent[snd];
+    for (; n < per_link && pn_link_credit(snd) > 0; ++n) {
+      pn_delivery(snd, pn_dtag("", 0));
+      pn_link_send(snd, body, sizeof(body));
+      pn_link_advance(snd);
+    }
+  }
+
+  bool handle(pn_event_t *e) CATCH_OVERRIDE {
+    switch (pn_event_type(e)) {
+    case PN_LISTENER_OPEN:
+      return true;
+    case PN_LISTENER_ACCEPT:
+      pn_listener_accept2(pn_event_listener(e), NULL, NULL);
+      return false;
+    case PN_CONNECTION_REMOTE_OPEN:
+      pn_connection_open(pn_event_connection(e));
+      return false;
+    case PN_SESSION_REMOTE_OPEN:
+      pn_session_open(pn_event_session(e));
+      return false;
+    case PN_LINK_REMOTE_OPEN:
+      pn_link_open(pn_event_link(e));
+      if (pn_link_is_receiver(pn_event_link(e)))
+        pn_link_flow(pn_event_link(e), 100);
+      return false;
+
+    case PN_LINK_FLOW:
+      if (pn_link_is_sender(pn_event_link(e))) send(pn_event_link(e));
+      return false;
+
+    case PN_DELIVERY: {
+      pn_delivery_t *d = pn_event_delivery(e);
+      pn_link_t *l = pn_delivery_link(d);
+      if (pn_link_is_receiver(l) && !pn_delivery_partial(d)) {
+        char buf[100];
+        while (pn_link_recv(l, buf, sizeof(buf)) > 0) {}
+        pn_delivery_settle(d);
+        pn_link_flow(l, 1);
+        return ++received == total;
+      }
+      return false;
+    }
+    default:
+      return false;
+    }
+  }
+};
+} // namespace
+
+TEST_CASE("proactor_benchmark_loopback", "[benchmark]") {
+  const int connections = 16;
+  const int per_link = 10000;
+  const int messages = connections * per_link;
+  stream_handler h(per_link, messages);
+  proactor p(&h);
+
+  pn_listener_t *l = p.listen();
+  REQUIRE_RUN(p, PN_LISTENER_OPEN);
+  for (int i = 0; i < connections; ++i) {
+    pn_connection_t *c = p.connect(l);
+    pn_session_t *ssn = pn_session(c);
+    pn_session_open(ssn);
+    pn_link_t *snd = pn_sender(ssn, "x");
+    pn_link_set_snd_settle_mode(snd, PN_SND_SETTLED);
+    pn_link_open(snd);
+  }
+
+  epoll_waits = other_syscalls = 0;
+  count_syscalls = true;
+  clock_t start = clock();
+  p.run();
+  double elapsed = double(clock() - start) / CLOCKS_PER_SEC;
+  count_syscalls = false;
+  CHECK(messages == h.received);
+
+  printf("proactor_benchmark_loopback: %d messages on %d connections, %.2f us "
+         "per message, %.3f epoll_wait and %.3f other system calls per message\n",
+         messages, connections, elapsed * 1e6 / messages,
+         double(epoll_waits) / messages, double(other_syscalls) / messages);
+}
@@ -36,6 +36,11 @@
 #include <string.h>
 
 #include <iostream>
+#include <map>
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
 
 using namespace pn_test;
 using Catch::Matchers::Contains;
@@ -174,6 +179,10 @@ TEST_CASE("proactor_connection_wake") {
   REQUIRE_RUN(p, PN_CONNECTION_REMOTE_OPEN);
   REQUIRE_RUN(p, PN_CONNECTION_REMOTE_OPEN);
   CHECK(!pn_proactor_get(p)); /* Should be idle */
+  pn_connection_memory_t m;
+  pn_proactor_connection_memory_usage(c, &m);
+  CHECK(m.io > 0);
+  CHECK(m.total > m.io);
   pn_connection_wake(c);
   REQUIRE_RUN(p, PN_CONNECTION_WAKE);
   REQUIRE_RUN(p, PN_TRANSPORT_CLOSED);
@@ -829,3 +838,191 @@ TEST_CASE("proactor_message_stream") {
   free(h.send_buf.start);
   free(h.recv_buf.start);
 }
+
+namespace {
+/* Sends a single delivery once it has credit, the receiving side collects it */
+struct large_delivery_handler : public common_handler {
+  std::string sent, received;
+  bool started, complete;
+
+  large_delivery_handler() : started(), complete() {}
+
+  bool handle(pn_event_t *e) CATCH_OVERRIDE {
+    pn_link_t *l = pn_event_link(e);
+    switch (pn_event_type(e)) {
+    case PN_LINK_REMOTE_OPEN:
+      common_handler::handle(e);
+      if (pn_link_is_receiver(l)) pn_link_flow(l, 1);
+      return false;
+
+    case PN_LINK_FLOW:
+      if (pn_link_is_sender(l) && pn_link_credit(l) > 0 && !started) {
+        started = true;
+        pn_delivery(l, pn_dtag("x", 1));
+        CHECK(ssize_t(sent.size()) == pn_link_send(l, sent.data(), sent.size()));
+        pn_link_advance(l);
+      }
+      return false;
+
+    case PN_DELIVERY: {
+      pn_delivery_t *dlv = pn_event_delivery(e);
+      size_t n = pn_delivery_pending(dlv);
+      size_t old = received.size();
+      received.resize(old + n);
+      REQUIRE(ssize_t(n) == pn_link_recv(l, &received[old], n));
+      complete = !pn_delivery_partial(dlv);
+      return true;
+    }
+    default:
+      return common_handler::handle(e);
+    }
+  }
+};
+} // namespace
+
+/* A delivery far larger than the socket buffers fills the socket, the output
+   waits in the transport till the socket drains */
+TEST_CASE("proactor_large_delivery") {
+  large_delivery_handler h;
+  h.sent.resize(16 * 1024 * 1024);
+  for (size_t i = 0; i < h.sent.size(); ++i) {
+    h.sent[i] = char(i % 251);
+  }
+  proactor p(&h);
+
+  pn_listener_t *l = p.listen();
+  REQUIRE_RUN(p, PN_LISTENER_OPEN);
+  pn_connection_t *c = p.connect(l);
+  pn_session_t *ssn = pn_session(c);
+  pn_session_open(ssn);
+  pn_link_open(pn_sender(ssn, "x"));
+  while (!h.complete) {
+    REQUIRE_RUN(p, PN_DELIVERY);
+  }
+  CHECK(h.received.size() == h.sent.size());
+  CHECK(h.received.compare(h.sent) == 0);
+}
+
+
+#if !defined(_WIN32)
+namespace {
+/* Records the connections as they open, returns when there are `expected`.
+   Closes a connection when it is woken. */
+struct open_counter : public common_handler {
+  std::vector<pn_connection_t *> opened;
+  size_t expected;
+
+  open_counter() : expected() {}
+
+  bool handle(pn_event_t *e) CATCH_OVERRIDE {
+    switch (pn_event_type(e)) {
+    case PN_CONNECTION_REMOTE_OPEN:
+      common_handler::handle(e);
+      opened.push_back(pn_event_connection(e));
+      return opened.size() == expected;
+    case PN_CONNECTION_WAKE:
+      pn_connection_close(pn_event_connection(e));
+      return false;
+    default:
+      return common_handler::handle(e);
+    }
+  }
+};
+
+/* Threads sharing a proactor count the wakes and remote closes of its
+   connections, till each connection has had one of each */
+struct wake_counter {
+  pn_proactor_t *proactor;
+  pthread_mutex_t lock;
+  std::map<pn_connection_t *, int> wakes;
+  size_t closed, expected;
+  bool done;
+
+  wake_counter(pn_proactor_t *p, size_t n)
+      : proactor(p), closed(), expected(n), done() {
+    pthread_mutex_init(&lock, NULL);
+  }
+  ~wake_counter() { pthread_mutex_destroy(&lock); }
+
+  // Return true when every connection has been woken and closed
+  bool handle(pn_event_t *e) {
+    pn_connection_t *c = pn_event_connection(e);
+    switch (pn_event_type(e)) {
+    case PN_CONNECTION_WAKE:
+      pthread_mutex_lock(&lock);
+      ++wakes[c];
+      break;
+    case PN_CONNECTION_REMOTE_CLOSE:
+      pn_connection_close(c);
+      pthread_mutex_lock(&lock);
+      ++closed;
+      break;
+    case PN_PROACTOR_INTERRUPT:
+      pthread_mutex_lock(&lock);
+      break;
+    default:
+      return false;
+    }
+    done = done || (wakes.size() == expected && closed == expected);
+    bool finished = done;
+    pthread_mutex_unlock(&lock);
+    return finished;
+  }
+
+  static void *run(void *arg) {
+    wake_counter &w = *(wake_counter *) arg;
+    bool finished = false;
+    while (!finished) {
+      pn_event_batch_t *b = pn_proactor_wait(w.proactor);
+      pn_event_t *e;
+      while ((e = pn_event_batch_next(b))) {
+        if (w.handle(e)) finished = true;
+      }
+      pn_proactor_done(w.proactor, b);
+    }
+    pn_proactor_interrupt(w.proactor); // Pass it on to the next thread
+    return NULL;
+  }
+};
+} // namespace
+
+/* Threads take the events of a proactor as more sockets turn ready than it
+   takes in one go, while its connections are also woken. Each wake is
+   delivered once. */
+TEST_CASE("proactor_many_wakes") {
+  const size_t connections = 40;
+  const int threads = 4;
+  open_counter sh, ch;
+  proactor server(&sh), client(&ch);
+  pn_listener_t *l = server.listen();
+  REQUIRE_RUN(server, PN_LISTENER_OPEN);
+  // Connect a few at a time, within the listen backlog
+  for (size_t i = 0; i < connections; i += 4) {
+    sh.expected = ch.expected = i + 4;
+    for (size_t j = i; j < i + 4; ++j) client.connect(l);
+    REQUIRE(PN_CONNECTION_REMOTE_OPEN == server.corun(client));
+    REQUIRE(PN_CONNECTION_REMOTE_OPEN == client.corun(server));
+  }
+  REQUIRE(connections == sh.opened.size());
+  REQUIRE(connections == ch.opened.size());
+
+  // The clients close while the server does not run, so their closes are all
+  // waiting to be read with the server's wakes when its threads start
+  for (size_t i = 0; i < connections; ++i) pn_connection_wake(ch.opened[i]);
+  for (size_t i = 0; i < connections; ++i) REQUIRE_RUN(client, PN_TRANSPORT_HEAD_CLOSED);
+  for (size_t i = 0; i < connections; ++i) pn_connection_wake(sh.opened[i]);
+
+  wake_counter w(server, connections);
+  pthread_t t[threads];
+  for (int i = 0; i < threads; ++i) pthread_create(&t[i], NULL, wake_counter::run, &w);
+  for (int i = 0; i < threads; ++i) pthread_join(t[i], NULL);
+
+  CHECK(connections == w.wakes.size());
+  size_t once = 0;
+  for (std::map<pn_connection_t *, int>::iterator i = w.wakes.begin(); i != w.wakes.end(); ++i) {
+    if (i->second == 1) ++once;
+  }
+  CHECK(connections == once);
+  CHECK(connections == w.closed);
+}
+#endif
@@ -39,6 +39,7 @@ namespace proton {
 class annotation_key;
 class message_id;
 class scalar;
+class scalar_base;
 class value;
 
 namespace internal {
@@ -136,6 +137,20 @@ class decoder : public internal::data {
     template <class T> static sequence_ref<T> sequence(T& x) { return sequence_ref<T>(x); }
     template <class T> static associative_ref<T> associative(T& x) { return associative_ref<T>(x); }
     template <class T> static pair_sequence_ref<T> pair_sequence(T& x) { return pair_sequence_ref<T>(x); }
+
+    // True if the next value is an ARRAY of element that extract_array() can
+    // copy in one go, size is set to its length. Does not move the decoder.
+    PN_CPP_EXTERN bool next_array(type_id element, size_t& size);
+
+    // Extract size elements of the next value, an ARRAY of element, in one go
+    PN_CPP_EXTERN decoder& extract_array(type_id element, void* values, size_t size);
+
+    // If the next value is a MAP with an entry for key, move to just before
+    // the entry's value and return true. Uses the hash index of
+    // pn_data_find() so it does not decode the rest of the map. A key
+    // only matches one of the same type. Does not move the decoder if
+    // there is no such entry.
+    PN_CPP_EXTERN bool find(const scalar_base& key);
     /// @endcond
 
     /// Extract any AMQP sequence (ARRAY, LIST or MAP) to a C++
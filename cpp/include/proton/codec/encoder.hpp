@@ -160,6 +160,9 @@ class encoder : public internal::data {
         *this << finish();
         return *this;
     }
+
+    // Insert an ARRAY of count fixed width values in one go, see pn_data_put_array_bulk()
+    PN_CPP_EXTERN encoder& insert_array(type_id element, const void* values, size_t count);
     /// @endcond
 
   private:
@@ -55,6 +55,46 @@ template <class T, class A> decoder& operator>>(decoder& d, std::vector<T, A>& x
 /// Decode to std::vector<std::pair<K, T> from an amqp::MAP.
 template <class A, class K, class T> decoder& operator>>(decoder& d, std::vector<std::pair<K, T> , A>& x) { return d >> decoder::pair_sequence(x); }
 
+/// @cond INTERNAL
+/// Vectors of fixed width numbers are copied to and from an amqp::ARRAY
+/// in one go rather than element by element.
+template <class T, class A> encoder& insert_array(encoder& e, const std::vector<T, A>& x) {
+    return e.insert_array(internal::type_id_of<T>::value, x.empty() ? 0 : &x[0], x.size());
+}
+
+template <class T, class A> decoder& extract_array(decoder& d, std::vector<T, A>& x) {
+    size_t size;
+    if (!d.next_array(internal::type_id_of<T>::value, size))
+        return d >> decoder::sequence(x);
+    x.resize(size);
+    return d.extract_array(internal::type_id_of<T>::value, x.empty() ? 0 : &x[0], size);
+}
+/// @endcond
+
+/// Encode std::vector<double> as amqp::ARRAY, copying the elements in bulk
+template <class A> encoder& operator<<(encoder& e, const std::vector<double, A>& x) { return insert_array(e, x); }
+
+/// Encode std::vector<float> as amqp::ARRAY, copying the elements in bulk
+template <class A> encoder& operator<<(encoder& e, const std::vector<float, A>& x) { return insert_array(e, x); }
+
+/// Encode std::vector<int64_t> as amqp::ARRAY, copying the elements in bulk
+template <class A> encoder& operator<<(encoder& e, const std::vector<int64_t, A>& x) { return insert_array(e, x); }
+
+/// Encode std::vector<int32_t> as amqp::ARRAY, copying the elements in bulk
+template <class A> encoder& operator<<(encoder& e, const std::vector<int32_t, A>& x) { return insert_array(e, x); }
+
+/// Decode to std::vector<double>, an amqp::ARRAY of DOUBLE is copied in bulk
+template <class A> decoder& operator>>(decoder& d, std::vector<double, A>& x) { return extract_array(d, x); }
+
+/// Decode to std::vector<float>, an amqp::ARRAY of FLOAT is copied in bulk
+template <class A> decoder& operator>>(decoder& d, std::vector<float, A>& x) { return extract_array(d, x); }
+
+/// Decode to std::vector<int64_t>, an amqp::ARRAY of LONG is copied in bulk
+template <class A> decoder& operator>>(decoder& d, std::vector<int64_t, A>& x) { return extract_array(d, x); }
+
+/// Decode to std::vector<int32_t>, an amqp::ARRAY of INT is copied in bulk
+template <class A> decoder& operator>>(decoder& d, std::vector<int32_t, A>& x) { return extract_array(d, x); }
+
 } // codec
 } // proton
 
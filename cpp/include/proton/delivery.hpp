@@ -64,6 +64,18 @@ class delivery : public transfer {
     /// Settle with MODIFIED state.
     PN_CPP_EXTERN void modify();
 
+    /// **Unsettled API** - Read message data received for a receiver
+    /// with a receiver_options::delivery_window().
+    ///
+    /// @return the number of bytes read, 0 if there are none to read now.
+    PN_CPP_EXTERN size_t read(char* data, size_t size);
+
+    /// **Unsettled API** - The number of received bytes not yet read.
+    PN_CPP_EXTERN size_t pending() const;
+
+    /// **Unsettled API** - True if more of the message is still to come.
+    PN_CPP_EXTERN bool partial() const;
+
     /// @cond INTERNAL
   friend class internal::factory<delivery>;
     /// @endcond
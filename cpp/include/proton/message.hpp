@@ -24,6 +24,7 @@
 
 #include "./fwd.hpp"
 #include "./internal/export.hpp"
+#include "./internal/object.hpp"
 #include "./duration.hpp"
 #include "./timestamp.hpp"
 #include "./value.hpp"
@@ -107,8 +108,42 @@ class message {
     PN_CPP_EXTERN std::vector<char> encode() const;
 
     /// Decode from string data into the message.
+    ///
+    /// Each section of the message is only parsed when one of its
+    /// fields is first used.  A malformed section makes that accessor,
+    /// and every later one for the same section, throw proton::error.
     PN_CPP_EXTERN void decode(const std::vector<char>&);
 
+    /// **Unsettled API** - Routing fields of an encoded message,
+    /// see peek().
+    struct routing_fields {
+        std::string to;         ///< The address
+        std::string subject;    ///< The subject
+        uint8_t priority;       ///< The priority
+        duration ttl;           ///< The time to live
+        bool durable;           ///< The durable flag
+    };
+
+    /// **Unsettled API** - Read the routing fields of an encoded
+    /// message without decoding it into a message.
+    ///
+    /// @throw proton::error if the message is incomplete
+    PN_CPP_EXTERN static routing_fields peek(const std::vector<char>&);
+
+    /// **Unsettled API** - Read a message annotation with a symbol
+    /// key from an encoded message without decoding it into a
+    /// message. Returns an empty value if there is no such annotation.
+    ///
+    /// @throw proton::error if the message is incomplete
+    PN_CPP_EXTERN static value peek_annotation(const std::vector<char>&, const std::string& key);
+
+    /// **Unsettled API** - Read an application property from an
+    /// encoded message without decoding it into a message. Returns
+    /// an empty value if there is no such property.
+    ///
+    /// @throw proton::error if the message is incomplete
+    PN_CPP_EXTERN static value peek_property(const std::vector<char>&, const std::string& key);
+
     /// @}
 
     /// @name Routing
@@ -329,6 +364,7 @@ class message {
     mutable pn_message_t* pn_msg_;
 
   PN_CPP_EXTERN friend void swap(message&, message&);
+  friend class internal::factory<message>;
     /// @endcond
 };
 
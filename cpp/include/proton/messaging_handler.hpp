@@ -86,6 +86,19 @@ PN_CPP_CLASS_EXTERN messaging_handler {
     /// A message is received.
     PN_CPP_EXTERN virtual void on_message(delivery&, message&);
 
+    /// **Unsettled API** - Message data has arrived on a receiver with
+    /// a receiver_options::delivery_window().  Read it with
+    /// delivery::read().  The delivery is accepted once it is complete
+    /// and all read, unless it was settled or auto-accept is off.
+    ///
+    /// Data left unread stays buffered and counts against the window.
+    /// Once the window is full no more transfers arrive on any
+    /// receiver of the same session until some is read, which can also
+    /// be done later, outside this callback.  If the connection has no
+    /// maximum frame size the whole connection waits instead, see
+    /// pn_link_set_delivery_window().
+    PN_CPP_EXTERN virtual void on_delivery_data(delivery&);
+
     /// A message can be sent.
     PN_CPP_EXTERN virtual void on_sendable(sender&);
 
@@ -100,6 +100,15 @@ class receiver_options {
     /// Set the link name. If not set a unique name is generated.
     PN_CPP_EXTERN receiver_options& name(const std::string& name);
 
+    /// **Unsettled API** - Receive messages as they arrive instead of
+    /// whole, holding at most about this many unread bytes of a message.
+    /// The data is delivered to messaging_handler::on_delivery_data()
+    /// instead of messaging_handler::on_message(), which must read it
+    /// to make room for more.  While the window is full the other
+    /// receivers on the same session wait too.  The default, 0, is to
+    /// receive whole messages.
+    PN_CPP_EXTERN receiver_options& delivery_window(size_t bytes);
+
 
   private:
     void apply(receiver &) const;
@@ -57,6 +57,27 @@ PN_CPP_CLASS_EXTERN sender : public link {
     /// Send a message on the sender.
     PN_CPP_EXTERN tracker send(const message &m);
 
+    /// **Unsettled API** - Start sending a message in parts.
+    ///
+    /// Write the encoded message with write() and finish it with
+    /// end_stream().  No other message can be sent on the sender until
+    /// then.
+    PN_CPP_EXTERN tracker begin_stream();
+
+    /// **Unsettled API** - Write more of the message started by begin_stream().
+    ///
+    /// @return the number of bytes taken, less than `size` if the
+    /// sender_options::delivery_window() is full.  Write the rest from
+    /// messaging_handler::on_sendable(), which is called again as the
+    /// window is sent.
+    PN_CPP_EXTERN size_t write(const char* data, size_t size);
+
+    /// **Unsettled API** - The number of bytes write() will take now.
+    PN_CPP_EXTERN size_t write_space() const;
+
+    /// **Unsettled API** - Finish the message started by begin_stream().
+    PN_CPP_EXTERN void end_stream();
+
     /// Get the source node.
     PN_CPP_EXTERN class source source() const;
 
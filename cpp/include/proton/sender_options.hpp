@@ -91,6 +91,11 @@ class sender_options {
     /// Set the link name. If not set a unique name is generated.
     PN_CPP_EXTERN sender_options& name(const std::string& name);
 
+    /// **Unsettled API** - Limit the bytes of a streamed message
+    /// (see sender::begin_stream()) that are held for sending at once.
+    /// The default, 0, is no limit.
+    PN_CPP_EXTERN sender_options& delivery_window(size_t bytes);
+
   private:
     void apply(sender&) const;
     const std::string* get_name() const; // Pointer to name if set, else 0
@@ -23,6 +23,8 @@
 #include "proton/internal/config.hpp"
 #include "proton/types.hpp"
 
+#include <vector>
+
 namespace {
 
 using namespace proton;
@@ -47,6 +49,39 @@ template <class T> void  uncodable_type_test() {
     ASSERT(!codec::is_encodable<T>::value);
 }
 
+// Numeric vectors are copied to and from arrays in bulk, other sequences of
+// the same values still decode to them.
+void bulk_array_test() {
+    std::vector<double> x;
+    for (int i = 0; i < 100; ++i) x.push_back(i * 0.25);
+    value v(x);
+    ASSERT_EQUAL(ARRAY, v.type());
+    std::vector<double> y;
+    codec::decoder d(v);
+    d >> y;
+    ASSERT(x == y);
+
+    value element_by_element;
+    codec::encoder e(element_by_element);
+    e << codec::encoder::array(x, DOUBLE);
+    ASSERT_EQUAL(element_by_element, v);
+
+    std::vector<value> l(x.begin(), x.end());
+    value vl(l);
+    ASSERT_EQUAL(LIST, vl.type());
+    y.clear();
+    codec::decoder dl(vl);
+    dl >> y;
+    ASSERT(x == y);
+
+    value vf(std::vector<float>(3, 1.5f));
+    std::vector<float> f;
+    codec::decoder df(vf);
+    df >> f;
+    ASSERT_EQUAL(3U, f.size());
+    ASSERT_EQUAL(1.5f, f[2]);
+}
+
 }
 
 int main(int, char**) {
@@ -104,6 +139,8 @@ int main(int, char**) {
     RUN_TEST(failed, simple_type_test(annotation_key(42)));
     RUN_TEST(failed, simple_type_test(message_id(42)));
 
+    RUN_TEST(failed, bulk_array_test());
+
     // Make sure we reject uncodable types
     RUN_TEST(failed, (uncodable_type_test<std::pair<int, float> >()));
     RUN_TEST(failed, (uncodable_type_test<std::pair<scalar, value> >()));
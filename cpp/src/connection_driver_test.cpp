@@ -23,6 +23,7 @@
 #include "link_namer.hpp"
 
 #include "proton/connection.hpp"
+#include "proton/delivery.hpp"
 #include "proton/container.hpp"
 #include "proton/io/connection_driver.hpp"
 #include "proton/link.hpp"
@@ -35,12 +36,14 @@
 #include "proton/source_options.hpp"
 #include "proton/target.hpp"
 #include "proton/target_options.hpp"
+#include "proton/tracker.hpp"
 #include "proton/transport.hpp"
 #include "proton/types_fwd.hpp"
 #include "proton/uuid.hpp"
 
 #include <deque>
 #include <algorithm>
+#include <vector>
 
 namespace {
 
@@ -490,6 +493,163 @@ void test_message() {
     ASSERT_EQUAL(value("b"), m2.message_annotations().get("a"));
 }
 
+/// A handler that keeps the received messages by swapping them out of the event
+struct swap_handler : public record_handler {
+    void on_message(proton::delivery&, proton::message& m) PN_CPP_OVERRIDE {
+        messages.push_back(proton::message());
+        swap(messages.back(), m);
+    }
+};
+
+void test_message_swap() {
+    // A message swapped out of on_message outlives the delivery it came from
+    swap_handler hb;
+    record_handler ha;
+    driver_pair d(ha, hb);
+
+    proton::sender s = d.a.connection().open_sender("x");
+    proton::message m("barefoot");
+    m.properties().put("x", "y");
+    s.send(m);
+    s.send(proton::message("second"));
+
+    while (hb.messages.size() < 2)
+        d.process();
+
+    proton::message m2 = quick_pop(hb.messages);
+    ASSERT_EQUAL(value("barefoot"), m2.body());
+    ASSERT_EQUAL(value("y"), m2.properties().get("x"));
+    ASSERT_EQUAL(value("second"), quick_pop(hb.messages).body());
+}
+
+void test_message_malformed() {
+    // A delivery that isn't a message is an error, and is consumed all the same
+    record_handler ha, hb;
+    driver_pair d(ha, hb);
+
+    proton::sender s = d.a.connection().open_sender("x");
+    while (s.credit() == 0)
+        d.process();
+    proton::receiver r = quick_pop(hb.receivers);
+    int credit = r.credit();
+    // An amqp-value section cut short
+    const char bad[] = { 0x00, 0x53, 0x77, (char) 0xc0, 0x05 };
+    s.begin_stream();
+    s.write(bad, sizeof(bad));
+    s.end_stream();
+    // The link moves on past it
+    while (r.credit() == credit)
+        d.process();
+    ASSERT_EQUAL(credit - 1, r.credit());
+    ASSERT(hb.messages.empty());
+    ASSERT_SUBSTRING("message decode", d.b.transport().error().what());
+}
+
+/// A handler that collects streamed message data
+struct stream_handler : public record_handler {
+    std::vector<char> data;
+    int complete;
+
+    stream_handler() : complete(0) {}
+
+    void on_delivery_data(proton::delivery& d) PN_CPP_OVERRIDE {
+        char buf[100];
+        size_t n;
+        while ((n = d.read(buf, sizeof(buf))) > 0)
+            data.insert(data.end(), buf, buf+n);
+        if (!d.partial()) ++complete;
+    }
+};
+
+void test_stream_message() {
+    // Verify a message streamed in parts arrives intact, in both directions
+    stream_handler ha, hb;
+    driver_pair d(ha, hb);
+
+    proton::message m(std::string(20000, 'x'));
+    std::vector<char> buf;
+    m.encode(buf);
+
+    // Sender window: whole message is received by on_message
+    proton::sender s = d.a.connection().open_sender("x", sender_options().delivery_window(1000));
+    while (s.credit() == 0)
+        d.process();
+    s.begin_stream();
+    size_t written = 0;
+    while (written < buf.size()) {
+        ASSERT(s.write_space() <= 1000);
+        size_t n = s.write(&buf[written], buf.size() - written);
+        ASSERT(n <= 1000);
+        written += n;
+        d.process();
+    }
+    s.end_stream();
+    while (hb.messages.size() == 0)
+        d.process();
+    ASSERT_EQUAL(m.body(), quick_pop(hb.messages).body());
+
+    // Receiver window: data is received by on_delivery_data
+    d.a.connection().open_receiver("y", receiver_options().delivery_window(1000));
+    while (hb.senders.size() == 0)
+        d.process();
+    proton::sender s2 = quick_pop(hb.senders);
+    while (s2.credit() == 0)
+        d.process();
+    proton::tracker t = s2.begin_stream();
+    s2.write(&buf[0], buf.size());
+    s2.end_stream();
+    while (!t.settled())
+        d.process();
+    ASSERT_EQUAL(1, ha.complete);
+    ASSERT(ha.messages.empty());
+    ASSERT(buf == ha.data);
+    ASSERT_EQUAL(transfer::ACCEPTED, t.state());
+}
+
+/// A handler that leaves streamed data unread until told to read it
+struct unread_stream_handler : public stream_handler {
+    bool reading;
+    proton::delivery last;
+
+    unread_stream_handler() : reading(false) {}
+
+    void on_delivery_data(proton::delivery& d) PN_CPP_OVERRIDE {
+        last = d;
+        if (reading) stream_handler::on_delivery_data(d);
+    }
+};
+
+void test_stream_message_unread() {
+    // Data on_delivery_data leaves unread holds the link up until it is read
+    unread_stream_handler ha;
+    record_handler hb;
+    driver_pair d(ha, hb);
+
+    d.a.connection().open_receiver("y", receiver_options().delivery_window(1000));
+    while (hb.senders.size() == 0)
+        d.process();
+    proton::sender s = quick_pop(hb.senders);
+    while (s.credit() == 0)
+        d.process();
+    std::vector<char> buf(100000, 'x');
+    proton::tracker t = s.begin_stream();
+    s.write(&buf[0], buf.size());
+    s.end_stream();
+    for (int i = 0; i < 100; ++i)
+        d.process();
+    ASSERT(ha.last.pending() > 0);
+    ASSERT(ha.last.pending() < buf.size());
+    ASSERT(!t.settled());
+
+    // Reading it later, outside the callback, lets the rest through
+    ha.reading = true;
+    ha.on_delivery_data(ha.last);
+    while (!t.settled())
+        d.process();
+    ASSERT_EQUAL(1, ha.complete);
+    ASSERT(buf == ha.data);
+}
+
 void test_message_timeout_succeed() {
     // Verify a message arrives intact
     record_handler ha, hb;
@@ -549,6 +709,10 @@ int main(int argc, char** argv) {
     RUN_ARGV_TEST(failed, test_link_anonymous_dynamic());
     RUN_ARGV_TEST(failed, test_link_capability_filter());
     RUN_ARGV_TEST(failed, test_message());
+    RUN_ARGV_TEST(failed, test_message_swap());
+    RUN_ARGV_TEST(failed, test_message_malformed());
+    RUN_ARGV_TEST(failed, test_stream_message());
+    RUN_ARGV_TEST(failed, test_stream_message_unread());
     RUN_ARGV_TEST(failed, test_message_timeout_succeed());
     RUN_ARGV_TEST(failed, test_message_timeout_fail());
     return failed;
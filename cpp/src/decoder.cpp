@@ -135,6 +135,37 @@ decoder& decoder::operator>>(const finish&) {
     return *this;
 }
 
+bool decoder::next_array(type_id element, size_t& size) {
+    internal::state_guard sg(*this);
+    if (!next()) return false;
+    pn_data_t* d = pn_object();
+    if (pn_data_type(d) != PN_ARRAY || pn_data_is_array_described(d) ||
+        type_id(pn_data_get_array_type(d)) != element)
+        return false;
+    size = pn_data_get_array(d);
+    return true;
+}
+
+decoder& decoder::extract_array(type_id element, void* values, size_t size) {
+    internal::state_guard sg(*this);
+    assert_type_equal(ARRAY, pre_get());
+    if (pn_data_get_array_bulk(pn_object(), pn_type_t(element), values, size) != size)
+        throw conversion_error(MSG("expected " << size << " " << element << " array elements"));
+    sg.cancel();
+    return *this;
+}
+
+bool decoder::find(const scalar_base& key) {
+    internal::state_guard sg(*this);
+    if (!next()) return false;
+    pn_data_t* d = pn_object();
+    if (pn_data_type(d) != PN_MAP || !pn_data_enter(d) || !pn_data_find(d, key.atom_))
+        return false;
+    pn_data_prev(d);            // Before the value, as for any other value
+    sg.cancel();
+    return true;
+}
+
 decoder& decoder::operator>>(null&) {
     internal::state_guard sg(*this);
     assert_type_equal(NULL_TYPE, pre_get());
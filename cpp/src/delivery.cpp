@@ -26,6 +26,7 @@
 #include "proton_bits.hpp"
 
 #include <proton/delivery.h>
+#include <proton/link.h>
 
 namespace {
 
@@ -46,4 +47,14 @@ void delivery::reject() { settle_delivery(pn_object(), REJECTED); }
 void delivery::release() { settle_delivery(pn_object(), RELEASED); }
 void delivery::modify() { settle_delivery(pn_object(), MODIFIED); }
 
+size_t delivery::read(char* data, size_t size) {
+    pn_link_t *lnk = pn_delivery_link(pn_object());
+    if (pn_link_current(lnk) != pn_object()) return 0;
+    ssize_t n = pn_link_recv(lnk, data, size);
+    return n > 0 ? size_t(n) : 0;
+}
+
+size_t delivery::pending() const { return pn_delivery_pending(pn_object()); }
+bool delivery::partial() const { return pn_delivery_partial(pn_object()); }
+
 }
@@ -151,6 +151,13 @@ encoder& encoder::operator<<(decltype(nullptr)) { pn_data_put_null(pn_object());
 
 encoder& encoder::operator<<(const scalar_base& x) { return insert(x.atom_, pn_data_put_atom); }
 
+encoder& encoder::insert_array(type_id element, const void* values, size_t count) {
+    internal::state_guard sg(*this);
+    check(pn_data_put_array_bulk(pn_object(), pn_type_t(element), values, count));
+    sg.cancel();
+    return *this;
+}
+
 encoder& encoder::operator<<(const internal::value_base& x) {
     data d = x.data_;
     if (*this == d)
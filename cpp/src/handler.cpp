@@ -44,6 +44,7 @@ messaging_handler::~messaging_handler(){}
 void messaging_handler::on_container_start(container &) {}
 void messaging_handler::on_container_stop(container &) {}
 void messaging_handler::on_message(delivery &, message &) {}
+void messaging_handler::on_delivery_data(delivery &) {}
 void messaging_handler::on_sendable(sender &) {}
 void messaging_handler::on_transport_close(transport &) {}
 void messaging_handler::on_transport_error(transport &t) { on_error(t.error()); }
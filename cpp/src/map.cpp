@@ -35,6 +35,9 @@
 // - if (map_.get()) then *map_ is the authority and value_ is empty()
 // - cache() ensures that *map_ is up to date and value_ is cleared.
 // - flush() ensures value_ is up to date and map_ is cleared.
+// - get() and exists() look keys up in value_ while map_ is not valid, so
+//   reading a few entries of a received map does not decode all of it. As
+//   when decoding into map_, a key only matches one of the same AMQP type.
 
 namespace proton {
 
@@ -42,6 +45,26 @@ namespace proton {
 template <class K, class T>
 class map_type_impl : public std::map<K, T> {};
 
+namespace {
+
+// The key as a scalar_base for codec::decoder::find()
+template <class K> scalar find_key(const K& k) { return scalar(k); }
+const annotation_key& find_key(const annotation_key& k) { return k; }
+
+// Find the entry for k in the encoded map v without decoding the rest of the
+// map, and extract its value to *x if x is not null.
+template <class K, class T> bool find_entry(const value& v, const K& k, T* x) {
+    codec::decoder d(v, true);
+    if (d.find(find_key(k))) {
+        if (x) d >> *x;
+        return true;
+    }
+    assert_type_equal(MAP, d.next_type());
+    return false;
+}
+
+} // namespace
+
 template <class K, class T>
 map<K,T>::map() {}
 
@@ -134,8 +157,13 @@ const proton::value& map<K,T>::value() const { return flush(); }
 
 template <class K, class T>
 T map<K,T>::get(const K& k) const {
-    if (this->empty()) return T();
-    typename map_type::const_iterator i = cache().find(k);
+    if (!map_.get()) {
+        // Look up the encoded map rather than decoding all of it
+        T x = T();
+        if (!value_.empty()) find_entry(value_, k, &x);
+        return x;
+    }
+    typename map_type::const_iterator i = map_->find(k);
     if (i == map_->end()) return T();
     return i->second;
 }
@@ -156,7 +184,8 @@ size_t map<K,T>::erase(const K& k) {
 
 template <class K, class T>
 bool map<K,T>::exists(const K& k) const {
-    return this->empty() ? 0 : cache().find(k) != cache().end();
+    if (!map_.get()) return !value_.empty() && find_entry(value_, k, static_cast<T*>(0));
+    return map_->find(k) != map_->end();
 }
 
 template <class K, class T>
@@ -19,6 +19,7 @@
  *
  */
 
+#include "proton/codec/decoder.hpp"
 #include "proton/delivery.hpp"
 #include "proton/error.hpp"
 #include "proton/link.hpp"
@@ -34,6 +35,7 @@
 
 #include "core/message-internal.h"
 #include "proton/delivery.h"
+#include "proton/error.h"
 
 #include <string>
 #include <algorithm>
@@ -88,7 +90,18 @@ message::~message() {
     }
 }
 
+namespace {
+// A message decoded from a delivery borrows the delivery's bytes, take a copy
+// before handing it on to outlive the delivery.
+void own(pn_message_t *msg) {
+    if (msg && pni_message_own(msg))
+        throw error(std::string("message decode: ") + pn_error_text(pn_message_error(msg)));
+}
+}
+
 void swap(message& x, message& y) {
+    own(x.pn_msg_);
+    own(y.pn_msg_);
     std::swap(x.pn_msg_, y.pn_msg_);
 }
 
@@ -126,113 +139,121 @@ namespace {
 void check(int err) {
     if (err) throw error(error_str(err));
 }
+
+// The sections of a decoded message are only parsed when first used, throw
+// if the one holding a field turns out to be malformed.
+pn_message_t *load(pn_message_t *msg, pni_section_t section) {
+    if (pni_message_load(msg, section))
+        throw error(std::string("message decode: ") + pn_error_text(pn_message_error(msg)));
+    return msg;
+}
 } // namespace
 
-void message::id(const message_id& id) { pn_message_set_id(pn_msg(), id.atom_); }
+void message::id(const message_id& id) { pn_message_set_id(load(pn_msg(), PNI_SECTION_PROPERTIES), id.atom_); }
 
 message_id message::id() const {
-    return pn_message_get_id(pn_msg());
+    return pn_message_get_id(load(pn_msg(), PNI_SECTION_PROPERTIES));
 }
 
 void message::user(const std::string &id) {
-    check(pn_message_set_user_id(pn_msg(), pn_bytes(id)));
+    check(pn_message_set_user_id(load(pn_msg(), PNI_SECTION_PROPERTIES), pn_bytes(id)));
 }
 
 std::string message::user() const {
-    return str(pn_message_get_user_id(pn_msg()));
+    return str(pn_message_get_user_id(load(pn_msg(), PNI_SECTION_PROPERTIES)));
 }
 
 void message::to(const std::string &addr) {
-    check(pn_message_set_address(pn_msg(), addr.c_str()));
+    check(pn_message_set_address(load(pn_msg(), PNI_SECTION_PROPERTIES), addr.c_str()));
 }
 
 std::string message::to() const {
-    const char* addr = pn_message_get_address(pn_msg());
+    const char* addr = pn_message_get_address(load(pn_msg(), PNI_SECTION_PROPERTIES));
     return addr ? std::string(addr) : std::string();
 }
 
 void message::address(const std::string &addr) {
-  check(pn_message_set_address(pn_msg(), addr.c_str()));
+  check(pn_message_set_address(load(pn_msg(), PNI_SECTION_PROPERTIES), addr.c_str()));
 }
 
 std::string message::address() const {
-  const char* addr = pn_message_get_address(pn_msg());
+  const char* addr = pn_message_get_address(load(pn_msg(), PNI_SECTION_PROPERTIES));
   return addr ? std::string(addr) : std::string();
 }
 
 void message::subject(const std::string &s) {
-    check(pn_message_set_subject(pn_msg(), s.c_str()));
+    check(pn_message_set_subject(load(pn_msg(), PNI_SECTION_PROPERTIES), s.c_str()));
 }
 
 std::string message::subject() const {
-    const char* s = pn_message_get_subject(pn_msg());
+    const char* s = pn_message_get_subject(load(pn_msg(), PNI_SECTION_PROPERTIES));
     return s ? std::string(s) : std::string();
 }
 
 void message::reply_to(const std::string &s) {
-    check(pn_message_set_reply_to(pn_msg(), s.c_str()));
+    check(pn_message_set_reply_to(load(pn_msg(), PNI_SECTION_PROPERTIES), s.c_str()));
 }
 
 std::string message::reply_to() const {
-    const char* s = pn_message_get_reply_to(pn_msg());
+    const char* s = pn_message_get_reply_to(load(pn_msg(), PNI_SECTION_PROPERTIES));
     return s ? std::string(s) : std::string();
 }
 
 void message::correlation_id(const message_id& id) {
-    value(pn_message_correlation_id(pn_msg())) = id;
+    value(pn_message_correlation_id(load(pn_msg(), PNI_SECTION_PROPERTIES))) = id;
 }
 
 message_id message::correlation_id() const {
-    return pn_message_get_correlation_id(pn_msg());
+    return pn_message_get_correlation_id(load(pn_msg(), PNI_SECTION_PROPERTIES));
 }
 
 void message::content_type(const std::string &s) {
-    check(pn_message_set_content_type(pn_msg(), s.c_str()));
+    check(pn_message_set_content_type(load(pn_msg(), PNI_SECTION_PROPERTIES), s.c_str()));
 }
 
 std::string message::content_type() const {
-    const char* s = pn_message_get_content_type(pn_msg());
+    const char* s = pn_message_get_content_type(load(pn_msg(), PNI_SECTION_PROPERTIES));
     return s ? std::string(s) : std::string();
 }
 
 void message::content_encoding(const std::string &s) {
-    check(pn_message_set_content_encoding(pn_msg(), s.c_str()));
+    check(pn_message_set_content_encoding(load(pn_msg(), PNI_SECTION_PROPERTIES), s.c_str()));
 }
 
 std::string message::content_encoding() const {
-    const char* s = pn_message_get_content_encoding(pn_msg());
+    const char* s = pn_message_get_content_encoding(load(pn_msg(), PNI_SECTION_PROPERTIES));
     return s ? std::string(s) : std::string();
 }
 
 void message::expiry_time(timestamp t) {
-    pn_message_set_expiry_time(pn_msg(), t.milliseconds());
+    pn_message_set_expiry_time(load(pn_msg(), PNI_SECTION_PROPERTIES), t.milliseconds());
 }
 timestamp message::expiry_time() const {
-    return timestamp(pn_message_get_expiry_time(pn_msg()));
+    return timestamp(pn_message_get_expiry_time(load(pn_msg(), PNI_SECTION_PROPERTIES)));
 }
 
 void message::creation_time(timestamp t) {
-    pn_message_set_creation_time(pn_msg(), t.milliseconds());
+    pn_message_set_creation_time(load(pn_msg(), PNI_SECTION_PROPERTIES), t.milliseconds());
 }
 timestamp message::creation_time() const {
-    return timestamp(pn_message_get_creation_time(pn_msg()));
+    return timestamp(pn_message_get_creation_time(load(pn_msg(), PNI_SECTION_PROPERTIES)));
 }
 
 void message::group_id(const std::string &s) {
-    check(pn_message_set_group_id(pn_msg(), s.c_str()));
+    check(pn_message_set_group_id(load(pn_msg(), PNI_SECTION_PROPERTIES), s.c_str()));
 }
 
 std::string message::group_id() const {
-    const char* s = pn_message_get_group_id(pn_msg());
+    const char* s = pn_message_get_group_id(load(pn_msg(), PNI_SECTION_PROPERTIES));
     return s ? std::string(s) : std::string();
 }
 
 void message::reply_to_group_id(const std::string &s) {
-    check(pn_message_set_reply_to_group_id(pn_msg(), s.c_str()));
+    check(pn_message_set_reply_to_group_id(load(pn_msg(), PNI_SECTION_PROPERTIES), s.c_str()));
 }
 
 std::string message::reply_to_group_id() const {
-    const char* s = pn_message_get_reply_to_group_id(pn_msg());
+    const char* s = pn_message_get_reply_to_group_id(load(pn_msg(), PNI_SECTION_PROPERTIES));
     return s ? std::string(s) : std::string();
 }
 
@@ -242,30 +263,40 @@ void message::inferred(bool b) { pn_message_set_inferred(pn_msg(), b); }
 
 void message::body(const value& x) { body() = x; }
 
-const value& message::body() const { return impl().body; }
-value& message::body() { return impl().body; }
+// The pn_message_* accessors load the section under the cached value and mark
+// it as changed, load() just loads it so it can still be encoded by copying the
+// bytes it was decoded from.
+
+const value& message::body() const { load(pn_msg(), PNI_SECTION_BODY); return impl().body; }
+value& message::body() { pn_message_body(load(pn_msg(), PNI_SECTION_BODY)); return impl().body; }
 
 message::property_map& message::properties() {
+    pn_message_properties(load(pn_msg(), PNI_SECTION_APPLICATION_PROPERTIES));
     return impl().properties;
 }
 
 const message::property_map& message::properties() const {
+    load(pn_msg(), PNI_SECTION_APPLICATION_PROPERTIES);
     return impl().properties;
 }
 
 message::annotation_map& message::message_annotations() {
+    pn_message_annotations(load(pn_msg(), PNI_SECTION_MESSAGE_ANNOTATIONS));
     return impl().annotations;
 }
 
 const message::annotation_map& message::message_annotations() const {
+    load(pn_msg(), PNI_SECTION_MESSAGE_ANNOTATIONS);
     return impl().annotations;
 }
 
 message::annotation_map& message::delivery_annotations() {
+    pn_message_instructions(load(pn_msg(), PNI_SECTION_DELIVERY_ANNOTATIONS));
     return impl().instructions;
 }
 
 const message::annotation_map& message::delivery_annotations() const {
+    load(pn_msg(), PNI_SECTION_DELIVERY_ANNOTATIONS);
     return impl().instructions;
 }
 
@@ -297,26 +328,64 @@ void message::decode(const std::vector<char> &s) {
     if (s.empty())
         throw error("message decode: no data");
     impl().clear();
-    check(pn_message_decode(pn_msg(), &s[0], s.size()));
+    check(pn_message_decode_lazy(pn_msg(), &s[0], s.size()));
+}
+
+message::routing_fields message::peek(const std::vector<char> &s) {
+    if (s.empty())
+        throw error("message peek: no data");
+    pn_message_peek_t fields;
+    check(pn_message_peek(&s[0], s.size(), &fields));
+    routing_fields r;
+    r.to = fields.address.start ? str(fields.address) : std::string();
+    r.subject = fields.subject.start ? str(fields.subject) : std::string();
+    r.priority = fields.priority;
+    r.ttl = duration(fields.ttl);
+    r.durable = fields.durable;
+    return r;
+}
+
+namespace {
+value peek_value(const std::vector<char> &s, pni_section_t section, const std::string& key) {
+    if (s.empty())
+        throw error("message peek: no data");
+    pn_bytes_t encoded;
+    ssize_t found = pni_message_peek_value(&s[0], s.size(), section, key.c_str(), &encoded);
+    if (found < 0) check(int(found));
+    value v;
+    if (found) {
+        codec::decoder d(v);
+        d.decode(encoded.start, encoded.size);
+    }
+    return v;
+}
+} // namespace
+
+value message::peek_annotation(const std::vector<char> &s, const std::string& key) {
+    return peek_value(s, PNI_SECTION_MESSAGE_ANNOTATIONS, key);
+}
+
+value message::peek_property(const std::vector<char> &s, const std::string& key) {
+    return peek_value(s, PNI_SECTION_APPLICATION_PROPERTIES, key);
 }
 
-bool message::durable() const { return pn_message_is_durable(pn_msg()); }
-void message::durable(bool b) { pn_message_set_durable(pn_msg(), b); }
+bool message::durable() const { return pn_message_is_durable(load(pn_msg(), PNI_SECTION_HEADER)); }
+void message::durable(bool b) { pn_message_set_durable(load(pn_msg(), PNI_SECTION_HEADER), b); }
 
-duration message::ttl() const { return duration(pn_message_get_ttl(pn_msg())); }
-void message::ttl(duration d) { pn_message_set_ttl(pn_msg(), d.milliseconds()); }
+duration message::ttl() const { return duration(pn_message_get_ttl(load(pn_msg(), PNI_SECTION_HEADER))); }
+void message::ttl(duration d) { pn_message_set_ttl(load(pn_msg(), PNI_SECTION_HEADER), d.milliseconds()); }
 
-uint8_t message::priority() const { return pn_message_get_priority(pn_msg()); }
-void message::priority(uint8_t d) { pn_message_set_priority(pn_msg(), d); }
+uint8_t message::priority() const { return pn_message_get_priority(load(pn_msg(), PNI_SECTION_HEADER)); }
+void message::priority(uint8_t d) { pn_message_set_priority(load(pn_msg(), PNI_SECTION_HEADER), d); }
 
-bool message::first_acquirer() const { return pn_message_is_first_acquirer(pn_msg()); }
-void message::first_acquirer(bool b) { pn_message_set_first_acquirer(pn_msg(), b); }
+bool message::first_acquirer() const { return pn_message_is_first_acquirer(load(pn_msg(), PNI_SECTION_HEADER)); }
+void message::first_acquirer(bool b) { pn_message_set_first_acquirer(load(pn_msg(), PNI_SECTION_HEADER), b); }
 
-uint32_t message::delivery_count() const { return pn_message_get_delivery_count(pn_msg()); }
-void message::delivery_count(uint32_t d) { pn_message_set_delivery_count(pn_msg(), d); }
+uint32_t message::delivery_count() const { return pn_message_get_delivery_count(load(pn_msg(), PNI_SECTION_HEADER)); }
+void message::delivery_count(uint32_t d) { pn_message_set_delivery_count(load(pn_msg(), PNI_SECTION_HEADER), d); }
 
-int32_t message::group_sequence() const { return pn_message_get_group_sequence(pn_msg()); }
-void message::group_sequence(int32_t d) { pn_message_set_group_sequence(pn_msg(), d); }
+int32_t message::group_sequence() const { return pn_message_get_group_sequence(load(pn_msg(), PNI_SECTION_PROPERTIES)); }
+void message::group_sequence(int32_t d) { pn_message_set_group_sequence(load(pn_msg(), PNI_SECTION_PROPERTIES), d); }
 
 const uint8_t message::default_priority = PN_DEFAULT_PRIORITY;
 
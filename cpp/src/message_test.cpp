@@ -21,9 +21,11 @@
 #include "proton/scalar.hpp"
 #include "test_bits.hpp"
 #include <string>
+#include <vector>
 #include <fstream>
 #include <streambuf>
 #include <iosfwd>
+#include <sstream>
 
 namespace {
 
@@ -194,6 +196,132 @@ void test_message_reuse() {
     ASSERT_EQUAL(value("b"), m1.properties().get("a"));
 }
 
+// Forwarding a decoded message copies the sections that weren't changed
+void test_message_forward() {
+    message m1("body");
+    m1.to("queue");
+    m1.properties().put("x", "y");
+    m1.message_annotations().put("a", 1);
+    std::vector<char> bytes = m1.encode();
+
+    message m2;
+    m2.decode(bytes);
+    const message& c2 = m2;
+    ASSERT_EQUAL(value("y"), c2.properties().get("x"));
+    ASSERT_EQUAL(value("body"), c2.body());
+    ASSERT(bytes == m2.encode());
+
+    m2.message_annotations().put("a", 2);
+    message m3;
+    m3.decode(m2.encode());
+    ASSERT_EQUAL(std::string("queue"), m3.to());
+    ASSERT_EQUAL(value("y"), m3.properties().get("x"));
+    ASSERT_EQUAL(value(2), m3.message_annotations().get("a"));
+    ASSERT_EQUAL(value("body"), m3.body());
+}
+
+void test_message_peek() {
+    message m("body");
+    m.to("queue");
+    m.subject("subject");
+    m.priority(7);
+    m.ttl(duration(1000));
+    m.durable(true);
+    m.properties().put("x", "y");
+    m.message_annotations().put(symbol("a"), 1);
+    std::vector<char> bytes = m.encode();
+
+    message::routing_fields f = message::peek(bytes);
+    ASSERT_EQUAL(std::string("queue"), f.to);
+    ASSERT_EQUAL(std::string("subject"), f.subject);
+    ASSERT_EQUAL(7, f.priority);
+    ASSERT_EQUAL(duration(1000), f.ttl);
+    ASSERT(f.durable);
+    ASSERT_EQUAL(value(1), message::peek_annotation(bytes, "a"));
+    ASSERT(message::peek_annotation(bytes, "b").empty());
+    ASSERT_EQUAL(value("y"), message::peek_property(bytes, "x"));
+    ASSERT(message::peek_property(bytes, "a").empty());
+
+    bytes.pop_back();
+    try {
+        message::peek(bytes);
+        FAIL("expected error");
+    } catch (const proton::error&) {}
+}
+
+// Sections are parsed on first use, so a malformed one is only found then
+void test_message_malformed() {
+    message m("body");
+    m.to("queue");
+    m.durable(true);
+    std::vector<char> bytes = m.encode();
+
+    std::vector<char> cut(bytes.begin(), bytes.end() - 1);
+    message m1;
+    ASSERT_THROWS(proton::error, m1.decode(cut));
+
+    // Replace the str8 type code of the address with one that doesn't exist
+    size_t i = std::string(bytes.begin(), bytes.end()).find("queue");
+    ASSERT(i != std::string::npos && bytes[i - 2] == char(0xa1));
+    bytes[i - 2] = char(0xff);
+    message m2;
+    m2.decode(bytes);
+    ASSERT(m2.durable());
+    ASSERT_EQUAL(value("body"), m2.body());
+    ASSERT_THROWS_MSG(proton::error, "message decode", m2.to());
+    ASSERT_THROWS_MSG(proton::error, "message decode", m2.to());
+    ASSERT_THROWS(proton::error, m2.subject("subject"));
+}
+
+void test_message_map_lookup() {
+    message m;
+    for (int i = 0; i < 50; ++i) {
+        std::ostringstream key;
+        key << "key" << i;
+        m.properties().put(key.str(), i);
+    }
+    m.message_annotations().put(23, "ulong");
+    m.message_annotations().put("sym", "symbol");
+    std::vector<char> bytes = m.encode();
+
+    // Keys are looked up in the received maps without decoding all of them
+    message m2;
+    m2.decode(bytes);
+    ASSERT_EQUAL(scalar(49), m2.properties().get("key49"));
+    ASSERT_EQUAL(scalar(0), m2.properties().get("key0"));
+    ASSERT(m2.properties().exists("key7"));
+    ASSERT(!m2.properties().exists("key50"));
+    ASSERT(m2.properties().get("key50").empty());
+    ASSERT_EQUAL(value("ulong"), m2.message_annotations().get(23));
+    ASSERT_EQUAL(value("symbol"), m2.message_annotations().get("sym"));
+    ASSERT(!m2.message_annotations().exists(24));
+
+    // And still after a change
+    m2.properties().put("key0", "changed");
+    ASSERT_EQUAL(scalar("changed"), m2.properties().get("key0"));
+    ASSERT_EQUAL(50U, m2.properties().size());
+}
+
+// A string key is not the same key as a symbol with the same characters, also
+// when looked up in a received map that hasn't been decoded.
+void test_message_map_key_types() {
+    const char bytes[] = {
+        // message-annotations: {:k="symbol", "k"="string"}
+        0x00, 0x53, 0x72, char(0xc1), 0x17, 0x04,
+        char(0xa3), 0x01, 'k', char(0xa1), 0x06, 's', 'y', 'm', 'b', 'o', 'l',
+        char(0xa1), 0x01, 'k', char(0xa1), 0x06, 's', 't', 'r', 'i', 'n', 'g',
+        // application-properties: {:p="x"}
+        0x00, 0x53, 0x74, char(0xc1), 0x07, 0x02, char(0xa3), 0x01, 'p', char(0xa1), 0x01, 'x'
+    };
+    message m;
+    m.decode(std::vector<char>(bytes, bytes + sizeof(bytes)));
+    const message& c = m;
+    ASSERT_EQUAL(value("symbol"), c.message_annotations().get(symbol("k")));
+    ASSERT(c.message_annotations().exists("k"));
+    ASSERT(!c.properties().exists("p"));
+    ASSERT(c.properties().get("p").empty());
+}
+
 void test_message_print() {
   message m("hello");
   m.to("to");
@@ -216,6 +344,11 @@ int main(int, char**) {
     RUN_TEST(failed, test_message_body());
     RUN_TEST(failed, test_message_maps());
     RUN_TEST(failed, test_message_reuse());
+    RUN_TEST(failed, test_message_forward());
+    RUN_TEST(failed, test_message_peek());
+    RUN_TEST(failed, test_message_malformed());
+    RUN_TEST(failed, test_message_map_lookup());
+    RUN_TEST(failed, test_message_map_key_types());
     RUN_TEST(failed, test_message_print());
     return failed;
 }
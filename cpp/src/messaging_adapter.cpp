@@ -35,6 +35,7 @@
 #include "proton/transport.hpp"
 
 #include "contexts.hpp"
+#include "core/message-internal.h"
 #include "msg.hpp"
 #include "proton_bits.hpp"
 
@@ -48,6 +49,8 @@
 
 #include <assert.h>
 
+#include <vector>
+
 namespace proton {
 
 namespace {
@@ -93,20 +96,50 @@ void on_link_flow(messaging_handler& handler, pn_event_t* event) {
     }
 }
 
-// Decode the message corresponding to a delivery from a link.
-void message_decode(message& msg, proton::delivery delivery) {
-    std::vector<char> buf;
-    buf.resize(pn_delivery_pending(unwrap(delivery)));
-    if (buf.empty())
-        throw error("message decode: no delivery pending on link");
-    proton::receiver link = delivery.receiver();
-    assert(!buf.empty());
-    ssize_t n = pn_link_recv(unwrap(link), const_cast<char *>(&buf[0]), buf.size());
-    if (n != ssize_t(buf.size())) throw error(MSG("receiver read failure"));
-    msg.clear();
-    msg.decode(buf);
-    pn_link_advance(unwrap(link));
-}
+// The message of a complete delivery, decoded where the delivery's data lies.
+// The message borrows the data rather than copying it, so it is cleared again
+// when this goes out of scope. Advancing the link only empties the delivery's
+// buffer, the data stays put until the delivery is freed, which the caller's
+// delivery wrapper prevents until then. The link is also advanced on the way
+// out if decoding throws, so a bad message doesn't stall the link.
+class delivery_message {
+  public:
+    delivery_message(message& msg, pn_delivery_t* dlv) : msg_(msg), dlv_(dlv) {}
+
+    ~delivery_message() {
+        pn_link_t *lnk = pn_delivery_link(dlv_);
+        if (pn_link_current(lnk) == dlv_) pn_link_advance(lnk);
+        msg_.clear();
+    }
+
+    void decode() {
+        size_t size = pn_delivery_pending(dlv_);
+        if (!size)
+            throw error("message decode: no delivery pending on link");
+        pn_link_t *lnk = pn_delivery_link(dlv_);
+        pn_bytes_t received;
+        if (pn_link_recv_buffers(lnk, &received, 1) != 1 || received.size != size) {
+            // Not in one piece, so gather it up first
+            buf_.resize(size);
+            ssize_t n = pn_link_recv(lnk, &buf_[0], buf_.size());
+            if (n != ssize_t(buf_.size())) throw error(MSG("receiver read failure"));
+            received = pn_bytes(buf_.size(), &buf_[0]);
+        }
+        msg_.clear();
+        pn_message_t *pnm = unwrap(msg_);
+        if (pni_message_decode_borrowed(pnm, received.start, received.size))
+            throw error(MSG("message decode: " << pn_error_text(pn_message_error(pnm))));
+        pn_link_advance(lnk);
+    }
+
+  private:
+    delivery_message(const delivery_message&);
+    delivery_message& operator=(const delivery_message&);
+
+    message& msg_;
+    pn_delivery_t *dlv_;
+    std::vector<char> buf_;
+};
 
 void on_delivery(messaging_handler& handler, pn_event_t* event) {
     pn_link_t *lnk = pn_event_link(event);
@@ -115,7 +148,17 @@ void on_delivery(messaging_handler& handler, pn_event_t* event) {
 
     if (pn_link_is_receiver(lnk)) {
         delivery d(make_wrapper<delivery>(dlv));
-        if (!pn_delivery_partial(dlv) && pn_delivery_readable(dlv)) {
+        if (pn_link_delivery_window(lnk) && pn_delivery_readable(dlv)) {
+            // Streamed: hand over the data as it arrives
+            if (pn_delivery_pending(dlv) || !pn_delivery_partial(dlv))
+                handler.on_delivery_data(d);
+            if (!pn_delivery_partial(dlv) && !pn_delivery_pending(dlv)) {
+                if (pn_link_current(lnk) == dlv) pn_link_advance(lnk);
+                if (lctx.auto_accept && pn_delivery_local_state(dlv) == 0) // Not set by handler
+                    d.accept();
+            }
+        }
+        else if (!pn_delivery_partial(dlv) && pn_delivery_readable(dlv)) {
             // generate on_message
             pn_connection_t *pnc = pn_session_connection(pn_link_session(lnk));
             connection_context& ctx = connection_context::get(pnc);
@@ -123,7 +166,8 @@ void on_delivery(messaging_handler& handler, pn_event_t* event) {
             // Avoid expensive heap malloc/free overhead.
             // See PROTON-998
             class message &msg(ctx.event_message);
-            message_decode(msg, d);
+            delivery_message received(msg, dlv);
+            received.decode();
             if (pn_link_state(lnk) & PN_LOCAL_CLOSED) {
                 if (lctx.auto_accept)
                     d.release();
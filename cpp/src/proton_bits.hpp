@@ -41,6 +41,7 @@ struct pn_connection_t;
 struct pn_session_t;
 struct pn_link_t;
 struct pn_delivery_t;
+struct pn_message_t;
 struct pn_condition_t;
 struct pn_acceptor_t;
 struct pn_terminus_t;
@@ -61,6 +62,7 @@ class receiver;
 class transfer;
 class tracker;
 class delivery;
+class message;
 class error_condition;
 class acceptor;
 class terminus;
@@ -122,6 +124,15 @@ public:
     static typename wrapped<T>::type* unwrap(const T& t) { return t.pn_object(); }
 };
 
+// A message owns its pn_message_t rather than wrapping a counted object
+template <> struct wrapped<message> { typedef pn_message_t type; };
+
+template <>
+class factory<message> {
+public:
+    static pn_message_t* unwrap(const message& m) { return m.pn_msg(); }
+};
+
 template <class T> struct context {};
 template <> struct context<link> {typedef link_context type; };
 template <> struct context<receiver> {typedef link_context type; };
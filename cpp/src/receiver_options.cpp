@@ -71,7 +71,7 @@ class receiver_options::impl {
     option<source_options> source;
     option<target_options> target;
     option<std::string> name;
-
+    option<size_t> delivery_window;
 
     void apply(receiver& r) {
         if (r.uninitialized()) {
@@ -80,6 +80,7 @@ class receiver_options::impl {
             if (auto_settle.set) get_context(r).auto_settle = auto_settle.value;
             if (auto_accept.set) get_context(r).auto_accept = auto_accept.value;
             if (credit_window.set) get_context(r).credit_window = credit_window.value;
+            if (delivery_window.set) pn_link_set_delivery_window(unwrap(r), delivery_window.value);
 
             if (source.set) {
                 proton::source local_s(make_wrapper<proton::source>(pn_link_source(unwrap(r))));
@@ -102,6 +103,7 @@ class receiver_options::impl {
         source.update(x.source);
         target.update(x.target);
         name.update(x.name);
+        delivery_window.update(x.delivery_window);
     }
 
 };
@@ -126,6 +128,7 @@ receiver_options& receiver_options::credit_window(int w) {impl_->credit_window =
 receiver_options& receiver_options::source(source_options &s) {impl_->source = s; return *this; }
 receiver_options& receiver_options::target(target_options &s) {impl_->target = s; return *this; }
 receiver_options& receiver_options::name(const std::string &s) {impl_->name = s; return *this; }
+receiver_options& receiver_options::delivery_window(size_t n) {impl_->delivery_window = n; return *this; }
 
 void receiver_options::apply(receiver& r) const { impl_->apply(r); }
 
@@ -62,24 +62,49 @@ class target sender::target() const {
 namespace {
 // TODO: revisit if thread safety required
 uint64_t tag_counter = 0;
+
+pn_delivery_t *new_delivery(pn_link_t *lnk) {
+    uint64_t id = ++tag_counter;
+    return pn_delivery(lnk, pn_dtag(reinterpret_cast<const char*>(&id), sizeof(id)));
+}
+
+void end_delivery(pn_link_t *lnk, pn_delivery_t *dlv) {
+    pn_link_advance(lnk);
+    if (pn_link_snd_settle_mode(lnk) == PN_SND_SETTLED)
+        pn_delivery_settle(dlv);
+    if (!pn_link_credit(lnk))
+        link_context::get(lnk).draining = false;
+}
 }
 
 tracker sender::send(const message &message) {
-    uint64_t id = ++tag_counter;
-    pn_delivery_t *dlv =
-        pn_delivery(pn_object(), pn_dtag(reinterpret_cast<const char*>(&id), sizeof(id)));
+    pn_delivery_t *dlv = new_delivery(pn_object());
     std::vector<char> buf;
     message.encode(buf);
     assert(!buf.empty());
     pn_link_send(pn_object(), &buf[0], buf.size());
-    pn_link_advance(pn_object());
-    if (pn_link_snd_settle_mode(pn_object()) == PN_SND_SETTLED)
-        pn_delivery_settle(dlv);
-    if (!pn_link_credit(pn_object()))
-        link_context::get(pn_object()).draining = false;
+    end_delivery(pn_object(), dlv);
     return make_wrapper<tracker>(dlv);
 }
 
+tracker sender::begin_stream() {
+    return make_wrapper<tracker>(new_delivery(pn_object()));
+}
+
+size_t sender::write(const char* data, size_t size) {
+    ssize_t n = pn_link_send(pn_object(), data, size);
+    return n > 0 ? size_t(n) : 0;
+}
+
+size_t sender::write_space() const {
+    return pn_link_send_space(pn_object());
+}
+
+void sender::end_stream() {
+    pn_delivery_t *dlv = pn_link_current(pn_object());
+    if (dlv) end_delivery(pn_object(), dlv);
+}
+
 void sender::return_credit() {
     link_context &lctx = link_context::get(pn_object());
     lctx.draining = false;
@@ -66,12 +66,14 @@ class sender_options::impl {
     option<source_options> source;
     option<target_options> target;
     option<std::string> name;
+    option<size_t> delivery_window;
 
     void apply(sender& s) {
         if (s.uninitialized()) {
             if (delivery_mode.set) set_delivery_mode(s, delivery_mode.value);
             if (handler.set && handler.value) container::impl::set_handler(s, handler.value);
             if (auto_settle.set) get_context(s).auto_settle = auto_settle.value;
+            if (delivery_window.set) pn_link_set_delivery_window(unwrap(s), delivery_window.value);
             if (source.set) {
                 proton::source local_s(make_wrapper<proton::source>(pn_link_source(unwrap(s))));
                 source.value.apply(local_s);
@@ -90,6 +92,7 @@ class sender_options::impl {
         source.update(x.source);
         target.update(x.target);
         name.update(x.name);
+        delivery_window.update(x.delivery_window);
     }
 
 };
@@ -113,6 +116,7 @@ sender_options& sender_options::auto_settle(bool b) {impl_->auto_settle = b; ret
 sender_options& sender_options::source(const source_options &s) {impl_->source = s; return *this; }
 sender_options& sender_options::target(const target_options &s) {impl_->target = s; return *this; }
 sender_options& sender_options::name(const std::string &s) {impl_->name = s; return *this; }
+sender_options& sender_options::delivery_window(size_t n) {impl_->delivery_window = n; return *this; }
 
 void sender_options::apply(sender& s) const { impl_->apply(s); }
 
@@ -129,6 +129,10 @@ int main(int, char**) {
                      ARRAY, many<bool>() + false + true, "@PN_BOOL[false, true]"));
         RUN_TEST(failed, sequence_test<vector<int> >(
                      ARRAY, many<int>() + -1 + 2, "@PN_INT[-1, 2]"));
+        RUN_TEST(failed, sequence_test<vector<int64_t> >(
+                     ARRAY, many<int64_t>() + -1 + 2, "@PN_LONG[-1, 2]"));
+        RUN_TEST(failed, sequence_test<vector<double> >(
+                     ARRAY, many<double>() + -1.5 + 2.25, "@PN_DOUBLE[-1.5, 2.25]"));
         RUN_TEST(failed, sequence_test<deque<string> >(
                      ARRAY, many<string>() + "a" + "b", "@PN_STRING[\"a\", \"b\"]"));
         RUN_TEST(failed, sequence_test<deque<symbol> >(
@@ -592,11 +592,11 @@ class Session(Wrapper, Endpoint):
         of a session determines how much incoming message data the session
         can buffer.
 
-        .. note:: If set, this value must be greater than or equal to the negotiated
-            frame size of the transport. The window is computed as a whole number of
-            frames when dividing remaining capacity at a given time by the connection
-            max frame size. As such, capacity and max frame size should be chosen so
-            as to ensure the frame window isn't unduly small and limiting performance.
+        .. note:: The window is computed as a whole number of frames when dividing
+            remaining capacity at a given time by the connection max frame size. A
+            capacity smaller than the frame size is taken to be one frame. As such,
+            capacity and max frame size should be chosen so as to ensure the frame
+            window isn't unduly small and limiting performance.
 
         :type: ``int`` (bytes)
         """)